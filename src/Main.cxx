@@ -54,6 +54,7 @@
 #include "lib/icu/Init.hxx"
 #include "config/ConfigGlobal.hxx"
 #include "config/Param.hxx"
+#include "config/Block.hxx"
 #include "config/ConfigDefaults.hxx"
 #include "config/ConfigOption.hxx"
 #include "config/ConfigError.hxx"
@@ -121,9 +122,22 @@ const
 #else
 constexpr
 #endif
-size_t MIN_BUFFER_SIZE = std::max(CHUNK_SIZE * 32,
+size_t MIN_BUFFER_SIZE = std::max(MIN_CHUNK_SIZE * 32,
 				  64 * KILOBYTE);
 
+/**
+ * The music buffer holds at least this many chunks; a larger chunk
+ * size is reduced.
+ */
+static constexpr unsigned MIN_BUFFER_CHUNKS = 32;
+
+/**
+ * The playing time of one #MusicChunk aimed at when the chunk size
+ * is chosen automatically.  This is what #DEFAULT_CHUNK_SIZE holds
+ * at 44.1 kHz, 16 bit, stereo.
+ */
+static constexpr double CHUNK_DURATION_S = 0.023;
+
 static constexpr unsigned DEFAULT_BUFFER_BEFORE_PLAY = 10;
 
 #ifdef ANDROID
@@ -276,6 +290,112 @@ glue_state_file_init()
 	instance->state_file->Read();
 }
 
+/**
+ * Determine the audio format the outputs are expected to play: the
+ * "audio_output_format" setting or else the largest fully defined
+ * "format" of all enabled audio outputs.  Returns an undefined
+ * #AudioFormat if it is unknown.
+ */
+static AudioFormat
+GetExpectedAudioFormat(AudioFormat configured_audio_format)
+{
+	if (configured_audio_format.IsFullyDefined())
+		return configured_audio_format;
+
+	AudioFormat result = AudioFormat::Undefined();
+
+	for (const auto *block = config_get_block(ConfigBlockOption::AUDIO_OUTPUT);
+	     block != nullptr; block = block->next) {
+		if (!block->GetBlockValue("enabled", true))
+			continue;
+
+		const char *value = block->GetBlockValue("format");
+		if (value == nullptr)
+			continue;
+
+		AudioFormat af;
+		try {
+			af = ParseAudioFormat(value, true);
+		} catch (const std::runtime_error &) {
+			/* the output will report this error */
+			continue;
+		}
+
+		if (af.IsFullyDefined() &&
+		    (!result.IsDefined() ||
+		     af.GetTimeToSize() > result.GetTimeToSize()))
+			result = af;
+	}
+
+	return result;
+}
+
+/**
+ * Round to the nearest power of two.
+ */
+gcc_const
+static size_t
+RoundPowerOfTwo(size_t size)
+{
+	size_t result = 1;
+	while (result < size)
+		result <<= 1;
+
+	if (result - size > size - result / 2)
+		result >>= 1;
+
+	return result;
+}
+
+/**
+ * Determine the payload size of a #MusicChunk from the
+ * "audio_chunk_size" setting, or from the expected audio format:
+ * high-resolution streams get larger chunks, which reduces the
+ * per-chunk overhead.
+ */
+static size_t
+GetChunkSize(size_t buffer_size, AudioFormat configured_audio_format)
+{
+	size_t chunk_size;
+
+	const auto *param = config_get_param(ConfigOption::AUDIO_CHUNK_SIZE);
+	if (param != nullptr) {
+		char *test;
+		long tmp = strtol(param->value.c_str(), &test, 10);
+		if (*test != '\0' || tmp <= 0 ||
+		    size_t(tmp) > MAX_CHUNK_SIZE / KILOBYTE)
+			FormatFatalError("chunk size \"%s\" is not a "
+					 "positive integer up to %u, line %i",
+					 param->value.c_str(),
+					 unsigned(MAX_CHUNK_SIZE / KILOBYTE),
+					 param->line);
+		chunk_size = tmp * KILOBYTE;
+	} else {
+		const auto af = GetExpectedAudioFormat(configured_audio_format);
+		if (af.IsDefined()) {
+			chunk_size = RoundPowerOfTwo(af.GetTimeToSize() *
+						     CHUNK_DURATION_S);
+			chunk_size = std::max(chunk_size, MIN_CHUNK_SIZE);
+			chunk_size = std::min(chunk_size, MAX_CHUNK_SIZE);
+		} else
+			chunk_size = DEFAULT_CHUNK_SIZE;
+	}
+
+	const size_t max_chunk_size = buffer_size / MIN_BUFFER_CHUNKS;
+	if (chunk_size > max_chunk_size) {
+		if (param != nullptr)
+			FormatWarning(config_domain,
+				      "chunk size %lu is too large for the buffer, using %lu bytes instead",
+				      (unsigned long)chunk_size,
+				      (unsigned long)max_chunk_size);
+		chunk_size = max_chunk_size;
+	}
+
+	FormatDebug(config_domain, "chunk size %lu bytes",
+		    (unsigned long)chunk_size);
+	return chunk_size;
+}
+
 /**
  * Initialize the decoder and player core, including the music pipe.
  */
@@ -304,7 +424,21 @@ initialize_decoder_and_player(const ReplayGainConfig &replay_gain_config)
 	} else
 		buffer_size = DEFAULT_BUFFER_SIZE;
 
-	const unsigned buffered_chunks = buffer_size / CHUNK_SIZE;
+	AudioFormat configured_audio_format = AudioFormat::Undefined();
+	param = config_get_param(ConfigOption::AUDIO_OUTPUT_FORMAT);
+	if (param != nullptr) {
+		try {
+			configured_audio_format = ParseAudioFormat(param->value.c_str(),
+								   true);
+		} catch (const std::runtime_error &) {
+			std::throw_with_nested(FormatRuntimeError("error parsing line %i",
+								  param->line));
+		}
+	}
+
+	const size_t chunk_size = GetChunkSize(buffer_size,
+					       configured_audio_format);
+	const unsigned buffered_chunks = buffer_size / chunk_size;
 
 	if (buffered_chunks >= 1 << 15)
 		FormatFatalError("buffer size \"%lu\" is too big",
@@ -345,21 +479,10 @@ initialize_decoder_and_player(const ReplayGainConfig &replay_gain_config)
 		config_get_positive(ConfigOption::MAX_PLAYLIST_LENGTH,
 				    DEFAULT_PLAYLIST_MAX_LENGTH);
 
-	AudioFormat configured_audio_format = AudioFormat::Undefined();
-	param = config_get_param(ConfigOption::AUDIO_OUTPUT_FORMAT);
-	if (param != nullptr) {
-		try {
-			configured_audio_format = ParseAudioFormat(param->value.c_str(),
-								   true);
-		} catch (const std::runtime_error &) {
-			std::throw_with_nested(FormatRuntimeError("error parsing line %i",
-								  param->line));
-		}
-	}
-
 	instance->partition = new Partition(*instance,
 					    max_length,
 					    buffered_chunks,
+					    chunk_size,
 					    buffered_before_play,
 					    configured_audio_format,
 					    replay_gain_config);
@@ -23,15 +23,17 @@
 
 #include <assert.h>
 
-MusicBuffer::MusicBuffer(unsigned num_chunks) noexcept
-	:buffer(num_chunks) {
+MusicBuffer::MusicBuffer(unsigned num_chunks, size_t _chunk_size) noexcept
+	:chunk_size(_chunk_size),
+	 buffer(num_chunks, sizeof(MusicChunk) + _chunk_size) {
+	assert(chunk_size >= MIN_CHUNK_SIZE);
+	assert(chunk_size <= MAX_CHUNK_SIZE);
 }
 
 MusicChunk *
 MusicBuffer::Allocate() noexcept
 {
-	const std::lock_guard<Mutex> protect(mutex);
-	return buffer.Allocate();
+	return buffer.Allocate(chunk_size);
 }
 
 void
@@ -39,8 +41,6 @@ MusicBuffer::Return(MusicChunk *chunk) noexcept
 {
 	assert(chunk != nullptr);
 
-	const std::lock_guard<Mutex> protect(mutex);
-
 	if (chunk->other != nullptr) {
 		assert(chunk->other->other == nullptr);
 		buffer.Free(chunk->other);
@@ -20,19 +20,23 @@
 #ifndef MPD_MUSIC_BUFFER_HXX
 #define MPD_MUSIC_BUFFER_HXX
 
-#include "util/SliceBuffer.hxx"
-#include "thread/Mutex.hxx"
+#include "util/AtomicSliceBuffer.hxx"
+
+#include <stddef.h>
 
 struct MusicChunk;
 
 /**
- * An allocator for #MusicChunk objects.
+ * An allocator for #MusicChunk objects.  It is lock-free and may be
+ * used by any number of threads.
  */
 class MusicBuffer {
-	/** a mutex which protects #buffer */
-	Mutex mutex;
+	/**
+	 * The payload size of each #MusicChunk.
+	 */
+	const size_t chunk_size;
 
-	SliceBuffer<MusicChunk> buffer;
+	AtomicSliceBuffer<MusicChunk> buffer;
 
 public:
 	/**
@@ -40,14 +44,15 @@ public:
 	 *
 	 * @param num_chunks the number of #MusicChunk reserved in
 	 * this buffer
+	 * @param _chunk_size the payload size of each #MusicChunk
 	 */
-	MusicBuffer(unsigned num_chunks) noexcept;
+	MusicBuffer(unsigned num_chunks, size_t _chunk_size) noexcept;
 
 #ifndef NDEBUG
 	/**
-	 * Check whether the buffer is empty.  This call is not
-	 * protected with the mutex, and may only be used while this
-	 * object is inaccessible to other threads.
+	 * Check whether the buffer is empty.  The result is only
+	 * meaningful while this object is inaccessible to other
+	 * threads.
 	 */
 	bool IsEmptyUnsafe() const {
 		return buffer.IsEmpty();
@@ -64,6 +69,13 @@ public:
 		return buffer.GetCapacity();
 	}
 
+	/**
+	 * Returns the payload size of each #MusicChunk.
+	 */
+	size_t GetChunkSize() const noexcept {
+		return chunk_size;
+	}
+
 	/**
 	 * Allocates a chunk from the buffer.  When it is not used anymore,
 	 * call Return().
@@ -21,12 +21,110 @@
 #include "MusicChunk.hxx"
 #include "AudioFormat.hxx"
 #include "tag/Tag.hxx"
+#include "thread/Mutex.hxx"
+
+#include <new>
 
 #include <assert.h>
+#include <string.h>
+
+/**
+ * Recycles the memory of #FilteredChunk objects, so the
+ * #SharedFilter does not need a heap allocation for each chunk.
+ * Allocations are rounded up to a power of two, with one free list
+ * for each size class; larger ones bypass the pool.
+ */
+class FilteredChunkPool {
+	static constexpr unsigned MIN_SHIFT = 12;
+	static constexpr unsigned N_CLASSES = 12;
+
+	/**
+	 * Keep at most this many objects in each free list.  While
+	 * playing, objects are freed as fast as they are allocated,
+	 * so a short list suffices.
+	 */
+	static constexpr unsigned MAX_FREE = 64;
+
+	struct FreeList {
+		FilteredChunk *head = nullptr;
+		unsigned n = 0;
+	};
+
+	Mutex mutex;
+
+	FreeList lists[N_CLASSES];
+
+public:
+	~FilteredChunkPool() noexcept {
+		for (auto &list : lists) {
+			while (list.head != nullptr) {
+				FilteredChunk *f = list.head;
+				list.head = f->next;
+				operator delete(f);
+			}
+		}
+	}
+
+	FilteredChunk *Allocate(size_t size) {
+		const size_t total = sizeof(FilteredChunk) + size;
+
+		unsigned size_class = 0;
+		while (size_class < N_CLASSES &&
+		       total > size_t(1) << (MIN_SHIFT + size_class))
+			++size_class;
+
+		void *p = nullptr;
+		if (size_class < N_CLASSES) {
+			const std::lock_guard<Mutex> protect(mutex);
+			auto &list = lists[size_class];
+			if (list.head != nullptr) {
+				p = list.head;
+				list.head = list.head->next;
+				--list.n;
+			}
+		}
+
+		if (p == nullptr)
+			p = operator new(size_class < N_CLASSES
+					 ? size_t(1) << (MIN_SHIFT + size_class)
+					 : total);
+
+		auto *f = new(p) FilteredChunk();
+		f->size = size;
+		f->size_class = size_class;
+		return f;
+	}
+
+	void Free(FilteredChunk *f) noexcept {
+		const unsigned size_class = f->size_class;
+		if (size_class < N_CLASSES) {
+			const std::lock_guard<Mutex> protect(mutex);
+			auto &list = lists[size_class];
+			if (list.n < MAX_FREE) {
+				f->next = list.head;
+				list.head = f;
+				++list.n;
+				return;
+			}
+		}
+
+		f->~FilteredChunk();
+		operator delete(f);
+	}
+};
+
+static FilteredChunkPool filtered_chunk_pool;
 
 MusicChunk::~MusicChunk()
 {
 	delete tag;
+
+	FilteredChunk *f = filtered.load(std::memory_order_relaxed);
+	while (f != nullptr) {
+		FilteredChunk *following = f->next;
+		filtered_chunk_pool.Free(f);
+		f = following;
+	}
 }
 
 #ifndef NDEBUG
@@ -59,8 +157,8 @@ MusicChunk::Write(const AudioFormat af,
 	}
 
 	const size_t frame_size = af.GetFrameSize();
-	size_t num_frames = (sizeof(data) - length) / frame_size;
-	return { data + length, num_frames * frame_size };
+	size_t num_frames = (capacity - length) / frame_size;
+	return { GetData() + length, num_frames * frame_size };
 }
 
 bool
@@ -68,10 +166,40 @@ MusicChunk::Expand(const AudioFormat af, size_t _length) noexcept
 {
 	const size_t frame_size = af.GetFrameSize();
 
-	assert(length + _length <= sizeof(data));
+	assert(length + _length <= capacity);
 	assert(audio_format == af);
 
 	length += _length;
 
-	return length + frame_size > sizeof(data);
+	return length + frame_size > capacity;
+}
+
+const FilteredChunk *
+MusicChunk::FindFiltered(uint64_t filter_id) const noexcept
+{
+	for (const FilteredChunk *f = filtered.load(std::memory_order_acquire);
+	     f != nullptr; f = f->next)
+		if (f->filter_id == filter_id)
+			return f;
+
+	return nullptr;
+}
+
+const FilteredChunk &
+MusicChunk::AddFiltered(uint64_t filter_id, ConstBuffer<void> data) const
+{
+	assert(FindFiltered(filter_id) == nullptr);
+
+	auto *f = filtered_chunk_pool.Allocate(data.size);
+	f->filter_id = filter_id;
+	memcpy(f + 1, data.data, data.size);
+
+	/* prepend it to the list; other threads may be walking the
+	   list or prepending concurrently */
+	f->next = filtered.load(std::memory_order_relaxed);
+	while (!filtered.compare_exchange_weak(f->next, f,
+					       std::memory_order_release,
+					       std::memory_order_relaxed)) {}
+
+	return *f;
 }
@@ -23,26 +23,66 @@
 #include "Chrono.hxx"
 #include "ReplayGainInfo.hxx"
 #include "util/WritableBuffer.hxx"
+#include "util/ConstBuffer.hxx"
 
 #ifndef NDEBUG
 #include "AudioFormat.hxx"
 #endif
 
+#include <atomic>
+
 #include <stdint.h>
 #include <stddef.h>
 
-static constexpr size_t CHUNK_SIZE = 4096;
+/**
+ * The default size of the #MusicChunk payload; see
+ * MusicBuffer::GetChunkSize().
+ */
+static constexpr size_t DEFAULT_CHUNK_SIZE = 4096;
+
+static constexpr size_t MIN_CHUNK_SIZE = 1024;
+static constexpr size_t MAX_CHUNK_SIZE = 256 * 1024;
 
 struct AudioFormat;
 struct Tag;
 
+/**
+ * The filtered data of a #MusicChunk, attached to it by
+ * #SharedFilter.  The payload is allocated right after this object.
+ */
+struct FilteredChunk {
+	FilteredChunk *next;
+
+	/**
+	 * Identifies the #SharedFilter which has produced this
+	 * object.
+	 */
+	uint64_t filter_id;
+
+	size_t size;
+
+	/**
+	 * Which free list this object is returned to; managed by
+	 * MusicChunk::AddFiltered() and ~MusicChunk().
+	 */
+	unsigned size_class;
+
+	ConstBuffer<void> GetData() const noexcept {
+		return {this + 1, size};
+	}
+};
+
 /**
  * A chunk of music data.  Its format is defined by the
  * MusicPipe::Push() caller.
  */
 struct MusicChunk {
-	/** the next chunk in a linked list */
-	MusicChunk *next;
+	/**
+	 * The next chunk in a linked list.  This is atomic because
+	 * #MusicPipe links new chunks while other threads follow
+	 * the list.
+	 */
+	std::atomic<MusicChunk *> next;
 
 	/**
 	 * An optional chunk which should be mixed into this chunk.
@@ -57,7 +97,7 @@ struct MusicChunk {
 	float mix_ratio;
 
 	/** number of bytes stored in this chunk */
-	uint16_t length = 0;
+	uint32_t length = 0;
 
 	/** current bit rate of the source file */
 	uint16_t bit_rate;
@@ -94,14 +134,24 @@ struct MusicChunk {
 	 */
 	unsigned replay_gain_serial;
 
-	/** the data (probably PCM) */
-	uint8_t data[CHUNK_SIZE];
+	/**
+	 * A linked list of filtered copies of this chunk, see
+	 * AddFiltered().
+	 */
+	mutable std::atomic<FilteredChunk *> filtered;
+
+	/**
+	 * The size of the payload, which is allocated by
+	 * #MusicBuffer right after this object.
+	 */
+	const size_t capacity;
 
 #ifndef NDEBUG
 	AudioFormat audio_format;
 #endif
 
-	MusicChunk() = default;
+	explicit MusicChunk(size_t _capacity) noexcept
+		:filtered(nullptr), capacity(_capacity) {}
 
 	MusicChunk(const MusicChunk &) = delete;
 
@@ -113,6 +163,17 @@ struct MusicChunk {
 		return length == 0 && tag == nullptr;
 	}
 
+	/**
+	 * Returns the data (probably PCM).
+	 */
+	uint8_t *GetData() noexcept {
+		return reinterpret_cast<uint8_t *>(this + 1);
+	}
+
+	const uint8_t *GetData() const noexcept {
+		return reinterpret_cast<const uint8_t *>(this + 1);
+	}
+
 #ifndef NDEBUG
 	/**
 	 * Checks if the audio format if the chunk is equal to the
@@ -147,6 +208,24 @@ struct MusicChunk {
 	 * @return true if the chunk is full
 	 */
 	bool Expand(AudioFormat af, size_t length) noexcept;
+
+	/**
+	 * Look up data attached by AddFiltered().  This method is
+	 * thread-safe.
+	 *
+	 * @return the data or nullptr if there is none for this
+	 * filter
+	 */
+	gcc_pure
+	const FilteredChunk *FindFiltered(uint64_t filter_id) const noexcept;
+
+	/**
+	 * Attach a copy of the given (filtered) data to this chunk.
+	 * It lives until this chunk is freed.  This method is
+	 * thread-safe, but each filter must attach only once.
+	 */
+	const FilteredChunk &AddFiltered(uint64_t filter_id,
+					 ConstBuffer<void> data) const;
 };
 
 #endif
@@ -22,14 +22,14 @@
 #include "MusicBuffer.hxx"
 #include "MusicChunk.hxx"
 
+#include <thread>
+
 #ifndef NDEBUG
 
 bool
 MusicPipe::Contains(const MusicChunk *chunk) const noexcept
 {
-	const std::lock_guard<Mutex> protect(mutex);
-
-	for (const MusicChunk *i = head; i != nullptr; i = i->next)
+	for (const MusicChunk *i = head.load(); i != nullptr; i = i->next)
 		if (i == chunk)
 			return true;
 
@@ -41,33 +41,51 @@ MusicPipe::Contains(const MusicChunk *chunk) const noexcept
 MusicChunk *
 MusicPipe::Shift() noexcept
 {
-	const std::lock_guard<Mutex> protect(mutex);
-
-	MusicChunk *chunk = head;
-	if (chunk != nullptr) {
-		assert(!chunk->IsEmpty());
-
-		head = chunk->next;
-		--size;
+	if (size.load(std::memory_order_acquire) == 0)
+		return nullptr;
 
-		if (head == nullptr) {
-			assert(size == 0);
-			assert(tail_r == &chunk->next);
+	MusicChunk *chunk = head.load(std::memory_order_acquire);
+	assert(chunk != nullptr);
+	assert(!chunk->IsEmpty());
 
-			tail_r = &head;
+	MusicChunk *next = chunk->next.load(std::memory_order_acquire);
+	if (next == nullptr) {
+		/* this looks like the last chunk; try to mark the
+		   pipe empty, unless Push() is just appending to
+		   it */
+		MusicChunk *expected = chunk;
+		if (tail.compare_exchange_strong(expected, nullptr,
+						 std::memory_order_acq_rel)) {
+			/* if Push() has already installed a new head,
+			   this fails and leaves it alone */
+			expected = chunk;
+			head.compare_exchange_strong(expected, nullptr,
+						     std::memory_order_acq_rel);
 		} else {
-			assert(size > 0);
-			assert(tail_r != &chunk->next);
+			/* Push() has claimed the tail, but has not
+			   linked the new chunk yet; this window is
+			   only a few instructions long */
+			while ((next = chunk->next.load(std::memory_order_acquire)) == nullptr)
+				std::this_thread::yield();
+
+			head.store(next, std::memory_order_release);
 		}
+	} else
+		head.store(next, std::memory_order_release);
+
+	const unsigned old_size = size.fetch_sub(1, std::memory_order_acq_rel);
+	assert(old_size > 0);
+	(void)old_size;
 
 #ifndef NDEBUG
-		/* poison the "next" reference */
-		chunk->next = (MusicChunk *)(void *)0x01010101;
+	/* poison the "next" reference */
+	chunk->next.store((MusicChunk *)(void *)0x01010101);
 
-		if (size == 0)
-			audio_format.Clear();
-#endif
+	if (old_size == 1) {
+		const std::lock_guard<Mutex> protect(mutex);
+		audio_format.Clear();
 	}
+#endif
 
 	return chunk;
 }
@@ -87,20 +105,27 @@ MusicPipe::Push(MusicChunk *chunk) noexcept
 	assert(!chunk->IsEmpty());
 	assert(chunk->length == 0 || chunk->audio_format.IsValid());
 
-	const std::lock_guard<Mutex> protect(mutex);
+#ifndef NDEBUG
+	{
+		const std::lock_guard<Mutex> protect(mutex);
 
-	assert(size > 0 || !audio_format.IsDefined());
-	assert(!audio_format.IsDefined() ||
-	       chunk->CheckFormat(audio_format));
+		assert(!audio_format.IsDefined() ||
+		       chunk->CheckFormat(audio_format));
 
-#ifndef NDEBUG
-	if (!audio_format.IsDefined() && chunk->length > 0)
-		audio_format = chunk->audio_format;
+		if (!audio_format.IsDefined() && chunk->length > 0)
+			audio_format = chunk->audio_format;
+	}
 #endif
 
-	chunk->next = nullptr;
-	*tail_r = chunk;
-	tail_r = &chunk->next;
+	chunk->next.store(nullptr, std::memory_order_relaxed);
+
+	/* claim the tail first, then link the chunk to its
+	   predecessor (or make it the new head) */
+	MusicChunk *prev = tail.exchange(chunk, std::memory_order_acq_rel);
+	if (prev == nullptr)
+		head.store(chunk, std::memory_order_release);
+	else
+		prev->next.store(chunk, std::memory_order_release);
 
-	++size;
+	size.fetch_add(1, std::memory_order_release);
 }
@@ -20,36 +20,47 @@
 #ifndef MPD_PIPE_H
 #define MPD_PIPE_H
 
-#include "thread/Mutex.hxx"
 #include "Compiler.h"
 
 #ifndef NDEBUG
+#include "thread/Mutex.hxx"
 #include "AudioFormat.hxx"
 #endif
 
+#include <atomic>
+
 #include <assert.h>
 
 struct MusicChunk;
 class MusicBuffer;
 
 /**
- * A queue of #MusicChunk objects.  One party appends chunks at the
- * tail, and the other consumes them from the head.
+ * A queue of #MusicChunk objects.  It is lock-free, but it has only
+ * one producer (calling Push()) and one consumer (calling Shift()
+ * and Clear()) at a time.  Any number of threads may call Peek() and
+ * follow the MusicChunk::next pointers.
  */
 class MusicPipe {
 	/** the first chunk */
-	MusicChunk *head = nullptr;
+	std::atomic<MusicChunk *> head;
 
-	/** a pointer to the tail of the chunk */
-	MusicChunk **tail_r = &head;
+	/**
+	 * The last chunk.  Push() uses it to find the chunk it
+	 * links to; Shift() resets it when removing the last chunk.
+	 */
+	std::atomic<MusicChunk *> tail;
 
-	/** the current number of chunks */
-	unsigned size = 0;
+	/**
+	 * The current number of chunks.  It is incremented only
+	 * after the new chunk has been linked, so a consumer which
+	 * observes a non-zero size is guaranteed to find a chunk.
+	 */
+	std::atomic<unsigned> size;
 
-	/** a mutex which protects #head and #tail_r */
+#ifndef NDEBUG
+	/** a mutex which protects #audio_format */
 	mutable Mutex mutex;
 
-#ifndef NDEBUG
 	AudioFormat audio_format = AudioFormat::Undefined();
 #endif
 
@@ -57,7 +68,8 @@ public:
 	/**
 	 * Creates a new #MusicPipe object.  It is empty.
 	 */
-	MusicPipe() = default;
+	MusicPipe() noexcept
+		:head(nullptr), tail(nullptr), size(0) {}
 
 	MusicPipe(const MusicPipe &) = delete;
 
@@ -65,8 +77,8 @@ public:
 	 * Frees the object.  It must be empty now.
 	 */
 	~MusicPipe() {
-		assert(head == nullptr);
-		assert(tail_r == &head);
+		assert(head.load() == nullptr);
+		assert(tail.load() == nullptr);
 	}
 
 	MusicPipe &operator=(const MusicPipe &) = delete;
@@ -78,6 +90,7 @@ public:
 	 */
 	gcc_pure
 	bool CheckFormat(AudioFormat other) const noexcept {
+		const std::lock_guard<Mutex> protect(mutex);
 		return !audio_format.IsDefined() ||
 			audio_format == other;
 	}
@@ -95,8 +108,9 @@ public:
 	 */
 	gcc_pure
 	const MusicChunk *Peek() const noexcept {
-		const std::lock_guard<Mutex> protect(mutex);
-		return head;
+		return size.load(std::memory_order_acquire) > 0
+			? head.load(std::memory_order_acquire)
+			: nullptr;
 	}
 
 	/**
@@ -121,8 +135,7 @@ public:
 	 */
 	gcc_pure
 	unsigned GetSize() const noexcept {
-		const std::lock_guard<Mutex> protect(mutex);
-		return size;
+		return size.load(std::memory_order_acquire);
 	}
 
 	gcc_pure
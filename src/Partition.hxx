@@ -58,6 +58,7 @@ struct Partition final : QueueListener, PlayerListener, MixerListener {
 	Partition(Instance &_instance,
 		  unsigned max_length,
 		  unsigned buffer_chunks,
+		  size_t chunk_size,
 		  unsigned buffered_before_play,
 		  AudioFormat configured_audio_format,
 		  const ReplayGainConfig &replay_gain_config);
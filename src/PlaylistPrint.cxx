@@ -28,6 +28,9 @@
 #include "Instance.hxx"
 #include "db/Interface.hxx"
 #include "client/Response.hxx"
+#include "client/ResponseStream.hxx"
+
+#include <algorithm>
 
 #define SONG_FILE "file: "
 #define SONG_TIME "Time: "
@@ -59,6 +62,57 @@ playlist_print_info(Response &r, Partition &partition,
 	queue_print_info(r, partition, queue, start, end);
 }
 
+/**
+ * The number of songs sent by one PlaylistInfoStream::Step() call.
+ */
+static constexpr unsigned PLAYLIST_PRINT_BATCH = 256;
+
+class PlaylistInfoStream final : public ResponseStream {
+	Partition &partition;
+	const struct playlist &playlist;
+
+	unsigned start, end;
+
+public:
+	PlaylistInfoStream(Partition &_partition,
+			   const struct playlist &_playlist,
+			   unsigned _start, unsigned _end)
+		:partition(_partition), playlist(_playlist),
+		 start(_start), end(_end) {}
+
+	/* virtual methods from class ResponseStream */
+	bool Step(Response &r) override {
+		const Queue &queue = playlist.queue;
+
+		/* the queue may have shrunk since the last batch */
+		end = std::min(end, queue.GetLength());
+		if (start >= end)
+			return true;
+
+		const unsigned batch_end =
+			std::min(end, start + PLAYLIST_PRINT_BATCH);
+		queue_print_info(r, partition, queue, start, batch_end);
+		start = batch_end;
+		return start >= end;
+	}
+};
+
+std::unique_ptr<ResponseStream>
+playlist_print_info_stream(Partition &partition, const playlist &playlist,
+			   unsigned start, unsigned end)
+{
+	end = std::min(end, playlist.queue.GetLength());
+
+	if (start > end)
+		/* an invalid "start" offset is fatal */
+		throw PlaylistError::BadRange();
+
+	return std::unique_ptr<ResponseStream>(new PlaylistInfoStream(partition,
+								      playlist,
+								      start,
+								      end));
+}
+
 void
 playlist_print_id(Response &r, Partition &partition, const playlist &playlist,
 		  unsigned id)
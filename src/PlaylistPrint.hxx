@@ -20,12 +20,15 @@
 #ifndef MPD_PLAYLIST_PRINT_HXX
 #define MPD_PLAYLIST_PRINT_HXX
 
+#include <memory>
+
 #include <stdint.h>
 
 struct playlist;
 struct Partition;
 class SongFilter;
 class Response;
+class ResponseStream;
 
 /**
  * Sends the whole playlist to the client, song URIs only.
@@ -47,6 +50,18 @@ playlist_print_info(Response &r, Partition &partition,
 		    const playlist &playlist,
 		    unsigned start, unsigned end);
 
+/**
+ * Like playlist_print_info(), but returns a #ResponseStream which
+ * sends the songs in small batches.  Songs are addressed by
+ * position, so if the queue is modified in the meantime, the
+ * response reflects the queue at the time each batch was sent.
+ *
+ * Throws #PlaylistError if the range is invalid.
+ */
+std::unique_ptr<ResponseStream>
+playlist_print_info_stream(Partition &partition, const playlist &playlist,
+			   unsigned start, unsigned end);
+
 /**
  * Sends the song with the specified id to the client.
  *
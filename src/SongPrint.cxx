@@ -56,7 +56,7 @@ song_print_uri(Response &r, Partition &partition, const char *uri, bool base)
 			uri = allocated.c_str();
 	}
 
-	r.Format(SONG_FILE "%s\n", uri);
+	r.WritePair("file", uri);
 }
 
 void
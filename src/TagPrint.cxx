@@ -28,20 +28,20 @@ tag_print_types(Response &r)
 {
 	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; i++)
 		if (IsTagEnabled(i))
-			r.Format("tagtype: %s\n", tag_item_names[i]);
+			r.WritePair("tagtype", tag_item_names[i]);
 }
 
 void
 tag_print(Response &r, TagType type, const char *value)
 {
-	r.Format("%s: %s\n", tag_item_names[type], value);
+	r.WritePair(tag_item_names[type], value);
 }
 
 void
 tag_print_values(Response &r, const Tag &tag)
 {
 	for (const auto &i : tag)
-		r.Format("%s: %s\n", tag_item_names[i.type], i.value);
+		r.WritePair(tag_item_names[i.type], i.value);
 }
 
 void
@@ -22,6 +22,7 @@
 
 #include "check.h"
 #include "ClientMessage.hxx"
+#include "ResponseStream.hxx"
 #include "command/CommandListBuilder.hxx"
 #include "event/FullyBufferedSocket.hxx"
 #include "event/TimeoutMonitor.hxx"
@@ -33,6 +34,7 @@
 #include <set>
 #include <string>
 #include <list>
+#include <memory>
 
 #include <stddef.h>
 #include <stdarg.h>
@@ -87,6 +89,19 @@ public:
 	 */
 	std::list<ClientMessage> messages;
 
+	/**
+	 * The remainder of a large response, which is generated each
+	 * time the output buffer has been flushed.  While this is
+	 * set, no further commands are read.
+	 */
+	std::unique_ptr<ResponseStream> response_stream;
+
+	/**
+	 * The name of the command which created #response_stream.
+	 * Used to generate error messages.
+	 */
+	const char *response_stream_command;
+
 	Client(EventLoop &loop, Partition &partition,
 	       int fd, int uid, int num);
 
@@ -114,6 +129,19 @@ public:
 	 */
 	bool Write(const char *data);
 
+	/**
+	 * Write a printf-like formatted string.
+	 */
+	bool FormatV(const char *fmt, va_list args);
+
+	/**
+	 * Continue the current command's response with the given
+	 * #ResponseStream as the output buffer drains.  The "OK"
+	 * line is sent when it is complete.
+	 */
+	void StartStream(const char *command,
+			 std::unique_ptr<ResponseStream> &&stream);
+
 	/**
 	 * returns the uid of the client process, or a negative value
 	 * if the uid is unknown
@@ -202,6 +230,9 @@ private:
 	void OnSocketError(std::exception_ptr ep) override;
 	virtual void OnSocketClosed() override;
 
+	/* virtual methods from class FullyBufferedSocket */
+	bool OnOutputEmpty() override;
+
 	/* virtual methods from class TimeoutMonitor */
 	virtual void OnTimeout() override;
 };
@@ -51,7 +51,8 @@ Client::Client(EventLoop &_loop, Partition &_partition,
 	 uid(_uid),
 	 num(_num),
 	 idle_waiting(false), idle_flags(0),
-	 num_subscriptions(0)
+	 num_subscriptions(0),
+	 response_stream_command(nullptr)
 {
 	TimeoutMonitor::Schedule(client_timeout);
 }
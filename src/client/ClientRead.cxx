@@ -29,6 +29,11 @@
 BufferedSocket::InputResult
 Client::OnSocketInput(void *data, size_t length)
 {
+	if (response_stream != nullptr)
+		/* don't read the next command before the current
+		   response is complete */
+		return InputResult::PAUSE;
+
 	char *p = (char *)data;
 	char *newline = (char *)memchr(p, '\n', length);
 	if (newline == nullptr)
@@ -51,6 +56,9 @@ Client::OnSocketInput(void *data, size_t length)
 	case CommandResult::ERROR:
 		break;
 
+	case CommandResult::STREAM:
+		return InputResult::PAUSE;
+
 	case CommandResult::KILL:
 		partition.instance.Shutdown();
 		Close();
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "ClientInternal.hxx"
+#include "Response.hxx"
+#include "protocol/Result.hxx"
+#include "command/CommandError.hxx"
+
+#include <assert.h>
+
+void
+Client::StartStream(const char *command,
+		    std::unique_ptr<ResponseStream> &&stream)
+{
+	assert(response_stream == nullptr);
+	assert(stream != nullptr);
+
+	response_stream = std::move(stream);
+	response_stream_command = command;
+}
+
+bool
+Client::OnOutputEmpty()
+{
+	if (response_stream == nullptr)
+		return true;
+
+	/* the client is making progress; don't let it time out while
+	   it receives a large response */
+	TimeoutMonitor::Schedule(client_timeout);
+
+	Response r(*this, 0);
+	r.SetCommand(response_stream_command);
+
+	bool success = true;
+	try {
+		if (!response_stream->Step(r) && !IsExpired())
+			/* more to come; Write() has rescheduled the
+			   output buffer flush */
+			return true;
+	} catch (...) {
+		PrintError(r, std::current_exception());
+		success = false;
+	}
+
+	response_stream.reset();
+
+	if (IsExpired())
+		return false;
+
+	if (success)
+		command_success(*this);
+
+	/* process the commands which have been received in the
+	   meantime */
+	return ResumeInput();
+}
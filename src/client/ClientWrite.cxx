@@ -22,6 +22,7 @@
 #include "util/FormatString.hxx"
 #include "util/AllocatedString.hxx"
 
+#include <stdio.h>
 #include <string.h>
 
 bool
@@ -37,6 +38,27 @@ Client::Write(const char *data)
 	return Write(data, strlen(data));
 }
 
+bool
+Client::FormatV(const char *fmt, va_list args)
+{
+	/* almost all lines fit into this buffer, which avoids a
+	   heap allocation per line */
+	char buffer[1024];
+
+	va_list tmp;
+	va_copy(tmp, args);
+	const int length = vsnprintf(buffer, sizeof(buffer), fmt, tmp);
+	va_end(tmp);
+
+	if (gcc_unlikely(length < 0))
+		return true;
+
+	if (gcc_likely(size_t(length) < sizeof(buffer)))
+		return Write(buffer, length);
+
+	return Write(FormatStringV(fmt, args).c_str());
+}
+
 void
 client_puts(Client &client, const char *s)
 {
@@ -46,7 +68,7 @@ client_puts(Client &client, const char *s)
 void
 client_vprintf(Client &client, const char *fmt, va_list args)
 {
-	client.Write(FormatStringV(fmt, args).c_str());
+	client.FormatV(fmt, args);
 }
 
 void
@@ -20,8 +20,12 @@
 #include "config.h"
 #include "Response.hxx"
 #include "Client.hxx"
-#include "util/FormatString.hxx"
-#include "util/AllocatedString.hxx"
+#include "ResponseStream.hxx"
+#include "Compiler.h"
+
+#include <algorithm>
+
+#include <string.h>
 
 bool
 Response::Write(const void *data, size_t length)
@@ -35,10 +39,31 @@ Response::Write(const char *data)
 	return client.Write(data);
 }
 
+bool
+Response::WritePair(const char *name, const char *value)
+{
+	const size_t name_length = strlen(name);
+	const size_t value_length = strlen(value);
+	const size_t length = name_length + 2 + value_length + 1;
+
+	char buffer[1024];
+	if (gcc_unlikely(length > sizeof(buffer)))
+		return Write(name, name_length) && Write(": ", 2) &&
+			Write(value, value_length) && Write("\n", 1);
+
+	char *p = std::copy_n(name, name_length, buffer);
+	*p++ = ':';
+	*p++ = ' ';
+	p = std::copy_n(value, value_length, p);
+	*p = '\n';
+
+	return Write(buffer, length);
+}
+
 bool
 Response::FormatV(const char *fmt, va_list args)
 {
-	return Write(FormatStringV(fmt, args).c_str());
+	return client.FormatV(fmt, args);
 }
 
 bool
@@ -51,6 +76,26 @@ Response::Format(const char *fmt, ...)
 	return success;
 }
 
+CommandResult
+Response::Stream(std::unique_ptr<ResponseStream> stream)
+{
+	if (stream->Step(*this) || client.IsExpired())
+		return CommandResult::OK;
+
+	if (client.cmd_list.IsActive()) {
+		/* the commands in a list are executed all at once, so
+		   there is no point in streaming */
+		while (!stream->Step(*this))
+			if (client.IsExpired())
+				break;
+
+		return CommandResult::OK;
+	}
+
+	client.StartStream(command, std::move(stream));
+	return CommandResult::STREAM;
+}
+
 void
 Response::Error(enum ack code, const char *msg)
 {
@@ -22,11 +22,15 @@
 
 #include "check.h"
 #include "protocol/Ack.hxx"
+#include "command/CommandResult.hxx"
+
+#include <memory>
 
 #include <stddef.h>
 #include <stdarg.h>
 
 class Client;
+class ResponseStream;
 
 class Response {
 	Client &client;
@@ -55,9 +59,26 @@ public:
 
 	bool Write(const void *data, size_t length);
 	bool Write(const char *data);
+
+	/**
+	 * Write a "name: value" line.  This is cheaper than
+	 * Format().
+	 */
+	bool WritePair(const char *name, const char *value);
+
 	bool FormatV(const char *fmt, va_list args);
 	bool Format(const char *fmt, ...);
 
+	/**
+	 * Generate the rest of the response with the given
+	 * #ResponseStream while the output buffer drains, instead of
+	 * buffering all of it at once.  The first batch is generated
+	 * right away, and errors are thrown from there.
+	 *
+	 * Throws std::runtime_error on error.
+	 */
+	CommandResult Stream(std::unique_ptr<ResponseStream> stream);
+
 	void Error(enum ack code, const char *msg);
 	void FormatError(enum ack code, const char *fmt, ...);
 };
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_RESPONSE_STREAM_HXX
+#define MPD_RESPONSE_STREAM_HXX
+
+#include "check.h"
+
+class Response;
+
+/**
+ * A response which may be too large to be generated at once.
+ * Instead of filling the client's output buffer with the whole
+ * response, it is generated in small batches, each time the output
+ * buffer has been flushed to the socket.  While a response is being
+ * streamed, the client's input is paused.
+ *
+ * @see Response::Stream()
+ */
+class ResponseStream {
+public:
+	virtual ~ResponseStream() {}
+
+	/**
+	 * Write the next batch of the response.  This must not write
+	 * the final "OK" line.
+	 *
+	 * Throws std::runtime_error on error.
+	 *
+	 * @return true if the response is complete; false means
+	 * that more is to come, and in that case, something must have
+	 * been written
+	 */
+	virtual bool Step(Response &r) = 0;
+};
+
+#endif
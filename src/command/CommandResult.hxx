@@ -41,6 +41,14 @@ enum class CommandResult {
 	 */
 	IDLE,
 
+	/**
+	 * The rest of the response is being generated by a
+	 * #ResponseStream; the "OK" response will be sent when it is
+	 * complete, and no further input shall be processed until
+	 * then.
+	 */
+	STREAM,
+
 	/**
 	 * There was an error.  The "ACK" response was sent to the
 	 * client.
@@ -171,10 +171,8 @@ handle_listall(Client &client, Request args, Response &r)
 	/* default is root directory */
 	const auto uri = args.GetOptional(0, "");
 
-	db_selection_print(r, client.partition,
-			   DatabaseSelection(uri, true),
-			   false, false);
-	return CommandResult::OK;
+	return r.Stream(db_print_recursive_stream(client.partition, uri,
+						  false));
 }
 
 CommandResult
@@ -247,8 +245,6 @@ handle_listallinfo(Client &client, Request args, Response &r)
 	/* default is root directory */
 	const auto uri = args.GetOptional(0, "");
 
-	db_selection_print(r, client.partition,
-			   DatabaseSelection(uri, true),
-			   true, false);
-	return CommandResult::OK;
+	return r.Stream(db_print_recursive_stream(client.partition, uri,
+						  true));
 }
@@ -235,9 +235,9 @@ handle_playlistinfo(Client &client, Request args, Response &r)
 {
 	RangeArg range = args.ParseOptional(0, RangeArg::All());
 
-	playlist_print_info(r, client.partition, client.playlist,
-			    range.start, range.end);
-	return CommandResult::OK;
+	return r.Stream(playlist_print_info_stream(client.partition,
+						   client.playlist,
+						   range.start, range.end));
 }
 
 CommandResult
@@ -247,12 +247,11 @@ handle_playlistid(Client &client, Request args, Response &r)
 		unsigned id = args.ParseUnsigned(0);
 		playlist_print_id(r, client.partition,
 				  client.playlist, id);
-	} else {
-		playlist_print_info(r, client.partition, client.playlist,
-				    0, std::numeric_limits<unsigned>::max());
-	}
-
-	return CommandResult::OK;
+		return CommandResult::OK;
+	} else
+		return r.Stream(playlist_print_info_stream(client.partition,
+							   client.playlist, 0,
+							   std::numeric_limits<unsigned>::max()));
 }
 
 static CommandResult
@@ -27,12 +27,18 @@
 #define MPD_DB_LOCK_HXX
 
 #include "check.h"
-#include "thread/Mutex.hxx"
+#include "thread/SharedMutex.hxx"
 #include "Compiler.h"
 
 #include <assert.h>
 
-extern Mutex db_mutex;
+/**
+ * The global database lock.  Threads which only read the database
+ * (clients walking the tree) lock it in "shared" mode, so they do
+ * not serialize behind each other; modifications (by the update
+ * thread and Mount()) require the "exclusive" mode.
+ */
+extern SharedMutex db_mutex;
 
 #ifndef NDEBUG
 
@@ -41,11 +47,27 @@ extern Mutex db_mutex;
 extern ThreadId db_mutex_holder;
 
 /**
- * Does the current thread hold the database lock?
+ * Does the current thread hold the database lock in "shared" mode?
+ */
+extern thread_local bool db_mutex_shared;
+
+/**
+ * Does the current thread hold the database lock (in any mode)?
  */
 gcc_pure
 static inline bool
 holding_db_lock() noexcept
+{
+	return db_mutex_holder.IsInside() || db_mutex_shared;
+}
+
+/**
+ * Does the current thread hold the database lock in "exclusive"
+ * mode, i.e. may it modify the database?
+ */
+gcc_pure
+static inline bool
+holding_db_lock_exclusive() noexcept
 {
 	return db_mutex_holder.IsInside();
 }
@@ -53,8 +75,9 @@ holding_db_lock() noexcept
 #endif
 
 /**
- * Obtain the global database lock.  This is needed before
- * dereferencing a #song or #directory.  It is not recursive.
+ * Obtain the global database lock in "exclusive" mode.  This is
+ * needed before modifying a #song or #directory.  It is not
+ * recursive.
  */
 static inline void
 db_lock(void)
@@ -75,7 +98,7 @@ db_lock(void)
 static inline void
 db_unlock(void)
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 #ifndef NDEBUG
 	db_mutex_holder = ThreadId::Null();
 #endif
@@ -83,6 +106,36 @@ db_unlock(void)
 	db_mutex.unlock();
 }
 
+/**
+ * Obtain the global database lock in "shared" mode.  This is needed
+ * before dereferencing a #song or #directory.  It is not recursive.
+ */
+static inline void
+db_lock_shared(void)
+{
+	assert(!holding_db_lock());
+
+	db_mutex.lock_shared();
+
+#ifndef NDEBUG
+	db_mutex_shared = true;
+#endif
+}
+
+/**
+ * Release the global database lock obtained with db_lock_shared().
+ */
+static inline void
+db_unlock_shared(void)
+{
+	assert(db_mutex_shared);
+#ifndef NDEBUG
+	db_mutex_shared = false;
+#endif
+
+	db_mutex.unlock_shared();
+}
+
 class ScopeDatabaseLock {
 	bool locked = true;
 
@@ -107,6 +160,34 @@ public:
 	}
 };
 
+/**
+ * Like #ScopeDatabaseLock, but lock in "shared" mode, for read-only
+ * access.
+ */
+class ScopeDatabaseSharedLock {
+	bool locked = true;
+
+public:
+	ScopeDatabaseSharedLock() {
+		db_lock_shared();
+	}
+
+	~ScopeDatabaseSharedLock() {
+		if (locked)
+			db_unlock_shared();
+	}
+
+	/**
+	 * Unlock the mutex now, making the destructor a no-op.
+	 */
+	void unlock() {
+		assert(locked);
+
+		db_unlock_shared();
+		locked = false;
+	}
+};
+
 /**
  * Unlock the database while in the current scope.
  */
@@ -121,4 +202,19 @@ public:
 	}
 };
 
+/**
+ * Unlock the database (locked in "shared" mode) while in the current
+ * scope.
+ */
+class ScopeDatabaseSharedUnlock {
+public:
+	ScopeDatabaseSharedUnlock() {
+		db_unlock_shared();
+	}
+
+	~ScopeDatabaseSharedUnlock() {
+		db_lock_shared();
+	}
+};
+
 #endif
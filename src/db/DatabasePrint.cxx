@@ -24,15 +24,22 @@
 #include "SongPrint.hxx"
 #include "TimePrint.hxx"
 #include "client/Response.hxx"
+#include "client/ResponseStream.hxx"
 #include "Partition.hxx"
 #include "tag/Tag.hxx"
 #include "LightSong.hxx"
 #include "LightDirectory.hxx"
 #include "PlaylistInfo.hxx"
 #include "Interface.hxx"
+#include "DatabaseError.hxx"
 #include "fs/Traits.hxx"
 
 #include <functional>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <string.h>
 
 static const char *
 ApplyBaseFlag(const char *uri, bool base)
@@ -180,6 +187,163 @@ db_selection_print(Response &r, Partition &partition,
 			   0, std::numeric_limits<int>::max());
 }
 
+/**
+ * The number of songs, directories and playlists printed by one
+ * DatabasePrintStream::Step() call (unless a single directory is
+ * larger than that).
+ */
+static constexpr unsigned DATABASE_PRINT_BATCH = 256;
+
+class DatabasePrintStream final : public ResponseStream {
+	Partition &partition;
+
+	const std::string uri;
+
+	const bool full;
+
+	bool started = false;
+
+	struct Task {
+		std::string uri;
+
+		time_t mtime;
+
+		/**
+		 * Print the "directory" line before the contents?
+		 */
+		bool header;
+
+		Task(const char *_uri, time_t _mtime, bool _header)
+			:uri(_uri), mtime(_mtime), header(_header) {}
+	};
+
+	/**
+	 * The directories which remain to be printed, the next one
+	 * at the end.
+	 */
+	std::vector<Task> stack;
+
+public:
+	DatabasePrintStream(Partition &_partition, const char *_uri,
+			    bool _full)
+		:partition(_partition), uri(_uri), full(_full) {}
+
+	/* virtual methods from class ResponseStream */
+	bool Step(Response &r) override;
+
+private:
+	void Start(const Database &db);
+};
+
+void
+DatabasePrintStream::Start(const Database &db)
+{
+	/* the "directory" line of the starting directory needs its
+	   mtime, which only the parent directory reports */
+	time_t mtime = 0;
+	bool header = false;
+
+	if (!uri.empty()) {
+		const char *slash = strrchr(uri.c_str(), '/');
+		const std::string parent = slash != nullptr
+			? std::string(uri.c_str(), slash)
+			: std::string();
+
+		const auto d = [this, &mtime, &header](const LightDirectory &directory){
+			if (uri == directory.GetPath()) {
+				mtime = directory.mtime;
+				header = true;
+			}
+		};
+
+		db.Visit(DatabaseSelection(parent.c_str(), false),
+			 d, VisitSong(), VisitPlaylist());
+	}
+
+	/* if this is not a directory, it may be a song, which is
+	   printed by visiting it */
+	stack.emplace_back(uri.c_str(), mtime, header);
+}
+
+bool
+DatabasePrintStream::Step(Response &r)
+{
+	const Database &db = partition.GetDatabaseOrThrow();
+
+	if (!started) {
+		started = true;
+		Start(db);
+	}
+
+	unsigned n = 0;
+
+	const auto d = [this](const LightDirectory &directory){
+		stack.emplace_back(directory.GetPath(), directory.mtime, true);
+	};
+
+	const auto s = [this, &r, &n](const LightSong &song){
+		if (full)
+			PrintSongFull(r, partition, false, song);
+		else
+			PrintSongBrief(r, partition, false, song);
+		++n;
+	};
+
+	const auto p = [this, &r, &n](const PlaylistInfo &playlist,
+				      const LightDirectory &directory){
+		if (full)
+			PrintPlaylistFull(r, false, playlist, directory);
+		else
+			PrintPlaylistBrief(r, false, playlist, directory);
+		++n;
+	};
+
+	while (!stack.empty() && n < DATABASE_PRINT_BATCH) {
+		const Task task = std::move(stack.back());
+		stack.pop_back();
+
+		if (task.header) {
+			const LightDirectory directory(task.uri.c_str(),
+						       task.mtime);
+			if (full)
+				PrintDirectoryFull(r, false, directory);
+			else
+				PrintDirectoryBrief(r, false, directory);
+			++n;
+		}
+
+		/* visit only this directory and collect its children
+		   on the stack, in reverse order, so they get printed
+		   in the same order as a recursive walk would */
+		const size_t first_child = stack.size();
+
+		try {
+			db.Visit(DatabaseSelection(task.uri.c_str(), false),
+				 d, s, p);
+		} catch (const DatabaseError &e) {
+			if (e.GetCode() != DatabaseErrorCode::NOT_FOUND ||
+			    !task.header)
+				throw;
+
+			/* this directory has been deleted meanwhile */
+			stack.erase(stack.begin() + first_child, stack.end());
+			continue;
+		}
+
+		std::reverse(stack.begin() + first_child, stack.end());
+	}
+
+	return stack.empty();
+}
+
+std::unique_ptr<ResponseStream>
+db_print_recursive_stream(Partition &partition, const char *uri, bool full)
+{
+	return std::unique_ptr<ResponseStream>(new DatabasePrintStream(partition,
+								       uri,
+								       full));
+}
+
 static void
 PrintSongURIVisitor(Response &r, Partition &partition, const LightSong &song)
 {
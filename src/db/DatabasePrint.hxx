@@ -22,10 +22,13 @@
 
 #include "tag/Mask.hxx"
 
+#include <memory>
+
 class SongFilter;
 struct DatabaseSelection;
 struct Partition;
 class Response;
+class ResponseStream;
 
 /**
  * @param full print attributes/tags
@@ -42,6 +45,17 @@ db_selection_print(Response &r, Partition &partition,
 		   bool full, bool base,
 		   unsigned window_start, unsigned window_end);
 
+/**
+ * Create a #ResponseStream which prints the specified directory
+ * recursively, like db_selection_print() does with a recursive
+ * #DatabaseSelection without filter.  The database is visited one
+ * directory at a time, and is not locked in between.
+ *
+ * @param full print attributes/tags
+ */
+std::unique_ptr<ResponseStream>
+db_print_recursive_stream(Partition &partition, const char *uri, bool full);
+
 void
 PrintUniqueTags(Response &r, Partition &partition,
 		unsigned type, tag_mask_t group_mask,
@@ -0,0 +1,710 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "BinaryDatabase.hxx"
+#include "Directory.hxx"
+#include "Song.hxx"
+#include "db/DatabaseLock.hxx"
+#include "db/PlaylistInfo.hxx"
+#include "fs/Path.hxx"
+#include "fs/Charset.hxx"
+#include "fs/io/FileReader.hxx"
+#include "fs/io/BufferedOutputStream.hxx"
+#include "tag/Tag.hxx"
+#include "tag/TagItem.hxx"
+#include "tag/TagPool.hxx"
+#include "tag/Settings.hxx"
+#include "util/Arena.hxx"
+#include "util/ConstBuffer.hxx"
+#include "util/StringView.hxx"
+#include "util/RuntimeError.hxx"
+
+#ifdef _WIN32
+#include <memory>
+#else
+#include "system/Error.hxx"
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <limits>
+
+#include <stdint.h>
+#include <string.h>
+
+static constexpr char BINARY_DB_MAGIC[8] = {
+	'M', 'P', 'D', 'B', 'I', 'N', 'D', 'B',
+};
+
+static constexpr uint32_t BINARY_DB_VERSION = 1;
+
+/**
+ * Detects files written on a host with a different byte order.
+ */
+static constexpr uint32_t BINARY_DB_BYTE_ORDER = 0x01020304;
+
+static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+/**
+ * A slice of the file: an array of records.
+ */
+struct BinarySection {
+	uint64_t offset, count;
+};
+
+struct BinaryHeader {
+	char magic[sizeof(BINARY_DB_MAGIC)];
+	uint32_t version;
+	uint32_t byte_order;
+
+	/**
+	 * The string table; "count" is the size in bytes.  It
+	 * begins with an empty string and ends with a null byte.
+	 */
+	BinarySection strings;
+
+	/**
+	 * #BinaryTagType records; #BinaryItem::type is an index into
+	 * this array.
+	 */
+	BinarySection tag_types;
+
+	/**
+	 * #BinaryItem records; the distinct tag items of all songs.
+	 */
+	BinarySection items;
+
+	/**
+	 * #BinaryDirectory records in pre-order; the first one is
+	 * the root directory.
+	 */
+	BinarySection directories;
+
+	/**
+	 * #BinarySong records, grouped by directory.
+	 */
+	BinarySection songs;
+
+	/**
+	 * Indexes into #items (uint32_t), grouped by song.
+	 */
+	BinarySection song_items;
+
+	/**
+	 * #BinaryPlaylist records, grouped by directory.
+	 */
+	BinarySection playlists;
+
+	uint32_t fs_charset;
+	uint32_t reserved;
+};
+
+struct BinaryTagType {
+	uint32_t name;
+	uint32_t enabled;
+};
+
+struct BinaryItem {
+	uint32_t type;
+	uint32_t value;
+};
+
+enum class BinaryDirectoryType : uint32_t {
+	REGULAR,
+	ARCHIVE,
+	CONTAINER,
+};
+
+struct BinaryDirectory {
+	uint32_t parent;
+	uint32_t name;
+	BinaryDirectoryType type;
+	uint32_t first_song, n_songs;
+	uint32_t first_playlist, n_playlists;
+	uint32_t reserved;
+	int64_t mtime;
+};
+
+struct BinarySong {
+	uint32_t uri;
+	uint32_t first_item, n_items;
+	uint32_t has_playlist;
+
+	/**
+	 * In milliseconds; negative if unknown.
+	 */
+	int32_t duration;
+
+	uint32_t start_ms, end_ms;
+	uint32_t reserved;
+	int64_t mtime;
+};
+
+struct BinaryPlaylist {
+	uint32_t name;
+	uint32_t reserved;
+	int64_t mtime;
+};
+
+static_assert(sizeof(BinaryHeader) == 136, "Unexpected size");
+static_assert(sizeof(BinaryDirectory) == 40, "Unexpected size");
+static_assert(sizeof(BinarySong) == 40, "Unexpected size");
+static_assert(sizeof(BinaryPlaylist) == 16, "Unexpected size");
+
+/**
+ * Align all sections to this many bytes.
+ */
+static constexpr size_t BINARY_DB_ALIGN = 8;
+
+class BinaryDatabaseWriter {
+	std::string strings;
+	std::unordered_map<std::string, uint32_t> string_map;
+
+	std::vector<BinaryItem> items;
+	std::unordered_map<const TagItem *, uint32_t> item_map;
+
+	std::vector<BinaryDirectory> directories;
+	std::vector<BinarySong> songs;
+	std::vector<uint32_t> song_items;
+	std::vector<BinaryPlaylist> playlists;
+
+public:
+	BinaryDatabaseWriter()
+		:strings(1, '\0') {}
+
+	uint32_t AddString(const char *s);
+
+	void AddDirectory(const Directory &directory, uint32_t parent);
+
+	void Write(BufferedOutputStream &os);
+
+private:
+	uint32_t AddItem(const TagItem &item);
+	void AddSong(const Song &song);
+};
+
+uint32_t
+BinaryDatabaseWriter::AddString(const char *s)
+{
+	if (*s == 0)
+		return 0;
+
+	auto r = string_map.emplace(s, strings.size());
+	if (r.second)
+		strings.append(s, strlen(s) + 1);
+	return r.first->second;
+}
+
+inline uint32_t
+BinaryDatabaseWriter::AddItem(const TagItem &item)
+{
+	/* TagItems are interned by the TagPool, which makes the
+	   pointer a good key (duplicates only cost some space) */
+	auto r = item_map.emplace(&item, items.size());
+	if (r.second)
+		items.push_back({uint32_t(item.type), AddString(item.value)});
+	return r.first->second;
+}
+
+inline void
+BinaryDatabaseWriter::AddSong(const Song &song)
+{
+	BinarySong b;
+	memset(&b, 0, sizeof(b));
+	b.uri = AddString(song.uri);
+	b.first_item = song_items.size();
+	b.n_items = song.tag.num_items;
+	b.has_playlist = song.tag.has_playlist;
+	b.duration = song.tag.duration.IsNegative()
+		? -1
+		: int32_t(song.tag.duration.ToMS());
+	b.start_ms = song.start_time.ToMS();
+	b.end_ms = song.end_time.ToMS();
+	b.mtime = song.mtime;
+	songs.push_back(b);
+
+	for (const auto &item : song.tag)
+		song_items.push_back(AddItem(item));
+}
+
+void
+BinaryDatabaseWriter::AddDirectory(const Directory &directory,
+				   uint32_t parent)
+{
+	const uint32_t i = directories.size();
+
+	BinaryDirectory b;
+	memset(&b, 0, sizeof(b));
+	b.parent = parent;
+	b.name = directory.IsRoot() ? 0 : AddString(directory.GetName());
+	b.type = directory.device == DEVICE_INARCHIVE
+		? BinaryDirectoryType::ARCHIVE
+		: (directory.device == DEVICE_CONTAINER
+		   ? BinaryDirectoryType::CONTAINER
+		   : BinaryDirectoryType::REGULAR);
+	b.mtime = directory.mtime;
+
+	b.first_song = songs.size();
+	for (const auto &song : directory.songs)
+		AddSong(song);
+	b.n_songs = songs.size() - b.first_song;
+
+	b.first_playlist = playlists.size();
+	for (const auto &playlist : directory.playlists)
+		playlists.push_back({AddString(playlist.name.c_str()), 0,
+				     int64_t(playlist.mtime)});
+	b.n_playlists = playlists.size() - b.first_playlist;
+
+	directories.push_back(b);
+
+	for (const auto &child : directory.children)
+		if (!child.IsMount())
+			AddDirectory(child, i);
+}
+
+template<typename T>
+static BinarySection
+MakeSection(uint64_t &offset, const T *, size_t count)
+{
+	BinarySection s{offset, count};
+	offset += count * sizeof(T);
+	offset += (BINARY_DB_ALIGN - offset % BINARY_DB_ALIGN) % BINARY_DB_ALIGN;
+	return s;
+}
+
+template<typename T>
+static void
+WriteSection(BufferedOutputStream &os, const T *data, size_t count)
+{
+	static constexpr char padding[BINARY_DB_ALIGN] = {};
+
+	const size_t size = count * sizeof(T);
+	os.Write(data, size);
+	os.Write(padding, (BINARY_DB_ALIGN - size % BINARY_DB_ALIGN) % BINARY_DB_ALIGN);
+}
+
+void
+BinaryDatabaseWriter::Write(BufferedOutputStream &os)
+{
+	BinaryTagType tag_types[TAG_NUM_OF_ITEM_TYPES];
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i) {
+		tag_types[i].name = AddString(tag_item_names[i]);
+		tag_types[i].enabled = IsTagEnabled(i);
+	}
+
+	BinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BINARY_DB_MAGIC, sizeof(header.magic));
+	header.version = BINARY_DB_VERSION;
+	header.byte_order = BINARY_DB_BYTE_ORDER;
+	header.fs_charset = AddString(GetFSCharset());
+
+	uint64_t offset = sizeof(header);
+	header.strings = MakeSection(offset, strings.data(), strings.size());
+	header.tag_types = MakeSection(offset, tag_types,
+				       TAG_NUM_OF_ITEM_TYPES);
+	header.items = MakeSection(offset, items.data(), items.size());
+	header.directories = MakeSection(offset, directories.data(),
+					 directories.size());
+	header.songs = MakeSection(offset, songs.data(), songs.size());
+	header.song_items = MakeSection(offset, song_items.data(),
+					song_items.size());
+	header.playlists = MakeSection(offset, playlists.data(),
+				       playlists.size());
+
+	os.Write(&header, sizeof(header));
+	WriteSection(os, strings.data(), strings.size());
+	WriteSection(os, tag_types, TAG_NUM_OF_ITEM_TYPES);
+	WriteSection(os, items.data(), items.size());
+	WriteSection(os, directories.data(), directories.size());
+	WriteSection(os, songs.data(), songs.size());
+	WriteSection(os, song_items.data(), song_items.size());
+	WriteSection(os, playlists.data(), playlists.size());
+}
+
+void
+db_save_binary(BufferedOutputStream &os, const Directory &root)
+{
+	BinaryDatabaseWriter writer;
+	writer.AddDirectory(root, NO_PARENT);
+	writer.Write(os);
+}
+
+/**
+ * A read-only view of a file's contents.  It is mapped into memory
+ * where possible, so only the pages which are actually used get read
+ * from disk.
+ */
+class FileImage {
+	const uint8_t *data = nullptr;
+	size_t size;
+
+#ifdef _WIN32
+	std::unique_ptr<uint8_t[]> buffer;
+#endif
+
+public:
+	explicit FileImage(Path path) {
+		FileReader reader(path);
+
+		const uint64_t size64 = reader.GetSize();
+		if (size64 > std::numeric_limits<size_t>::max())
+			throw std::runtime_error("Database file is too large");
+
+		size = size64;
+		if (size == 0)
+			return;
+
+#ifdef _WIN32
+		buffer.reset(new uint8_t[size]);
+		for (size_t pos = 0; pos < size;) {
+			size_t nbytes = reader.Read(buffer.get() + pos,
+						    size - pos);
+			if (nbytes == 0)
+				throw std::runtime_error("Unexpected end of file");
+			pos += nbytes;
+		}
+
+		data = buffer.get();
+#else
+		void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE,
+			       reader.GetFD().Get(), 0);
+		if (p == MAP_FAILED)
+			throw MakeErrno("Failed to map database file");
+
+		data = (const uint8_t *)p;
+#endif
+	}
+
+	~FileImage() {
+#ifndef _WIN32
+		if (data != nullptr)
+			munmap(const_cast<uint8_t *>(data), size);
+#endif
+	}
+
+	FileImage(const FileImage &) = delete;
+	FileImage &operator=(const FileImage &) = delete;
+
+	size_t GetSize() const {
+		return size;
+	}
+
+	const uint8_t *GetData() const {
+		return data;
+	}
+};
+
+class BinaryDatabaseReader {
+	const uint8_t *const data;
+	const BinaryHeader &header;
+
+	const char *strings;
+	const BinaryTagType *tag_types;
+	const BinaryItem *items;
+	const BinaryDirectory *directories;
+	const BinarySong *songs;
+	const uint32_t *song_items;
+	const BinaryPlaylist *playlists;
+
+	/**
+	 * Maps #BinaryTagType indexes to #TagType.
+	 */
+	std::vector<TagType> tag_map;
+
+	/**
+	 * One #TagPool reference for each #BinaryItem.
+	 */
+	std::vector<TagItem *> tag_items;
+
+public:
+	BinaryDatabaseReader(const FileImage &file);
+	~BinaryDatabaseReader();
+
+	void Load(Directory &root, Arena *arena);
+
+private:
+	template<typename T>
+	const T *GetSection(const BinarySection &s, size_t file_size);
+
+	const char *GetString(uint32_t offset) const;
+
+	void CheckTagTypes();
+	void LoadItems();
+	TagItem *DupItem(uint32_t i);
+	void LoadSongs(Directory &directory, const BinaryDirectory &b,
+		       Arena *arena);
+	void LoadPlaylists(Directory &directory, const BinaryDirectory &b);
+};
+
+template<typename T>
+const T *
+BinaryDatabaseReader::GetSection(const BinarySection &s, size_t file_size)
+{
+	if (s.offset % BINARY_DB_ALIGN != 0 || s.offset > file_size ||
+	    s.count > (file_size - s.offset) / sizeof(T))
+		throw std::runtime_error("Database corrupted");
+
+	return (const T *)(data + s.offset);
+}
+
+inline const char *
+BinaryDatabaseReader::GetString(uint32_t offset) const
+{
+	/* the string table is null-terminated (checked by the
+	   constructor), so this is all that needs to be checked */
+	if (offset >= header.strings.count)
+		throw std::runtime_error("Database corrupted");
+
+	return strings + offset;
+}
+
+BinaryDatabaseReader::BinaryDatabaseReader(const FileImage &file)
+	:data(file.GetData()), header(*(const BinaryHeader *)data)
+{
+	const size_t size = file.GetSize();
+
+	if (header.version != BINARY_DB_VERSION)
+		throw std::runtime_error("Database format mismatch, "
+					 "discarding database file");
+
+	if (header.byte_order != BINARY_DB_BYTE_ORDER)
+		throw std::runtime_error("Database byte order mismatch, "
+					 "discarding database file");
+
+	strings = GetSection<char>(header.strings, size);
+	tag_types = GetSection<BinaryTagType>(header.tag_types, size);
+	items = GetSection<BinaryItem>(header.items, size);
+	directories = GetSection<BinaryDirectory>(header.directories, size);
+	songs = GetSection<BinarySong>(header.songs, size);
+	song_items = GetSection<uint32_t>(header.song_items, size);
+	playlists = GetSection<BinaryPlaylist>(header.playlists, size);
+
+	if (header.strings.count == 0 ||
+	    strings[header.strings.count - 1] != 0 ||
+	    header.directories.count == 0 ||
+	    directories[0].parent != NO_PARENT)
+		throw std::runtime_error("Database corrupted");
+
+	const char *new_charset = GetString(header.fs_charset);
+	const char *const old_charset = GetFSCharset();
+	if (*old_charset != 0 && strcmp(new_charset, old_charset) != 0)
+		throw FormatRuntimeError("Existing database has charset "
+					 "\"%s\" instead of \"%s\"; "
+					 "discarding database file",
+					 new_charset, old_charset);
+}
+
+BinaryDatabaseReader::~BinaryDatabaseReader()
+{
+	for (TagItem *item : tag_items)
+		tag_pool_put_item(item);
+}
+
+void
+BinaryDatabaseReader::CheckTagTypes()
+{
+	bool enabled[TAG_NUM_OF_ITEM_TYPES];
+	std::fill_n(enabled, size_t(TAG_NUM_OF_ITEM_TYPES), false);
+
+	tag_map.reserve(header.tag_types.count);
+	for (size_t i = 0; i < header.tag_types.count; ++i) {
+		const char *name = GetString(tag_types[i].name);
+		TagType tag = tag_name_parse(name);
+		if (tag == TAG_NUM_OF_ITEM_TYPES)
+			throw FormatRuntimeError("Unrecognized tag '%s', "
+						 "discarding database file",
+						 name);
+
+		tag_map.push_back(tag);
+		if (tag_types[i].enabled)
+			enabled[tag] = true;
+	}
+
+	for (unsigned i = 0; i < TAG_NUM_OF_ITEM_TYPES; ++i)
+		if (IsTagEnabled(i) && !enabled[i])
+			throw std::runtime_error("Tag list mismatch, "
+						 "discarding database file");
+}
+
+void
+BinaryDatabaseReader::LoadItems()
+{
+	/* intern each distinct value only once; the songs share
+	   these references */
+	tag_items.reserve(header.items.count);
+
+	for (size_t i = 0; i < header.items.count; ++i) {
+		const auto &b = items[i];
+		if (b.type >= tag_map.size())
+			throw std::runtime_error("Database corrupted");
+
+		tag_items.push_back(tag_pool_get_item(tag_map[b.type],
+						      GetString(b.value)));
+	}
+}
+
+/**
+ * Obtain a new reference to an item.
+ */
+inline TagItem *
+BinaryDatabaseReader::DupItem(uint32_t i)
+{
+	TagItem *&cached = tag_items[i];
+	TagItem *item = tag_pool_dup_item(cached);
+	if (item != cached) {
+		/* the reference counter was full; continue with the
+		   new slot, or all following songs would have to look
+		   up the value again */
+		tag_pool_put_item(cached);
+		cached = tag_pool_dup_item(item);
+	}
+
+	return item;
+}
+
+inline void
+BinaryDatabaseReader::LoadSongs(Directory &directory,
+				const BinaryDirectory &b, Arena *arena)
+{
+	if (b.first_song > header.songs.count ||
+	    b.n_songs > header.songs.count - b.first_song)
+		throw std::runtime_error("Database corrupted");
+
+	for (const auto &s : ConstBuffer<BinarySong>(songs + b.first_song,
+						     b.n_songs)) {
+		const char *uri = GetString(s.uri);
+		if (*uri == 0 ||
+		    s.first_item > header.song_items.count ||
+		    s.n_items > header.song_items.count - s.first_item ||
+		    s.n_items > std::numeric_limits<decltype(Tag::num_items)>::max())
+			throw std::runtime_error("Database corrupted");
+
+		Song *song = Song::NewFile(uri, directory, arena);
+		song->mtime = s.mtime;
+		song->start_time = SongTime::FromMS(s.start_ms);
+		song->end_time = SongTime::FromMS(s.end_ms);
+
+		Tag &tag = song->tag;
+		if (s.duration >= 0)
+			tag.duration = SignedSongTime::FromMS(s.duration);
+		tag.has_playlist = s.has_playlist != 0;
+
+		if (s.n_items > 0) {
+			const uint32_t *refs = song_items + s.first_item;
+			for (unsigned i = 0; i < s.n_items; ++i) {
+				if (refs[i] >= tag_items.size()) {
+					song->Free();
+					throw std::runtime_error("Database corrupted");
+				}
+			}
+
+			if (arena != nullptr) {
+				tag.items = arena->NewArray<TagItem *>(s.n_items);
+				song->tag_in_arena = true;
+			} else
+				tag.items = new TagItem *[s.n_items];
+
+			for (unsigned i = 0; i < s.n_items; ++i)
+				tag.items[i] = DupItem(refs[i]);
+			tag.num_items = s.n_items;
+		}
+
+		directory.AddSong(song);
+	}
+}
+
+inline void
+BinaryDatabaseReader::LoadPlaylists(Directory &directory,
+				    const BinaryDirectory &b)
+{
+	if (b.first_playlist > header.playlists.count ||
+	    b.n_playlists > header.playlists.count - b.first_playlist)
+		throw std::runtime_error("Database corrupted");
+
+	for (const auto &p : ConstBuffer<BinaryPlaylist>(playlists + b.first_playlist,
+							 b.n_playlists))
+		directory.playlists.UpdateOrInsert(PlaylistInfo(GetString(p.name),
+								p.mtime));
+}
+
+void
+BinaryDatabaseReader::Load(Directory &root, Arena *arena)
+{
+	CheckTagTypes();
+	LoadItems();
+
+	std::vector<Directory *> map;
+	map.reserve(header.directories.count);
+
+	for (size_t i = 0; i < header.directories.count; ++i) {
+		const auto &b = directories[i];
+
+		Directory *directory;
+		if (i == 0) {
+			directory = &root;
+		} else {
+			const char *name = GetString(b.name);
+			if (b.parent >= i || *name == 0 ||
+			    strchr(name, '/') != nullptr)
+				throw std::runtime_error("Database corrupted");
+
+			directory = map[b.parent]->CreateChild(name, arena);
+
+			switch (b.type) {
+			case BinaryDirectoryType::REGULAR:
+				break;
+
+			case BinaryDirectoryType::ARCHIVE:
+				directory->device = DEVICE_INARCHIVE;
+				break;
+
+			case BinaryDirectoryType::CONTAINER:
+				directory->device = DEVICE_CONTAINER;
+				break;
+			}
+		}
+
+		directory->mtime = b.mtime;
+		map.push_back(directory);
+
+		LoadSongs(*directory, b, arena);
+		LoadPlaylists(*directory, b);
+	}
+}
+
+bool
+db_load_binary(Path path, Directory &root, Arena *arena)
+{
+	const FileImage file(path);
+	if (file.GetSize() < sizeof(BinaryHeader) ||
+	    memcmp(file.GetData(), BINARY_DB_MAGIC,
+		   sizeof(BINARY_DB_MAGIC)) != 0)
+		return false;
+
+	BinaryDatabaseReader reader(file);
+
+	const ScopeDatabaseLock protect;
+	reader.Load(root, arena);
+	return true;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/** \file
+ *
+ * A binary database file format which is loaded with mmap().  It
+ * consists of a header describing the location of several arrays of
+ * fixed-size records; all strings are stored once in a string table.
+ */
+
+#ifndef MPD_BINARY_DATABASE_HXX
+#define MPD_BINARY_DATABASE_HXX
+
+struct Directory;
+class Path;
+class Arena;
+class BufferedOutputStream;
+
+void
+db_save_binary(BufferedOutputStream &os, const Directory &root);
+
+/**
+ * Throws #std::runtime_error on error.
+ *
+ * @param arena an optional #Arena to allocate the new objects from
+ * @return false if the file is not a binary database
+ */
+bool
+db_load_binary(Path path, Directory &root, Arena *arena=nullptr);
+
+#endif
@@ -65,7 +65,7 @@ db_save_internal(BufferedOutputStream &os, const Directory &music_root)
 }
 
 void
-db_load_internal(TextFile &file, Directory &music_root)
+db_load_internal(TextFile &file, Directory &music_root, Arena *arena)
 {
 	char *line;
 	unsigned format = 0;
@@ -128,5 +128,5 @@ db_load_internal(TextFile &file, Directory &music_root)
 						 "discarding database file");
 
 	const ScopeDatabaseLock protect;
-	directory_load(file, music_root);
+	directory_load(file, music_root, arena);
 }
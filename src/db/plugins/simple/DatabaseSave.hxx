@@ -23,14 +23,17 @@
 struct Directory;
 class BufferedOutputStream;
 class TextFile;
+class Arena;
 
 void
 db_save_internal(BufferedOutputStream &os, const Directory &root);
 
 /**
  * Throws #std::runtime_error on error.
+ *
+ * @param arena an optional #Arena to allocate the new objects from
  */
 void
-db_load_internal(TextFile &file, Directory &root);
+db_load_internal(TextFile &file, Directory &root, Arena *arena=nullptr);
 
 #endif
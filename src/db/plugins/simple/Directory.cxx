@@ -21,6 +21,7 @@
 #include "Directory.hxx"
 #include "SongSort.hxx"
 #include "Song.hxx"
+#include "TagIndex.hxx"
 #include "Mount.hxx"
 #include "db/LightDirectory.hxx"
 #include "db/LightSong.hxx"
@@ -31,37 +32,118 @@
 #include "lib/icu/Collate.hxx"
 #include "fs/Traits.hxx"
 #include "util/Alloc.hxx"
-#include "util/DeleteDisposer.hxx"
+#include "util/Arena.hxx"
 
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 
 Directory::Directory(std::string &&_path_utf8, Directory *_parent)
-	:parent(_parent),
+	:n_children(0), n_songs(0),
+	 parent(_parent),
 	 mtime(0),
 	 inode(0), device(0),
 	 path(std::move(_path_utf8)),
-	 mounted_database(nullptr)
+	 mounted_database(nullptr),
+	 tag_index(_parent != nullptr ? _parent->tag_index : nullptr),
+	 in_arena(false)
 {
 }
 
+/**
+ * Create a #NameIndex for directories with more children or songs
+ * than this.
+ */
+static constexpr unsigned NAME_INDEX_THRESHOLD = 32;
+
+template<typename T, typename L, typename F>
+static void
+AddToNameIndex(std::unique_ptr<NameIndex<T>> &index, unsigned n,
+	       L &list, T &item, F get_name)
+{
+	if (index != nullptr) {
+		/* emplace() keeps the existing entry for duplicate
+		   names, just like the linear search finds the first
+		   one */
+		index->emplace(get_name(item), &item);
+	} else if (n > NAME_INDEX_THRESHOLD) {
+		index.reset(new NameIndex<T>(n));
+		for (auto &i : list)
+			index->emplace(get_name(i), &i);
+	}
+}
+
+template<typename T>
+static void
+RemoveFromNameIndex(NameIndex<T> *index, const char *name,
+		    const T &item) noexcept
+{
+	if (index == nullptr)
+		return;
+
+	auto i = index->find(name);
+	if (i != index->end() && i->second == &item)
+		index->erase(i);
+}
+
+inline void
+Directory::IndexChild(Directory &child)
+{
+	AddToNameIndex(child_index, n_children, children, child,
+		       [](const Directory &d){ return d.GetName(); });
+}
+
+inline void
+Directory::UnindexChild(const Directory &child) noexcept
+{
+	RemoveFromNameIndex(child_index.get(), child.GetName(), child);
+}
+
+inline void
+Directory::IndexSong(Song &song)
+{
+	AddToNameIndex(song_index, n_songs, songs, song,
+		       [](const Song &s){ return s.uri; });
+}
+
+inline void
+Directory::UnindexSong(const Song &song) noexcept
+{
+	RemoveFromNameIndex(song_index.get(), song.uri, song);
+}
+
 Directory::~Directory()
 {
 	delete mounted_database;
 
+	if (tag_index != nullptr)
+		for (auto &song : songs)
+			tag_index->Remove(song);
+
 	songs.clear_and_dispose(Song::Disposer());
-	children.clear_and_dispose(DeleteDisposer());
+	children.clear_and_dispose(Disposer());
+}
+
+void
+Directory::Free()
+{
+	if (in_arena)
+		/* the memory is released together with the Arena */
+		this->~Directory();
+	else
+		delete this;
 }
 
 void
 Directory::Delete()
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 	assert(parent != nullptr);
 
+	parent->UnindexChild(*this);
+	--parent->n_children;
 	parent->children.erase_and_dispose(parent->children.iterator_to(*this),
-					   DeleteDisposer());
+					   Disposer());
 }
 
 const char *
@@ -73,9 +155,9 @@ Directory::GetName() const noexcept
 }
 
 Directory *
-Directory::CreateChild(const char *name_utf8)
+Directory::CreateChild(const char *name_utf8, Arena *arena)
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 	assert(name_utf8 != nullptr);
 	assert(*name_utf8 != 0);
 
@@ -83,8 +165,16 @@ Directory::CreateChild(const char *name_utf8)
 		? std::string(name_utf8)
 		: PathTraitsUTF8::Build(GetPath(), name_utf8);
 
-	Directory *child = new Directory(std::move(path_utf8), this);
+	Directory *child;
+	if (arena != nullptr) {
+		child = arena->New<Directory>(std::move(path_utf8), this);
+		child->in_arena = true;
+	} else
+		child = new Directory(std::move(path_utf8), this);
+
 	children.push_back(*child);
+	++n_children;
+	IndexChild(*child);
 	return child;
 }
 
@@ -93,6 +183,11 @@ Directory::FindChild(const char *name) const noexcept
 {
 	assert(holding_db_lock());
 
+	if (child_index != nullptr) {
+		auto i = child_index->find(name);
+		return i != child_index->end() ? i->second : nullptr;
+	}
+
 	for (const auto &child : children)
 		if (strcmp(child.GetName(), name) == 0)
 			return &child;
@@ -103,16 +198,18 @@ Directory::FindChild(const char *name) const noexcept
 void
 Directory::PruneEmpty() noexcept
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 
 	for (auto child = children.begin(), end = children.end();
 	     child != end;) {
 		child->PruneEmpty();
 
-		if (child->IsEmpty() && !child->IsMount())
+		if (child->IsEmpty() && !child->IsMount()) {
+			UnindexChild(*child);
+			--n_children;
 			child = children.erase_and_dispose(child,
-							   DeleteDisposer());
-		else
+							   Disposer());
+		} else
 			++child;
 	}
 }
@@ -153,33 +250,59 @@ Directory::LookupDirectory(const char *uri) noexcept
 		name = slash + 1;
 	}
 
-	free(duplicated);
-
 	const char *rest = name == nullptr
 		? nullptr
 		: uri + (name - duplicated);
 
+	free(duplicated);
+
 	return { d, rest };
 }
 
 void
 Directory::AddSong(Song *song)
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 	assert(song != nullptr);
 	assert(song->parent == this);
 
 	songs.push_back(*song);
+	++n_songs;
+	IndexSong(*song);
+
+	if (tag_index != nullptr)
+		tag_index->Add(*song);
 }
 
 void
 Directory::RemoveSong(Song *song) noexcept
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 	assert(song != nullptr);
 	assert(song->parent == this);
 
+	UnindexSong(*song);
+	--n_songs;
 	songs.erase(songs.iterator_to(*song));
+
+	if (tag_index != nullptr)
+		tag_index->Remove(*song);
+}
+
+void
+Directory::UpdateSongTag(Song &song, Tag &&tag)
+{
+	assert(holding_db_lock_exclusive());
+	assert(song.parent == this);
+
+	if (tag_index != nullptr)
+		tag_index->Remove(song);
+
+	song.ClearArenaTag();
+	song.tag = std::move(tag);
+
+	if (tag_index != nullptr)
+		tag_index->Add(song);
 }
 
 const Song *
@@ -188,6 +311,11 @@ Directory::FindSong(const char *name_utf8) const noexcept
 	assert(holding_db_lock());
 	assert(name_utf8 != nullptr);
 
+	if (song_index != nullptr) {
+		auto i = song_index->find(name_utf8);
+		return i != song_index->end() ? i->second : nullptr;
+	}
+
 	for (auto &song : songs) {
 		assert(song.parent == this);
 
@@ -208,7 +336,7 @@ directory_cmp(const Directory &a, const Directory &b) noexcept
 void
 Directory::Sort() noexcept
 {
-	assert(holding_db_lock());
+	assert(holding_db_lock_exclusive());
 
 	children.sort(directory_cmp);
 	song_list_sort(songs);
@@ -228,7 +356,7 @@ Directory::Walk(bool recursive, const SongFilter *filter,
 		/* TODO: eliminate this unlock/lock; it is necessary
 		   because the child's SimpleDatabasePlugin::Visit()
 		   call will lock it again */
-		const ScopeDatabaseUnlock unlock;
+		const ScopeDatabaseSharedUnlock unlock;
 		WalkMount(GetPath(), *mounted_database,
 			  "", recursive, filter,
 			  visit_directory, visit_song,
@@ -25,10 +25,12 @@
 #include "db/Visitor.hxx"
 #include "db/PlaylistVector.hxx"
 #include "Song.hxx"
+#include "NameIndex.hxx"
 
 #include <boost/intrusive/list.hpp>
 
 #include <string>
+#include <memory>
 
 /**
  * Virtual directory that is really an archive file or a folder inside
@@ -45,12 +47,20 @@ static constexpr unsigned DEVICE_CONTAINER = -2;
 
 class SongFilter;
 class Database;
+class TagIndex;
+class Arena;
 
 struct Directory {
 	static constexpr auto link_mode = boost::intrusive::normal_link;
 	typedef boost::intrusive::link_mode<link_mode> LinkMode;
 	typedef boost::intrusive::list_member_hook<LinkMode> Hook;
 
+	struct Disposer {
+		void operator()(Directory *directory) const {
+			directory->Free();
+		}
+	};
+
 	/**
 	 * Pointers to the siblings of this directory within the
 	 * parent directory.  It is unused (undefined) in the root
@@ -82,6 +92,21 @@ struct Directory {
 	 */
 	SongList songs;
 
+	/**
+	 * Hash indexes over the names in #children and #songs for
+	 * FindChild() and FindSong().  They are only created when a
+	 * list grows beyond a certain size.
+	 *
+	 * These attributes are protected with the global #db_mutex.
+	 */
+	std::unique_ptr<NameIndex<Directory>> child_index;
+	std::unique_ptr<NameIndex<Song>> song_index;
+
+	/**
+	 * The number of elements in #children and #songs.
+	 */
+	unsigned n_children, n_songs;
+
 	PlaylistVector playlists;
 
 	Directory *parent;
@@ -96,22 +121,44 @@ struct Directory {
 	 */
 	Database *mounted_database;
 
+	/**
+	 * The #TagIndex which songs in this directory are added to;
+	 * nullptr if there is none.  Child directories inherit it.
+	 */
+	TagIndex *tag_index;
+
+	/**
+	 * Was this object allocated from an #Arena?
+	 */
+	bool in_arena;
+
 public:
 	Directory(std::string &&_path_utf8, Directory *_parent);
 	~Directory();
 
 	/**
 	 * Create a new root #Directory object.
+	 *
+	 * @param _tag_index an optional #TagIndex to be maintained for
+	 * all songs in the tree
 	 */
 	gcc_malloc
-	static Directory *NewRoot() {
-		return new Directory(std::string(), nullptr);
+	static Directory *NewRoot(TagIndex *_tag_index=nullptr) {
+		auto *root = new Directory(std::string(), nullptr);
+		root->tag_index = _tag_index;
+		return root;
 	}
 
 	bool IsMount() const {
 		return mounted_database != nullptr;
 	}
 
+	/**
+	 * Destruct and free this object.  Unlike Delete(), this does
+	 * not remove it from its parent.
+	 */
+	void Free();
+
 	/**
 	 * Remove this #Directory object from its parent and free it.  This
 	 * must not be called with the root Directory.
@@ -126,8 +173,9 @@ public:
 	 * Caller must lock the #db_mutex.
 	 *
 	 * @param name_utf8 the UTF-8 encoded name of the new sub directory
+	 * @param arena an optional #Arena to allocate the object from
 	 */
-	Directory *CreateChild(const char *name_utf8);
+	Directory *CreateChild(const char *name_utf8, Arena *arena=nullptr);
 
 	/**
 	 * Caller must lock the #db_mutex.
@@ -249,6 +297,21 @@ public:
 	 */
 	void RemoveSong(Song *song) noexcept;
 
+	/**
+	 * Replace the tag of a song in this directory.
+	 *
+	 * Caller must lock the #db_mutex.
+	 */
+	void UpdateSongTag(Song &song, Tag &&tag);
+
+private:
+	void IndexChild(Directory &child);
+	void UnindexChild(const Directory &child) noexcept;
+	void IndexSong(Song &song);
+	void UnindexSong(const Song &song) noexcept;
+
+public:
+
 	/**
 	 * Caller must lock the #db_mutex.
 	 */
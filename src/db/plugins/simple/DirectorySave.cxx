@@ -113,12 +113,13 @@ ParseLine(Directory &directory, const char *line)
 }
 
 static Directory *
-directory_load_subdir(TextFile &file, Directory &parent, const char *name)
+directory_load_subdir(TextFile &file, Directory &parent, const char *name,
+		      Arena *arena)
 {
 	if (parent.FindChild(name) != nullptr)
 		throw FormatRuntimeError("Duplicate subdirectory '%s'", name);
 
-	Directory *directory = parent.CreateChild(name);
+	Directory *directory = parent.CreateChild(name, arena);
 
 	try {
 		while (true) {
@@ -133,7 +134,7 @@ directory_load_subdir(TextFile &file, Directory &parent, const char *name)
 				throw FormatRuntimeError("Malformed line: %s", line);
 		}
 
-		directory_load(file, *directory);
+		directory_load(file, *directory, arena);
 	} catch (...) {
 		directory->Delete();
 		throw;
@@ -143,7 +144,7 @@ directory_load_subdir(TextFile &file, Directory &parent, const char *name)
 }
 
 void
-directory_load(TextFile &file, Directory &directory)
+directory_load(TextFile &file, Directory &directory, Arena *arena)
 {
 	const char *line;
 
@@ -151,7 +152,7 @@ directory_load(TextFile &file, Directory &directory)
 	       !StringStartsWith(line, DIRECTORY_END)) {
 		const char *p;
 		if ((p = StringAfterPrefix(line, DIRECTORY_DIR))) {
-			directory_load_subdir(file, directory, p);
+			directory_load_subdir(file, directory, p, arena);
 		} else if ((p = StringAfterPrefix(line, SONG_BEGIN))) {
 			const char *name = p;
 
@@ -161,7 +162,7 @@ directory_load(TextFile &file, Directory &directory)
 			DetachedSong *song = song_load(file, name);
 
 			directory.AddSong(Song::NewFrom(std::move(*song),
-							directory));
+							directory, arena));
 			delete song;
 		} else if ((p = StringAfterPrefix(line, PLAYLIST_META_BEGIN))) {
 			const char *name = p;
@@ -22,6 +22,7 @@
 
 struct Directory;
 class TextFile;
+class Arena;
 class BufferedOutputStream;
 
 void
@@ -29,8 +30,11 @@ directory_save(BufferedOutputStream &os, const Directory &directory);
 
 /**
  * Throws #std::runtime_error on error.
+ *
+ * @param arena an optional #Arena to allocate the new objects from
  */
 void
-directory_load(TextFile &file, Directory &directory);
+directory_load(TextFile &file, Directory &directory,
+	       Arena *arena=nullptr);
 
 #endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_NAME_INDEX_HXX
+#define MPD_NAME_INDEX_HXX
+
+#include "util/StringAPI.hxx"
+#include "Compiler.h"
+
+#include <unordered_map>
+
+#include <stddef.h>
+
+struct NameIndexHash {
+	gcc_pure
+	size_t operator()(const char *p) const noexcept {
+		/* FNV-1a */
+		size_t hash = 2166136261u;
+		while (*p != 0)
+			hash = (hash ^ (unsigned char)*p++) * 16777619u;
+		return hash;
+	}
+};
+
+struct NameIndexEqual {
+	gcc_pure
+	bool operator()(const char *a, const char *b) const noexcept {
+		return StringIsEqual(a, b);
+	}
+};
+
+/**
+ * A hash table which maps the names of the children or songs of a
+ * #Directory to the objects.  The keys point into the objects
+ * themselves.
+ */
+template<typename T>
+using NameIndex = std::unordered_map<const char *, T *,
+				     NameIndexHash, NameIndexEqual>;
+
+#endif
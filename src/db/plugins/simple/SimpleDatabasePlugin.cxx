@@ -29,9 +29,12 @@
 #include "db/LightDirectory.hxx"
 #include "Directory.hxx"
 #include "Song.hxx"
+#include "SongFilter.hxx"
 #include "DatabaseSave.hxx"
+#include "BinaryDatabase.hxx"
 #include "db/DatabaseLock.hxx"
 #include "db/DatabaseError.hxx"
+#include "tag/TagPool.hxx"
 #include "fs/io/TextFile.hxx"
 #include "fs/io/BufferedOutputStream.hxx"
 #include "fs/io/FileOutputStream.hxx"
@@ -40,6 +43,7 @@
 #include "fs/FileSystem.hxx"
 #include "util/CharUtil.hxx"
 #include "util/Domain.hxx"
+#include "util/RuntimeError.hxx"
 #include "Log.hxx"
 
 #ifdef ENABLE_ZLIB
@@ -47,17 +51,33 @@
 #endif
 
 #include <memory>
+#include <mutex>
 
 #include <errno.h>
+#include <stdint.h>
+#include <string.h>
 
 static constexpr Domain simple_db_domain("simple_db");
 
+static bool
+ParseDatabaseFormat(const char *format)
+{
+	if (strcmp(format, "text") == 0)
+		return false;
+	else if (strcmp(format, "binary") == 0)
+		return true;
+	else
+		throw FormatRuntimeError("Unrecognized database format: %s",
+					 format);
+}
+
 inline SimpleDatabase::SimpleDatabase(const ConfigBlock &block)
 	:Database(simple_db_plugin),
 	 path(block.GetPath("path")),
 #ifdef ENABLE_ZLIB
 	 compress(block.GetBlockValue("compress", true)),
 #endif
+	 binary(ParseDatabaseFormat(block.GetBlockValue("format", "text"))),
 	 cache_path(block.GetPath("cache_directory")),
 	 prefixed_light_song(nullptr)
 {
@@ -78,6 +98,7 @@ inline SimpleDatabase::SimpleDatabase(AllocatedPath &&_path,
 #ifdef ENABLE_ZLIB
 	 compress(_compress),
 #endif
+	 binary(false),
 	 cache_path(AllocatedPath::Null()),
 	 prefixed_light_song(nullptr) {
 }
@@ -143,17 +164,41 @@ SimpleDatabase::Check() const
 #endif
 }
 
+/**
+ * Log the #TagPool counters, which help with sizing it.
+ */
+static void
+LogTagPoolStats()
+{
+	const auto stats = tag_pool_get_stats();
+	FormatDebug(simple_db_domain,
+		    "tag pool: %zu items, load factor %.2f, "
+		    "%llu hits, %llu misses",
+		    stats.n_items,
+		    stats.capacity > 0
+		    ? double(stats.n_items) / stats.capacity
+		    : 0.,
+		    (unsigned long long)stats.hits,
+		    (unsigned long long)stats.misses);
+}
+
 void
 SimpleDatabase::Load()
 {
 	assert(!path.IsNull());
 	assert(root != nullptr);
 
-	TextFile file(path);
-
 	LogDebug(simple_db_domain, "reading DB");
 
-	db_load_internal(file, *root);
+	/* the format is detected by the file contents, so switching
+	   the "format" setting doesn't discard the existing
+	   database */
+	if (!db_load_binary(path, *root, &arena)) {
+		TextFile file(path);
+		db_load_internal(file, *root, &arena);
+	}
+
+	LogTagPoolStats();
 
 	FileInfo fi;
 	if (GetFileInfo(path, fi))
@@ -165,7 +210,8 @@ SimpleDatabase::Open()
 {
 	assert(prefixed_light_song == nullptr);
 
-	root = Directory::NewRoot();
+	root = Directory::NewRoot(&tag_index);
+	n_mounts = 0;
 	mtime = 0;
 
 #ifndef NDEBUG
@@ -177,11 +223,13 @@ SimpleDatabase::Open()
 	} catch (const std::exception &e) {
 		LogError(e);
 
+		tag_index.Clear();
 		delete root;
+		arena.Clear();
 
 		Check();
 
-		root = Directory::NewRoot();
+		root = Directory::NewRoot(&tag_index);
 	}
 }
 
@@ -192,7 +240,11 @@ SimpleDatabase::Close()
 	assert(prefixed_light_song == nullptr);
 	assert(borrowed_song_count == 0);
 
+	/* clear the index first, to avoid removing each song
+	   individually */
+	tag_index.Clear();
 	delete root;
+	arena.Clear();
 }
 
 const LightSong *
@@ -202,7 +254,7 @@ SimpleDatabase::GetSong(const char *uri) const
 	assert(prefixed_light_song == nullptr);
 	assert(borrowed_song_count == 0);
 
-	ScopeDatabaseLock protect;
+	ScopeDatabaseSharedLock protect;
 
 	auto r = root->LookupDirectory(uri);
 
@@ -268,7 +320,7 @@ SimpleDatabase::Visit(const DatabaseSelection &selection,
 		      VisitSong visit_song,
 		      VisitPlaylist visit_playlist) const
 {
-	ScopeDatabaseLock protect;
+	ScopeDatabaseSharedLock protect;
 
 	auto r = root->LookupDirectory(selection.uri.c_str());
 
@@ -289,6 +341,12 @@ SimpleDatabase::Visit(const DatabaseSelection &selection,
 		if (selection.recursive && visit_directory)
 			visit_directory(r.directory->Export());
 
+		if (selection.filter != nullptr && visit_song &&
+		    !visit_directory && !visit_playlist &&
+		    VisitIndexed(*r.directory, selection.recursive,
+				 *selection.filter, visit_song))
+			return;
+
 		r.directory->Walk(selection.recursive, selection.filter,
 				  visit_directory, visit_song,
 				  visit_playlist);
@@ -312,6 +370,114 @@ SimpleDatabase::Visit(const DatabaseSelection &selection,
 			    "No such directory");
 }
 
+/**
+ * Determine whether the given directory is the base directory or
+ * one of its descendants, and mark all directories on the way up as
+ * "wanted".
+ */
+static bool
+MarkWanted(const Directory &base, const Directory *directory,
+	   std::unordered_map<const Directory *, bool> &wanted)
+{
+	auto r = wanted.emplace(directory, false);
+	if (!r.second)
+		return r.first->second;
+
+	/* references to elements survive rehashing */
+	bool &result = r.first->second;
+	result = directory == &base ||
+		(directory->parent != nullptr &&
+		 MarkWanted(base, directory->parent, wanted));
+	return result;
+}
+
+/**
+ * Like Directory::Walk(), but visit only the given songs, and skip
+ * directories which do not contain any of them.
+ */
+static void
+WalkIndexed(const Directory &directory, bool recursive,
+	    const SongFilter &filter,
+	    const std::unordered_map<const Directory *, bool> &wanted,
+	    const std::vector<bool> &songs,
+	    const VisitSong &visit_song)
+{
+	for (const auto &song : directory.songs) {
+		if (song.index_id >= songs.size() || !songs[song.index_id])
+			continue;
+
+		const LightSong song2 = song.Export();
+		if (filter.Match(song2))
+			visit_song(song2);
+	}
+
+	if (!recursive)
+		return;
+
+	for (const auto &child : directory.children) {
+		auto i = wanted.find(&child);
+		if (i != wanted.end() && i->second)
+			WalkIndexed(child, recursive, filter, wanted, songs,
+				    visit_song);
+	}
+}
+
+bool
+SimpleDatabase::VisitIndexed(const Directory &directory, bool recursive,
+			     const SongFilter &filter,
+			     VisitSong visit_song) const
+{
+	if (n_mounts > 0)
+		/* the index doesn't know mounted databases */
+		return false;
+
+	std::unique_lock<Mutex> lock(index_scratch_mutex, std::try_to_lock);
+	if (lock.owns_lock())
+		return VisitIndexed(directory, recursive, filter, visit_song,
+				    index_scratch);
+
+	/* another thread is using the buffers (or this is a nested
+	   call from visit_song) */
+	IndexScratch scratch;
+	return VisitIndexed(directory, recursive, filter, visit_song,
+			    scratch);
+}
+
+bool
+SimpleDatabase::VisitIndexed(const Directory &directory, bool recursive,
+			     const SongFilter &filter,
+			     const VisitSong &visit_song,
+			     IndexScratch &scratch) const
+{
+	/* without recursion, Directory::Walk() only checks the songs
+	   of this directory; the index must beat that */
+	if (!tag_index.Find(filter,
+			    recursive ? SIZE_MAX : directory.n_songs,
+			    scratch.find))
+		return false;
+
+	auto &songs = scratch.songs;
+	songs.clear();
+
+	auto &wanted = scratch.wanted;
+	wanted.clear();
+
+	for (const Song *song : scratch.find.songs) {
+		if (recursive
+		    ? MarkWanted(directory, song->parent, wanted)
+		    : song->parent == &directory) {
+			if (song->index_id >= songs.size())
+				songs.resize(song->index_id + 1);
+			songs[song->index_id] = true;
+		}
+	}
+
+	if (!songs.empty())
+		WalkIndexed(directory, recursive, filter, wanted, songs,
+			    visit_song);
+	return true;
+}
+
 void
 SimpleDatabase::VisitUniqueTags(const DatabaseSelection &selection,
 				TagType tag_type, tag_mask_t group_mask,
@@ -347,7 +513,7 @@ SimpleDatabase::Save()
 
 #ifdef ENABLE_ZLIB
 	std::unique_ptr<GzipOutputStream> gzip;
-	if (compress) {
+	if (compress && !binary) {
 		gzip.reset(new GzipOutputStream(*os));
 		os = gzip.get();
 	}
@@ -355,7 +521,10 @@ SimpleDatabase::Save()
 
 	BufferedOutputStream bos(*os);
 
-	db_save_internal(bos, *root);
+	if (binary)
+		db_save_binary(bos, *root);
+	else
+		db_save_internal(bos, *root);
 
 	bos.Flush();
 
@@ -368,6 +537,8 @@ SimpleDatabase::Save()
 
 	fos.Commit();
 
+	LogTagPoolStats();
+
 	FileInfo fi;
 	if (GetFileInfo(path, fi))
 		mtime = fi.GetModificationTime();
@@ -396,6 +567,7 @@ SimpleDatabase::Mount(const char *uri, Database *db)
 
 	Directory *mnt = r.directory->CreateChild(r.uri);
 	mnt->mounted_database = db;
+	++n_mounts;
 }
 
 static constexpr bool
@@ -459,6 +631,9 @@ SimpleDatabase::LockUmountSteal(const char *uri)
 	r.directory->mounted_database = nullptr;
 	r.directory->Delete();
 
+	assert(n_mounts > 0);
+	--n_mounts;
+
 	return db;
 }
 
@@ -24,8 +24,14 @@
 #include "db/Interface.hxx"
 #include "fs/AllocatedPath.hxx"
 #include "db/LightSong.hxx"
+#include "TagIndex.hxx"
+#include "util/Arena.hxx"
+#include "thread/Mutex.hxx"
 #include "Compiler.h"
 
+#include <unordered_map>
+#include <vector>
+
 #include <cassert>
 
 struct ConfigBlock;
@@ -34,6 +40,7 @@ struct DatabasePlugin;
 class EventLoop;
 class DatabaseListener;
 class PrefixedLightSong;
+class SongFilter;
 
 class SimpleDatabase : public Database {
 	AllocatedPath path;
@@ -43,6 +50,12 @@ class SimpleDatabase : public Database {
 	bool compress;
 #endif
 
+	/**
+	 * Save the database in the memory-mappable binary format
+	 * instead of the text format?
+	 */
+	bool binary;
+
 	/**
 	 * The path where cache files for Mount() are located.
 	 */
@@ -50,6 +63,52 @@ class SimpleDatabase : public Database {
 
 	Directory *root;
 
+	/**
+	 * The memory of the objects created by Load().  Objects
+	 * added later by the update thread are allocated from the
+	 * heap, so this does not grow while MPD runs; memory of
+	 * removed objects is only reclaimed when the whole tree is
+	 * deleted.
+	 */
+	Arena arena;
+
+	/**
+	 * An index of all songs in #root, used by Visit() for
+	 * filtered requests.
+	 */
+	TagIndex tag_index;
+
+	/**
+	 * Buffers for VisitIndexed(), kept between calls to avoid
+	 * allocating them for each request.
+	 */
+	struct IndexScratch {
+		TagIndex::Scratch find;
+
+		/**
+		 * A bit for each Song::index_id.
+		 */
+		std::vector<bool> songs;
+
+		std::unordered_map<const Directory *, bool> wanted;
+	};
+
+	/**
+	 * Protects #index_scratch.  VisitIndexed() may be called by
+	 * several threads holding the shared #db_mutex; if this is
+	 * already locked, it uses temporary buffers instead.
+	 */
+	mutable Mutex index_scratch_mutex;
+	mutable IndexScratch index_scratch;
+
+	/**
+	 * The number of mounted databases.  Visit() cannot use the
+	 * #TagIndex if there are any.  This may be too large if a
+	 * mount point was removed by the update thread; that only
+	 * disables the optimization.
+	 */
+	unsigned n_mounts;
+
 	time_t mtime;
 
 	/**
@@ -134,6 +193,22 @@ private:
 
 	void Check() const;
 
+	/**
+	 * Visit the songs matching the filter using #tag_index.
+	 *
+	 * Caller must lock the #db_mutex.
+	 *
+	 * @return false if the filter cannot be used with the index
+	 */
+	bool VisitIndexed(const Directory &directory, bool recursive,
+			  const SongFilter &filter,
+			  VisitSong visit_song) const;
+
+	bool VisitIndexed(const Directory &directory, bool recursive,
+			  const SongFilter &filter,
+			  const VisitSong &visit_song,
+			  IndexScratch &scratch) const;
+
 	/**
 	 * Throws #std::runtime_error on error.
 	 */
@@ -21,16 +21,21 @@
 #include "Song.hxx"
 #include "Directory.hxx"
 #include "tag/Tag.hxx"
+#include "tag/TagPool.hxx"
 #include "util/VarSize.hxx"
+#include "util/Arena.hxx"
 #include "DetachedSong.hxx"
 #include "db/LightSong.hxx"
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 
 inline Song::Song(const char *_uri, size_t uri_length, Directory &_parent)
 	:parent(&_parent), mtime(0),
-	 start_time(SongTime::zero()), end_time(SongTime::zero())
+	 start_time(SongTime::zero()), end_time(SongTime::zero()),
+	 index_id(0), in_arena(false), tag_in_arena(false)
 {
 	memcpy(uri, _uri, uri_length + 1);
 }
@@ -40,7 +45,7 @@ inline Song::~Song()
 }
 
 static Song *
-song_alloc(const char *uri, Directory &parent)
+song_alloc(const char *uri, Directory &parent, Arena *arena)
 {
 	size_t uri_length;
 
@@ -48,16 +53,41 @@ song_alloc(const char *uri, Directory &parent)
 	uri_length = strlen(uri);
 	assert(uri_length);
 
-	return NewVarSize<Song>(sizeof(Song::uri),
-				uri_length + 1,
-				uri, uri_length, parent);
+	if (arena == nullptr)
+		return NewVarSize<Song>(sizeof(Song::uri),
+					uri_length + 1,
+					uri, uri_length, parent);
+
+	const size_t size = sizeof(Song) - sizeof(Song::uri) + uri_length + 1;
+	Song *song = new(arena->Allocate(size, alignof(Song)))
+		Song(uri, uri_length, parent);
+	song->in_arena = true;
+	return song;
 }
 
 Song *
-Song::NewFrom(DetachedSong &&other, Directory &parent)
+Song::NewFrom(DetachedSong &&other, Directory &parent, Arena *arena)
 {
-	Song *song = song_alloc(other.GetURI(), parent);
-	song->tag = std::move(other.WritableTag());
+	Song *song = song_alloc(other.GetURI(), parent, arena);
+
+	Tag &src = other.WritableTag();
+	if (arena != nullptr && src.num_items > 0) {
+		/* move the TagItem pointers to an array in the arena,
+		   next to the Song, without touching the reference
+		   counters */
+		song->tag.duration = src.duration;
+		song->tag.has_playlist = src.has_playlist;
+		song->tag.items = arena->NewArray<TagItem *>(src.num_items);
+		song->tag.num_items = src.num_items;
+		std::copy_n(src.items, src.num_items, song->tag.items);
+		song->tag_in_arena = true;
+
+		delete[] src.items;
+		src.items = nullptr;
+		src.num_items = 0;
+	} else
+		song->tag = std::move(src);
+
 	song->mtime = other.GetLastModified();
 	song->start_time = other.GetStartTime();
 	song->end_time = other.GetEndTime();
@@ -65,15 +95,35 @@ Song::NewFrom(DetachedSong &&other, Directory &parent)
 }
 
 Song *
-Song::NewFile(const char *path, Directory &parent)
+Song::NewFile(const char *path, Directory &parent, Arena *arena)
 {
-	return song_alloc(path, parent);
+	return song_alloc(path, parent, arena);
 }
 
 void
 Song::Free()
 {
-	DeleteVarSize(this);
+	ClearArenaTag();
+
+	if (in_arena)
+		/* the memory is released together with the Arena */
+		this->~Song();
+	else
+		DeleteVarSize(this);
+}
+
+void
+Song::ClearArenaTag() noexcept
+{
+	if (!tag_in_arena)
+		return;
+
+	for (unsigned i = 0; i < tag.num_items; ++i)
+		tag_pool_put_item(tag.items[i]);
+
+	tag.items = nullptr;
+	tag.num_items = 0;
+	tag_in_arena = false;
 }
 
 std::string
@@ -29,10 +29,12 @@
 
 #include <string>
 
+#include <stdint.h>
 #include <time.h>
 
 struct LightSong;
 struct Directory;
+class Arena;
 class DetachedSong;
 class Storage;
 class ArchiveFile;
@@ -83,6 +85,25 @@ struct Song {
 	 */
 	SongTime end_time;
 
+	/**
+	 * The id of this song in the #TagIndex.
+	 *
+	 * This attribute is protected with the global #db_mutex.
+	 */
+	uint32_t index_id;
+
+	/**
+	 * Was this object allocated from an #Arena?
+	 */
+	bool in_arena;
+
+	/**
+	 * Was the #Tag::items array allocated from an #Arena?  It
+	 * must then be released with ClearArenaTag() before the #tag
+	 * is modified.
+	 */
+	bool tag_in_arena;
+
 	/**
 	 * The file name.
 	 */
@@ -91,12 +112,18 @@ struct Song {
 	Song(const char *_uri, size_t uri_length, Directory &parent);
 	~Song();
 
+	/**
+	 * @param arena an optional #Arena to allocate the object and
+	 * its tag from
+	 */
 	gcc_malloc
-	static Song *NewFrom(DetachedSong &&other, Directory &parent);
+	static Song *NewFrom(DetachedSong &&other, Directory &parent,
+			     Arena *arena=nullptr);
 
 	/** allocate a new song with a local file name */
 	gcc_malloc
-	static Song *NewFile(const char *path_utf8, Directory &parent);
+	static Song *NewFile(const char *path_utf8, Directory &parent,
+			     Arena *arena=nullptr);
 
 	/**
 	 * allocate a new song structure with a local file name and attempt to
@@ -109,6 +136,12 @@ struct Song {
 
 	void Free();
 
+	/**
+	 * If the #Tag::items array was allocated from an #Arena,
+	 * release its items and clear the #tag.
+	 */
+	void ClearArenaTag() noexcept;
+
 	bool UpdateFile(Storage &storage);
 
 #ifdef ENABLE_ARCHIVE
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "TagIndex.hxx"
+#include "Song.hxx"
+#include "SongFilter.hxx"
+#include "tag/Tag.hxx"
+#include "lib/icu/CaseFold.hxx"
+#include "util/StringAPI.hxx"
+
+#ifdef HAVE_ICU_CASE_FOLD
+#include "util/AllocatedString.hxx"
+#else
+#include <ctype.h>
+#endif
+
+#include <algorithm>
+#include <iterator>
+
+#include <assert.h>
+#include <string.h>
+
+static constexpr uint32_t REMOVED_ID = UINT32_MAX;
+
+/**
+ * Compact the index after this many songs have been removed, but
+ * only if they are the majority.
+ */
+static constexpr size_t COMPACT_THRESHOLD = 1024;
+
+/**
+ * Folded needles shorter than this cannot be looked up in the
+ * trigram index.
+ */
+static constexpr size_t MIN_FOLDED_LENGTH = 3;
+
+/**
+ * Find() gives up if more than 1/MAX_CANDIDATE_RATIO of all songs
+ * are candidates, because then checking the candidates costs more
+ * than Directory::Walk().
+ */
+static constexpr size_t MAX_CANDIDATE_RATIO = 4;
+
+/**
+ * Fold the case of the given string the same way #IcuCompare does.
+ */
+static std::string
+FoldCase(const char *value) noexcept
+{
+#ifdef HAVE_ICU_CASE_FOLD
+	return IcuCaseFold(value).c_str();
+#else
+	std::string result(value);
+	for (auto &ch : result)
+		ch = tolower((unsigned char)ch);
+	return result;
+#endif
+}
+
+static constexpr uint32_t
+MakeTrigram(const char *p) noexcept
+{
+	return uint8_t(p[0]) | (uint8_t(p[1]) << 8) | (uint8_t(p[2]) << 16);
+}
+
+void
+TagIndex::TypeIndex::AddTrigrams(uint32_t i)
+{
+	const std::string &folded = values[i].folded;
+	for (size_t j = 0; j + 3 <= folded.length(); ++j) {
+		auto &list = trigrams[MakeTrigram(folded.data() + j)];
+		if (list.empty() || list.back() != i)
+			list.push_back(i);
+	}
+}
+
+void
+TagIndex::TypeIndex::Add(const char *value, uint32_t id)
+{
+	auto r = lookup.emplace(value, values.size());
+	if (r.second) {
+		values.emplace_back();
+		values.back().folded = FoldCase(value);
+		AddTrigrams(r.first->second);
+	}
+
+	auto &ids = values[r.first->second].songs;
+	if (ids.empty() || ids.back() != id)
+		ids.push_back(id);
+}
+
+void
+TagIndex::TypeIndex::Find(const char *value, bool folded,
+			  IdList &dest) const noexcept
+{
+	if (!folded) {
+		auto i = lookup.find(value);
+		if (i != lookup.end()) {
+			const auto &ids = values[i->second].songs;
+			dest.insert(dest.end(), ids.begin(), ids.end());
+		}
+
+		return;
+	}
+
+	const size_t length = strlen(value);
+	assert(length >= MIN_FOLDED_LENGTH);
+
+	/* every value containing the needle contains all of its
+	   trigrams; verify only those containing the rarest one */
+	const IdList *shortest = nullptr;
+	for (size_t j = 0; j + 3 <= length; ++j) {
+		auto i = trigrams.find(MakeTrigram(value + j));
+		if (i == trigrams.end())
+			return;
+
+		if (shortest == nullptr || i->second.size() < shortest->size())
+			shortest = &i->second;
+	}
+
+	for (uint32_t i : *shortest) {
+		const auto &v = values[i];
+		if (StringFind(v.folded.c_str(), value) != nullptr)
+			dest.insert(dest.end(),
+				    v.songs.begin(), v.songs.end());
+	}
+}
+
+void
+TagIndex::TypeIndex::Compact(const IdList &renumber) noexcept
+{
+	IdList value_renumber;
+	value_renumber.reserve(values.size());
+
+	uint32_t n = 0;
+	for (auto &v : values) {
+		auto dest = v.songs.begin();
+		for (uint32_t id : v.songs) {
+			id = renumber[id];
+			if (id != REMOVED_ID)
+				*dest++ = id;
+		}
+
+		v.songs.erase(dest, v.songs.end());
+
+		if (v.songs.empty()) {
+			value_renumber.push_back(REMOVED_ID);
+		} else {
+			value_renumber.push_back(n);
+			if (&values[n] != &v)
+				values[n] = std::move(v);
+			++n;
+		}
+	}
+
+	if (n == values.size())
+		/* no value was removed */
+		return;
+
+	values.erase(std::next(values.begin(), n), values.end());
+	values.shrink_to_fit();
+
+	for (auto i = lookup.begin(); i != lookup.end();) {
+		i->second = value_renumber[i->second];
+		if (i->second == REMOVED_ID)
+			i = lookup.erase(i);
+		else
+			++i;
+	}
+
+	trigrams.clear();
+	for (uint32_t i = 0; i < n; ++i)
+		AddTrigrams(i);
+}
+
+void
+TagIndex::Clear() noexcept
+{
+	for (auto &t : types)
+		t.Clear();
+
+	songs.clear();
+	n_removed = 0;
+}
+
+void
+TagIndex::Add(Song &song)
+{
+	const uint32_t id = songs.size();
+	songs.push_back(&song);
+	song.index_id = id;
+
+	for (const auto &item : song.tag)
+		if (*item.value != 0)
+			types[item.type].Add(item.value, id);
+}
+
+void
+TagIndex::Remove(Song &song) noexcept
+{
+	const uint32_t id = song.index_id;
+	if (id >= songs.size() || songs[id] != &song)
+		return;
+
+	songs[id] = nullptr;
+	++n_removed;
+
+	if (n_removed >= COMPACT_THRESHOLD && n_removed > songs.size() / 2)
+		Compact();
+}
+
+void
+TagIndex::Compact() noexcept
+{
+	IdList renumber;
+	renumber.reserve(songs.size());
+
+	uint32_t n = 0;
+	for (Song *song : songs) {
+		if (song == nullptr) {
+			renumber.push_back(REMOVED_ID);
+		} else {
+			renumber.push_back(n);
+			song->index_id = n;
+			songs[n++] = song;
+		}
+	}
+
+	songs.resize(n);
+	n_removed = 0;
+
+	for (auto &t : types)
+		t.Compact(renumber);
+}
+
+gcc_pure
+static bool
+IsIndexable(const SongFilter::Item &item) noexcept
+{
+	const unsigned tag = item.GetTag();
+	return (tag < TAG_NUM_OF_ITEM_TYPES || tag == LOCATE_TAG_ANY_TYPE) &&
+		*item.GetValue() != 0;
+}
+
+bool
+TagIndex::Find(const SongFilter &filter, size_t max_candidates,
+	       Scratch &scratch) const
+{
+	max_candidates = std::min(max_candidates,
+				  songs.size() / MAX_CANDIDATE_RATIO);
+
+	IdList &candidates = scratch.candidates, &ids = scratch.ids;
+	bool indexed = false;
+
+	for (const auto &item : filter.GetItems()) {
+		if (!IsIndexable(item))
+			continue;
+
+		const bool folded = item.GetFoldCase();
+		const std::string value = folded
+			? FoldCase(item.GetValue())
+			: std::string(item.GetValue());
+		if (folded && value.length() < MIN_FOLDED_LENGTH)
+			/* too short for the trigram index; leave
+			   this item to SongFilter::Match() */
+			continue;
+
+		ids.clear();
+
+		const unsigned tag = item.GetTag();
+		if (tag == LOCATE_TAG_ANY_TYPE) {
+			for (const auto &t : types)
+				t.Find(value.c_str(), folded, ids);
+		} else {
+			types[tag].Find(value.c_str(), folded, ids);
+
+			if (tag == TAG_ALBUM_ARTIST)
+				/* SongFilter falls back to "artist" if
+				   there is no "album artist" */
+				types[TAG_ARTIST].Find(value.c_str(), folded,
+						       ids);
+		}
+
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+		if (!indexed) {
+			candidates.swap(ids);
+			indexed = true;
+		} else {
+			IdList &tmp = scratch.tmp;
+			tmp.clear();
+			std::set_intersection(candidates.begin(),
+					      candidates.end(),
+					      ids.begin(), ids.end(),
+					      std::back_inserter(tmp));
+			candidates.swap(tmp);
+		}
+
+		if (candidates.empty())
+			break;
+	}
+
+	if (!indexed || candidates.size() > max_candidates)
+		return false;
+
+	auto &result = scratch.songs;
+	result.clear();
+	for (uint32_t id : candidates)
+		if (songs[id] != nullptr)
+			result.push_back(songs[id]);
+
+	return true;
+}
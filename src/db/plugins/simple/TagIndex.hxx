@@ -0,0 +1,169 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_TAG_INDEX_HXX
+#define MPD_TAG_INDEX_HXX
+
+#include "check.h"
+#include "tag/TagType.h"
+#include "Compiler.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <stdint.h>
+
+struct Song;
+struct Tag;
+class SongFilter;
+
+/**
+ * An inverted index which maps tag values to the songs containing
+ * them.  It is used by #SimpleDatabase to answer "find" and "search"
+ * requests without matching the filter against every song.
+ *
+ * For case-insensitive substring matches ("search"), each distinct
+ * value is stored case-folded, and the folded values are indexed by
+ * trigram.  Needles shorter than a trigram cannot be looked up.
+ *
+ * Songs are identified by a number (Song::index_id) which is
+ * assigned in ascending order, which keeps all posting lists sorted.
+ * Removing a song only clears its slot; the posting lists are
+ * compacted once most of the slots are unused.
+ *
+ * This object is protected with the global #db_mutex.
+ */
+class TagIndex {
+	typedef std::vector<uint32_t> IdList;
+
+	struct Value {
+		/**
+		 * The case-folded value, for "search".
+		 */
+		std::string folded;
+
+		/**
+		 * Ids of the songs which contain this value.  May
+		 * contain ids of songs which have been removed
+		 * already.
+		 */
+		IdList songs;
+	};
+
+	struct TypeIndex {
+		/**
+		 * Maps each value to its position in #values.
+		 */
+		std::unordered_map<std::string, uint32_t> lookup;
+
+		std::vector<Value> values;
+
+		/**
+		 * Maps each trigram of a folded value to the
+		 * positions in #values containing it.
+		 */
+		std::unordered_map<uint32_t, IdList> trigrams;
+
+		void Clear() noexcept {
+			lookup.clear();
+			values.clear();
+			trigrams.clear();
+		}
+
+		void AddTrigrams(uint32_t i);
+
+		void Add(const char *value, uint32_t id);
+
+		/**
+		 * Append the ids of all songs containing the
+		 * given value (or, if "folded" is true, a value
+		 * containing the given folded string, which must be
+		 * at least 3 bytes long) to the list.
+		 */
+		void Find(const char *value, bool folded,
+			  IdList &dest) const noexcept;
+
+		void Compact(const IdList &renumber) noexcept;
+	};
+
+	TypeIndex types[TAG_NUM_OF_ITEM_TYPES];
+
+	/**
+	 * Maps ids to songs; removed songs are nullptr.
+	 */
+	std::vector<Song *> songs;
+
+	/**
+	 * The number of nullptr elements in #songs.
+	 */
+	size_t n_removed = 0;
+
+public:
+	/**
+	 * Buffers for Find().  Reusing them for several calls avoids
+	 * allocating memory for each request.
+	 */
+	struct Scratch {
+		IdList candidates, ids, tmp;
+
+		/**
+		 * The result of Find().
+		 */
+		std::vector<const Song *> songs;
+	};
+
+	TagIndex() = default;
+	TagIndex(const TagIndex &) = delete;
+	TagIndex &operator=(const TagIndex &) = delete;
+
+	void Clear() noexcept;
+
+	/**
+	 * Add a song which was just added to the database (or whose
+	 * tag has been replaced after Remove()).
+	 */
+	void Add(Song &song);
+
+	/**
+	 * Remove a song from the index.  Songs which are not in the
+	 * index are ignored.
+	 */
+	void Remove(Song &song) noexcept;
+
+	/**
+	 * Collect all songs which may match the given filter, in
+	 * no particular order, into Scratch::songs.  This is a
+	 * superset; the caller has to check each one with
+	 * SongFilter::Match().
+	 *
+	 * @param max_candidates give up if there are more candidates
+	 * than this
+	 * @return false if the filter has no item which can be
+	 * looked up in the index, or if the index would not narrow
+	 * the search enough to be faster than visiting all songs
+	 */
+	bool Find(const SongFilter &filter, size_t max_candidates,
+		  Scratch &scratch) const;
+
+private:
+	void Compact() noexcept;
+};
+
+#endif
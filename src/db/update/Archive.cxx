@@ -41,7 +41,7 @@
 static Directory *
 LockFindChild(Directory &directory, const char *name)
 {
-	const ScopeDatabaseLock protect;
+	const ScopeDatabaseSharedLock protect;
 	return directory.FindChild(name);
 }
 
@@ -55,7 +55,7 @@ LockMakeChild(Directory &directory, const char *name)
 static Song *
 LockFindSong(Directory &directory, const char *name)
 {
-	const ScopeDatabaseLock protect;
+	const ScopeDatabaseSharedLock protect;
 	return directory.FindSong(name);
 }
 
@@ -95,11 +95,21 @@ UpdateWalk::UpdateArchiveTree(ArchiveFile &archive, Directory &directory,
 					      directory.GetPath(), name);
 			}
 		} else {
-			if (!song->UpdateFileInArchive(archive)) {
+			/* load into a new (detached) Song object and
+			   replace the tag while holding the database
+			   lock, to keep the #TagIndex consistent */
+			Song *loaded = Song::LoadFromArchive(archive, name,
+							     directory);
+			if (loaded == nullptr) {
 				FormatDebug(update_domain,
 					    "deleting unrecognized file %s/%s",
 					    directory.GetPath(), name);
 				editor.LockDeleteSong(directory, song);
+			} else {
+				const ScopeDatabaseLock protect;
+				directory.UpdateSongTag(*song,
+							std::move(loaded->tag));
+				loaded->Free();
 			}
 		}
 	}
@@ -19,6 +19,7 @@
 
 #include "config.h" /* must be first for large file support */
 #include "Walk.hxx"
+#include "UpdateIO.hxx"
 #include "UpdateDomain.hxx"
 #include "DetachedSong.hxx"
 #include "db/DatabaseLock.hxx"
@@ -32,6 +33,8 @@
 #include "Log.hxx"
 #include "util/AllocatedString.hxx"
 
+#include <memory>
+
 Directory *
 UpdateWalk::MakeDirectoryIfModified(Directory &parent, const char *name,
 				    const StorageFileInfo &info)
@@ -67,7 +70,8 @@ SupportsContainerSuffix(const DecoderPlugin &plugin, const char *suffix)
 bool
 UpdateWalk::UpdateContainerFile(Directory &directory,
 				const char *name, const char *suffix,
-				const StorageFileInfo &info)
+				const StorageFileInfo &info,
+				Song *song)
 {
 	const DecoderPlugin *_plugin = decoder_plugins_find([suffix](const DecoderPlugin &plugin){
 			return SupportsContainerSuffix(plugin, suffix);
@@ -76,18 +80,35 @@ UpdateWalk::UpdateContainerFile(Directory &directory,
 		return false;
 	const DecoderPlugin &plugin = *_plugin;
 
+	/* both may be deleted below */
+	{
+		const Directory *old;
+		{
+			const ScopeDatabaseSharedLock protect;
+			old = directory.FindChild(name);
+		}
+
+		if (old != nullptr)
+			FlushScansFor(*old);
+		if (song != nullptr)
+			FlushScansFor(*song);
+	}
+
 	Directory *contdir;
 	{
 		const ScopeDatabaseLock protect;
 		contdir = MakeDirectoryIfModified(directory, name, info);
-		if (contdir == nullptr)
+		if (contdir == nullptr) {
 			/* not modified */
+			if (song != nullptr)
+				editor.DeleteSong(directory, song);
 			return true;
+		}
 
 		contdir->device = DEVICE_CONTAINER;
 	}
 
-	const auto pathname = storage.MapFS(contdir->GetPath());
+	auto pathname = storage.MapFS(contdir->GetPath());
 	if (pathname.IsNull()) {
 		/* not a local file: skip, because the container API
 		   supports only local files */
@@ -95,35 +116,68 @@ UpdateWalk::UpdateContainerFile(Directory &directory,
 		return false;
 	}
 
-	try {
-		auto v = plugin.container_scan(pathname);
+	const std::string name2(name);
+	std::string fingerprint = GetScanFingerprint(directory, &plugin);
+	std::string song_fingerprint = GetSongScanFingerprint(directory, name);
+
+	PushScan(*contdir, song,
+		 [this, &plugin, &directory, contdir, name2, info, song,
+		  pathname = std::move(pathname),
+		  fingerprint = std::move(fingerprint),
+		  song_fingerprint = std::move(song_fingerprint)]() -> UpdateScanPool::CommitFunction {
+		std::forward_list<DetachedSong> v;
+		std::exception_ptr error;
+
+		if (!scan_cache.Load(plugin.name, info, pathname,
+				     fingerprint.c_str(), v)) {
+			try {
+				v = plugin.ContainerScan(pathname);
+				scan_cache.Store(plugin.name, info, pathname,
+						 fingerprint.c_str(), v);
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}
+
 		if (v.empty()) {
-			editor.LockDeleteDirectory(contdir);
-			return false;
+			/* not a container after all: scan it as a
+			   regular song file */
+			auto commit = ScanSongFile(directory, name2.c_str(),
+						   info, song_fingerprint,
+						   song);
+			return [this, contdir, error, commit](){
+				editor.LockDeleteDirectory(contdir);
+				if (error)
+					LogError(error);
+				commit();
+			};
 		}
 
-		for (auto &vtrack : v) {
-			Song *song = Song::NewFrom(std::move(vtrack),
-						   *contdir);
+		auto tracks = std::make_shared<std::forward_list<DetachedSong>>(std::move(v));
+		const time_t mtime = info.mtime;
+		return [this, &directory, contdir, mtime, song, tracks](){
+			if (song != nullptr)
+				editor.LockDeleteSong(directory, song);
 
-			// shouldn't be necessary but it's there..
-			song->mtime = info.mtime;
+			for (auto &vtrack : *tracks) {
+				Song *track = Song::NewFrom(std::move(vtrack),
+							    *contdir);
 
-			FormatDefault(update_domain, "added %s/%s",
-				      contdir->GetPath(), song->uri);
+				// shouldn't be necessary but it's there..
+				track->mtime = mtime;
 
-			{
-				const ScopeDatabaseLock protect;
-				contdir->AddSong(song);
+				FormatDefault(update_domain, "added %s/%s",
+					      contdir->GetPath(), track->uri);
+
+				{
+					const ScopeDatabaseLock protect;
+					contdir->AddSong(track);
+				}
 			}
 
 			modified = true;
-		}
-	} catch (const std::runtime_error &e) {
-		editor.LockDeleteDirectory(contdir);
-		LogError(e);
-		return false;
-	}
+		};
+	});
 
 	return true;
 }
@@ -52,6 +52,23 @@ InotifyQueue::OnTimeout()
 
 		queue.pop_front();
 	}
+
+	if (!files.empty()) {
+		const std::list<std::string> list(files.begin(), files.end());
+		id = update.EnqueueFiles(list, renames);
+		if (id == 0) {
+			/* retry later */
+			Schedule(INOTIFY_UPDATE_DELAY);
+			return;
+		}
+
+		FormatDebug(inotify_domain, "updating %zu files job=%u",
+			    list.size(), id);
+
+		files.clear();
+		renames.clear();
+		moved_from.clear();
+	}
 }
 
 gcc_pure
@@ -66,6 +83,17 @@ path_in(const char *path, const char *possible_parent) noexcept
 		(StringIsEmpty(rest) || rest[0] == '/');
 }
 
+/**
+ * Is the given file inside the given directory?  Unlike path_in(),
+ * this is true for all files if the directory is the root.
+ */
+gcc_pure
+static bool
+file_in(const char *path, const char *directory) noexcept
+{
+	return StringIsEmpty(directory) || path_in(path, directory);
+}
+
 void
 InotifyQueue::Enqueue(const char *uri_utf8)
 {
@@ -88,4 +116,65 @@ InotifyQueue::Enqueue(const char *uri_utf8)
 	}
 
 	queue.emplace_back(uri_utf8);
+
+	/* the walk will update these files */
+
+	for (auto i = files.begin(), end = files.end(); i != end;) {
+		if (file_in(i->c_str(), uri_utf8))
+			i = files.erase(i);
+		else
+			++i;
+	}
+
+	for (auto i = renames.begin(), end = renames.end(); i != end;) {
+		if (file_in(i->from_utf8.c_str(), uri_utf8) ||
+		    file_in(i->to_utf8.c_str(), uri_utf8)) {
+			/* the other path may be outside of the
+			   directory; update it as a plain file */
+			EnqueueFile(i->from_utf8.c_str());
+			EnqueueFile(i->to_utf8.c_str());
+			i = renames.erase(i);
+		} else
+			++i;
+	}
+}
+
+void
+InotifyQueue::EnqueueFile(const char *uri_utf8)
+{
+	Schedule(INOTIFY_UPDATE_DELAY);
+
+	for (const auto &i : queue)
+		if (file_in(uri_utf8, i.c_str()))
+			/* already enqueued */
+			return;
+
+	files.emplace(uri_utf8);
+}
+
+void
+InotifyQueue::MovedFrom(unsigned cookie, const char *uri_utf8)
+{
+	/* if the file was moved out of the music directory, this
+	   update deletes it */
+	EnqueueFile(uri_utf8);
+
+	moved_from[cookie] = uri_utf8;
+}
+
+void
+InotifyQueue::MovedTo(unsigned cookie, const char *uri_utf8)
+{
+	EnqueueFile(uri_utf8);
+
+	auto i = moved_from.find(cookie);
+	if (i == moved_from.end())
+		/* moved into the music directory */
+		return;
+
+	if (files.find(i->second) != files.end() &&
+	    files.find(uri_utf8) != files.end())
+		renames.emplace_back(i->second, uri_utf8);
+
+	moved_from.erase(i);
 }
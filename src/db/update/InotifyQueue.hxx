@@ -20,10 +20,13 @@
 #ifndef MPD_INOTIFY_QUEUE_HXX
 #define MPD_INOTIFY_QUEUE_HXX
 
+#include "Queue.hxx"
 #include "event/TimeoutMonitor.hxx"
 #include "Compiler.h"
 
 #include <list>
+#include <map>
+#include <set>
 #include <string>
 
 class UpdateService;
@@ -31,14 +34,56 @@ class UpdateService;
 class InotifyQueue final : private TimeoutMonitor {
 	UpdateService &update;
 
+	/**
+	 * Directories which shall be walked.
+	 */
 	std::list<std::string> queue;
 
+	/**
+	 * Files which shall be updated without walking their parent
+	 * directory.  None of them is inside a directory in #queue.
+	 */
+	std::set<std::string> files;
+
+	/**
+	 * Renamed files; both paths of each item are in #files as
+	 * well.
+	 */
+	std::list<UpdateRename> renames;
+
+	/**
+	 * IN_MOVED_FROM events waiting for the matching IN_MOVED_TO
+	 * event, indexed by cookie.  If the file was moved out of
+	 * the music directory, there will never be one.
+	 */
+	std::map<unsigned, std::string> moved_from;
+
 public:
 	InotifyQueue(EventLoop &_loop, UpdateService &_update)
 		:TimeoutMonitor(_loop), update(_update) {}
 
+	/**
+	 * Queue a walk of the given directory.
+	 */
 	void Enqueue(const char *uri_utf8);
 
+	/**
+	 * Queue an update of just the given file.
+	 */
+	void EnqueueFile(const char *uri_utf8);
+
+	/**
+	 * A file was moved away from the given path.
+	 */
+	void MovedFrom(unsigned cookie, const char *uri_utf8);
+
+	/**
+	 * A file was moved to the given path.  If it comes from
+	 * inside the music directory, this is coalesced with the
+	 * preceding MovedFrom() call into a rename.
+	 */
+	void MovedTo(unsigned cookie, const char *uri_utf8);
+
 private:
 	virtual void OnTimeout() override;
 };
@@ -25,7 +25,12 @@
 
 class FileDescriptor;
 
+/**
+ * @param cookie the cookie which connects the IN_MOVED_FROM and
+ * IN_MOVED_TO events of one rename, or 0
+ */
 typedef void (*mpd_inotify_callback_t)(int wd, unsigned mask,
+				       unsigned cookie,
 				       const char *name, void *ctx);
 
 class InotifySource final : private SocketMonitor {
@@ -235,9 +235,47 @@ WatchDirectory::GetDepth() const noexcept
 	return depth;
 }
 
+/**
+ * Handle an event about a file (not a directory) by updating just
+ * this file.
+ */
 static void
-mpd_inotify_callback(int wd, unsigned mask,
-		     gcc_unused const char *name, gcc_unused void *ctx)
+inotify_file_event(const AllocatedPath &uri_fs, unsigned mask,
+		   unsigned cookie, const char *name)
+{
+	if ((mask & (IN_CLOSE_WRITE|IN_MOVE|IN_DELETE)) == 0)
+		return;
+
+	const std::string directory_utf8 = uri_fs.IsNull()
+		? std::string()
+		: uri_fs.ToUTF8();
+	if (!uri_fs.IsNull() && directory_utf8.empty())
+		return;
+
+	if (strcmp(name, ".mpdignore") == 0) {
+		/* this affects all files in the directory */
+		inotify_queue->Enqueue(directory_utf8.c_str());
+		return;
+	}
+
+	const auto file_fs = uri_fs.IsNull()
+		? AllocatedPath::FromFS(name)
+		: AllocatedPath::Build(uri_fs, name);
+	const std::string uri_utf8 = file_fs.ToUTF8();
+	if (uri_utf8.empty())
+		return;
+
+	if ((mask & IN_MOVED_FROM) != 0)
+		inotify_queue->MovedFrom(cookie, uri_utf8.c_str());
+	else if ((mask & IN_MOVED_TO) != 0)
+		inotify_queue->MovedTo(cookie, uri_utf8.c_str());
+	else
+		inotify_queue->EnqueueFile(uri_utf8.c_str());
+}
+
+static void
+mpd_inotify_callback(int wd, unsigned mask, unsigned cookie,
+		     const char *name, gcc_unused void *ctx)
 {
 	WatchDirectory *directory;
 
@@ -254,6 +292,12 @@ mpd_inotify_callback(int wd, unsigned mask,
 		return;
 	}
 
+	if ((mask & IN_ISDIR) == 0 && name != nullptr) {
+		if (!skip_path(name))
+			inotify_file_event(uri_fs, mask, cookie, name);
+		return;
+	}
+
 	if ((mask & (IN_ATTRIB|IN_CREATE|IN_MOVE)) != 0 &&
 	    (mask & IN_ISDIR) != 0) {
 		/* a sub directory was changed: register those in
@@ -273,8 +317,8 @@ mpd_inotify_callback(int wd, unsigned mask,
 	       directories */
 	    (directory->GetDepth() == inotify_max_depth &&
 	     (mask & (IN_CREATE|IN_ISDIR)) == (IN_CREATE|IN_ISDIR))) {
-		/* a file was changed, or a directory was
-		   moved/deleted: queue a database update */
+		/* a directory was moved/deleted: queue a database
+		   update */
 
 		if (!uri_fs.IsNull()) {
 			const std::string uri_utf8 = uri_fs.ToUTF8();
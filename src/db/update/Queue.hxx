@@ -29,11 +29,35 @@
 class SimpleDatabase;
 class Storage;
 
+/**
+ * A file which was renamed.  Its database entry can be moved
+ * instead of deleting it and scanning the new file.
+ */
+struct UpdateRename {
+	std::string from_utf8, to_utf8;
+
+	UpdateRename(const std::string &_from, const std::string &_to)
+		:from_utf8(_from), to_utf8(_to) {}
+};
+
 struct UpdateQueueItem {
 	SimpleDatabase *db;
 	Storage *storage;
 
 	std::string path_utf8;
+
+	/**
+	 * If this list is not empty, then only these paths are
+	 * updated, and #path_utf8 is ignored.
+	 */
+	std::list<std::string> files;
+
+	/**
+	 * Renamed files; both paths of each item are in #files as
+	 * well.
+	 */
+	std::list<UpdateRename> renames;
+
 	unsigned id;
 	bool discard;
 
@@ -50,6 +74,10 @@ struct UpdateQueueItem {
 		return id != 0;
 	}
 
+	bool HasFiles() const {
+		return !files.empty();
+	}
+
 	void Clear() {
 		id = 0;
 	}
@@ -65,6 +93,8 @@ public:
 	bool Push(SimpleDatabase &db, Storage &storage,
 		  const char *path, bool discard, unsigned id);
 
+	bool Push(UpdateQueueItem &&item);
+
 	UpdateQueueItem Pop();
 
 	void Clear() {
@@ -0,0 +1,404 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "ScanCache.hxx"
+#include "UpdateDomain.hxx"
+#include "db/plugins/simple/Song.hxx"
+#include "storage/FileInfo.hxx"
+#include "decoder/DecoderPlugin.hxx"
+#include "config/ConfigGlobal.hxx"
+#include "config/Block.hxx"
+#include "tag/Settings.hxx"
+#include "DetachedSong.hxx"
+#include "SongSave.hxx"
+#include "fs/io/TextFile.hxx"
+#include "fs/io/FileOutputStream.hxx"
+#include "fs/io/BufferedOutputStream.hxx"
+#include "fs/FileSystem.hxx"
+#include "fs/FileInfo.hxx"
+#include "fs/DirectoryReader.hxx"
+#include "util/StringCompare.hxx"
+#include "util/StringFormat.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#define SCAN_CACHE_HEADER "mpd_scan_cache: 2"
+#define SCAN_CACHE_PATH "path: "
+#define SCAN_CACHE_KEY "key: "
+
+/**
+ * 64 bit FNV-1a.
+ */
+gcc_pure
+static uint64_t
+HashString(const char *s) noexcept
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (; *s != 0; ++s) {
+		hash ^= (unsigned char)*s;
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+std::string
+ScanCache::MakeFingerprint(const DecoderPlugin *plugin,
+			   const std::string &companions) noexcept
+{
+	std::string result = StringFormat<32>("tags=%llx",
+					      (unsigned long long)global_tag_mask).c_str();
+
+	const ConfigBlock *block = plugin != nullptr
+		? config_find_block(ConfigBlockOption::DECODER, "plugin",
+				    plugin->name)
+		: nullptr;
+	if (block != nullptr) {
+		for (const auto &i : block->block_params) {
+			result += ' ';
+			result += i.name;
+			result += '=';
+			result += i.value;
+		}
+	}
+
+	if (!companions.empty()) {
+		result += " companions";
+		result += companions;
+	}
+
+	return result;
+}
+
+AllocatedPath
+ScanCache::MakePath(const char *plugin,
+		    const StorageFileInfo &info,
+		    Path path_fs,
+		    const char *fingerprint) const noexcept
+{
+	if (directory.IsNull() || path_fs.IsNull() ||
+	    (info.device == 0 && info.inode == 0))
+		return AllocatedPath::Null();
+
+	/* all entries of a file are in the same shard, which Prune()
+	   relies on */
+	const auto shard = StringFormat<4>("%02x",
+					   unsigned(info.inode & 0xff));
+
+	/* the fingerprint may be long (one stamp per companion
+	   file), so only its hash is part of the file name */
+	const auto name =
+		StringFormat<192>("%llx-%llx-%llx-%llx-%s-%016llx",
+				  (unsigned long long)info.device,
+				  (unsigned long long)info.inode,
+				  (unsigned long long)info.size,
+				  (unsigned long long)info.mtime,
+				  plugin,
+				  (unsigned long long)HashString(fingerprint));
+	return AllocatedPath::Build(AllocatedPath::Build(directory,
+							 AllocatedPath::FromUTF8(shard.c_str())),
+				    AllocatedPath::FromUTF8(name.c_str()));
+}
+
+/**
+ * Read the header of an entry.
+ *
+ * @param path_utf8 receives the path of the scanned file
+ * @param fingerprint receives the fingerprint
+ * @return false if this is not a valid entry
+ */
+static bool
+ReadHeader(TextFile &file, std::string &path_utf8, std::string &fingerprint)
+{
+	const char *line = file.ReadLine();
+	if (line == nullptr || strcmp(line, SCAN_CACHE_HEADER) != 0)
+		return false;
+
+	line = file.ReadLine();
+	const char *value = line != nullptr
+		? StringAfterPrefix(line, SCAN_CACHE_PATH)
+		: nullptr;
+	if (value == nullptr)
+		return false;
+
+	path_utf8 = value;
+
+	line = file.ReadLine();
+	value = line != nullptr
+		? StringAfterPrefix(line, SCAN_CACHE_KEY)
+		: nullptr;
+	if (value == nullptr)
+		return false;
+
+	fingerprint = value;
+	return true;
+}
+
+bool
+ScanCache::Load(const char *plugin, const StorageFileInfo &info,
+		Path path_fs, const char *fingerprint,
+		std::forward_list<DetachedSong> &songs) const noexcept
+{
+	const auto path = MakePath(plugin, info, path_fs, fingerprint);
+	if (path.IsNull() || !FileExists(path))
+		return false;
+
+	try {
+		TextFile file(path);
+
+		/* the file name contains only hashes of these, so
+		   compare them */
+		std::string path_utf8, fingerprint2;
+		if (!ReadHeader(file, path_utf8, fingerprint2) ||
+		    path_utf8 != path_fs.ToUTF8() ||
+		    fingerprint2 != fingerprint)
+			return false;
+
+		std::forward_list<DetachedSong> result;
+		auto tail = result.before_begin();
+
+		char *p;
+		while ((p = file.ReadLine()) != nullptr) {
+			const char *uri = StringAfterPrefix(p, SONG_BEGIN);
+			if (uri == nullptr)
+				return false;
+
+			std::unique_ptr<DetachedSong> song(song_load(file, uri));
+			tail = result.emplace_after(tail, std::move(*song));
+		}
+
+		songs = std::move(result);
+		return true;
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+		return false;
+	}
+}
+
+template<typename F>
+void
+ScanCache::WriteEntry(Path path, Path path_fs, const char *fingerprint,
+		      F &&write_songs) const noexcept
+{
+	/* both are lines in the header */
+	const auto path_utf8 = path_fs.ToUTF8();
+	if (path_utf8.empty() ||
+	    path_utf8.find('\n') != path_utf8.npos ||
+	    strchr(fingerprint, '\n') != nullptr)
+		return;
+
+#ifndef _WIN32
+	/* create the shard on demand; if this fails, opening the file
+	   will fail, too (there are no entries on WIN32, because it
+	   has no inode numbers) */
+	mkdir(path.GetDirectoryName().c_str(), 0777);
+#endif
+
+	try {
+		FileOutputStream fos(path);
+		BufferedOutputStream os(fos);
+
+		os.Write(SCAN_CACHE_HEADER "\n");
+		os.Format(SCAN_CACHE_PATH "%s\n", path_utf8.c_str());
+		os.Format(SCAN_CACHE_KEY "%s\n", fingerprint);
+		write_songs(os);
+
+		os.Flush();
+		fos.Commit();
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+	}
+}
+
+void
+ScanCache::Store(const char *plugin, const StorageFileInfo &info,
+		 Path path_fs, const char *fingerprint,
+		 const std::forward_list<DetachedSong> &songs) const noexcept
+{
+	const auto path = MakePath(plugin, info, path_fs, fingerprint);
+	if (path.IsNull())
+		return;
+
+	WriteEntry(path, path_fs, fingerprint,
+		   [&songs](BufferedOutputStream &os){
+			   for (const auto &song : songs)
+				   song_save(os, song);
+		   });
+}
+
+void
+ScanCache::Store(const char *plugin, const StorageFileInfo &info,
+		 Path path_fs, const char *fingerprint,
+		 const Song *song) const noexcept
+{
+	const auto path = MakePath(plugin, info, path_fs, fingerprint);
+	if (path.IsNull())
+		return;
+
+	WriteEntry(path, path_fs, fingerprint,
+		   [song](BufferedOutputStream &os){
+			   if (song != nullptr)
+				   song_save(os, *song);
+		   });
+}
+
+static void
+DeleteEntry(Path path) noexcept
+{
+	try {
+		RemoveFile(path);
+		FormatDebug(update_domain, "deleted scan cache entry %s",
+			    path.c_str());
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+	}
+}
+
+/**
+ * Does the scanned file still have the device, inode, size and
+ * modification time which are encoded in the entry's name?
+ */
+static bool
+IsEntryCurrent(Path path, const char *name)
+{
+	unsigned long long device, inode, size, mtime;
+	if (sscanf(name, "%llx-%llx-%llx-%llx-",
+		   &device, &inode, &size, &mtime) != 4)
+		return false;
+
+	std::string path_utf8, fingerprint;
+	{
+		TextFile file(path);
+		if (!ReadHeader(file, path_utf8, fingerprint))
+			return false;
+	}
+
+	const auto path_fs = AllocatedPath::FromUTF8(path_utf8.c_str());
+	FileInfo info;
+	return !path_fs.IsNull() && GetFileInfo(path_fs, info) &&
+		info.IsRegular() &&
+		(unsigned long long)info.GetDevice() == device &&
+		(unsigned long long)info.GetInode() == inode &&
+		info.GetSize() == size &&
+		(unsigned long long)info.GetModificationTime() == mtime;
+}
+
+void
+ScanCache::PruneShard(Path shard) const
+{
+	struct Entry {
+		AllocatedPath path;
+
+		/**
+		 * The entry's name without the fingerprint hash; it
+		 * identifies the scanned file and the plugin.
+		 */
+		std::string file;
+
+		time_t mtime;
+	};
+
+	std::vector<Entry> entries;
+
+	DirectoryReader reader(shard);
+	while (reader.ReadEntry()) {
+		const Path name_fs = reader.GetEntry();
+		const auto name = name_fs.ToUTF8();
+		if (name.empty() || name.front() == '.')
+			continue;
+
+		auto path = AllocatedPath::Build(shard, name_fs);
+		FileInfo info;
+		if (!GetFileInfo(path, info, false) || !info.IsRegular())
+			continue;
+
+		bool current;
+		try {
+			current = IsEntryCurrent(path, name.c_str());
+		} catch (const std::runtime_error &e) {
+			LogError(e);
+			current = false;
+		}
+
+		if (!current) {
+			DeleteEntry(path);
+			continue;
+		}
+
+		entries.push_back({std::move(path),
+				   name.substr(0, name.rfind('-')),
+				   info.GetModificationTime()});
+	}
+
+	/* newest entry of each file first */
+	std::sort(entries.begin(), entries.end(),
+		  [](const Entry &a, const Entry &b){
+			  return a.file != b.file
+				  ? a.file < b.file
+				  : a.mtime > b.mtime;
+		  });
+
+	for (auto i = entries.begin(); i != entries.end(); ++i)
+		if (i != entries.begin() && i->file == std::prev(i)->file)
+			DeleteEntry(i->path);
+}
+
+void
+ScanCache::Prune() const noexcept
+{
+	if (directory.IsNull())
+		return;
+
+	try {
+		DirectoryReader reader(directory);
+		while (reader.ReadEntry()) {
+			const Path name = reader.GetEntry();
+			if (name.c_str()[0] == '.')
+				continue;
+
+			const auto path = AllocatedPath::Build(directory, name);
+			FileInfo info;
+			if (!GetFileInfo(path, info, false))
+				continue;
+
+			if (info.IsDirectory()) {
+				try {
+					PruneShard(path);
+				} catch (const std::runtime_error &e) {
+					LogError(e);
+				}
+			} else if (info.IsRegular())
+				/* an entry of the old version, which
+				   did not have shards */
+				DeleteEntry(path);
+		}
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+	}
+}
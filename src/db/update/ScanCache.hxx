@@ -0,0 +1,133 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_UPDATE_SCAN_CACHE_HXX
+#define MPD_UPDATE_SCAN_CACHE_HXX
+
+#include "check.h"
+#include "fs/AllocatedPath.hxx"
+#include "Compiler.h"
+
+#include <forward_list>
+#include <string>
+
+struct StorageFileInfo;
+struct Song;
+struct DecoderPlugin;
+class DetachedSong;
+
+/**
+ * A persistent cache of decoder plugin scan results.  Each entry is
+ * a file in one of 256 subdirectories of the configured directory.
+ * Its name is made from the device, inode, size and modification
+ * time of the scanned file, the name of the decoder plugin and a
+ * hash of the "fingerprint" (see MakeFingerprint()).  The file
+ * begins with the path of the scanned file and the full fingerprint,
+ * which are verified by Load().  The cache lives outside of the
+ * database, so it survives "rescan" and the deletion of the database
+ * file; Prune() deletes stale entries.
+ *
+ * All methods are thread-safe.
+ */
+class ScanCache {
+	AllocatedPath directory;
+
+public:
+	/**
+	 * Construct a disabled cache.
+	 */
+	ScanCache():directory(AllocatedPath::Null()) {}
+
+	explicit ScanCache(AllocatedPath &&_directory)
+		:directory(std::move(_directory)) {}
+
+	bool IsDefined() const noexcept {
+		return !directory.IsNull();
+	}
+
+	/**
+	 * Describe everything besides the file itself which a scan
+	 * result depends on: the tag types enabled by
+	 * "metadata_to_use", the plugin's configuration block and its
+	 * companion files.
+	 *
+	 * @param plugin the plugin which scans the file or nullptr
+	 * @param companions the result of GetCompanionStamps()
+	 */
+	gcc_pure
+	static std::string MakeFingerprint(const DecoderPlugin *plugin,
+					   const std::string &companions) noexcept;
+
+	/**
+	 * Look up an entry.  An entry without songs means the
+	 * plugin did not recognize the file.
+	 *
+	 * @param path_fs the local path of the scanned file
+	 * @param fingerprint the result of MakeFingerprint()
+	 * @return false if there is no entry
+	 */
+	bool Load(const char *plugin, const StorageFileInfo &info,
+		  Path path_fs, const char *fingerprint,
+		  std::forward_list<DetachedSong> &songs) const noexcept;
+
+	/**
+	 * Store the result of a container scan.  Errors are logged.
+	 */
+	void Store(const char *plugin, const StorageFileInfo &info,
+		   Path path_fs, const char *fingerprint,
+		   const std::forward_list<DetachedSong> &songs) const noexcept;
+
+	/**
+	 * Store the result of a tag scan.  Errors are logged.
+	 *
+	 * @param song the loaded song or nullptr if the plugin did not
+	 * recognize the file
+	 */
+	void Store(const char *plugin, const StorageFileInfo &info,
+		   Path path_fs, const char *fingerprint,
+		   const Song *song) const noexcept;
+
+	/**
+	 * Delete the entries of files which no longer exist or have
+	 * been modified, and all but the newest entry of each file
+	 * (the others were made with different settings or companion
+	 * files).  This reads every entry, so call it only after a
+	 * complete database update.  Errors are logged.
+	 */
+	void Prune() const noexcept;
+
+private:
+	/**
+	 * Returns the path of the entry or a "null" path if this file
+	 * cannot be cached.
+	 */
+	gcc_pure
+	AllocatedPath MakePath(const char *plugin,
+			       const StorageFileInfo &info,
+			       Path path_fs,
+			       const char *fingerprint) const noexcept;
+
+	template<typename F>
+	void WriteEntry(Path path, Path path_fs, const char *fingerprint,
+			F &&write_songs) const noexcept;
+
+	void PruneShard(Path shard) const;
+};
+
+#endif
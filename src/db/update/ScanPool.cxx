@@ -0,0 +1,160 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "ScanPool.hxx"
+#include "thread/Name.hxx"
+#include "thread/Util.hxx"
+
+#include <assert.h>
+
+void
+UpdateScanPool::Start(unsigned _n_threads)
+{
+	assert(threads.empty());
+	assert(jobs.empty());
+
+	quit = false;
+	n_threads = _n_threads;
+
+	for (unsigned i = 0; i < n_threads; ++i) {
+		threads.emplace_front(BIND_THIS_METHOD(Run));
+		threads.front().Start();
+	}
+}
+
+void
+UpdateScanPool::Stop()
+{
+	Flush();
+
+	{
+		const std::lock_guard<Mutex> protect(mutex);
+		quit = true;
+		cond.broadcast();
+	}
+
+	for (auto &thread : threads)
+		thread.Join();
+
+	threads.clear();
+	n_threads = 0;
+}
+
+void
+UpdateScanPool::Push(ScanFunction &&scan)
+{
+	if (n_threads == 0) {
+		auto commit = scan();
+		commit();
+		return;
+	}
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	jobs.emplace_back(std::move(scan));
+	if (next == jobs.end())
+		next = std::prev(jobs.end());
+
+	cond.signal();
+
+	CommitFinished();
+
+	while (jobs.size() > n_threads * MAX_PENDING_PER_THREAD)
+		CommitFront();
+}
+
+void
+UpdateScanPool::Flush()
+{
+	const std::lock_guard<Mutex> protect(mutex);
+
+	while (!jobs.empty())
+		CommitFront();
+}
+
+void
+UpdateScanPool::CommitFront()
+{
+	assert(!jobs.empty());
+
+	Job &job = jobs.front();
+
+	if (next == jobs.begin()) {
+		/* no worker has picked it up yet; don't wait, run it
+		   right here */
+		++next;
+
+		CommitFunction commit;
+		{
+			ScopeUnlock unlock(mutex);
+			commit = job.scan();
+		}
+
+		job.commit = std::move(commit);
+		job.done = true;
+	}
+
+	while (!job.done)
+		done_cond.wait(mutex);
+
+	auto commit = std::move(job.commit);
+	jobs.pop_front();
+
+	const ScopeUnlock unlock(mutex);
+	commit();
+}
+
+void
+UpdateScanPool::CommitFinished()
+{
+	while (!jobs.empty() && jobs.front().done)
+		CommitFront();
+}
+
+void
+UpdateScanPool::Run()
+{
+	SetThreadName("update_scan");
+	SetThreadIdlePriority();
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	while (true) {
+		if (next == jobs.end()) {
+			if (quit)
+				break;
+
+			cond.wait(mutex);
+			continue;
+		}
+
+		Job &job = *next++;
+
+		CommitFunction commit;
+		{
+			ScopeUnlock unlock(mutex);
+			commit = job.scan();
+		}
+
+		job.commit = std::move(commit);
+		job.done = true;
+		done_cond.broadcast();
+	}
+}
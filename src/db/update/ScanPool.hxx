@@ -0,0 +1,154 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_UPDATE_SCAN_POOL_HXX
+#define MPD_UPDATE_SCAN_POOL_HXX
+
+#include "check.h"
+#include "thread/Mutex.hxx"
+#include "thread/Cond.hxx"
+#include "thread/Thread.hxx"
+
+#include <functional>
+#include <forward_list>
+#include <list>
+
+/**
+ * A pool of worker threads which run the expensive part of a
+ * database update (decoder plugin scans) in parallel.  The results
+ * are committed by the update thread in the order in which the jobs
+ * were submitted, so the resulting database does not depend on
+ * scheduling.
+ */
+class UpdateScanPool final {
+public:
+	/**
+	 * Applies the result of a scan to the database.  It is called
+	 * in the update thread.
+	 */
+	typedef std::function<void()> CommitFunction;
+
+	/**
+	 * Performs a scan.  It is called in a worker thread, must not
+	 * modify the database and must not throw.  The caller must
+	 * keep all database objects it refers to alive until its
+	 * #CommitFunction has run (or call Flush() before deleting
+	 * them).
+	 */
+	typedef std::function<CommitFunction()> ScanFunction;
+
+private:
+	/**
+	 * The maximum number of uncommitted jobs per worker thread.
+	 * This limits the memory occupied by pending results.
+	 */
+	static constexpr unsigned MAX_PENDING_PER_THREAD = 16;
+
+	struct Job {
+		ScanFunction scan;
+		CommitFunction commit;
+		bool done = false;
+
+		explicit Job(ScanFunction &&_scan)
+			:scan(std::move(_scan)) {}
+	};
+
+	Mutex mutex;
+
+	/**
+	 * Wakes up the worker threads when a job was submitted or
+	 * when they shall quit.
+	 */
+	Cond cond;
+
+	/**
+	 * Wakes up the update thread when a job has finished.
+	 */
+	Cond done_cond;
+
+	/**
+	 * All uncommitted jobs in submission order.
+	 */
+	std::list<Job> jobs;
+
+	/**
+	 * The first job in #jobs which no worker has picked up yet.
+	 */
+	std::list<Job>::iterator next = jobs.end();
+
+	std::forward_list<Thread> threads;
+
+	unsigned n_threads = 0;
+
+	bool quit = false;
+
+public:
+	UpdateScanPool() = default;
+
+	~UpdateScanPool() {
+		Stop();
+	}
+
+	UpdateScanPool(const UpdateScanPool &) = delete;
+	UpdateScanPool &operator=(const UpdateScanPool &) = delete;
+
+	/**
+	 * Launch the given number of worker threads.  With zero
+	 * threads, Push() runs each job synchronously.
+	 */
+	void Start(unsigned _n_threads);
+
+	/**
+	 * Commit all pending jobs and stop the worker threads.
+	 */
+	void Stop();
+
+	/**
+	 * Submit a job.  This may commit previously submitted jobs
+	 * which have finished (or wait for them if too many are
+	 * pending).
+	 */
+	void Push(ScanFunction &&scan);
+
+	/**
+	 * Wait for all pending jobs and commit them.
+	 */
+	void Flush();
+
+private:
+	/**
+	 * Commit the first job, waiting for it (or running it in the
+	 * calling thread) if it is not yet finished.
+	 *
+	 * Caller must lock the mutex.
+	 */
+	void CommitFront();
+
+	/**
+	 * Commit all leading jobs which are already finished.
+	 *
+	 * Caller must lock the mutex.
+	 */
+	void CommitFinished();
+
+	/* the worker thread */
+	void Run();
+};
+
+#endif
@@ -79,7 +79,7 @@ UpdateService::CancelMount(const char *uri)
 
 	Directory::LookupResult lr;
 	{
-		const ScopeDatabaseLock protect;
+		const ScopeDatabaseSharedLock protect;
 		lr = db.GetRoot().LookupDirectory(uri);
 	}
 
@@ -116,7 +116,10 @@ UpdateService::Task()
 
 	SetThreadName("update");
 
-	if (!next.path_utf8.empty())
+	if (next.HasFiles())
+		FormatDebug(update_domain, "starting: %zu files",
+			    next.files.size());
+	else if (!next.path_utf8.empty())
 		FormatDebug(update_domain, "starting: %s",
 			    next.path_utf8.c_str());
 	else
@@ -124,8 +127,13 @@ UpdateService::Task()
 
 	SetThreadIdlePriority();
 
-	modified = walk->Walk(next.db->GetRoot(), next.path_utf8.c_str(),
-			      next.discard);
+	if (next.HasFiles())
+		modified = walk->WalkFiles(next.db->GetRoot(), next.files,
+					   next.renames);
+	else
+		modified = walk->Walk(next.db->GetRoot(),
+				      next.path_utf8.c_str(),
+				      next.discard);
 
 	if (modified || !next.db->FileExists()) {
 		try {
@@ -135,7 +143,10 @@ UpdateService::Task()
 		}
 	}
 
-	if (!next.path_utf8.empty())
+	if (next.HasFiles())
+		FormatDebug(update_domain, "finished: %zu files",
+			    next.files.size());
+	else if (!next.path_utf8.empty())
 		FormatDebug(update_domain, "finished: %s",
 			    next.path_utf8.c_str());
 	else
@@ -182,7 +193,7 @@ UpdateService::Enqueue(const char *path, bool discard)
 
 	Directory::LookupResult lr;
 	{
-		const ScopeDatabaseLock protect;
+		const ScopeDatabaseSharedLock protect;
 		lr = db.GetRoot().LookupDirectory(path);
 	}
 
@@ -221,23 +232,74 @@ UpdateService::Enqueue(const char *path, bool discard)
 		   happen */
 		return 0;
 
+	return Start(UpdateQueueItem(*db2, *storage2, path, discard, 0));
+}
+
+unsigned
+UpdateService::Start(UpdateQueueItem &&i)
+{
+	i.id = GenerateId();
+
 	if (walk != nullptr) {
-		const unsigned id = GenerateId();
-		if (!queue.Push(*db2, *storage2, path, discard, id))
+		const unsigned id = i.id;
+		if (!queue.Push(std::move(i)))
 			return 0;
 
 		update_task_id = id;
 		return id;
 	}
 
-	const unsigned id = update_task_id = GenerateId();
-	StartThread(UpdateQueueItem(*db2, *storage2, path, discard, id));
+	const unsigned id = update_task_id = i.id;
+	StartThread(std::move(i));
 
 	idle_add(IDLE_UPDATE);
 
 	return id;
 }
 
+bool
+UpdateService::IsInMount(const char *path) const noexcept
+{
+	const ScopeDatabaseSharedLock protect;
+	return db.GetRoot().LookupDirectory(path).directory->IsMount();
+}
+
+unsigned
+UpdateService::EnqueueFiles(const std::list<std::string> &files,
+			    const std::list<UpdateRename> &renames)
+{
+	assert(GetEventLoop().IsInsideOrNull());
+
+	Storage *storage2 = storage.GetMount("");
+	if (storage2 == nullptr)
+		return 0;
+
+	UpdateQueueItem i(db, *storage2, "", false, 0);
+
+	unsigned id = 0;
+	for (const auto &path : files) {
+		if (IsInMount(path.c_str())) {
+			/* let Enqueue() follow the mount point */
+			id = Enqueue(path.c_str(), false);
+			if (id == 0)
+				FormatWarning(update_domain,
+					      "failed to update %s",
+					      path.c_str());
+		} else
+			i.files.emplace_back(path);
+	}
+
+	for (const auto &rename : renames)
+		if (!IsInMount(rename.from_utf8.c_str()) &&
+		    !IsInMount(rename.to_utf8.c_str()))
+			i.renames.emplace_back(rename);
+
+	if (!i.HasFiles())
+		return id;
+
+	return Start(std::move(i));
+}
+
 /**
  * Called in the main thread after the database update is finished.
  */
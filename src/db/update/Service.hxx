@@ -79,6 +79,20 @@ public:
 	gcc_nonnull_all
 	unsigned Enqueue(const char *path, bool discard);
 
+	/**
+	 * Update just the given files (or directories) in one job,
+	 * without walking their parent directories.  This is used
+	 * by inotify, which knows which files were modified.  Paths
+	 * inside a mounted database are passed to Enqueue().
+	 *
+	 * @param files the paths to update
+	 * @param renames renamed files; both paths of each item must
+	 * be in #files as well
+	 * @return the job id, or 0 on error
+	 */
+	unsigned EnqueueFiles(const std::list<std::string> &files,
+			      const std::list<UpdateRename> &renames);
+
 	/**
 	 * Clear the queue and cancel the current update.  Does not
 	 * wait for the thread to exit.
@@ -102,6 +116,17 @@ private:
 	void StartThread(UpdateQueueItem &&i);
 
 	unsigned GenerateId();
+
+	/**
+	 * Start the given job, or append it to the queue if another
+	 * one is running.
+	 *
+	 * @return the job id, or 0 if the queue is full
+	 */
+	unsigned Start(UpdateQueueItem &&i);
+
+	gcc_pure
+	bool IsInMount(const char *path) const noexcept;
 };
 
 #endif
@@ -25,9 +25,16 @@
 #include "fs/Traits.hxx"
 #include "fs/FileSystem.hxx"
 #include "fs/AllocatedPath.hxx"
+#include "decoder/DecoderPlugin.hxx"
+#include "util/UriUtil.hxx"
+#include "util/StringFormat.hxx"
+#include "util/StringUtil.hxx"
 #include "Log.hxx"
 
 #include <stdexcept>
+#include <memory>
+#include <vector>
+#include <algorithm>
 
 #include <errno.h>
 
@@ -108,3 +115,47 @@ directory_child_access(Storage &storage, const Directory &directory,
 	return CheckAccess(path, mode) || errno != EACCES;
 #endif
 }
+
+std::string
+GetCompanionStamps(Storage &storage, const Directory &directory,
+		   const DecoderPlugin &plugin) noexcept
+{
+	std::string result;
+	if (plugin.companion_suffixes == nullptr)
+		return result;
+
+	std::vector<std::string> stamps;
+
+	try {
+		std::unique_ptr<StorageDirectoryReader>
+			reader(storage.OpenDirectory(directory.GetPath()));
+
+		const char *name;
+		while ((name = reader->Read()) != nullptr) {
+			const char *suffix = uri_get_suffix(name);
+			if (suffix == nullptr ||
+			    !StringArrayContainsCase(plugin.companion_suffixes,
+						     suffix))
+				continue;
+
+			StorageFileInfo info;
+			if (!GetInfo(*reader, info) || !info.IsRegular())
+				continue;
+
+			stamps.emplace_back(StringFormat<80>("-%llx-%llx-%llx",
+							     (unsigned long long)info.inode,
+							     (unsigned long long)info.size,
+							     (unsigned long long)info.mtime).c_str());
+		}
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+	}
+
+	/* the directory order is arbitrary */
+	std::sort(stamps.begin(), stamps.end());
+
+	for (const auto &i : stamps)
+		result += i;
+
+	return result;
+}
@@ -23,7 +23,10 @@
 #include "check.h"
 #include "Compiler.h"
 
+#include <string>
+
 struct Directory;
+struct DecoderPlugin;
 struct StorageFileInfo;
 class Storage;
 class StorageDirectoryReader;
@@ -59,4 +62,16 @@ bool
 directory_child_access(Storage &storage, const Directory &directory,
 		       const char *name, int mode) noexcept;
 
+/**
+ * Describes the inode, size and modification time of all files in
+ * the directory which have one of the plugin's companion suffixes
+ * (see DecoderPlugin::companion_suffixes), for the #ScanCache key.
+ * This is the same for all files in the directory, so the caller
+ * should remember it.
+ */
+gcc_pure
+std::string
+GetCompanionStamps(Storage &storage, const Directory &directory,
+		   const DecoderPlugin &plugin) noexcept;
+
 #endif
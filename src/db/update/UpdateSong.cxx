@@ -25,46 +25,85 @@
 #include "db/plugins/simple/Directory.hxx"
 #include "db/plugins/simple/Song.hxx"
 #include "decoder/DecoderList.hxx"
+#include "decoder/DecoderPlugin.hxx"
+#include "DetachedSong.hxx"
+#include "util/UriUtil.hxx"
+#include "storage/StorageInterface.hxx"
 #include "storage/FileInfo.hxx"
 #include "Log.hxx"
 
 #include <unistd.h>
 
-inline void
-UpdateWalk::UpdateSongFile2(Directory &directory,
-			    const char *name, const char *suffix,
-			    const StorageFileInfo &info)
+/**
+ * Returns the decoder plugin which will scan the file or nullptr if
+ * the generic tag scanner will be used.  Its name is part of the
+ * #ScanCache key.
+ */
+gcc_pure
+static const DecoderPlugin *
+GetScanPlugin(const char *name) noexcept
 {
-	Song *song;
-	{
-		const ScopeDatabaseLock protect;
-		song = directory.FindSong(name);
-	}
+	const char *suffix = uri_get_suffix(name);
+	return suffix != nullptr
+		? decoder_plugins_find([suffix](const DecoderPlugin &p){
+				return p.SupportsSuffix(suffix);
+			})
+		: nullptr;
+}
 
-	if (!directory_child_access(storage, directory, name, R_OK)) {
-		FormatError(update_domain,
-			    "no read permissions on %s/%s",
-			    directory.GetPath(), name);
-		if (song != nullptr)
-			editor.LockDeleteSong(directory, song);
+std::string
+UpdateWalk::GetSongScanFingerprint(const Directory &directory,
+				   const char *name)
+{
+	return GetScanFingerprint(directory, GetScanPlugin(name));
+}
 
-		return;
-	}
+UpdateScanPool::CommitFunction
+UpdateWalk::ScanSongFile(Directory &directory, const char *name,
+			 const StorageFileInfo &info,
+			 const std::string &fingerprint, Song *song)
+{
+	const DecoderPlugin *plugin = GetScanPlugin(name);
+	const char *plugin_name = plugin != nullptr
+		? plugin->name
+		: "tag";
+	const auto path_fs = storage.MapChildFS(directory.GetPath(), name);
 
-	if (!(song != nullptr && info.mtime == song->mtime &&
-	      !walk_discard) &&
-	    UpdateContainerFile(directory, name, suffix, info)) {
-		if (song != nullptr)
-			editor.LockDeleteSong(directory, song);
+	/* load into a new (detached) Song object; the existing one
+	   is updated by CommitSongFile() while holding the database
+	   lock */
+	Song *loaded = nullptr;
 
-		return;
+	std::forward_list<DetachedSong> cached;
+	if (scan_cache.Load(plugin_name, info, path_fs, fingerprint.c_str(),
+			    cached)) {
+		if (!cached.empty()) {
+			loaded = Song::NewFile(name, directory);
+			loaded->tag = std::move(cached.front().WritableTag());
+			loaded->mtime = info.mtime;
+		}
+	} else {
+		try {
+			loaded = Song::LoadFile(storage, name, directory);
+			scan_cache.Store(plugin_name, info, path_fs,
+					 fingerprint.c_str(), loaded);
+		} catch (...) {
+			LogError(std::current_exception());
+		}
 	}
 
+	std::string name2(name);
+	return [this, &directory, name2, song, loaded](){
+		CommitSongFile(directory, name2.c_str(), song, loaded);
+	};
+}
+
+void
+UpdateWalk::CommitSongFile(Directory &directory, const char *name,
+			   Song *song, Song *loaded)
+{
 	if (song == nullptr) {
-		FormatDebug(update_domain, "reading %s/%s",
-			    directory.GetPath(), name);
-		song = Song::LoadFile(storage, name, directory);
-		if (song == nullptr) {
+		if (loaded == nullptr) {
 			FormatDebug(update_domain,
 				    "ignoring unrecognized file %s/%s",
 				    directory.GetPath(), name);
@@ -73,26 +112,76 @@ UpdateWalk::UpdateSongFile2(Directory &directory,
 
 		{
 			const ScopeDatabaseLock protect;
-			directory.AddSong(song);
+			directory.AddSong(loaded);
 		}
 
 		modified = true;
 		FormatDefault(update_domain, "added %s/%s",
 			      directory.GetPath(), name);
-	} else if (info.mtime != song->mtime || walk_discard) {
+	} else {
 		FormatDefault(update_domain, "updating %s/%s",
 			      directory.GetPath(), name);
-		if (!song->UpdateFile(storage)) {
+		if (loaded == nullptr) {
 			FormatDebug(update_domain,
 				    "deleting unrecognized file %s/%s",
 				    directory.GetPath(), name);
 			editor.LockDeleteSong(directory, song);
+		} else {
+			const ScopeDatabaseLock protect;
+			directory.UpdateSongTag(*song,
+						std::move(loaded->tag));
+			song->mtime = loaded->mtime;
+			loaded->Free();
 		}
 
 		modified = true;
 	}
 }
 
+inline void
+UpdateWalk::UpdateSongFile2(Directory &directory,
+			    const char *name, const char *suffix,
+			    const StorageFileInfo &info)
+{
+	Song *song;
+	{
+		const ScopeDatabaseSharedLock protect;
+		song = directory.FindSong(name);
+	}
+
+	if (!directory_child_access(storage, directory, name, R_OK)) {
+		FormatError(update_domain,
+			    "no read permissions on %s/%s",
+			    directory.GetPath(), name);
+		if (song != nullptr) {
+			FlushScansFor(*song);
+			editor.LockDeleteSong(directory, song);
+		}
+
+		return;
+	}
+
+	if (song != nullptr && info.mtime == song->mtime && !walk_discard)
+		/* not modified */
+		return;
+
+	if (UpdateContainerFile(directory, name, suffix, info, song))
+		return;
+
+	if (song == nullptr)
+		FormatDebug(update_domain, "reading %s/%s",
+			    directory.GetPath(), name);
+
+	std::string name2(name);
+	std::string fingerprint = GetSongScanFingerprint(directory, name);
+	PushScan(directory, song,
+		 [this, &directory, name2, info,
+		  fingerprint = std::move(fingerprint), song](){
+			return ScanSongFile(directory, name2.c_str(),
+					    info, fingerprint, song);
+		});
+}
+
 bool
 UpdateWalk::UpdateSongFile(Directory &directory,
 			   const char *name, const char *suffix,
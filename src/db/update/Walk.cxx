@@ -23,12 +23,14 @@
 #include "Editor.hxx"
 #include "UpdateDomain.hxx"
 #include "db/DatabaseLock.hxx"
+#include "Queue.hxx"
 #include "db/PlaylistVector.hxx"
 #include "db/Uri.hxx"
 #include "db/plugins/simple/Directory.hxx"
 #include "db/plugins/simple/Song.hxx"
 #include "storage/StorageInterface.hxx"
 #include "playlist/PlaylistRegistry.hxx"
+#include "decoder/DecoderPlugin.hxx"
 #include "ExcludeList.hxx"
 #include "config/ConfigGlobal.hxx"
 #include "config/ConfigOption.hxx"
@@ -45,7 +47,9 @@
 #include "Log.hxx"
 
 #include <stdexcept>
+#include <forward_list>
 #include <memory>
+#include <thread>
 
 #include <assert.h>
 #include <string.h>
@@ -56,7 +60,8 @@ UpdateWalk::UpdateWalk(EventLoop &_loop, DatabaseListener &_listener,
 		       Storage &_storage)
 	:cancel(false),
 	 storage(_storage),
-	 editor(_loop, _listener)
+	 editor(_loop, _listener),
+	 scan_cache(config_get_path(ConfigOption::SCAN_CACHE_DIR))
 {
 #ifndef _WIN32
 	follow_inside_symlinks =
@@ -80,6 +85,8 @@ inline void
 UpdateWalk::RemoveExcludedFromDirectory(Directory &directory,
 					const ExcludeList &exclude_list)
 {
+	FlushScansFor(directory);
+
 	const ScopeDatabaseLock protect;
 
 	directory.ForEachChildSafe([&](Directory &child){
@@ -110,6 +117,7 @@ UpdateWalk::PurgeDeletedFromDirectory(Directory &directory)
 			if (child.IsMount() || DirectoryExists(storage, child))
 				return;
 
+			FlushScansFor(child);
 			editor.LockDeleteDirectory(&child);
 
 			modified = true;
@@ -118,6 +126,7 @@ UpdateWalk::PurgeDeletedFromDirectory(Directory &directory)
 	directory.ForEachSongSafe([&](Song &song){
 			if (!directory_child_is_regular(storage, directory,
 							song.uri)) {
+				FlushScansFor(song);
 				editor.LockDeleteSong(directory, &song);
 
 				modified = true;
@@ -136,6 +145,32 @@ UpdateWalk::PurgeDeletedFromDirectory(Directory &directory)
 	}
 }
 
+std::string
+UpdateWalk::GetScanFingerprint(const Directory &directory,
+			       const DecoderPlugin *plugin)
+{
+	if (!scan_cache.IsDefined())
+		return std::string();
+
+	if (fingerprint_cache.directory != directory.GetPath()) {
+		fingerprint_cache.directory = directory.GetPath();
+		fingerprint_cache.fingerprints.clear();
+	}
+
+	auto i = fingerprint_cache.fingerprints.find(plugin);
+	if (i == fingerprint_cache.fingerprints.end()) {
+		const auto companions = plugin != nullptr
+			? GetCompanionStamps(storage, directory, *plugin)
+			: std::string();
+		auto fingerprint = ScanCache::MakeFingerprint(plugin,
+							      companions);
+		i = fingerprint_cache.fingerprints.emplace(plugin,
+							   std::move(fingerprint)).first;
+	}
+
+	return i->second;
+}
+
 #ifndef _WIN32
 static bool
 update_directory_stat(Storage &storage, Directory &directory)
@@ -238,8 +273,10 @@ try {
 
 		assert(&directory == subdir->parent);
 
-		if (!UpdateDirectory(*subdir, exclude_list, info))
+		if (!UpdateDirectory(*subdir, exclude_list, info)) {
+			FlushScansFor(*subdir);
 			editor.LockDeleteDirectory(subdir);
+		}
 	} else {
 		FormatDebug(update_domain,
 			    "%s is not a directory, archive or music", name);
@@ -328,6 +365,27 @@ UpdateWalk::SkipSymlink(const Directory *directory,
 #endif
 }
 
+/**
+ * Load the ".mpdignore" file of the given directory.  A missing file
+ * is not an error.
+ */
+static void
+LoadExcludeList(Storage &storage, const char *directory_utf8,
+		ExcludeList &exclude_list)
+{
+	try {
+		Mutex mutex;
+		Cond cond;
+		auto is = InputStream::OpenReady(PathTraitsUTF8::Build(storage.MapUTF8(directory_utf8).c_str(),
+								       ".mpdignore").c_str(),
+						 mutex, cond);
+		exclude_list.Load(std::move(is));
+	} catch (...) {
+		if (!IsFileNotFound(std::current_exception()))
+			LogError(std::current_exception());
+	}
+}
+
 bool
 UpdateWalk::UpdateDirectory(Directory &directory,
 			    const ExcludeList &exclude_list,
@@ -347,18 +405,7 @@ UpdateWalk::UpdateDirectory(Directory &directory,
 	}
 
 	ExcludeList child_exclude_list(exclude_list);
-
-	try {
-		Mutex mutex;
-		Cond cond;
-		auto is = InputStream::OpenReady(PathTraitsUTF8::Build(storage.MapUTF8(directory.GetPath()).c_str(),
-								       ".mpdignore").c_str(),
-						 mutex, cond);
-		child_exclude_list.Load(std::move(is));
-	} catch (...) {
-		if (!IsFileNotFound(std::current_exception()))
-			LogError(std::current_exception());
-	}
+	LoadExcludeList(storage, directory.GetPath(), child_exclude_list);
 
 	if (!child_exclude_list.IsEmpty())
 		RemoveExcludedFromDirectory(directory, child_exclude_list);
@@ -377,13 +424,13 @@ UpdateWalk::UpdateDirectory(Directory &directory,
 		}
 
 		if (SkipSymlink(&directory, name_utf8)) {
-			modified |= editor.DeleteNameIn(directory, name_utf8);
+			modified |= DeleteNameIn(directory, name_utf8);
 			continue;
 		}
 
 		StorageFileInfo info2;
 		if (!GetInfo(*reader, info2)) {
-			modified |= editor.DeleteNameIn(directory, name_utf8);
+			modified |= DeleteNameIn(directory, name_utf8);
 			continue;
 		}
 
@@ -402,7 +449,7 @@ UpdateWalk::DirectoryMakeChildChecked(Directory &parent,
 {
 	Directory *directory;
 	{
-		const ScopeDatabaseLock protect;
+		const ScopeDatabaseSharedLock protect;
 		directory = parent.FindChild(name_utf8);
 	}
 
@@ -423,6 +470,8 @@ UpdateWalk::DirectoryMakeChildChecked(Directory &parent,
 
 	/* if we're adding directory paths, make sure to delete filenames
 	   with potentially the same name */
+	FlushScansFor(parent);
+
 	{
 		const ScopeDatabaseLock protect;
 		Song *conflicting = parent.FindSong(name_utf8);
@@ -472,13 +521,13 @@ try {
 	const char *name = PathTraitsUTF8::GetBase(uri);
 
 	if (SkipSymlink(parent, name)) {
-		modified |= editor.DeleteNameIn(*parent, name);
+		modified |= DeleteNameIn(*parent, name);
 		return;
 	}
 
 	StorageFileInfo info;
 	if (!GetInfo(storage, uri, info)) {
-		modified |= editor.DeleteNameIn(*parent, name);
+		modified |= DeleteNameIn(*parent, name);
 		return;
 	}
 
@@ -489,23 +538,267 @@ try {
 	LogError(e);
 }
 
+inline void
+UpdateWalk::RenameSong(Directory &root, const char *from, const char *to)
+try {
+	/* this runs before the scan pool is started */
+	assert(pending_scans.empty());
+
+	Directory *from_parent;
+	Song *song;
+
+	{
+		const ScopeDatabaseSharedLock protect;
+		const auto lr = root.LookupDirectory(from);
+		if (lr.uri == nullptr || strchr(lr.uri, '/') != nullptr ||
+		    lr.directory->IsMount())
+			return;
+
+		from_parent = lr.directory;
+		song = from_parent->FindSong(lr.uri);
+	}
+
+	if (song == nullptr)
+		return;
+
+	/* a rename does not change the modification time; if it
+	   differs, the file needs to be scanned again */
+	StorageFileInfo info;
+	if (!GetInfo(storage, to, info) || !info.IsRegular() ||
+	    info.mtime != song->mtime)
+		return;
+
+	Directory *to_parent = DirectoryMakeUriParentChecked(root, to);
+	if (to_parent == nullptr)
+		return;
+
+	const char *name = PathTraitsUTF8::GetBase(to);
+	if (SkipSymlink(to_parent, name))
+		return;
+
+	{
+		const ScopeDatabaseLock protect;
+
+		if (to_parent->FindChild(name) != nullptr)
+			return;
+
+		Song *conflicting = to_parent->FindSong(name);
+		if (conflicting != nullptr)
+			editor.DeleteSong(*to_parent, conflicting);
+
+		Song *moved = Song::NewFile(name, *to_parent);
+		moved->tag = Tag(song->tag);
+		moved->mtime = song->mtime;
+		moved->start_time = song->start_time;
+		moved->end_time = song->end_time;
+		to_parent->AddSong(moved);
+
+		editor.DeleteSong(*from_parent, song);
+	}
+
+	modified = true;
+	FormatDefault(update_domain, "renamed %s to %s", from, to);
+} catch (const std::exception &e) {
+	LogError(e);
+}
+
+inline void
+UpdateWalk::DeleteUri(Directory &root, const char *uri)
+{
+	Directory *directory;
+	std::string name;
+
+	{
+		const ScopeDatabaseSharedLock protect;
+		const auto lr = root.LookupDirectory(uri);
+		if (lr.directory->IsMount() ||
+		    (lr.uri != nullptr && strchr(lr.uri, '/') != nullptr))
+			/* not in this database */
+			return;
+
+		directory = lr.directory;
+		if (lr.uri != nullptr)
+			name = lr.uri;
+	}
+
+	if (!name.empty()) {
+		modified |= DeleteNameIn(*directory, name.c_str());
+	} else if (!directory->IsRoot()) {
+		FlushScansFor(*directory);
+		editor.LockDeleteDirectory(directory);
+		modified = true;
+	}
+}
+
+bool
+UpdateWalk::IsExcluded(const char *uri)
+{
+	/* each ExcludeList points to its parent; std::forward_list
+	   never moves its items */
+	std::forward_list<ExcludeList> lists;
+	lists.emplace_front();
+
+	const char *name = uri;
+	while (true) {
+		const std::string parent(uri, name > uri ? name - 1 : uri);
+		lists.emplace_front(lists.front());
+		LoadExcludeList(storage, parent.c_str(), lists.front());
+
+		const char *slash = strchr(name, '/');
+		const std::string name_utf8 = slash != nullptr
+			? std::string(name, slash)
+			: std::string(name);
+
+		const auto name_fs = AllocatedPath::FromUTF8(name_utf8.c_str());
+		if (name_fs.IsNull() || lists.front().Check(name_fs))
+			return true;
+
+		if (slash == nullptr)
+			return false;
+
+		name = slash + 1;
+	}
+}
+
+void
+UpdateWalk::PushScan(const Directory &directory, const Song *song,
+		     UpdateScanPool::ScanFunction &&scan)
+{
+	/* if the song is visited twice, the first commit may delete
+	   it while the second scan still refers to it */
+	if (song != nullptr)
+		FlushScansFor(*song);
+
+	pending_scans.push_back({&directory, song});
+
+	scan_pool.Push([this, scan = std::move(scan)]() -> UpdateScanPool::CommitFunction {
+			auto commit = scan();
+			return [this, commit = std::move(commit)](){
+				pending_scans.pop_front();
+				commit();
+			};
+		});
+}
+
+bool
+UpdateWalk::IsScanPending(const Directory &directory) const noexcept
+{
+	for (const auto &i : pending_scans)
+		for (auto d = i.directory; d != nullptr; d = d->parent)
+			if (d == &directory)
+				return true;
+
+	return false;
+}
+
+bool
+UpdateWalk::IsScanPending(const Song &song) const noexcept
+{
+	for (const auto &i : pending_scans)
+		if (i.song == &song)
+			return true;
+
+	return false;
+}
+
+bool
+UpdateWalk::DeleteNameIn(Directory &parent, const char *name)
+{
+	const Directory *directory;
+	const Song *song;
+
+	{
+		const ScopeDatabaseSharedLock protect;
+		directory = parent.FindChild(name);
+		song = parent.FindSong(name);
+	}
+
+	if (directory != nullptr)
+		FlushScansFor(*directory);
+	if (song != nullptr)
+		FlushScansFor(*song);
+
+	return editor.DeleteNameIn(parent, name);
+}
+
+void
+UpdateWalk::StartScanPool()
+{
+	/* scan in parallel only on local storage; other storage
+	   plugins are not known to be thread-safe */
+	scan_pool.Start(storage.MapFS("").IsNull()
+			? 0
+			: std::thread::hardware_concurrency());
+
+	/* companion files may have been modified since the last
+	   walk */
+	fingerprint_cache.directory.clear();
+	fingerprint_cache.fingerprints.clear();
+}
+
 bool
 UpdateWalk::Walk(Directory &root, const char *path, bool discard)
 {
 	walk_discard = discard;
 	modified = false;
 
+	StartScanPool();
+
 	if (path != nullptr && !isRootDirectory(path)) {
 		UpdateUri(root, path);
 	} else {
 		StorageFileInfo info;
-		if (!GetInfo(storage, "", info))
+		if (!GetInfo(storage, "", info)) {
+			scan_pool.Stop();
 			return false;
+		}
 
 		ExcludeList exclude_list;
 
 		UpdateDirectory(root, exclude_list, info);
 	}
 
+	scan_pool.Stop();
+
+	if (!cancel && (path == nullptr || isRootDirectory(path)))
+		/* only now all entries which are still needed have
+		   been looked up or stored */
+		scan_cache.Prune();
+
+	return modified;
+}
+
+bool
+UpdateWalk::WalkFiles(Directory &root, const std::list<std::string> &files,
+		      const std::list<UpdateRename> &renames)
+{
+	walk_discard = false;
+	modified = false;
+
+	/* move the entries of renamed files first, so the following
+	   UpdateUri() calls find them unmodified */
+	for (const auto &i : renames) {
+		if (cancel)
+			return modified;
+
+		if (!IsExcluded(i.to_utf8.c_str()))
+			RenameSong(root, i.from_utf8.c_str(),
+				   i.to_utf8.c_str());
+	}
+
+	StartScanPool();
+
+	for (const auto &i : files) {
+		if (cancel)
+			break;
+
+		if (IsExcluded(i.c_str()))
+			DeleteUri(root, i.c_str());
+		else
+			UpdateUri(root, i.c_str());
+	}
+
+	scan_pool.Stop();
+
 	return modified;
 }
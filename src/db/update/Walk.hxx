@@ -22,11 +22,21 @@
 
 #include "check.h"
 #include "Editor.hxx"
+#include "ScanPool.hxx"
+#include "ScanCache.hxx"
 #include "Compiler.h"
 
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+
 struct StorageFileInfo;
+struct UpdateRename;
 struct Directory;
+struct Song;
 struct ArchivePlugin;
+struct DecoderPlugin;
 class ArchiveFile;
 class Storage;
 class ExcludeList;
@@ -58,6 +68,42 @@ class UpdateWalk final {
 
 	DatabaseEditor editor;
 
+	/**
+	 * Runs decoder plugin scans of local files in parallel.
+	 */
+	UpdateScanPool scan_pool;
+
+	/**
+	 * Remembers decoder plugin scan results across updates.
+	 */
+	ScanCache scan_cache;
+
+	/**
+	 * The objects which a submitted scan refers to.  Its commit
+	 * function dereferences them, so they must not be deleted
+	 * before it has run.
+	 */
+	struct PendingScan {
+		const Directory *directory;
+		const Song *song;
+	};
+
+	/**
+	 * All scans which have not been committed yet, in submission
+	 * order.  Only accessed by the update thread.
+	 */
+	std::deque<PendingScan> pending_scans;
+
+	/**
+	 * Remembers ScanCache::MakeFingerprint() for the directory
+	 * whose files are being updated, because it is the same for
+	 * all of them.  Only accessed by the update thread.
+	 */
+	struct FingerprintCache {
+		std::string directory;
+		std::map<const DecoderPlugin *, std::string> fingerprints;
+	} fingerprint_cache;
+
 public:
 	UpdateWalk(EventLoop &_loop, DatabaseListener &_listener,
 		   Storage &_storage);
@@ -75,7 +121,61 @@ public:
 	 */
 	bool Walk(Directory &root, const char *path, bool discard);
 
+	/**
+	 * Update only the given files, and move the database entries
+	 * of renamed files which are unmodified.
+	 *
+	 * @param renames both paths of each item must be in "files"
+	 * as well
+	 * @return true if the database was modified
+	 */
+	bool WalkFiles(Directory &root, const std::list<std::string> &files,
+		       const std::list<UpdateRename> &renames);
+
 private:
+	void StartScanPool();
+
+	/**
+	 * Submit a scan to #scan_pool.
+	 *
+	 * @param directory the #Directory which the scan refers to
+	 * @param song the #Song which the scan refers to or nullptr
+	 */
+	void PushScan(const Directory &directory, const Song *song,
+		      UpdateScanPool::ScanFunction &&scan);
+
+	/**
+	 * Does a pending scan refer to this #Directory or one of its
+	 * descendants?
+	 */
+	gcc_pure
+	bool IsScanPending(const Directory &directory) const noexcept;
+
+	gcc_pure
+	bool IsScanPending(const Song &song) const noexcept;
+
+	/**
+	 * Commit all pending scans if one of them refers to the given
+	 * object.  Call this before deleting it outside of a commit
+	 * function, and without holding the database lock.
+	 */
+	template<typename T>
+	void FlushScansFor(const T &object) {
+		if (IsScanPending(object))
+			scan_pool.Flush();
+	}
+
+	/**
+	 * Wrapper for DatabaseEditor::DeleteNameIn() which calls
+	 * FlushScansFor() first.
+	 */
+	bool DeleteNameIn(Directory &parent, const char *name);
+
+	/**
+	 * Check whether the given URI is excluded by a ".mpdignore"
+	 * file in one of its parent directories.
+	 */
+	bool IsExcluded(const char *uri);
 	gcc_pure
 	bool SkipSymlink(const Directory *directory,
 			 const char *utf8_name) const noexcept;
@@ -85,6 +185,39 @@ private:
 
 	void PurgeDeletedFromDirectory(Directory &directory);
 
+	/**
+	 * Returns the #ScanCache fingerprint of files in the given
+	 * directory.  Must be called in the update thread.
+	 *
+	 * @param plugin the plugin which scans the files or nullptr
+	 */
+	std::string GetScanFingerprint(const Directory &directory,
+				       const DecoderPlugin *plugin);
+
+	/**
+	 * GetScanFingerprint() for the plugin which scans the given
+	 * file in ScanSongFile().
+	 */
+	std::string GetSongScanFingerprint(const Directory &directory,
+					   const char *name);
+
+	/**
+	 * Scan the tags of a new or modified song file.  Called in a
+	 * worker thread of #scan_pool; the returned function adds the
+	 * new #Song or updates the existing one.
+	 *
+	 * @param fingerprint the result of GetSongScanFingerprint()
+	 * @param song the existing #Song object or nullptr
+	 */
+	UpdateScanPool::CommitFunction ScanSongFile(Directory &directory,
+						    const char *name,
+						    const StorageFileInfo &info,
+						    const std::string &fingerprint,
+						    Song *song);
+
+	void CommitSongFile(Directory &directory, const char *name,
+			    Song *song, Song *loaded);
+
 	void UpdateSongFile2(Directory &directory,
 			     const char *name, const char *suffix,
 			     const StorageFileInfo &info);
@@ -93,9 +226,18 @@ private:
 			    const char *name, const char *suffix,
 			    const StorageFileInfo &info);
 
+	/**
+	 * Attempt to scan the file as a container.  If it turns out
+	 * not to be one, it is scanned as a regular song file.
+	 *
+	 * @param song the existing #Song object with this name or
+	 * nullptr; it is taken over if this method returns true
+	 * @return false if no container plugin could be applied
+	 */
 	bool UpdateContainerFile(Directory &directory,
 				 const char *name, const char *suffix,
-				 const StorageFileInfo &info);
+				 const StorageFileInfo &info,
+				 Song *song);
 
 
 #ifdef ENABLE_ARCHIVE
@@ -155,6 +297,18 @@ private:
 						 const char *uri);
 
 	void UpdateUri(Directory &root, const char *uri);
+
+	/**
+	 * Move the #Song at "from" to "to" without scanning the file
+	 * again.  Does nothing if there is no such #Song or if the
+	 * file was modified.
+	 */
+	void RenameSong(Directory &root, const char *from, const char *to);
+
+	/**
+	 * Remove the database entry at the given URI (if any).
+	 */
+	void DeleteUri(Directory &root, const char *uri);
 };
 
 #endif
@@ -453,21 +453,38 @@ DecoderBridge::SubmitData(InputStream *is,
 	/* send stream tags */
 
 	if (UpdateStreamTag(is)) {
-		if (decoder_tag != nullptr) {
-			/* merge with tag from decoder plugin */
-			Tag *tag = Tag::Merge(*decoder_tag,
-					      *stream_tag);
-			cmd = DoSendTag(*tag);
-			delete tag;
-		} else
-			/* send only the stream tag */
-			cmd = DoSendTag(*stream_tag);
-
+		cmd = SendStreamTag();
 		if (cmd != DecoderCommand::NONE)
 			return cmd;
 	}
 
-	cmd = DecoderCommand::NONE;
+	return WriteData(data, length, kbit_rate);
+}
+
+DecoderCommand
+DecoderBridge::SendStreamTag()
+{
+	assert(stream_tag != nullptr);
+
+	DecoderCommand cmd;
+	if (decoder_tag != nullptr) {
+		/* merge with tag from decoder plugin */
+		Tag *tag = Tag::Merge(*decoder_tag,
+				      *stream_tag);
+		cmd = DoSendTag(*tag);
+		delete tag;
+	} else
+		/* send only the stream tag */
+		cmd = DoSendTag(*stream_tag);
+
+	return cmd;
+}
+
+DecoderCommand
+DecoderBridge::WriteData(const void *data, size_t length,
+			 uint16_t kbit_rate)
+{
+	DecoderCommand cmd = DecoderCommand::NONE;
 
 	const size_t frame_size = dc.in_audio_format.GetFrameSize();
 	size_t data_frames = length / frame_size;
@@ -530,9 +547,11 @@ DecoderBridge::SubmitData(InputStream *is,
 
 		const size_t nbytes = std::min(dest.size, length);
 
-		/* copy the buffer */
+		/* copy the buffer, unless the decoder plugin has
+		   rendered right into it (see GetDataBuffer()) */
 
-		memcpy(dest.data, data, nbytes);
+		if (dest.data != data)
+			memcpy(dest.data, data, nbytes);
 
 		/* expand the music pipe chunk */
 
@@ -554,6 +573,89 @@ DecoderBridge::SubmitData(InputStream *is,
 	return cmd;
 }
 
+WritableBuffer<void>
+DecoderBridge::GetDataBuffer()
+{
+	assert(dc.state == DecoderState::DECODE);
+	assert(dc.pipe != nullptr);
+	assert(pending_data == nullptr);
+
+	if (convert == nullptr &&
+	    LockGetVirtualCommand() == DecoderCommand::NONE) {
+		/* let the decoder plugin write to the current chunk
+		   directly */
+
+		while (true) {
+			auto *chunk = GetChunk();
+			if (chunk == nullptr)
+				/* a command has arrived; the data will
+				   be discarded by CommitData() anyway */
+				break;
+
+			const auto dest =
+				chunk->Write(dc.out_audio_format,
+					     SongTime::FromS(timestamp) -
+					     dc.song->GetStartTime(),
+					     0);
+			if (dest.IsEmpty()) {
+				/* the chunk is full, flush it */
+				FlushChunk();
+				continue;
+			}
+
+			pending_data = dest.data;
+			pending_in_chunk = true;
+			return dest;
+		}
+	}
+
+	const size_t frame_size = dc.in_audio_format.GetFrameSize();
+	const size_t size = std::max(dc.buffer->GetChunkSize() / frame_size,
+				     size_t(1)) * frame_size;
+	pending_data = data_buffer.Get(size);
+	pending_in_chunk = false;
+	return {pending_data, size};
+}
+
+DecoderCommand
+DecoderBridge::CommitData(InputStream *is, size_t length,
+			  uint16_t kbit_rate)
+{
+	assert(pending_data != nullptr);
+
+	const void *data = std::exchange(pending_data, nullptr);
+	if (!pending_in_chunk)
+		return SubmitData(is, data, length, kbit_rate);
+
+	assert(current_chunk != nullptr);
+	assert(data == current_chunk->GetData() + current_chunk->length);
+	assert(length % dc.in_audio_format.GetFrameSize() == 0);
+
+	DecoderCommand cmd = LockGetVirtualCommand();
+
+	if (cmd == DecoderCommand::STOP || cmd == DecoderCommand::SEEK ||
+	    length == 0)
+		return cmd;
+
+	assert(!initial_seek_pending);
+	assert(!initial_seek_running);
+
+	if (UpdateStreamTag(is)) {
+		/* the tag will be sent in a new chunk, and the data
+		   must follow it; move it out of the current chunk
+		   before that one gets flushed */
+		void *copy = data_buffer.Get(length);
+		memcpy(copy, data, length);
+		data = copy;
+
+		cmd = SendStreamTag();
+		if (cmd != DecoderCommand::NONE)
+			return cmd;
+	}
+
+	return WriteData(data, length, kbit_rate);
+}
+
 DecoderCommand
 DecoderBridge::SubmitTag(InputStream *is, Tag &&tag)
 {
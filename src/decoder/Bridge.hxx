@@ -22,6 +22,7 @@
 
 #include "Client.hxx"
 #include "ReplayGainInfo.hxx"
+#include "pcm/PcmBuffer.hxx"
 
 #include <exception>
 
@@ -90,6 +91,24 @@ public:
 	/** the chunk currently being written to */
 	MusicChunk *current_chunk = nullptr;
 
+	/**
+	 * The buffer returned by GetDataBuffer() if it cannot point
+	 * into #current_chunk, e.g. because the data needs to be
+	 * converted.
+	 */
+	PcmBuffer data_buffer;
+
+	/**
+	 * The buffer most recently returned by GetDataBuffer(), or
+	 * nullptr if there is none.
+	 */
+	void *pending_data = nullptr;
+
+	/**
+	 * Does #pending_data point into #current_chunk?
+	 */
+	bool pending_in_chunk;
+
 	ReplayGainInfo replay_gain_info;
 
 	/**
@@ -150,6 +169,9 @@ public:
 	DecoderCommand SubmitData(InputStream *is,
 				  const void *data, size_t length,
 				  uint16_t kbit_rate) override;
+	WritableBuffer<void> GetDataBuffer() override;
+	DecoderCommand CommitData(InputStream *is, size_t length,
+				  uint16_t kbit_rate) override;
 	DecoderCommand SubmitTag(InputStream *is, Tag &&tag) override ;
 	void SubmitReplayGain(const ReplayGainInfo *replay_gain_info) override;
 	void SubmitMixRamp(MixRampInfo &&mix_ramp) override;
@@ -176,6 +198,21 @@ private:
 	DecoderCommand DoSendTag(const Tag &tag);
 
 	bool UpdateStreamTag(InputStream *is);
+
+	/**
+	 * Sends the stream tag (merged with the decoder tag) to the
+	 * #MusicPipe.  Call this after UpdateStreamTag() has
+	 * returned true.
+	 */
+	DecoderCommand SendStreamTag();
+
+	/**
+	 * The second half of SubmitData(): convert the data and
+	 * append it to the #MusicPipe.  If the data already is at
+	 * the end of #current_chunk, it is not copied.
+	 */
+	DecoderCommand WriteData(const void *data, size_t length,
+				 uint16_t kbit_rate);
 };
 
 #endif
@@ -24,6 +24,7 @@
 #include "DecoderCommand.hxx"
 #include "Chrono.hxx"
 #include "input/Ptr.hxx"
+#include "util/WritableBuffer.hxx"
 #include "Compiler.h"
 
 #include <stdint.h>
@@ -138,6 +139,29 @@ public:
 		return SubmitData(&is, data, length, kbit_rate);
 	}
 
+	/**
+	 * Obtain a buffer the decoder plugin may render PCM data
+	 * into; it is usually the free space of the current
+	 * #MusicChunk, which saves copying the data in SubmitData().
+	 * Submit the data with CommitData(); no other method except
+	 * SubmitTimestamp() may be called in between.
+	 *
+	 * @return a buffer for a whole number of frames in the
+	 * format passed to Ready(); never empty
+	 */
+	virtual WritableBuffer<void> GetDataBuffer() = 0;
+
+	/**
+	 * Submit data which was rendered into the buffer returned by
+	 * GetDataBuffer().
+	 *
+	 * @param length the number of bytes written to the buffer
+	 * @return the current command, or DecoderCommand::NONE if there is no
+	 * command pending
+	 */
+	virtual DecoderCommand CommitData(InputStream *is, size_t length,
+					  uint16_t kbit_rate) = 0;
+
 	/**
 	 * This function is called by the decoder plugin when it has
 	 * successfully decoded a tag.
@@ -44,6 +44,7 @@
 #include "plugins/FluidsynthDecoderPlugin.hxx"
 #include "plugins/SidplayDecoderPlugin.hxx"
 #include "plugins/LazyusfDecoderPlugin.hxx"
+#include "thread/Mutex.hxx"
 #include "util/Macros.hxx"
 
 #include <string.h>
@@ -121,6 +122,21 @@ static constexpr unsigned num_decoder_plugins =
 /** which plugins have been initialized successfully? */
 bool decoder_plugins_enabled[num_decoder_plugins];
 
+/** serializes the scan methods of plugins which are not reentrant */
+static Mutex decoder_plugins_scan_mutex[num_decoder_plugins];
+
+Mutex &
+decoder_plugin_scan_mutex(const DecoderPlugin &plugin) noexcept
+{
+	for (unsigned i = 0; decoder_plugins[i] != nullptr; ++i)
+		if (decoder_plugins[i] == &plugin)
+			return decoder_plugins_scan_mutex[i];
+
+	/* not a registered plugin: share one fallback mutex */
+	static Mutex fallback;
+	return fallback;
+}
+
 const struct DecoderPlugin *
 decoder_plugin_from_name(const char *name) noexcept
 {
@@ -23,6 +23,7 @@
 #include "Compiler.h"
 
 struct DecoderPlugin;
+class Mutex;
 
 extern const struct DecoderPlugin *const decoder_plugins[];
 extern bool decoder_plugins_enabled[];
@@ -33,6 +34,14 @@ gcc_pure
 const struct DecoderPlugin *
 decoder_plugin_from_name(const char *name) noexcept;
 
+/**
+ * Returns the mutex which serializes the scan methods of the
+ * specified plugin; see DecoderPlugin::reentrant_scan.
+ */
+gcc_pure
+Mutex &
+decoder_plugin_scan_mutex(const DecoderPlugin &plugin) noexcept;
+
 /* this is where we "load" all the "plugins" ;-) */
 void
 decoder_plugin_init_all();
@@ -19,6 +19,8 @@
 
 #include "config.h"
 #include "DecoderPlugin.hxx"
+#include "DecoderList.hxx"
+#include "thread/Mutex.hxx"
 #include "util/StringUtil.hxx"
 
 #include <assert.h>
@@ -46,3 +48,18 @@ DecoderPlugin::SupportsMimeType(const char *mime_type) const noexcept
 	return mime_types != nullptr &&
 		StringArrayContainsCase(mime_types, mime_type);
 }
+
+DecoderPlugin::ScanLock::ScanLock(const DecoderPlugin &plugin) noexcept
+	:mutex(plugin.reentrant_scan
+	       ? nullptr
+	       : &decoder_plugin_scan_mutex(plugin))
+{
+	if (mutex != nullptr)
+		mutex->lock();
+}
+
+DecoderPlugin::ScanLock::~ScanLock() noexcept
+{
+	if (mutex != nullptr)
+		mutex->unlock();
+}
@@ -30,6 +30,7 @@ struct TagHandler;
 class Path;
 class DecoderClient;
 class DetachedSong;
+class Mutex;
 
 struct DecoderPlugin {
 	const char *name;
@@ -99,6 +100,42 @@ struct DecoderPlugin {
 	const char *const*suffixes;
 	const char *const*mime_types;
 
+	/* the following fields are optional; they are last so plugins
+	   which don't need them can omit them */
+
+	/**
+	 * May scan_file(), scan_stream() and container_scan() be
+	 * called by several threads at the same time (e.g. by the
+	 * database update's scan pool)?  If not, ScanFile(),
+	 * ScanStream() and ContainerScan() serialize them.
+	 */
+	bool reentrant_scan = false;
+
+	/**
+	 * Suffixes of files in the same directory which the plugin
+	 * may read together with the scanned file (e.g. a playlist
+	 * with track names or a shared library of a "mini" rip).
+	 * The inode, size and modification time of all of them are
+	 * part of the database update's scan cache key.  May be
+	 * nullptr.
+	 */
+	const char *const*companion_suffixes = nullptr;
+
+	/**
+	 * Holds the plugin's scan mutex during its lifetime, unless
+	 * #reentrant_scan is set.
+	 */
+	class ScanLock {
+		Mutex *const mutex;
+
+	public:
+		explicit ScanLock(const DecoderPlugin &plugin) noexcept;
+		~ScanLock() noexcept;
+
+		ScanLock(const ScanLock &) = delete;
+		ScanLock &operator=(const ScanLock &) = delete;
+	};
+
 	/**
 	 * Initialize a decoder plugin.
 	 *
@@ -141,9 +178,11 @@ struct DecoderPlugin {
 	template<typename P>
 	bool ScanFile(P path_fs,
 		      const TagHandler &handler, void *handler_ctx) const {
-		return scan_file != nullptr
-			? scan_file(path_fs, handler, handler_ctx)
-			: false;
+		if (scan_file == nullptr)
+			return false;
+
+		const ScanLock lock(*this);
+		return scan_file(path_fs, handler, handler_ctx);
 	}
 
 	/**
@@ -151,17 +190,20 @@ struct DecoderPlugin {
 	 */
 	bool ScanStream(InputStream &is,
 			const TagHandler &handler, void *handler_ctx) const {
-		return scan_stream != nullptr
-			? scan_stream(is, handler, handler_ctx)
-			: false;
+		if (scan_stream == nullptr)
+			return false;
+
+		const ScanLock lock(*this);
+		return scan_stream(is, handler, handler_ctx);
 	}
 
 	/**
 	 * return "virtual" tracks in a container
 	 */
 	template<typename P>
-	char *ContainerScan(P path, const unsigned int tnum) const {
-		return container_scan(path, tnum);
+	std::forward_list<DetachedSong> ContainerScan(P path_fs) const {
+		const ScanLock lock(*this);
+		return container_scan(path_fs);
 	}
 
 	/**
@@ -21,7 +21,9 @@
 #include "AdPlugDecoderPlugin.h"
 #include "tag/TagHandler.hxx"
 #include "../DecoderAPI.hxx"
+#include "LoadInputStream.hxx"
 #include "CheckAudioFormat.hxx"
+#include "input/InputStream.hxx"
 #include "fs/Path.hxx"
 #include "util/Domain.hxx"
 #include "util/Macros.hxx"
@@ -29,11 +31,24 @@
 
 #include <adplug/adplug.h>
 #include <adplug/emuopl.h>
+#include <adplug/fprovide.h>
+#include <binstr.h>
+
+#include <algorithm>
+#include <forward_list>
+#include <string>
 
 #include <assert.h>
 
 static constexpr Domain adplug_domain("adplug");
 
+static constexpr unsigned ADPLUG_FRAMES_PER_UPDATE = 1024;
+
+/**
+ * The maximum size of a file loaded from an #InputStream.
+ */
+static constexpr size_t ADPLUG_FILE_LIMIT = 16 * 1024 * 1024;
+
 static unsigned sample_rate;
 
 static bool
@@ -48,16 +63,70 @@ adplug_init(const ConfigBlock &block)
 	return true;
 }
 
-static void
-adplug_file_decode(DecoderClient &client, Path path_fs)
+/**
+ * A #CFileProvider which serves a file which was loaded from an
+ * #InputStream, and opens other files (e.g. the instrument bank of a
+ * Sierra song) next to it with #InputStream.
+ */
+class AdPlugStreamProvider final : public CFileProvider {
+	const std::string uri;
+
+	/**
+	 * The contents of the file at #uri.  It is opened once for
+	 * each player which probes it.
+	 */
+	mutable AllocatedArray<uint8_t> main_file;
+
+	/**
+	 * The contents of other files which were opened.  They are
+	 * kept until this object is destroyed, because the
+	 * #binisstream objects point into them.
+	 */
+	mutable std::forward_list<AllocatedArray<uint8_t>> other_files;
+
+public:
+	AdPlugStreamProvider(const char *_uri, AllocatedArray<uint8_t> &&data)
+		:uri(_uri), main_file(std::move(data)) {}
+
+	binistream *open(std::string filename) const override {
+		if (filename == uri)
+			return new binisstream(main_file.begin(),
+					       main_file.size());
+
+		auto data = LoadUri(filename.c_str(), ADPLUG_FILE_LIMIT);
+		if (data.IsNull())
+			return nullptr;
+
+		other_files.emplace_front(std::move(data));
+		auto &f = other_files.front();
+		return new binisstream(f.begin(), f.size());
+	}
+
+	void close(binistream *f) const override {
+		delete f;
+	}
+};
+
+/**
+ * Load a file from an #InputStream and create a player for it.
+ *
+ * @param client the decoder client; nullptr while scanning
+ */
+static CPlayer *
+LoadAdPlugStream(DecoderClient *client, InputStream &is, Copl &opl)
 {
-	CEmuopl opl(sample_rate, true, true);
-	opl.init();
+	auto data = LoadInputStream(client, is, ADPLUG_FILE_LIMIT);
+	if (data.IsNull())
+		return nullptr;
 
-	CPlayer *player = CAdPlug::factory(path_fs.c_str(), &opl);
-	if (player == nullptr)
-		return;
+	const AdPlugStreamProvider provider(is.GetURI(), std::move(data));
+	return CAdPlug::factory(is.GetURI(), &opl, CAdPlug::players,
+				provider);
+}
 
+static void
+AdPlugDecode(DecoderClient &client, CEmuopl &opl, CPlayer *player)
+{
 	const AudioFormat audio_format(sample_rate, SampleFormat::S16, 2);
 	assert(audio_format.IsValid());
 
@@ -70,37 +139,64 @@ adplug_file_decode(DecoderClient &client, Path path_fs)
 		if (!player->update())
 			break;
 
-		int16_t buffer[2048];
-		constexpr unsigned frames_per_buffer = ARRAY_SIZE(buffer) / 2;
-		opl.update(buffer, frames_per_buffer);
-		cmd = client.SubmitData(nullptr,
-					buffer, sizeof(buffer),
-					0);
+		/* render right into the music chunk; each update
+		   produces this many frames, possibly spanning
+		   several chunks */
+		unsigned remaining_frames = ADPLUG_FRAMES_PER_UPDATE;
+		do {
+			const auto dest = client.GetDataBuffer();
+			const unsigned n_frames =
+				std::min<size_t>(dest.size / (2 * sizeof(int16_t)),
+						 remaining_frames);
+			opl.update((int16_t *)dest.data, n_frames);
+			cmd = client.CommitData(nullptr,
+						n_frames * 2 * sizeof(int16_t),
+						0);
+			remaining_frames -= n_frames;
+		} while (remaining_frames > 0 && cmd == DecoderCommand::NONE);
 	} while (cmd == DecoderCommand::NONE);
 
 	delete player;
 }
 
 static void
-adplug_scan_tag(TagType type, const std::string &value,
-		const TagHandler &handler, void *handler_ctx)
+adplug_file_decode(DecoderClient &client, Path path_fs)
 {
-	if (!value.empty())
-		tag_handler_invoke_tag(handler, handler_ctx,
-				       type, value.c_str());
+	CEmuopl opl(sample_rate, true, true);
+	opl.init();
+
+	CPlayer *player = CAdPlug::factory(path_fs.c_str(), &opl);
+	if (player == nullptr)
+		return;
+
+	AdPlugDecode(client, opl, player);
 }
 
-static bool
-adplug_scan_file(Path path_fs,
-		 const TagHandler &handler, void *handler_ctx)
+static void
+adplug_stream_decode(DecoderClient &client, InputStream &is)
 {
 	CEmuopl opl(sample_rate, true, true);
 	opl.init();
 
-	CPlayer *player = CAdPlug::factory(path_fs.c_str(), &opl);
+	CPlayer *player = LoadAdPlugStream(&client, is, opl);
 	if (player == nullptr)
-		return false;
+		return;
+
+	AdPlugDecode(client, opl, player);
+}
+
+static void
+adplug_scan_tag(TagType type, const std::string &value,
+		const TagHandler &handler, void *handler_ctx)
+{
+	if (!value.empty())
+		tag_handler_invoke_tag(handler, handler_ctx,
+				       type, value.c_str());
+}
 
+static void
+AdPlugScan(CPlayer *player, const TagHandler &handler, void *handler_ctx)
+{
 	tag_handler_invoke_duration(handler, handler_ctx,
 				    SongTime::FromMS(player->songlength()));
 
@@ -114,6 +210,35 @@ adplug_scan_file(Path path_fs,
 	}
 
 	delete player;
+}
+
+static bool
+adplug_scan_file(Path path_fs,
+		 const TagHandler &handler, void *handler_ctx)
+{
+	CEmuopl opl(sample_rate, true, true);
+	opl.init();
+
+	CPlayer *player = CAdPlug::factory(path_fs.c_str(), &opl);
+	if (player == nullptr)
+		return false;
+
+	AdPlugScan(player, handler, handler_ctx);
+	return true;
+}
+
+static bool
+adplug_scan_stream(InputStream &is,
+		   const TagHandler &handler, void *handler_ctx)
+{
+	CEmuopl opl(sample_rate, true, true);
+	opl.init();
+
+	CPlayer *player = LoadAdPlugStream(nullptr, is, opl);
+	if (player == nullptr)
+		return false;
+
+	AdPlugScan(player, handler, handler_ctx);
 	return true;
 }
 
@@ -132,10 +257,10 @@ const struct DecoderPlugin adplug_decoder_plugin = {
 	"adplug",
 	adplug_init,
 	nullptr,
-	nullptr,
+	adplug_stream_decode,
 	adplug_file_decode,
 	adplug_scan_file,
-	nullptr,
+	adplug_scan_stream,
 	nullptr,
 	adplug_suffixes,
 	nullptr,
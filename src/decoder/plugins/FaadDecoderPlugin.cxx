@@ -443,4 +443,5 @@ const DecoderPlugin faad_decoder_plugin = {
 	nullptr,
 	faad_suffixes,
 	faad_mime_types,
+	true,
 };
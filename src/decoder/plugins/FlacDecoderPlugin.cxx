@@ -383,6 +383,7 @@ const struct DecoderPlugin oggflac_decoder_plugin = {
 	nullptr,
 	oggflac_suffixes,
 	oggflac_mime_types,
+	true,
 };
 
 static const char *const flac_suffixes[] = { "flac", nullptr };
@@ -405,4 +406,5 @@ const struct DecoderPlugin flac_decoder_plugin = {
 	nullptr,
 	flac_suffixes,
 	flac_mime_types,
+	true,
 };
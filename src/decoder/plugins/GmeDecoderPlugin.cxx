@@ -20,9 +20,15 @@
 #include "config.h"
 #include "GmeDecoderPlugin.hxx"
 #include "../DecoderAPI.hxx"
+#include "RenderCache.hxx"
+#include "LoadInputStream.hxx"
 #include "config/Block.cxx"
+#include "config/ConfigGlobal.hxx"
+#include "config/ConfigOption.hxx"
+#include "config/Param.hxx"
 #include "CheckAudioFormat.hxx"
 #include "DetachedSong.hxx"
+#include "input/InputStream.hxx"
 #include "tag/TagHandler.hxx"
 #include "tag/TagBuilder.hxx"
 #include "fs/Path.hxx"
@@ -36,6 +42,8 @@
 
 #include <gme/gme.h>
 
+#include <algorithm>
+
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,12 +52,18 @@
 
 static constexpr Domain gme_domain("gme");
 
-static constexpr unsigned GME_SAMPLE_RATE = 44100;
+static constexpr unsigned GME_DEFAULT_SAMPLE_RATE = 44100;
 static constexpr unsigned GME_CHANNELS = 2;
 static constexpr unsigned GME_BUFFER_FRAMES = 2048;
 static constexpr unsigned GME_BUFFER_SAMPLES =
 	GME_BUFFER_FRAMES * GME_CHANNELS;
 
+/**
+ * The maximum size of a file loaded from an #InputStream.  Chiptunes
+ * are tiny; this only guards against mistakes.
+ */
+static constexpr size_t GME_FILE_LIMIT = 16 * 1024 * 1024;
+
 struct GmeContainerPath {
 	AllocatedPath path;
 	unsigned track;
@@ -59,8 +73,56 @@ struct GmeContainerPath {
 static int gme_accuracy;
 #endif
 
+static RenderCache gme_render_cache;
+
+static unsigned gme_sample_rate;
+
+/**
+ * Parses the sample rate from an "audio_output_format" or
+ * "format" setting.  Returns 0 if it is missing or masked with "*".
+ */
+gcc_pure
+static unsigned
+ParseFormatSampleRate(const char *format) noexcept
+{
+	char *endptr;
+	const unsigned long rate = strtoul(format, &endptr, 10);
+	if (endptr == format || *endptr != ':')
+		return 0;
+
+	return rate;
+}
+
+/**
+ * Determines the sample rate the outputs will be running at, so the
+ * emulator can render at that rate and no resampler is needed.
+ * This is the global "audio_output_format" or else the "format" of
+ * the first enabled "audio_output" block which has one.  Returns 0
+ * if unknown.
+ */
+gcc_pure
+static unsigned
+FindOutputSampleRate() noexcept
+{
+	const auto *param = config_get_param(ConfigOption::AUDIO_OUTPUT_FORMAT);
+	if (param != nullptr)
+		return ParseFormatSampleRate(param->value.c_str());
+
+	for (const auto *block = config_get_block(ConfigBlockOption::AUDIO_OUTPUT);
+	     block != nullptr; block = block->next) {
+		if (!block->GetBlockValue("enabled", true))
+			continue;
+
+		const char *format = block->GetBlockValue("format");
+		if (format != nullptr)
+			return ParseFormatSampleRate(format);
+	}
+
+	return 0;
+}
+
 static bool
-gme_plugin_init(gcc_unused const ConfigBlock &block)
+gme_plugin_init(const ConfigBlock &block)
 {
 #if GME_VERSION >= 0x000600
 	auto accuracy = block.GetBlockParam("accuracy");
@@ -69,6 +131,21 @@ gme_plugin_init(gcc_unused const ConfigBlock &block)
 		: -1;
 #endif
 
+	const char *sample_rate = block.GetBlockValue("sample_rate");
+	if (sample_rate != nullptr && strcmp(sample_rate, "output") == 0) {
+		gme_sample_rate = FindOutputSampleRate();
+		if (gme_sample_rate == 0)
+			gme_sample_rate = GME_DEFAULT_SAMPLE_RATE;
+	} else
+		gme_sample_rate = block.GetBlockValue("sample_rate",
+						      GME_DEFAULT_SAMPLE_RATE);
+
+	CheckSampleRate(gme_sample_rate);
+
+	FormatDebug(gme_domain, "sample rate %u", gme_sample_rate);
+
+	gme_render_cache.Configure(block);
+
 	return true;
 }
 
@@ -105,42 +182,109 @@ ParseContainerPath(Path path_fs)
 	return { path_fs.GetDirectoryName(), track - 1 };
 }
 
+/**
+ * Returns the path of the ".m3u" playlist which belongs to the given
+ * file (it may not exist), or an empty string if the file name has
+ * no suffix.
+ */
+static std::string
+GetM3uPath(const char *path)
+{
+	const char *suffix = uri_get_suffix(path);
+	if (suffix == nullptr)
+		return std::string();
+
+	std::string m3u_path(path, suffix);
+	m3u_path += "m3u";
+	return m3u_path;
+}
+
 static Music_Emu *LoadGmeAndM3u(GmeContainerPath container) {
 
 	const char *container_path = container.path.c_str();
-	const char *container_suffix = uri_get_suffix(container_path);
-	unsigned int basename_len = container_suffix - container_path;
 
 	Music_Emu *emu;
 	const char *gme_err =
-		gme_open_file(container_path, &emu, GME_SAMPLE_RATE);
+		gme_open_file(container_path, &emu, gme_sample_rate);
 	if (gme_err != nullptr) {
 		LogWarning(gme_domain, gme_err);
 		return nullptr;
 	}
-        if(container_suffix != nullptr) {
-		std::string m3u_path(container_path,basename_len);
-		m3u_path += "m3u";
-		if(FileExists(Path::FromFS(m3u_path.c_str()))) {
-			gme_load_m3u(emu,m3u_path.c_str());
-		}
-		if(gme_err != nullptr) {
-			LogWarning(gme_domain,gme_err);
-		}
+
+	const auto m3u_path = GetM3uPath(container_path);
+	if (!m3u_path.empty() &&
+	    FileExists(Path::FromFS(m3u_path.c_str()))) {
+		gme_err = gme_load_m3u(emu, m3u_path.c_str());
+		if (gme_err != nullptr)
+			LogWarning(gme_domain, gme_err);
 	}
 	return emu;
 }
 
-static void
-gme_file_decode(DecoderClient &client, Path path_fs)
+/**
+ * Load a file from an #InputStream into the emulator, together with
+ * the ".m3u" playlist next to it (if any).
+ *
+ * @param client the decoder client; nullptr while scanning
+ */
+static Music_Emu *
+LoadGmeStream(DecoderClient *client, InputStream &is)
 {
-	const auto container = ParseContainerPath(path_fs);
+	const auto data = LoadInputStream(client, is, GME_FILE_LIMIT);
+	if (data.IsNull())
+		return nullptr;
 
-	Music_Emu *emu = LoadGmeAndM3u(container);
-        if(emu == nullptr) { return; }
+	Music_Emu *emu;
+	const char *gme_err = gme_open_data(data.begin(), data.size(),
+					    &emu, gme_sample_rate);
+	if (gme_err != nullptr) {
+		LogWarning(gme_domain, gme_err);
+		return nullptr;
+	}
 
-	AtScopeExit(emu) { gme_delete(emu); };
+	const char *uri = is.GetURI();
+	const char *suffix = uri_get_suffix(uri);
+	if (suffix != nullptr) {
+		std::string m3u_uri(uri, suffix);
+		m3u_uri += "m3u";
+
+		const auto m3u = LoadUri(m3u_uri.c_str(), GME_FILE_LIMIT);
+		if (!m3u.IsNull()) {
+			gme_err = gme_load_m3u_data(emu, m3u.begin(),
+						    m3u.size());
+			if (gme_err != nullptr)
+				LogWarning(gme_domain, gme_err);
+		}
+	}
 
+	return emu;
+}
+
+/**
+ * Describes all settings which affect the rendered PCM data, for
+ * the #RenderCache key.
+ */
+gcc_pure
+static StringBuffer<64>
+GetRenderSettings() noexcept
+{
+#if GME_VERSION >= 0x000600
+	return StringFormat<64>("gme:%u:%d", gme_sample_rate, gme_accuracy);
+#else
+	return StringFormat<64>("gme:%u", gme_sample_rate);
+#endif
+}
+
+/**
+ * Play one track of a loaded emulator.
+ *
+ * @param cache_entry the #RenderCache file for this track; may be
+ * undefined
+ */
+static void
+GmeDecode(DecoderClient &client, Music_Emu *emu, unsigned track,
+	  const RenderCacheEntry &cache_entry)
+{
 	FormatDebug(gme_domain, "emulator type '%s'\n",
 		    gme_type_system(gme_type(emu)));
 
@@ -150,7 +294,7 @@ gme_file_decode(DecoderClient &client, Path path_fs)
 #endif
 
 	gme_info_t *ti;
-	const char *gme_err = gme_track_info(emu, &ti, container.track);
+	const char *gme_err = gme_track_info(emu, &ti, track);
 	if (gme_err != nullptr) {
 		LogWarning(gme_domain, gme_err);
 		return;
@@ -165,13 +309,21 @@ gme_file_decode(DecoderClient &client, Path path_fs)
 
 	/* initialize the MPD decoder */
 
-	const auto audio_format = CheckAudioFormat(GME_SAMPLE_RATE,
+	const auto audio_format = CheckAudioFormat(gme_sample_rate,
 						   SampleFormat::S16,
 						   GME_CHANNELS);
 
 	client.Ready(audio_format, true, song_len);
 
-	gme_err = gme_start_track(emu, container.track);
+	/* only songs with a known length end by themselves and can
+	   be cached */
+	RenderCacheWriter cache_writer(gme_render_cache,
+				       length > 0
+				       ? cache_entry
+				       : RenderCacheEntry(),
+				       audio_format);
+
+	gme_err = gme_start_track(emu, track);
 	if (gme_err != nullptr)
 		LogWarning(gme_domain, gme_err);
 
@@ -181,15 +333,26 @@ gme_file_decode(DecoderClient &client, Path path_fs)
 	/* play */
 	DecoderCommand cmd;
 	do {
-		short buf[GME_BUFFER_SAMPLES];
-		gme_err = gme_play(emu, GME_BUFFER_SAMPLES, buf);
+		/* render right into the music chunk */
+		const auto dest = client.GetDataBuffer();
+		const size_t n_samples =
+			std::min<size_t>(dest.size / sizeof(short),
+					 GME_BUFFER_SAMPLES);
+		short *buf = (short *)dest.data;
+		const size_t nbytes = n_samples * sizeof(*buf);
+
+		gme_err = gme_play(emu, n_samples, buf);
 		if (gme_err != nullptr) {
 			LogWarning(gme_domain, gme_err);
 			return;
 		}
 
-		cmd = client.SubmitData(nullptr, buf, sizeof(buf), 0);
+		cache_writer.Append(buf, nbytes);
+
+		cmd = client.CommitData(nullptr, nbytes, 0);
 		if (cmd == DecoderCommand::SEEK) {
+			cache_writer.Cancel();
+
 			unsigned where = client.GetSeekTime().ToMS();
 			gme_err = gme_seek(emu, where);
 			if (gme_err != nullptr) {
@@ -199,11 +362,55 @@ gme_file_decode(DecoderClient &client, Path path_fs)
 				client.CommandFinished();
 		}
 
-		if (gme_track_ended(emu))
+		if (gme_track_ended(emu)) {
+			cache_writer.Commit();
 			break;
+		}
 	} while (cmd != DecoderCommand::STOP);
 }
 
+static void
+gme_file_decode(DecoderClient &client, Path path_fs)
+{
+	const auto container = ParseContainerPath(path_fs);
+
+	/* the track list and the track lengths may come from the
+	   ".m3u" file */
+	std::string settings(GetRenderSettings().c_str());
+	const auto m3u_path = GetM3uPath(container.path.c_str());
+	if (!m3u_path.empty())
+		AppendFileStamp(settings, Path::FromFS(m3u_path.c_str()));
+
+	const auto cache_entry =
+		gme_render_cache.Lookup(container.path, container.track,
+					settings.c_str());
+	if (RenderCache::Play(client, cache_entry))
+		return;
+
+	Music_Emu *emu = LoadGmeAndM3u(container);
+        if(emu == nullptr) { return; }
+
+	AtScopeExit(emu) { gme_delete(emu); };
+
+	GmeDecode(client, emu, container.track, cache_entry);
+}
+
+/**
+ * Play a file which is not in the local file system.  Such a URI
+ * cannot address a subtune, so this always plays the first track.
+ */
+static void
+gme_stream_decode(DecoderClient &client, InputStream &is)
+{
+	Music_Emu *emu = LoadGmeStream(&client, is);
+	if (emu == nullptr)
+		return;
+
+	AtScopeExit(emu) { gme_delete(emu); };
+
+	GmeDecode(client, emu, 0, RenderCacheEntry());
+}
+
 static void
 ScanGmeInfo(const gme_info_t &info, unsigned song_num, int track_count,
 	    const TagHandler &handler, void *handler_ctx)
@@ -274,6 +481,19 @@ gme_scan_file(Path path_fs,
 	return ScanMusicEmu(emu, container.track, handler, handler_ctx);
 }
 
+static bool
+gme_scan_stream(InputStream &is,
+		const TagHandler &handler, void *handler_ctx)
+{
+	Music_Emu *emu = LoadGmeStream(nullptr, is);
+	if (emu == nullptr)
+		return false;
+
+	AtScopeExit(emu) { gme_delete(emu); };
+
+	return ScanMusicEmu(emu, 0, handler, handler_ctx);
+}
+
 static std::forward_list<DetachedSong>
 gme_container_scan(Path path_fs)
 {
@@ -317,15 +537,23 @@ static const char *const gme_suffixes[] = {
 	nullptr
 };
 
+/* the ".m3u" playlist loaded by LoadGmeAndM3u() */
+static const char *const gme_companion_suffixes[] = {
+	"m3u",
+	nullptr
+};
+
 const struct DecoderPlugin gme_decoder_plugin = {
 	"gme",
 	gme_plugin_init,
 	nullptr,
-	nullptr,
+	gme_stream_decode,
 	gme_file_decode,
 	gme_scan_file,
-	nullptr,
+	gme_scan_stream,
 	gme_container_scan,
 	gme_suffixes,
 	nullptr,
+	true,
+	gme_companion_suffixes,
 };
@@ -3,10 +3,13 @@
 #include "config.h"
 #include "LazyusfDecoderPlugin.hxx"
 #include "../DecoderAPI.hxx"
+#include "RenderCache.hxx"
+#include "PsfLibCache.hxx"
 #include "CheckAudioFormat.hxx"
 #include "tag/TagHandler.hxx"
 #include "tag/TagBuilder.hxx"
 #include "fs/Path.hxx"
+#include "input/InputStream.hxx"
 #include "util/ScopeExit.hxx"
 #include "util/Domain.hxx"
 #include "util/StringFormat.hxx"
@@ -14,21 +17,24 @@
 
 #include <psflib/psflib.h>
 #include <lazyusf/usf.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include <stdint.h>
 
 static constexpr Domain lazyusf_domain("lazyusf");
 
 static constexpr unsigned LAZYUSF_CHANNELS = 2;
 static constexpr unsigned LAZYUSF_BUFFER_FRAMES = 1024;
-static constexpr unsigned LAZYUSF_BUFFER_SAMPLES =
-  LAZYUSF_BUFFER_FRAMES * LAZYUSF_CHANNELS;
-
-static const char *LazyUSF_separators = "\\/:|";
 
 #define MIN(a,b) (a < b ? a : b)
 
 static int8_t enable_hle;
 static int32_t sample_rate;
+static RenderCache lazyusf_render_cache;
+static PsfLibCache lazyusf_lib_cache;
 
 /**
  * applies a fade to an audio sample
@@ -83,50 +89,6 @@ ParseUSFTime(const char *ts)
 	return c + t;
 }
 
-static void
-*LazyUSF_fopen(const char *path)
-{
-	return fopen(path,"rb");
-}
-
-static size_t
-LazyUSF_fread(void *buffer, size_t size, size_t count, void *handle)
-{
-	FILE *f = (FILE *)handle;
-	return fread(buffer,size,count,f);
-}
-
-static int
-LazyUSF_fseek(void * handle, int64_t offset, int whence)
-{
-	FILE *f = (FILE *)handle;
-	return fseek(f,offset,whence);
-}
-
-static int
-LazyUSF_fclose(void * handle)
-{
-	FILE *f = (FILE *)handle;
-	return fclose(f);
-}
-
-static long
-LazyUSF_ftell(void * handle)
-{
-	FILE *f = (FILE *)handle;
-	return ftell(f);
-}
-
-static psf_file_callbacks LazyUSF_psf_callbacks =
-{
-	LazyUSF_separators,
-	LazyUSF_fopen,
-	LazyUSF_fread,
-	LazyUSF_fseek,
-	LazyUSF_fclose,
-	LazyUSF_ftell,
-};
-
 struct LazyUSF_TagHolder
 {
 	unsigned int length;
@@ -193,28 +155,20 @@ LazyUSF_Loader(void *context, const uint8_t *exe,
 	return usf_upload_section(usf, reserved, reserved_size);
 }
 
-static bool
-LazyUSF_openfile(void *context, Path path_fs,
-    struct LazyUSF_TagHolder *holder)
+static void
+LazyUSF_reset(usf_state_t *usf, struct LazyUSF_TagHolder *holder)
 {
-    usf_state_t *usf = (usf_state_t *)context;
-
 	usf_clear(usf);
 
 	holder->length = 0;
 	holder->fade = 0;
 	holder->enable_compare = 0;
 	holder->enable_fifo_full = 0;
+}
 
-	if(psf_load(path_fs.c_str(),
-	  &LazyUSF_psf_callbacks, 0x21,
-	  LazyUSF_Loader, usf,
-	  LazyUSF_TagHandler,holder,0) < 0)
-	{
-		LogWarning(lazyusf_domain,"error loading file");
-		return false;
-	}
-
+static bool
+LazyUSF_setup(usf_state_t *usf, struct LazyUSF_TagHolder *holder)
+{
 	usf_set_compare(usf,holder->enable_compare);
 	usf_set_fifo_full(usf,holder->enable_fifo_full);
 	usf_set_hle_audio(usf,enable_hle);
@@ -231,8 +185,55 @@ LazyUSF_openfile(void *context, Path path_fs,
 	return true;
 }
 
+/**
+ * @param libraries if not nullptr, the paths of the ".usflib" files
+ * referenced by the file are added to this list
+ */
+static bool
+LazyUSF_openfile(void *context, Path path_fs,
+    struct LazyUSF_TagHolder *holder,
+    std::vector<std::string> *libraries=nullptr)
+{
+    usf_state_t *usf = (usf_state_t *)context;
+
+	LazyUSF_reset(usf,holder);
+
+	if(lazyusf_lib_cache.Load(path_fs.c_str(), 0x21,
+	  LazyUSF_Loader, usf,
+	  LazyUSF_TagHandler,holder,libraries) < 0)
+	{
+		LogWarning(lazyusf_domain,"error loading file");
+		return false;
+	}
+
+	return LazyUSF_setup(usf,holder);
+}
+
+/**
+ * Like LazyUSF_openfile(), but reads the file and its libraries
+ * through #InputStream.
+ */
+static bool
+LazyUSF_openstream(void *context, DecoderClient *client, InputStream &is,
+    struct LazyUSF_TagHolder *holder)
+{
+    usf_state_t *usf = (usf_state_t *)context;
+
+	LazyUSF_reset(usf,holder);
+
+	if(lazyusf_lib_cache.LoadStream(client, is, 0x21,
+	  LazyUSF_Loader, usf,
+	  LazyUSF_TagHandler,holder) < 0)
+	{
+		LogWarning(lazyusf_domain,"error loading stream");
+		return false;
+	}
+
+	return LazyUSF_setup(usf,holder);
+}
+
 static int
-LazyUSF_ApplyFade(int16_t *buf, int64_t song_samples,
+LazyUSF_ApplyFade(int16_t *buf, unsigned n_frames, int64_t song_samples,
 	int64_t rem_samples, int64_t fade_samples)
 {
 	unsigned int i = 0;
@@ -241,7 +242,7 @@ LazyUSF_ApplyFade(int16_t *buf, int64_t song_samples,
 		return 0;
 	}
 
-	for(i = 0 - song_samples; i<LAZYUSF_BUFFER_FRAMES; i++)
+	for(i = 0 - song_samples; i<n_frames; i++)
 	{
 		if(i > rem_samples)
 		{
@@ -253,7 +254,38 @@ LazyUSF_ApplyFade(int16_t *buf, int64_t song_samples,
 			buf[i*2 + 1] = FadeUSFSample(buf[i*2 + 1],rem_samples - i - song_samples,fade_samples);
 		}
 	}
-	return LAZYUSF_BUFFER_FRAMES;
+	return n_frames;
+}
+
+/**
+ * fast-forwards the emulator by the given number of output frames,
+ * rendering at the native rate and discarding the audio
+ *
+ * @param out_rate the resampler's output rate, or 0 if not resampling
+ */
+static const char *
+LazyUSF_Skip(usf_state_t *usf, int64_t frames, int32_t out_rate)
+{
+	int32_t native_rate = 0;
+	while(frames > 0)
+	{
+		const size_t n = MIN(frames,(int64_t)LAZYUSF_BUFFER_FRAMES);
+
+		/* without a buffer, usf_render_resampled() drops the
+		   frames buffered in the resampler and then skips the
+		   corresponding number of native frames, so no stale
+		   audio is played after the seek */
+		const char *usf_err = out_rate > 0
+			? usf_render_resampled(usf,nullptr,n,out_rate)
+			: usf_render(usf,nullptr,n,&native_rate);
+		if(usf_err != nullptr)
+		{
+			return usf_err;
+		}
+		frames -= n;
+	}
+
+	return nullptr;
 }
 
 static bool
@@ -268,6 +300,9 @@ lazyusf_plugin_init(const ConfigBlock &block)
 	fprintf(stderr,"enable_hle: %d\n",enable_hle);
 	fprintf(stderr,"sample_rate: %d\n",sample_rate);
 
+	lazyusf_render_cache.Configure(block);
+	lazyusf_lib_cache.Configure(block);
+
 	return true;
 
 }
@@ -299,24 +334,22 @@ lazyusf_scan_file(Path path_fs,
     return LazyUSF_openfile(usf,path_fs,&holder);
 }
 
-static void
-lazyusf_file_decode(DecoderClient &client, Path path_fs)
+static bool
+lazyusf_scan_stream(InputStream &is,
+       const TagHandler &handler, void *handler_ctx)
 {
 	struct LazyUSF_TagHolder holder =
 	{
-		.handler = add_tag_handler,
-		.handler_ctx = nullptr,
+		.handler = handler,
+		.handler_ctx = handler_ctx,
 	};
-	const char *usf_err = nullptr;
-	int8_t resample = true;
 
 	usf_state_t *usf =
 		(usf_state_t *)malloc(usf_get_state_size());
-
 	if(!usf)
 	{
 		LogWarning(lazyusf_domain,"out of memory");
-		return;
+		return false;
 	}
 
 	AtScopeExit(usf)
@@ -325,14 +358,29 @@ lazyusf_file_decode(DecoderClient &client, Path path_fs)
 		free(usf);
 	};
 
-    if(!LazyUSF_openfile(usf,path_fs,&holder)) {
-		return;
-	}
+    return LazyUSF_openstream(usf,nullptr,is,&holder);
+}
 
-	/* get sample rate */
-    if(sample_rate <= 0) {
+/**
+ * Play a loaded file.
+ *
+ * @param cache_entry the #RenderCache file for this song; may be
+ * undefined
+ */
+static void
+LazyUSF_decode(DecoderClient &client, usf_state_t *usf,
+    const struct LazyUSF_TagHolder &holder,
+    const RenderCacheEntry &cache_entry)
+{
+	const char *usf_err = nullptr;
+	int8_t resample = true;
+
+	/* get sample rate; the configured one must not be
+	   overwritten, it is part of the #RenderCache key */
+	int32_t out_rate = sample_rate;
+    if(out_rate <= 0) {
 		resample = false;
-		usf_err = usf_render(usf,nullptr,0,&sample_rate);
+		usf_err = usf_render(usf,nullptr,0,&out_rate);
 		if(usf_err != nullptr)
 		{
 			LogWarning(lazyusf_domain,usf_err);
@@ -344,65 +392,84 @@ lazyusf_file_decode(DecoderClient &client, Path path_fs)
 		? SignedSongTime::FromMS(holder.length + holder.fade)
 		: SignedSongTime::Negative();
 
-	const auto audio_format = CheckAudioFormat(sample_rate,
+	const auto audio_format = CheckAudioFormat(out_rate,
 		SampleFormat::S16,
 		LAZYUSF_CHANNELS);
 
 	client.Ready(audio_format,true,song_len);
 
+	RenderCacheWriter cache_writer(lazyusf_render_cache,cache_entry,
+		audio_format);
+
 	DecoderCommand cmd;
-	int16_t buf[LAZYUSF_BUFFER_SAMPLES];
-	int64_t song_samples = (holder.length / 1000) * sample_rate;
-	int64_t fade_samples = (holder.fade / 1000) * sample_rate;
+	int64_t song_samples = (int64_t)holder.length * out_rate / 1000;
+	int64_t fade_samples = (int64_t)holder.fade * out_rate / 1000;
 	int64_t rem_samples = fade_samples;
 
 	do
 	{
+		/* render right into the music chunk */
+		const auto dest = client.GetDataBuffer();
+		const unsigned n_frames = std::min<size_t>(
+			dest.size / (sizeof(int16_t) * LAZYUSF_CHANNELS),
+			LAZYUSF_BUFFER_FRAMES);
+		int16_t *buf = (int16_t *)dest.data;
+		const size_t nbytes = n_frames * sizeof(int16_t) * LAZYUSF_CHANNELS;
+
 		usf_err = resample
-		  ? usf_render_resampled(usf,buf,LAZYUSF_BUFFER_FRAMES,sample_rate)
-		  : usf_render(usf,buf,LAZYUSF_BUFFER_FRAMES,&sample_rate);
+		  ? usf_render_resampled(usf,buf,n_frames,out_rate)
+		  : usf_render(usf,buf,n_frames,&out_rate);
 		if(usf_err != nullptr)
 		{
 			LogWarning(lazyusf_domain,usf_err);
+			cache_writer.Cancel();
 		}
 
 		if(song_samples > 0)
 		{
-		  song_samples -= LAZYUSF_BUFFER_FRAMES;
+		  song_samples -= n_frames;
 		}
 
 		if(song_samples <= 0)
 		{
 			rem_samples -= 
-				LazyUSF_ApplyFade(buf,song_samples,rem_samples,fade_samples);
+				LazyUSF_ApplyFade(buf,n_frames,song_samples,rem_samples,fade_samples);
 			song_samples = 0;
 		}
 
-		if(song_samples == 0 && rem_samples <= 0) break;
+		if(song_samples == 0 && rem_samples <= 0) {
+			cache_writer.Commit();
+			break;
+		}
 
-		cmd = client.SubmitData(nullptr,buf,sizeof(buf),0);
+		cache_writer.Append(buf,nbytes);
+
+		cmd = client.CommitData(nullptr,nbytes,0);
 
 		if (cmd == DecoderCommand::SEEK)
 		{
+			cache_writer.Cancel();
 
-			int64_t where = (holder.length - client.GetSeekTime().ToMS()) / 1000 * sample_rate;
+			int64_t where = ((int64_t)holder.length -
+				(int64_t)client.GetSeekTime().ToMS()) * out_rate / 1000;
 
 			if(where > song_samples) {
-			    usf_restart(usf);
-	            song_samples = (holder.length / 1000) * sample_rate;
-			    fade_samples = (holder.fade / 1000) * sample_rate;
-			    rem_samples = fade_samples;
+				usf_restart(usf);
+				song_samples = (int64_t)holder.length * out_rate / 1000;
+				rem_samples = fade_samples;
 			}
 
-			while(song_samples > where && song_samples >= 0) {
-				usf_err = resample
-				  ? usf_render_resampled(usf,buf,LAZYUSF_BUFFER_FRAMES,sample_rate)
-				  : usf_render(usf,buf,LAZYUSF_BUFFER_FRAMES,&sample_rate);
+			/* skip ahead without resampling or copying any audio */
+			const int64_t skip = song_samples - (where > 0 ? where : 0);
+			if(skip > 0) {
+				usf_err = LazyUSF_Skip(usf,skip,
+					resample ? out_rate : 0);
 				if(usf_err != nullptr) {
 					LogWarning(lazyusf_domain,usf_err);
+					client.SeekError();
 					return;
 				}
-				song_samples -= LAZYUSF_BUFFER_FRAMES;
+				song_samples -= skip;
 			}
 
 			if(where < 0) {
@@ -416,20 +483,101 @@ lazyusf_file_decode(DecoderClient &client, Path path_fs)
 
 }
 
+static void
+lazyusf_file_decode(DecoderClient &client, Path path_fs)
+{
+	struct LazyUSF_TagHolder holder =
+	{
+		.handler = add_tag_handler,
+		.handler_ctx = nullptr,
+	};
+
+	usf_state_t *usf =
+		(usf_state_t *)malloc(usf_get_state_size());
+
+	if(!usf)
+	{
+		LogWarning(lazyusf_domain,"out of memory");
+		return;
+	}
+
+	AtScopeExit(usf)
+	{
+		usf_shutdown(usf);
+		free(usf);
+	};
+
+	std::vector<std::string> libraries;
+    if(!LazyUSF_openfile(usf,path_fs,&holder,&libraries)) {
+		return;
+	}
+
+	/* the output depends on the libraries, too */
+	std::string settings(StringFormat<64>("lazyusf:%d:%d",
+		(int)enable_hle,(int)sample_rate).c_str());
+	for(const auto &i : libraries)
+		AppendFileStamp(settings,Path::FromFS(i.c_str()));
+
+	const auto cache_entry = lazyusf_render_cache.Lookup(path_fs,0,
+		settings.c_str());
+	if(RenderCache::Play(client,cache_entry))
+		return;
+
+	LazyUSF_decode(client,usf,holder,cache_entry);
+}
+
+static void
+lazyusf_stream_decode(DecoderClient &client, InputStream &is)
+{
+	struct LazyUSF_TagHolder holder =
+	{
+		.handler = add_tag_handler,
+		.handler_ctx = nullptr,
+	};
+
+	usf_state_t *usf =
+		(usf_state_t *)malloc(usf_get_state_size());
+
+	if(!usf)
+	{
+		LogWarning(lazyusf_domain,"out of memory");
+		return;
+	}
+
+	AtScopeExit(usf)
+	{
+		usf_shutdown(usf);
+		free(usf);
+	};
+
+    if(!LazyUSF_openstream(usf,&client,is,&holder)) {
+		return;
+	}
+
+	LazyUSF_decode(client,usf,holder,RenderCacheEntry());
+}
+
 static const char *const lazyusf_suffixes[] = {
 	"miniusf", nullptr
 };
 
+/* the libraries referenced by "_lib" tags, see #PsfLibCache */
+static const char *const lazyusf_companion_suffixes[] = {
+	"usflib", nullptr
+};
+
 const struct DecoderPlugin lazyusf_decoder_plugin = {
 	"lazyusf", /* name */
 	lazyusf_plugin_init,   /* init function */
 	nullptr,   /* finish function */
-	nullptr,   /* stream_decode */
+	lazyusf_stream_decode,   /* stream_decode */
 	lazyusf_file_decode,   /* file_decode */
 	lazyusf_scan_file,   /* scan_file */
-	nullptr,   /* scan_stream */
+	lazyusf_scan_stream,   /* scan_stream */
 	nullptr,   /* container_scan */
 	lazyusf_suffixes,
 	nullptr,
+	true,
+	lazyusf_companion_suffixes,
 };
 
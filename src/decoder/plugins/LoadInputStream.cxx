@@ -0,0 +1,106 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include "config.h"
+#include "LoadInputStream.hxx"
+#include "../DecoderAPI.hxx"
+#include "input/InputStream.hxx"
+#include "thread/Mutex.hxx"
+#include "thread/Cond.hxx"
+#include "util/Domain.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <stdexcept>
+
+static constexpr Domain load_input_stream_domain("load_input_stream");
+
+static constexpr size_t LOAD_PREALLOC_BLOCK = 256 * 1024;
+
+AllocatedArray<uint8_t>
+LoadInputStream(DecoderClient *client, InputStream &is, size_t limit)
+{
+	const bool known_size = is.KnownSize();
+
+	size_t capacity;
+	if (known_size) {
+		const auto size = is.GetSize();
+		if (size == 0) {
+			LogWarning(load_input_stream_domain, "file is empty");
+			return {};
+		}
+
+		if (size > offset_type(limit)) {
+			LogWarning(load_input_stream_domain, "file too large");
+			return {};
+		}
+
+		capacity = size;
+	} else
+		capacity = std::min(LOAD_PREALLOC_BLOCK, limit);
+
+	AllocatedArray<uint8_t> buffer(capacity);
+	size_t fill = 0;
+
+	while (true) {
+		if (fill == buffer.size()) {
+			if (known_size)
+				break;
+
+			if (fill >= limit) {
+				LogWarning(load_input_stream_domain,
+					   "stream too large");
+				return {};
+			}
+
+			buffer.GrowPreserve(std::min(fill * 2, limit), fill);
+		}
+
+		size_t nbytes = decoder_read(client, is, &buffer[fill],
+					     buffer.size() - fill);
+		if (nbytes == 0) {
+			if (is.LockIsEOF())
+				break;
+
+			/* I/O error or decoder command */
+			return {};
+		}
+
+		fill += nbytes;
+	}
+
+	buffer.SetSize(fill);
+	return buffer;
+}
+
+AllocatedArray<uint8_t>
+LoadUri(const char *uri, size_t limit)
+{
+	Mutex mutex;
+	Cond cond;
+
+	try {
+		auto is = InputStream::OpenReady(uri, mutex, cond);
+		return LoadInputStream(nullptr, *is, limit);
+	} catch (const std::runtime_error &e) {
+		FormatDebug(load_input_stream_domain, "%s: %s", uri, e.what());
+		return {};
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef MPD_DECODER_LOAD_INPUT_STREAM_HXX
+#define MPD_DECODER_LOAD_INPUT_STREAM_HXX
+
+#include "check.h"
+#include "util/AllocatedArray.hxx"
+
+#include <stddef.h>
+#include <stdint.h>
+
+class DecoderClient;
+class InputStream;
+class Mutex;
+class Cond;
+
+/**
+ * Read the whole #InputStream into memory.  This is for emulator
+ * libraries which can only load complete files.
+ *
+ * @param client the decoder client, which allows interrupting the
+ * transfer with a command; nullptr while scanning
+ * @param limit the maximum file size [bytes]
+ * @return the file contents or a "null" array on error (which has
+ * been logged)
+ */
+AllocatedArray<uint8_t>
+LoadInputStream(DecoderClient *client, InputStream &is, size_t limit);
+
+/**
+ * Open a file next to the given #InputStream (e.g. the ".m3u" of a
+ * chiptune, or a psflib library) and read it into memory.  This
+ * works for local files and for remote URIs alike.
+ *
+ * @param uri the absolute URI of the file
+ * @return the file contents or a "null" array if the file does not
+ * exist or could not be read
+ */
+AllocatedArray<uint8_t>
+LoadUri(const char *uri, size_t limit);
+
+#endif
@@ -281,4 +281,5 @@ const struct DecoderPlugin mpcdec_decoder_plugin = {
 	nullptr,
 	mpcdec_suffixes,
 	nullptr,
+	true,
 };
@@ -332,4 +332,5 @@ const struct DecoderPlugin mpg123_decoder_plugin = {
 	nullptr,
 	mpg123_suffixes,
 	nullptr,
+	true,
 };
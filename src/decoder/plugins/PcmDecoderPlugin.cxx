@@ -214,4 +214,5 @@ const struct DecoderPlugin pcm_decoder_plugin = {
 	nullptr,
 	nullptr,
 	pcm_mime_types,
+	true,
 };
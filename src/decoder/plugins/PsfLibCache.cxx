@@ -0,0 +1,507 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "PsfLibCache.hxx"
+#include "LoadInputStream.hxx"
+#include "config/Block.hxx"
+#include "fs/Path.hxx"
+#include "fs/FileInfo.hxx"
+#include "input/InputStream.hxx"
+#include "thread/Cond.hxx"
+#include "util/Domain.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static constexpr Domain psflib_cache_domain("psflib_cache");
+
+/**
+ * The maximum size of a file loaded from an #InputStream.
+ */
+static constexpr size_t PSF_FILE_LIMIT = 64 * 1024 * 1024;
+
+/**
+ * The contents of a library file, as passed to the psflib load
+ * callback.
+ */
+struct PsfLib {
+	struct Section {
+		std::vector<uint8_t> exe, reserved;
+	};
+
+	std::string path;
+	uint8_t version;
+
+	time_t mtime;
+	uint64_t file_size;
+
+	std::vector<Section> sections;
+
+	size_t memory_size = 0;
+
+	bool Match(const char *_path, uint8_t _version,
+		   time_t _mtime, uint64_t _file_size) const noexcept {
+		return path == _path && version == _version &&
+			mtime == _mtime && file_size == _file_size;
+	}
+};
+
+/**
+ * The state of one PsfLibCache::Load() call.  The psflib file
+ * callbacks have no context pointer, so this is passed in a
+ * thread-local variable.
+ */
+struct PsfLoadContext {
+	PsfLibCache &cache;
+
+	const char *path;
+	uint8_t version;
+
+	psf_load_callback load_target;
+	void *load_context;
+
+	/**
+	 * Are files read through #InputStream?
+	 */
+	bool stream;
+
+	/**
+	 * In stream mode, the contents of the file at #path, which
+	 * were loaded before psf_load() was called.
+	 */
+	AllocatedArray<uint8_t> data;
+
+	/**
+	 * The cached library which was opened last; its sections are
+	 * submitted at the next load callback, which is the one for
+	 * the stub file.
+	 */
+	std::shared_ptr<const PsfLib> pending;
+
+	/**
+	 * If not nullptr, the paths of all libraries opened by
+	 * psflib are added to this list.
+	 */
+	std::vector<std::string> *libraries;
+};
+
+static thread_local PsfLoadContext *psf_load_context;
+
+/**
+ * A file opened by psflib: either a real file, or a file loaded into
+ * memory, or an empty stub which stands for a cached library.
+ */
+struct PsfFile {
+	FILE *file = nullptr;
+
+	AllocatedArray<uint8_t> data;
+
+	long position = 0;
+
+	explicit PsfFile(FILE *_file):file(_file) {}
+
+	explicit PsfFile(AllocatedArray<uint8_t> &&_data)
+		:data(std::move(_data)) {}
+
+	/**
+	 * Create a PSF header without sections and without tags.
+	 */
+	static PsfFile *NewStub(uint8_t version) {
+		AllocatedArray<uint8_t> stub(16);
+		std::fill(stub.begin(), stub.end(), 0);
+		memcpy(stub.begin(), "PSF", 3);
+		stub[3] = version;
+		return new PsfFile(std::move(stub));
+	}
+
+	long GetSize() const {
+		return data.size();
+	}
+};
+
+/**
+ * Open a library through #InputStream, and look it up in the cache.
+ */
+static void *
+PsfOpenStream(PsfLoadContext &ctx, const char *uri)
+{
+	Mutex mutex;
+	Cond cond;
+
+	InputStreamPtr is;
+	try {
+		is = InputStream::OpenReady(uri, mutex, cond);
+	} catch (const std::runtime_error &e) {
+		FormatWarning(psflib_cache_domain, "%s: %s", uri, e.what());
+		return nullptr;
+	}
+
+	auto lib = ctx.cache.Get(*is, ctx.version);
+	if (lib) {
+		ctx.pending = std::move(lib);
+		return PsfFile::NewStub(ctx.version);
+	}
+
+	/* the cache is disabled, or loading through the cache has
+	   failed; try again without it */
+	try {
+		is->LockRewind();
+	} catch (const std::runtime_error &) {
+		return nullptr;
+	}
+
+	auto data = LoadInputStream(nullptr, *is, PSF_FILE_LIMIT);
+	if (data.IsNull())
+		return nullptr;
+
+	return new PsfFile(std::move(data));
+}
+
+static void *
+PsfOpen(const char *path)
+{
+	auto *ctx = psf_load_context;
+	if (ctx != nullptr && strcmp(path, ctx->path) != 0) {
+		/* this is a library */
+		if (ctx->libraries != nullptr)
+			ctx->libraries->emplace_back(path);
+
+		if (ctx->stream)
+			return PsfOpenStream(*ctx, path);
+
+		auto lib = ctx->cache.Get(path, ctx->version);
+		if (lib) {
+			ctx->pending = std::move(lib);
+			return PsfFile::NewStub(ctx->version);
+		}
+	} else if (ctx != nullptr && ctx->stream) {
+		if (ctx->data.IsNull())
+			/* opened twice? */
+			return nullptr;
+
+		return new PsfFile(std::move(ctx->data));
+	}
+
+	FILE *file = fopen(path, "rb");
+	if (file == nullptr)
+		return nullptr;
+
+	return new PsfFile(file);
+}
+
+static size_t
+PsfRead(void *buffer, size_t size, size_t count, void *handle)
+{
+	auto &f = *(PsfFile *)handle;
+	if (f.file != nullptr)
+		return fread(buffer, size, count, f.file);
+
+	if (size == 0 || f.position >= f.GetSize())
+		return 0;
+
+	count = std::min(count, (f.GetSize() - f.position) / size);
+	memcpy(buffer, f.data.begin() + f.position, count * size);
+	f.position += count * size;
+	return count;
+}
+
+static int
+PsfSeek(void *handle, int64_t offset, int whence)
+{
+	auto &f = *(PsfFile *)handle;
+	if (f.file != nullptr)
+		return fseek(f.file, offset, whence);
+
+	switch (whence) {
+	case SEEK_SET:
+		break;
+
+	case SEEK_CUR:
+		offset += f.position;
+		break;
+
+	case SEEK_END:
+		offset += f.GetSize();
+		break;
+
+	default:
+		return -1;
+	}
+
+	if (offset < 0 || offset > f.GetSize())
+		return -1;
+
+	f.position = offset;
+	return 0;
+}
+
+static int
+PsfClose(void *handle)
+{
+	auto *f = (PsfFile *)handle;
+	int result = f->file != nullptr
+		? fclose(f->file)
+		: 0;
+	delete f;
+	return result;
+}
+
+static long
+PsfTell(void *handle)
+{
+	auto &f = *(PsfFile *)handle;
+	return f.file != nullptr
+		? ftell(f.file)
+		: f.position;
+}
+
+static const psf_file_callbacks psf_cache_callbacks = {
+	"\\/:|",
+	PsfOpen,
+	PsfRead,
+	PsfSeek,
+	PsfClose,
+	PsfTell,
+};
+
+static int
+PsfLoadSection(void *context, const uint8_t *exe, size_t exe_size,
+	       const uint8_t *reserved, size_t reserved_size)
+{
+	auto &ctx = *(PsfLoadContext *)context;
+
+	if (ctx.pending) {
+		/* this is the stub; submit the cached sections
+		   instead */
+		const auto lib = std::move(ctx.pending);
+
+		for (const auto &i : lib->sections) {
+			int result = ctx.load_target(ctx.load_context,
+						     i.exe.data(),
+						     i.exe.size(),
+						     i.reserved.data(),
+						     i.reserved.size());
+			if (result != 0)
+				return result;
+		}
+
+		return 0;
+	}
+
+	return ctx.load_target(ctx.load_context, exe, exe_size,
+			       reserved, reserved_size);
+}
+
+static int
+PsfRecordSection(void *context, const uint8_t *exe, size_t exe_size,
+		 const uint8_t *reserved, size_t reserved_size)
+{
+	auto &lib = *(PsfLib *)context;
+
+	lib.sections.emplace_back();
+	auto &section = lib.sections.back();
+	section.exe.assign(exe, exe + exe_size);
+	section.reserved.assign(reserved, reserved + reserved_size);
+	lib.memory_size += exe_size + reserved_size;
+	return 0;
+}
+
+static int
+PsfIgnoreTag(void *, const char *, const char *)
+{
+	return 0;
+}
+
+void
+PsfLibCache::Configure(const ConfigBlock &block)
+{
+	max_size = block.GetBlockValue("lib_cache_size",
+				       unsigned(max_size / 1024)) * size_t(1024);
+}
+
+int
+PsfLibCache::Load(const char *path, uint8_t version,
+		  psf_load_callback load_target, void *load_context,
+		  psf_info_callback info_target, void *info_context,
+		  std::vector<std::string> *libraries)
+{
+	PsfLoadContext ctx{*this, path, version,
+			load_target, load_context,
+			false, {}, nullptr, libraries};
+
+	auto *const previous = psf_load_context;
+	psf_load_context = &ctx;
+
+	int result = psf_load(path, &psf_cache_callbacks, version,
+			      PsfLoadSection, &ctx,
+			      info_target, info_context, 0);
+
+	psf_load_context = previous;
+	return result;
+}
+
+int
+PsfLibCache::LoadStream(DecoderClient *client, InputStream &is,
+			uint8_t version,
+			psf_load_callback load_target, void *load_context,
+			psf_info_callback info_target, void *info_context)
+{
+	const char *uri = is.GetURI();
+
+	PsfLoadContext ctx{*this, uri, version,
+			load_target, load_context,
+			true, LoadInputStream(client, is, PSF_FILE_LIMIT),
+			nullptr, nullptr};
+	if (ctx.data.IsNull())
+		return -1;
+
+	auto *const previous = psf_load_context;
+	psf_load_context = &ctx;
+
+	int result = psf_load(uri, &psf_cache_callbacks, version,
+			      PsfLoadSection, &ctx,
+			      info_target, info_context, 0);
+
+	psf_load_context = previous;
+	return result;
+}
+
+std::shared_ptr<const PsfLib>
+PsfLibCache::Find(const char *path, uint8_t version,
+		  time_t mtime, uint64_t file_size)
+{
+	const std::lock_guard<Mutex> protect(mutex);
+
+	for (auto i = libs.begin(); i != libs.end(); ++i) {
+		if ((*i)->Match(path, version, mtime, file_size)) {
+			/* move to the front */
+			libs.splice(libs.begin(), libs, i);
+			return libs.front();
+		}
+	}
+
+	return nullptr;
+}
+
+std::shared_ptr<const PsfLib>
+PsfLibCache::Get(const char *path, uint8_t version)
+{
+	if (max_size == 0)
+		return nullptr;
+
+	FileInfo fi;
+	if (!GetFileInfo(Path::FromFS(path), fi) || !fi.IsRegular())
+		return nullptr;
+
+	auto found = Find(path, version,
+			  fi.GetModificationTime(), fi.GetSize());
+	if (found)
+		return found;
+
+	/* load the library (and its own libraries, recursively)
+	   without holding the mutex */
+
+	auto lib = std::make_shared<PsfLib>();
+	lib->path = path;
+	lib->version = version;
+	lib->mtime = fi.GetModificationTime();
+	lib->file_size = fi.GetSize();
+
+	if (Load(path, version, PsfRecordSection, lib.get(),
+		 PsfIgnoreTag, nullptr) < 0) {
+		FormatWarning(psflib_cache_domain,
+			      "Failed to load library %s", path);
+		return nullptr;
+	}
+
+	FormatDebug(psflib_cache_domain, "Loaded library %s (%zu bytes)",
+		    path, lib->memory_size);
+
+	Insert(lib);
+	return lib;
+}
+
+std::shared_ptr<const PsfLib>
+PsfLibCache::Get(InputStream &is, uint8_t version)
+{
+	if (max_size == 0)
+		return nullptr;
+
+	const char *uri = is.GetURI();
+	const uint64_t file_size = is.KnownSize() ? is.GetSize() : 0;
+
+	auto found = Find(uri, version, 0, file_size);
+	if (found)
+		return found;
+
+	auto lib = std::make_shared<PsfLib>();
+	lib->path = uri;
+	lib->version = version;
+	lib->mtime = 0;
+	lib->file_size = file_size;
+
+	if (LoadStream(nullptr, is, version, PsfRecordSection, lib.get(),
+		       PsfIgnoreTag, nullptr) < 0) {
+		FormatWarning(psflib_cache_domain,
+			      "Failed to load library %s", uri);
+		return nullptr;
+	}
+
+	FormatDebug(psflib_cache_domain, "Loaded library %s (%zu bytes)",
+		    uri, lib->memory_size);
+
+	Insert(lib);
+	return lib;
+}
+
+void
+PsfLibCache::Insert(std::shared_ptr<const PsfLib> lib)
+{
+	if (lib->memory_size > max_size)
+		return;
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	/* remove stale versions of this file, and entries which
+	   another thread has just loaded */
+	for (auto i = libs.begin(); i != libs.end();) {
+		if ((*i)->path == lib->path && (*i)->version == lib->version) {
+			size -= (*i)->memory_size;
+			i = libs.erase(i);
+		} else
+			++i;
+	}
+
+	size += lib->memory_size;
+	libs.emplace_front(std::move(lib));
+
+	/* evict the least recently used libraries */
+	while (size > max_size) {
+		size -= libs.back()->memory_size;
+		libs.pop_back();
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_DECODER_PSFLIB_CACHE_HXX
+#define MPD_DECODER_PSFLIB_CACHE_HXX
+
+#include "check.h"
+#include "thread/Mutex.hxx"
+
+#include <psflib/psflib.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+struct ConfigBlock;
+struct PsfLib;
+class DecoderClient;
+class InputStream;
+
+/**
+ * An in-memory LRU cache of psflib library files ("_lib" tags).  All
+ * songs of a set refer to the same (often multi-megabyte) library,
+ * and without this cache, psflib reads and decompresses it again for
+ * each song which is played or scanned.
+ *
+ * The cache stores the sections loaded from the library (including
+ * its own libraries) and replays them to the psflib load callback.
+ * Entries are invalidated when the file's size or modification time
+ * changes.
+ */
+class PsfLibCache {
+	Mutex mutex;
+
+	/**
+	 * The maximum total size of all cached sections [bytes].
+	 */
+	size_t max_size = 64 * 1024 * 1024;
+
+	size_t size = 0;
+
+	/**
+	 * The most recently used library is at the front.
+	 */
+	std::list<std::shared_ptr<const PsfLib>> libs;
+
+public:
+	PsfLibCache() = default;
+
+	PsfLibCache(const PsfLibCache &) = delete;
+	PsfLibCache &operator=(const PsfLibCache &) = delete;
+
+	/**
+	 * Read the "lib_cache_size" setting [KiB] from the decoder
+	 * block.  Zero disables the cache.
+	 */
+	void Configure(const ConfigBlock &block);
+
+	/**
+	 * A replacement for psf_load() which serves library files
+	 * from the cache.  Tags of nested files are not reported.
+	 *
+	 * @param libraries if not nullptr, the paths of the libraries
+	 * referenced by the file are added to this list
+	 */
+	int Load(const char *path, uint8_t version,
+		 psf_load_callback load_target, void *load_context,
+		 psf_info_callback info_target, void *info_context,
+		 std::vector<std::string> *libraries=nullptr);
+
+	/**
+	 * Like Load(), but read the file and its libraries through
+	 * #InputStream, which allows loading them from remote
+	 * storage or from inside archives.  Library URIs are
+	 * resolved relative to the stream's URI.
+	 *
+	 * @param client the decoder client, which allows
+	 * interrupting the transfer; nullptr while scanning
+	 */
+	int LoadStream(DecoderClient *client, InputStream &is,
+		       uint8_t version,
+		       psf_load_callback load_target, void *load_context,
+		       psf_info_callback info_target, void *info_context);
+
+	/**
+	 * Look up the given library file, and load it if it is not
+	 * in the cache.  Returns nullptr if the cache is disabled or
+	 * the file cannot be loaded.
+	 */
+	std::shared_ptr<const PsfLib> Get(const char *path, uint8_t version);
+
+	/**
+	 * Like Get(), but for a library opened as #InputStream.  The
+	 * modification time of remote files is unknown, therefore
+	 * only the size is compared.
+	 */
+	std::shared_ptr<const PsfLib> Get(InputStream &is, uint8_t version);
+
+private:
+	std::shared_ptr<const PsfLib> Find(const char *path, uint8_t version,
+					   time_t mtime, uint64_t file_size);
+
+	void Insert(std::shared_ptr<const PsfLib> lib);
+};
+
+#endif
@@ -0,0 +1,391 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "RenderCache.hxx"
+#include "../DecoderAPI.hxx"
+#include "CheckAudioFormat.hxx"
+#include "config/Block.hxx"
+#include "fs/FileInfo.hxx"
+#include "fs/FileSystem.hxx"
+#include "fs/DirectoryReader.hxx"
+#include "fs/io/FileReader.hxx"
+#include "fs/io/FileOutputStream.hxx"
+#include "util/StringAPI.hxx"
+#include "util/StringFormat.hxx"
+#include "util/Domain.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+static constexpr Domain render_cache_domain("render_cache");
+
+static constexpr char RENDER_CACHE_MAGIC[8] = {
+	'M', 'P', 'D', 'R', 'C', '0', '0', '2'
+};
+
+/**
+ * The header at the beginning of each cache file, followed by the
+ * key (#key_size bytes, see RenderCacheEntry::key) and native-endian
+ * 16 bit samples.
+ */
+struct RenderCacheHeader {
+	char magic[8];
+	uint32_t sample_rate;
+	uint32_t channels;
+	uint32_t key_size;
+};
+
+/**
+ * The 64 bit FNV-1a hash, used to derive the cache file name from
+ * the key.
+ */
+gcc_pure
+static uint64_t
+HashKey(const char *p) noexcept
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (; *p != 0; ++p) {
+		hash ^= (unsigned char)*p;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+void
+RenderCache::Configure(const ConfigBlock &block)
+{
+	directory = block.GetPath("render_cache_directory");
+	max_size = block.GetBlockValue("render_cache_size",
+				       unsigned(max_size / 1024)) * uint64_t(1024);
+}
+
+void
+AppendFileStamp(std::string &dest, Path path_fs) noexcept
+{
+	FileInfo info;
+	if (!GetFileInfo(path_fs, info) || !info.IsRegular()) {
+		dest += "\n-";
+		return;
+	}
+
+	dest += StringFormat<64>("\n%llu:%lld",
+				 (unsigned long long)info.GetSize(),
+				 (long long)info.GetModificationTime()).c_str();
+}
+
+RenderCacheEntry
+RenderCache::Lookup(Path path_fs, unsigned track,
+		    const char *settings) const noexcept
+{
+	RenderCacheEntry entry;
+	if (directory.IsNull())
+		return entry;
+
+	FileInfo info;
+	if (!GetFileInfo(path_fs, info) || !info.IsRegular())
+		return entry;
+
+	/* the key contains everything the rendered PCM depends on;
+	   a modified song file gets a new cache file */
+	entry.key = path_fs.c_str();
+	entry.key += StringFormat<128>("\n%u\n%llu\n%lld\n",
+				       track,
+				       (unsigned long long)info.GetSize(),
+				       (long long)info.GetModificationTime()).c_str();
+	entry.key += settings;
+
+	const auto name = StringFormat<32>("%016llx.pcm",
+					   (unsigned long long)HashKey(entry.key.c_str()));
+	entry.path = AllocatedPath::Build(directory,
+					  AllocatedPath::FromUTF8(name));
+	return entry;
+}
+
+/**
+ * Read the key after the #RenderCacheHeader and compare it with the
+ * expected one, because the file name is only a hash of it.
+ */
+static bool
+CheckKey(FileReader &reader, const RenderCacheHeader &header,
+	 const std::string &key)
+{
+	if (header.key_size != key.size())
+		return false;
+
+	std::unique_ptr<char[]> buffer(new char[key.size()]);
+	return reader.Read(buffer.get(), key.size()) == key.size() &&
+		memcmp(buffer.get(), key.data(), key.size()) == 0;
+}
+
+bool
+RenderCache::Play(DecoderClient &client, const RenderCacheEntry &entry)
+try {
+	if (!entry.IsDefined())
+		return false;
+
+	const Path cache_path = entry.path;
+
+	FileInfo info;
+	if (!GetFileInfo(cache_path, info) || !info.IsRegular())
+		return false;
+
+	FileReader reader(cache_path);
+
+	RenderCacheHeader header;
+	if (reader.Read(&header, sizeof(header)) != sizeof(header) ||
+	    memcmp(header.magic, RENDER_CACHE_MAGIC,
+		   sizeof(header.magic)) != 0 ||
+	    !CheckKey(reader, header, entry.key))
+		return false;
+
+	const auto audio_format = CheckAudioFormat(header.sample_rate,
+						   SampleFormat::S16,
+						   header.channels);
+	const size_t frame_size = audio_format.GetFrameSize();
+	const uint64_t data_offset = sizeof(header) + header.key_size;
+	const uint64_t n_frames = (info.GetSize() - data_offset) / frame_size;
+
+#ifndef _WIN32
+	/* Prune() deletes the files with the oldest modification
+	   time first, so this makes it an LRU cache */
+	futimens(reader.GetFD().Get(), nullptr);
+#endif
+
+	FormatDebug(render_cache_domain, "playing %s", cache_path.c_str());
+
+	client.Ready(audio_format, true,
+		     SongTime::FromScale<uint64_t>(n_frames,
+						   audio_format.sample_rate));
+
+	/* from here on, the song has been announced to the client;
+	   errors must not be reported to the caller, or it would
+	   fall back to the emulator and call Ready() again */
+	try {
+		DecoderCommand cmd;
+		do {
+			int16_t buffer[4096];
+			size_t nbytes = reader.Read(buffer, sizeof(buffer));
+			nbytes -= nbytes % frame_size;
+			if (nbytes == 0)
+				break;
+
+			cmd = client.SubmitData(nullptr, buffer, nbytes, 0);
+			if (cmd == DecoderCommand::SEEK) {
+				uint64_t frame = client.GetSeekFrame();
+				if (frame > n_frames)
+					frame = n_frames;
+
+				try {
+					reader.Seek(data_offset + frame * frame_size);
+					client.CommandFinished();
+				} catch (const std::runtime_error &e) {
+					LogError(e);
+					client.SeekError();
+				}
+			}
+		} while (cmd != DecoderCommand::STOP);
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+	}
+
+	return true;
+} catch (const std::runtime_error &e) {
+	LogError(e);
+	return false;
+}
+
+void
+RenderCache::Add(uint64_t size) noexcept
+{
+	if (max_size == 0)
+		return;
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	if (total_size != uint64_t(-1)) {
+		total_size += size;
+		if (total_size <= max_size)
+			return;
+	}
+
+	/* delete a bit more than necessary, so the next few files
+	   fit without scanning the directory again */
+	total_size = Prune(max_size - max_size / 8);
+}
+
+uint64_t
+RenderCache::Prune(uint64_t target) noexcept
+{
+	struct Entry {
+		AllocatedPath path;
+		time_t mtime;
+		uint64_t size;
+	};
+
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+
+	try {
+		DirectoryReader reader(directory);
+		while (reader.ReadEntry()) {
+			const Path name = reader.GetEntry();
+			const auto *suffix = name.GetSuffix();
+			if (suffix == nullptr ||
+			    !StringIsEqual(suffix, PATH_LITERAL("pcm")))
+				continue;
+
+			auto path = AllocatedPath::Build(directory, name);
+			FileInfo info;
+			if (!GetFileInfo(path, info, false) || !info.IsRegular())
+				continue;
+
+			total += info.GetSize();
+			entries.push_back({std::move(path),
+					   info.GetModificationTime(),
+					   info.GetSize()});
+		}
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+		/* try again with the next file */
+		return uint64_t(-1);
+	}
+
+	if (total <= max_size)
+		return total;
+
+	/* the least recently played ones first; Play() updates the
+	   modification time */
+	std::sort(entries.begin(), entries.end(),
+		  [](const Entry &a, const Entry &b){
+			  return a.mtime < b.mtime;
+		  });
+
+	for (const auto &i : entries) {
+		if (total <= target)
+			break;
+
+		try {
+			RemoveFile(i.path);
+			FormatDebug(render_cache_domain, "deleted %s",
+				    i.path.c_str());
+		} catch (const std::runtime_error &e) {
+			LogError(e);
+		}
+
+		/* subtract even if deleting has failed, or a file
+		   which cannot be deleted would empty the cache */
+		total -= i.size;
+	}
+
+	return total;
+}
+
+RenderCacheWriter::RenderCacheWriter(RenderCache &_cache,
+				     const RenderCacheEntry &entry,
+				     AudioFormat audio_format) noexcept
+	:cache(_cache), size(0)
+{
+	assert(audio_format.format == SampleFormat::S16);
+
+	if (!entry.IsDefined())
+		return;
+
+	RenderCacheHeader header;
+	memcpy(header.magic, RENDER_CACHE_MAGIC, sizeof(header.magic));
+	header.sample_rate = audio_format.sample_rate;
+	header.channels = audio_format.channels;
+	header.key_size = entry.key.size();
+
+	try {
+		file.reset(new FileOutputStream(entry.path));
+		file->Write(&header, sizeof(header));
+		file->Write(entry.key.data(), entry.key.size());
+		size = sizeof(header) + entry.key.size();
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+		file.reset();
+	}
+}
+
+RenderCacheWriter::~RenderCacheWriter()
+{
+	Cancel();
+}
+
+void
+RenderCacheWriter::Append(const void *data, size_t _size) noexcept
+{
+	if (!file)
+		return;
+
+	try {
+		file->Write(data, _size);
+		size += _size;
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+		Cancel();
+	}
+}
+
+void
+RenderCacheWriter::Cancel() noexcept
+{
+	if (!file)
+		return;
+
+	try {
+		file->Cancel();
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+	}
+
+	file.reset();
+}
+
+void
+RenderCacheWriter::Commit() noexcept
+{
+	if (!file)
+		return;
+
+	try {
+		file->Commit();
+		FormatDebug(render_cache_domain, "wrote %s",
+			    file->GetPath().c_str());
+	} catch (const std::runtime_error &e) {
+		LogError(e);
+		file.reset();
+		return;
+	}
+
+	file.reset();
+
+	cache.Add(size);
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_DECODER_RENDER_CACHE_HXX
+#define MPD_DECODER_RENDER_CACHE_HXX
+
+#include "check.h"
+#include "AudioFormat.hxx"
+#include "fs/AllocatedPath.hxx"
+#include "thread/Mutex.hxx"
+#include "Compiler.h"
+
+#include <memory>
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ConfigBlock;
+class DecoderClient;
+class FileOutputStream;
+
+/**
+ * The cache file of one song, returned by RenderCache::Lookup().
+ */
+struct RenderCacheEntry {
+	/**
+	 * A "null" path if the song cannot be cached.
+	 */
+	AllocatedPath path = AllocatedPath::Null();
+
+	/**
+	 * Describes everything the rendered PCM depends on.  The file
+	 * name contains only a hash of it, so the key is stored in
+	 * the file and verified by RenderCache::Play().
+	 */
+	std::string key;
+
+	bool IsDefined() const noexcept {
+		return !path.IsNull();
+	}
+};
+
+/**
+ * An on-disk cache of PCM data rendered by an emulating decoder
+ * plugin (gme, lazyusf, sidplay).  Their output is deterministic for
+ * a given file, sub-track and plugin configuration, so a track which
+ * has been rendered completely once can later be served by reading
+ * the cache file instead of running the emulator again.
+ *
+ * Only 16 bit samples are supported.
+ */
+class RenderCache {
+	AllocatedPath directory = AllocatedPath::Null();
+
+	/**
+	 * The maximum total size of all cache files [bytes]; 0 means
+	 * no limit.
+	 */
+	uint64_t max_size = uint64_t(1024) * 1024 * 1024;
+
+	/**
+	 * Protects #total_size.
+	 */
+	Mutex mutex;
+
+	/**
+	 * The total size of all cache files [bytes] as of the last
+	 * Prune(), plus the files committed since then.  Files
+	 * written by other #RenderCache objects sharing the directory
+	 * are only seen by the next Prune(), so this is a lower
+	 * bound.  -1 means it has not been determined yet.
+	 */
+	uint64_t total_size = uint64_t(-1);
+
+public:
+	/**
+	 * Read the "render_cache_directory" and "render_cache_size"
+	 * settings from the decoder block.
+	 *
+	 * Throws std::runtime_error on error.
+	 */
+	void Configure(const ConfigBlock &block);
+
+	bool IsDefined() const noexcept {
+		return !directory.IsNull();
+	}
+
+	/**
+	 * Determine the cache file for the given song.  The entry is
+	 * undefined if caching is disabled or the song file cannot be
+	 * accessed.
+	 *
+	 * @param settings a string describing all plugin settings
+	 * and other files (see AppendFileStamp()) which affect the
+	 * output
+	 */
+	gcc_pure
+	RenderCacheEntry Lookup(Path path_fs, unsigned track,
+				const char *settings) const noexcept;
+
+	/**
+	 * Play the song from the given cache file, and mark it as
+	 * recently used, so Prune() deletes it last.  Seeking is
+	 * supported.
+	 *
+	 * @return false if the file does not exist or is not usable;
+	 * true if DecoderClient::Ready() has been called, even if
+	 * reading the file failed later
+	 */
+	static bool Play(DecoderClient &client,
+			 const RenderCacheEntry &entry);
+
+	/**
+	 * Account for a new cache file, and call Prune() if the total
+	 * size exceeds the configured limit.  The directory is
+	 * scanned only then (and on the first call), not after each
+	 * file.
+	 */
+	void Add(uint64_t size) noexcept;
+
+private:
+	/**
+	 * If the total size of the cache files exceeds the configured
+	 * limit, delete the least recently used ones until it is
+	 * below the given target.  Errors are logged.
+	 *
+	 * @return the remaining total size
+	 */
+	uint64_t Prune(uint64_t target) noexcept;
+};
+
+/**
+ * Append the size and modification time of the given file to a
+ * #RenderCache key, for songs whose output depends
+ * on other files, e.g. a playlist or a library.  A missing file is
+ * recorded, too.
+ */
+void
+AppendFileStamp(std::string &dest, Path path_fs) noexcept;
+
+/**
+ * Writes the PCM data produced by the decoder plugin to a new cache
+ * file.  The file becomes visible only after Commit(), which must be
+ * called only if the whole song was rendered without seeking.
+ */
+class RenderCacheWriter {
+	RenderCache &cache;
+
+	std::unique_ptr<FileOutputStream> file;
+
+	/**
+	 * The number of bytes written so far.
+	 */
+	uint64_t size;
+
+public:
+	/**
+	 * @param _cache the #RenderCache which the new file is added
+	 * to by Commit()
+	 * @param entry the return value of RenderCache::Lookup(); if
+	 * undefined, this object does nothing
+	 */
+	RenderCacheWriter(RenderCache &_cache, const RenderCacheEntry &entry,
+			  AudioFormat audio_format) noexcept;
+	~RenderCacheWriter();
+
+	RenderCacheWriter(const RenderCacheWriter &) = delete;
+	RenderCacheWriter &operator=(const RenderCacheWriter &) = delete;
+
+	void Append(const void *data, size_t size) noexcept;
+
+	/**
+	 * Discard the file, e.g. because the song was seeked.
+	 */
+	void Cancel() noexcept;
+
+	void Commit() noexcept;
+};
+
+#endif
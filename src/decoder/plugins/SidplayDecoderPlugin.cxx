@@ -20,11 +20,14 @@
 #include "config.h"
 #include "SidplayDecoderPlugin.hxx"
 #include "../DecoderAPI.hxx"
+#include "RenderCache.hxx"
+#include "LoadInputStream.hxx"
 #include "tag/TagHandler.hxx"
 #include "tag/TagBuilder.hxx"
 #include "DetachedSong.hxx"
 #include "fs/Path.hxx"
 #include "fs/AllocatedPath.hxx"
+#include "input/InputStream.hxx"
 #include "util/Macros.hxx"
 #include "util/StringFormat.hxx"
 #include "util/Domain.hxx"
@@ -47,6 +50,8 @@
 #include <sidplay/utils/SidDatabase.h>
 #endif
 
+#include <algorithm>
+
 #include <string.h>
 #include <stdio.h>
 
@@ -58,6 +63,27 @@
 
 static constexpr Domain sidplay_domain("sidplay");
 
+static constexpr size_t SIDPLAY_BUFFER_SAMPLES = 4096;
+
+/**
+ * The maximum size of a file loaded from an #InputStream.
+ */
+static constexpr size_t SIDPLAY_FILE_LIMIT = 1024 * 1024;
+
+#ifdef HAVE_SIDPLAYFP
+typedef SidTune SidplayTune;
+#else
+typedef SidTuneMod SidplayTune;
+#endif
+
+#ifdef HAVE_SIDPLAYFP
+/**
+ * The fast-forward factor (in percent) used while seeking.  3200 is
+ * the maximum supported by libsidplayfp.
+ */
+static constexpr unsigned SIDPLAY_SEEK_FAST_FORWARD = 3200;
+#endif
+
 static SidDatabase *songlength_database;
 
 static bool all_files_are_containers;
@@ -65,6 +91,8 @@ static unsigned default_songlength;
 
 static bool filter_setting;
 
+static RenderCache sidplay_render_cache;
+
 static SidDatabase *
 sidplay_load_songlength_db(const Path path)
 {
@@ -100,6 +128,8 @@ sidplay_init(const ConfigBlock &block)
 
 	filter_setting = block.GetBlockValue("filter", true);
 
+	sidplay_render_cache.Configure(block);
+
 	return true;
 }
 
@@ -167,37 +197,63 @@ get_song_length(T &tune)
 	return SignedSongTime::FromS(length);
 }
 
+/**
+ * Load a tune from an #InputStream.  Check tune.getStatus()
+ * afterwards.
+ *
+ * @param client the decoder client; nullptr while scanning
+ */
 static void
-sidplay_file_decode(DecoderClient &client, Path path_fs)
+LoadSidplayTune(SidplayTune &tune, DecoderClient *client, InputStream &is)
 {
-	int channels;
+	const auto data = LoadInputStream(client, is, SIDPLAY_FILE_LIMIT);
+	if (data.IsNull())
+		return;
 
-	/* load the tune */
+	tune.read(data.begin(), data.size());
+}
 
-	const auto container = ParseContainerPath(path_fs);
-#ifdef HAVE_SIDPLAYFP
-	SidTune tune(container.path.c_str());
-#else
-	SidTuneMod tune(container.path.c_str());
-#endif
-	if (!tune.getStatus()) {
+static void
+LogSidplayTuneError(SidplayTune &tune)
+{
 #ifdef HAVE_SIDPLAYFP
-		const char *error = tune.statusString();
+	const char *error = tune.statusString();
 #else
-		const char *error = tune.getInfo().statusString;
+	const char *error = tune.getInfo().statusString;
 #endif
-		FormatWarning(sidplay_domain, "failed to load file: %s",
-			      error);
-		return;
-	}
+	FormatWarning(sidplay_domain, "failed to load file: %s",
+		      error);
+}
+
+/**
+ * Play one song of a loaded tune.
+ *
+ * @param path_fs the path of the file, for the #RenderCache; "null"
+ * if it was not loaded from the local file system
+ */
+static void
+SidplayDecode(DecoderClient &client, SidplayTune &tune, int song_num,
+	      Path path_fs)
+{
+	int channels;
 
-	const int song_num = container.track;
 	tune.selectSong(song_num);
 
 	auto duration = get_song_length(tune);
 	if (duration.IsNegative() && default_songlength > 0)
 		duration = SongTime::FromS(default_songlength);
 
+	/* only songs with a known length end by themselves and can
+	   be cached */
+	const auto cache_entry = !duration.IsNegative() && !path_fs.IsNull()
+		? sidplay_render_cache.Lookup(path_fs, song_num,
+					      StringFormat<64>("sidplay:%d:%u",
+							       (int)filter_setting,
+							       (unsigned)duration.ToMS()))
+		: RenderCacheEntry();
+	if (RenderCache::Play(client, cache_entry))
+		return;
+
 	/* initialize the player */
 
 #ifdef HAVE_SIDPLAYFP
@@ -332,6 +388,9 @@ sidplay_file_decode(DecoderClient &client, Path path_fs)
 
 	client.Ready(audio_format, true, duration);
 
+	RenderCacheWriter cache_writer(sidplay_render_cache, cache_entry,
+				       audio_format);
+
 	/* .. and play */
 
 #ifdef HAVE_SIDPLAYFP
@@ -345,9 +404,14 @@ sidplay_file_decode(DecoderClient &client, Path path_fs)
 
 	DecoderCommand cmd;
 	do {
-		short buffer[4096];
-
-		const auto result = player.play(buffer, ARRAY_SIZE(buffer));
+		/* render right into the music chunk */
+		const auto dest = client.GetDataBuffer();
+		short *buffer = (short *)dest.data;
+
+		const auto result =
+			player.play(buffer,
+				    std::min<size_t>(dest.size / sizeof(*buffer),
+						     SIDPLAY_BUFFER_SAMPLES));
 		if (result <= 0)
 			break;
 
@@ -361,9 +425,13 @@ sidplay_file_decode(DecoderClient &client, Path path_fs)
 
 		client.SubmitTimestamp((double)player.time() / timebase);
 
-		cmd = client.SubmitData(nullptr, buffer, nbytes, 0);
+		cache_writer.Append(buffer, nbytes);
+
+		cmd = client.CommitData(nullptr, nbytes, 0);
 
 		if (cmd == DecoderCommand::SEEK) {
+			cache_writer.Cancel();
+
 			unsigned data_time = player.time();
 			unsigned target_time =
 				client.GetSeekTime().ToScale(timebase);
@@ -374,20 +442,72 @@ sidplay_file_decode(DecoderClient &client, Path path_fs)
 				data_time=0;
 			}
 
+#ifdef HAVE_SIDPLAYFP
+			/* skip the filter and decimate the mixer output
+			   while fast-forwarding; nobody hears these
+			   samples */
+			if (data_time < target_time) {
+				if (filter_setting)
+					builder.filter(false);
+				player.fastForward(SIDPLAY_SEEK_FAST_FORWARD);
+			}
+#endif
+
 			/* ignore data until target time is reached */
+			short discard[SIDPLAY_BUFFER_SAMPLES];
 			while (data_time < target_time &&
-			       player.play(buffer, ARRAY_SIZE(buffer)) > 0)
+			       player.play(discard, ARRAY_SIZE(discard)) > 0)
 				data_time = player.time();
 
+#ifdef HAVE_SIDPLAYFP
+			player.fastForward(100);
+			if (filter_setting)
+				builder.filter(true);
+#endif
+
 			client.CommandFinished();
 		}
 
-		if (end > 0 && player.time() >= end)
+		if (end > 0 && player.time() >= end) {
+			cache_writer.Commit();
 			break;
+		}
 
 	} while (cmd != DecoderCommand::STOP);
 }
 
+static void
+sidplay_file_decode(DecoderClient &client, Path path_fs)
+{
+	/* load the tune */
+
+	const auto container = ParseContainerPath(path_fs);
+	SidplayTune tune(container.path.c_str());
+	if (!tune.getStatus()) {
+		LogSidplayTuneError(tune);
+		return;
+	}
+
+	SidplayDecode(client, tune, container.track, container.path);
+}
+
+/**
+ * Play a file which is not in the local file system.  Such a URI
+ * cannot address a subtune, so this always plays the first song.
+ */
+static void
+sidplay_stream_decode(DecoderClient &client, InputStream &is)
+{
+	SidplayTune tune(nullptr);
+	LoadSidplayTune(tune, &client, is);
+	if (!tune.getStatus()) {
+		LogSidplayTuneError(tune);
+		return;
+	}
+
+	SidplayDecode(client, tune, 1, Path::Null());
+}
+
 gcc_pure
 static const char *
 GetInfoString(const SidTuneInfo &info, unsigned i) noexcept
@@ -438,21 +558,10 @@ ScanSidTuneInfo(const SidTuneInfo &info, unsigned track, unsigned n_tracks,
 			       StringFormat<16>("%u", track));
 }
 
-static bool
-sidplay_scan_file(Path path_fs,
-		  const TagHandler &handler, void *handler_ctx)
+static void
+ScanSidplayTune(SidplayTune &tune, unsigned song_num,
+		const TagHandler &handler, void *handler_ctx)
 {
-	const auto container = ParseContainerPath(path_fs);
-	const unsigned song_num = container.track;
-
-#ifdef HAVE_SIDPLAYFP
-	SidTune tune(container.path.c_str());
-#else
-	SidTuneMod tune(container.path.c_str());
-#endif
-	if (!tune.getStatus())
-		return false;
-
 	tune.selectSong(song_num);
 
 #ifdef HAVE_SIDPLAYFP
@@ -470,7 +579,32 @@ sidplay_scan_file(Path path_fs,
 	if (!duration.IsNegative())
 		tag_handler_invoke_duration(handler, handler_ctx,
 					    SongTime(duration));
+}
+
+static bool
+sidplay_scan_file(Path path_fs,
+		  const TagHandler &handler, void *handler_ctx)
+{
+	const auto container = ParseContainerPath(path_fs);
+
+	SidplayTune tune(container.path.c_str());
+	if (!tune.getStatus())
+		return false;
+
+	ScanSidplayTune(tune, container.track, handler, handler_ctx);
+	return true;
+}
+
+static bool
+sidplay_scan_stream(InputStream &is,
+		    const TagHandler &handler, void *handler_ctx)
+{
+	SidplayTune tune(nullptr);
+	LoadSidplayTune(tune, nullptr, is);
+	if (!tune.getStatus())
+		return false;
 
+	ScanSidplayTune(tune, 1, handler, handler_ctx);
 	return true;
 }
 
@@ -534,10 +668,10 @@ const struct DecoderPlugin sidplay_decoder_plugin = {
 	"sidplay",
 	sidplay_init,
 	sidplay_finish,
-	nullptr, /* stream_decode() */
+	sidplay_stream_decode,
 	sidplay_file_decode,
 	sidplay_scan_file,
-	nullptr, /* stream_tag() */
+	sidplay_scan_stream,
 	sidplay_container_scan,
 	sidplay_suffixes,
 	nullptr, /* mime_types */
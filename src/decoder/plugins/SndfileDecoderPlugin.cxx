@@ -332,4 +332,5 @@ const struct DecoderPlugin sndfile_decoder_plugin = {
 	nullptr,
 	sndfile_suffixes,
 	sndfile_mime_types,
+	true,
 };
@@ -631,5 +631,6 @@ const struct DecoderPlugin wavpack_decoder_plugin = {
 	wavpack_scan_stream,
 	nullptr,
 	wavpack_suffixes,
-	wavpack_mime_types
+	wavpack_mime_types,
+	true,
 };
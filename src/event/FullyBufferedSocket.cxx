@@ -101,6 +101,12 @@ FullyBufferedSocket::OnSocketReady(unsigned flags)
 
 		if (!Flush())
 			return false;
+
+		if (output.IsEmpty() && !OnOutputEmpty())
+			/* we must return "true" here or
+			   SocketMonitor::Dispatch() will call
+			   Cancel() on a freed object */
+			return true;
 	}
 
 	if (!BufferedSocket::OnSocketReady(flags))
@@ -112,6 +118,11 @@ FullyBufferedSocket::OnSocketReady(unsigned flags)
 void
 FullyBufferedSocket::OnIdle()
 {
-	if (Flush() && !output.IsEmpty())
+	if (!Flush())
+		return;
+
+	if (output.IsEmpty())
+		OnOutputEmpty();
+	else
 		ScheduleWrite();
 }
@@ -61,6 +61,16 @@ protected:
 	 */
 	bool Write(const void *data, size_t length);
 
+	/**
+	 * The output buffer has been flushed completely.  This is a
+	 * chance to generate more output with Write().
+	 *
+	 * @return false if the socket has been closed
+	 */
+	virtual bool OnOutputEmpty() {
+		return true;
+	}
+
 	virtual bool OnSocketReady(unsigned flags) override;
 	virtual void OnIdle() override;
 };
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_OUTPUT_CHUNK_FILTER_HXX
+#define MPD_OUTPUT_CHUNK_FILTER_HXX
+
+#include "check.h"
+#include "AudioFormat.hxx"
+#include "ReplayGainMode.hxx"
+#include "pcm/PcmBuffer.hxx"
+#include "pcm/PcmDither.hxx"
+#include "util/ConstBuffer.hxx"
+
+#include <assert.h>
+
+struct MusicChunk;
+class Filter;
+class PreparedFilter;
+
+/**
+ * Applies ReplayGain, cross-fading and a filter chain to
+ * #MusicChunk objects.
+ */
+class ChunkFilter {
+	/**
+	 * The audio_format of the #MusicChunk objects.
+	 */
+	AudioFormat in_audio_format;
+
+	/**
+	 * The serial number of the last replay gain info.  0 means no
+	 * replay gain info was available.
+	 */
+	unsigned replay_gain_serial;
+
+	/**
+	 * The serial number of the last replay gain info by the
+	 * "other" chunk during cross-fading.
+	 */
+	unsigned other_replay_gain_serial;
+
+	/**
+	 * The replay_gain_filter_plugin instance.
+	 */
+	Filter *replay_gain_filter_instance = nullptr;
+
+	/**
+	 * The replay_gain_filter_plugin instance to be applied to
+	 * the second chunk during cross-fading.
+	 */
+	Filter *other_replay_gain_filter_instance = nullptr;
+
+	/**
+	 * The buffer used to allocate the cross-fading result.
+	 */
+	PcmBuffer cross_fade_buffer;
+
+	/**
+	 * The dithering state for cross-fading two streams.
+	 */
+	PcmDither cross_fade_dither;
+
+	/**
+	 * The filter chain.
+	 */
+	Filter *filter_instance = nullptr;
+
+public:
+	ChunkFilter() = default;
+	ChunkFilter(const ChunkFilter &) = delete;
+	ChunkFilter &operator=(const ChunkFilter &) = delete;
+
+	~ChunkFilter() {
+		Close();
+	}
+
+	bool IsOpen() const {
+		return filter_instance != nullptr;
+	}
+
+	/**
+	 * Throws #std::runtime_error on error.
+	 */
+	void Open(AudioFormat audio_format,
+		  PreparedFilter *prepared_replay_gain_filter,
+		  PreparedFilter *prepared_other_replay_gain_filter,
+		  PreparedFilter &prepared_filter);
+
+	void Close() noexcept;
+
+	/**
+	 * Reset the state of all filters, e.g. after seeking.
+	 */
+	void Reset() noexcept;
+
+	gcc_pure
+	AudioFormat GetOutAudioFormat() const noexcept;
+
+	/**
+	 * Throws #std::runtime_error on error.
+	 *
+	 * @return the filtered data; it is valid until the next
+	 * call
+	 */
+	ConstBuffer<void> FilterChunk(const MusicChunk &chunk,
+				      ReplayGainMode replay_gain_mode);
+
+private:
+	ConstBuffer<void> GetChunkData(const MusicChunk &chunk,
+				       Filter *replay_gain_filter,
+				       ReplayGainMode replay_gain_mode,
+				       unsigned *replay_gain_serial_p);
+};
+
+#endif
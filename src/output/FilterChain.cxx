@@ -0,0 +1,58 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "FilterChain.hxx"
+#include "filter/FilterPlugin.hxx"
+#include "filter/FilterRegistry.hxx"
+#include "filter/FilterConfig.hxx"
+#include "filter/Observer.hxx"
+#include "filter/plugins/AutoConvertFilterPlugin.hxx"
+#include "filter/plugins/ChainFilterPlugin.hxx"
+#include "config/ConfigGlobal.hxx"
+#include "config/ConfigOption.hxx"
+#include "config/Block.hxx"
+
+#include <assert.h>
+
+void
+BuildOutputFilterChain(PreparedFilter &chain, const char *filters)
+{
+	/* create the normalization filter (if configured) */
+
+	if (config_get_bool(ConfigOption::VOLUME_NORMALIZATION, false)) {
+		auto *normalize_filter =
+			filter_new(&normalize_filter_plugin, ConfigBlock());
+		assert(normalize_filter != nullptr);
+
+		filter_chain_append(chain, "normalize",
+				    autoconvert_filter_new(normalize_filter));
+	}
+
+	filter_chain_parse(chain, filters);
+}
+
+void
+AppendConvertFilter(PreparedFilter &chain, FilterObserver &convert_filter)
+{
+	auto *f = filter_new(&convert_filter_plugin, ConfigBlock());
+	assert(f != nullptr);
+
+	filter_chain_append(chain, "convert", convert_filter.Set(f));
+}
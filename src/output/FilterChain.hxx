@@ -0,0 +1,45 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_OUTPUT_FILTER_CHAIN_HXX
+#define MPD_OUTPUT_FILTER_CHAIN_HXX
+
+class PreparedFilter;
+class FilterObserver;
+
+/**
+ * Append the configurable filters of an audio output to the given
+ * (empty) chain: the "normalize" filter (if "volume_normalization"
+ * is enabled) and the output's "filters" setting.  Used by
+ * #AudioOutput and #SharedFilter, which must build the same chain.
+ *
+ * Throws #std::runtime_error if the "filters" setting is invalid;
+ * the filters parsed until then remain in the chain.
+ */
+void
+BuildOutputFilterChain(PreparedFilter &chain, const char *filters);
+
+/**
+ * Append the "convert" filter, which must be the last one in the
+ * chain of an audio output.
+ */
+void
+AppendConvertFilter(PreparedFilter &chain, FilterObserver &convert_filter);
+
+#endif
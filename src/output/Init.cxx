@@ -20,17 +20,18 @@
 #include "config.h"
 #include "Internal.hxx"
 #include "Registry.hxx"
+#include "FilterChain.hxx"
+#include "SharedFilter.hxx"
 #include "Domain.hxx"
 #include "OutputAPI.hxx"
-#include "filter/FilterConfig.hxx"
 #include "AudioParser.hxx"
 #include "mixer/MixerList.hxx"
 #include "mixer/MixerType.hxx"
 #include "mixer/MixerControl.hxx"
+#include "mixer/MixerInternal.hxx"
 #include "mixer/plugins/SoftwareMixerPlugin.hxx"
 #include "filter/FilterPlugin.hxx"
 #include "filter/FilterRegistry.hxx"
-#include "filter/plugins/AutoConvertFilterPlugin.hxx"
 #include "filter/plugins/ReplayGainFilterPlugin.hxx"
 #include "filter/plugins/ChainFilterPlugin.hxx"
 #include "config/ConfigError.hxx"
@@ -182,20 +183,9 @@ AudioOutput::Configure(const ConfigBlock &block)
 	prepared_filter = filter_chain_new();
 	assert(prepared_filter != nullptr);
 
-	/* create the normalization filter (if configured) */
-
-	if (config_get_bool(ConfigOption::VOLUME_NORMALIZATION, false)) {
-		auto *normalize_filter =
-			filter_new(&normalize_filter_plugin, ConfigBlock());
-		assert(normalize_filter != nullptr);
-
-		filter_chain_append(*prepared_filter, "normalize",
-				    autoconvert_filter_new(normalize_filter));
-	}
-
 	try {
-		filter_chain_parse(*prepared_filter,
-				   block.GetBlockValue(AUDIO_FILTERS, ""));
+		BuildOutputFilterChain(*prepared_filter,
+				       block.GetBlockValue(AUDIO_FILTERS, ""));
 	} catch (const std::runtime_error &e) {
 		/* It's not really fatal - Part of the filter chain
 		   has been set up already and even an empty one will
@@ -260,11 +250,17 @@ AudioOutput::Setup(EventLoop &event_loop,
 
 	/* the "convert" filter must be the last one in the chain */
 
-	auto *f = filter_new(&convert_filter_plugin, ConfigBlock());
-	assert(f != nullptr);
+	AppendConvertFilter(*prepared_filter, convert_filter);
+
+	/* outputs with the same filter settings share one filter
+	   chain, unless it depends on this output's mixer */
 
-	filter_chain_append(*prepared_filter, "convert",
-			    convert_filter.Set(f));
+	if (strcmp(replay_gain_handler, "mixer") != 0 &&
+	    (mixer == nullptr || !mixer->IsPlugin(software_mixer_plugin)))
+		shared_filter_config =
+			&SharedFilter::Register(replay_gain_config,
+						prepared_replay_gain_filter != nullptr,
+						block.GetBlockValue(AUDIO_FILTERS, ""));
 }
 
 AudioOutput *
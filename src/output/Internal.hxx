@@ -41,6 +41,7 @@ struct MusicChunk;
 struct ConfigBlock;
 struct AudioOutputPlugin;
 struct ReplayGainConfig;
+struct SharedFilterConfig;
 
 struct AudioOutput {
 	enum class Command {
@@ -209,6 +210,14 @@ struct AudioOutput {
 	 */
 	FilterObserver convert_filter;
 
+	/**
+	 * The filter settings of this output, for sharing the filter
+	 * chain with other outputs (see #SharedFilter).  nullptr if
+	 * the chain cannot be shared, because it depends on this
+	 * output's mixer.
+	 */
+	const SharedFilterConfig *shared_filter_config = nullptr;
+
 	/**
 	 * The thread handle, or nullptr if the output thread isn't
 	 * running.
@@ -155,6 +155,18 @@ AudioOutput::Open()
 		}
 	}
 
+	if (shared_filter_config != nullptr) {
+		try {
+			source.SetSharedFilter(*shared_filter_config,
+					       out_audio_format);
+		} catch (const std::runtime_error &e) {
+			/* not fatal: this output keeps using its own
+			   filter chain */
+			FormatError(e, "Failed to share the filter of \"%s\" [%s]",
+				    name, plugin.name);
+		}
+	}
+
 	if (f != source.GetInputAudioFormat() || f != out_audio_format)
 		FormatDebug(output_domain, "converting in=%s -> f=%s -> out=%s",
 			    ToString(source.GetInputAudioFormat()).c_str(),
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "SharedFilter.hxx"
+#include "FilterChain.hxx"
+#include "Domain.hxx"
+#include "MusicChunk.hxx"
+#include "filter/FilterInternal.hxx"
+#include "filter/plugins/ChainFilterPlugin.hxx"
+#include "filter/plugins/ConvertFilterPlugin.hxx"
+#include "filter/plugins/ReplayGainFilterPlugin.hxx"
+#include "AudioFormat.hxx"
+#include "util/StringBuffer.hxx"
+#include "Log.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <forward_list>
+#include <list>
+#include <string>
+
+#include <assert.h>
+
+struct SharedFilterConfig {
+	const ReplayGainConfig &replay_gain_config;
+
+	const bool replay_gain;
+
+	const std::string filters;
+
+	/**
+	 * The number of outputs which have registered these
+	 * settings.
+	 */
+	unsigned n_outputs = 0;
+
+	SharedFilterConfig(const ReplayGainConfig &_replay_gain_config,
+			   bool _replay_gain, const char *_filters)
+		:replay_gain_config(_replay_gain_config),
+		 replay_gain(_replay_gain), filters(_filters) {}
+};
+
+/**
+ * All settings passed to SharedFilter::Register().  This is only
+ * modified by the main thread, before the output threads start.
+ */
+static std::forward_list<SharedFilterConfig> shared_filter_configs;
+
+/**
+ * Protects #shared_filters and SharedFilter::refs.
+ */
+static Mutex shared_filters_mutex;
+
+static std::list<SharedFilter *> shared_filters;
+
+static std::atomic<uint64_t> shared_filter_next_id(1);
+
+SharedFilterConfig &
+SharedFilter::Register(const ReplayGainConfig &replay_gain_config,
+		       bool replay_gain, const char *filters)
+{
+	auto i = std::find_if(shared_filter_configs.begin(),
+			      shared_filter_configs.end(),
+			      [&](const SharedFilterConfig &c){
+				      return &c.replay_gain_config == &replay_gain_config &&
+					      c.replay_gain == replay_gain &&
+					      c.filters == filters;
+			      });
+	if (i == shared_filter_configs.end()) {
+		shared_filter_configs.emplace_front(replay_gain_config,
+						    replay_gain, filters);
+		i = shared_filter_configs.begin();
+	}
+
+	++i->n_outputs;
+	return *i;
+}
+
+SharedFilter::SharedFilter(const SharedFilterConfig &_config,
+			   AudioFormat _in_audio_format,
+			   AudioFormat _out_audio_format,
+			   ReplayGainMode _replay_gain_mode)
+	:config(_config),
+	 in_audio_format(_in_audio_format),
+	 out_audio_format(_out_audio_format),
+	 replay_gain_mode(_replay_gain_mode),
+	 id(shared_filter_next_id.fetch_add(1, std::memory_order_relaxed))
+{
+	/* build the same filter chain as AudioOutput::Configure()
+	   and AudioOutput::Setup() */
+
+	try {
+		if (config.replay_gain) {
+			prepared_replay_gain_filter =
+				NewReplayGainFilter(config.replay_gain_config);
+			prepared_other_replay_gain_filter =
+				NewReplayGainFilter(config.replay_gain_config);
+		}
+
+		prepared_filter = filter_chain_new();
+		BuildOutputFilterChain(*prepared_filter,
+				       config.filters.c_str());
+		AppendConvertFilter(*prepared_filter, convert_filter);
+
+		filter.Open(in_audio_format,
+			    prepared_replay_gain_filter,
+			    prepared_other_replay_gain_filter,
+			    *prepared_filter);
+
+		convert_filter_set(convert_filter.Get(), out_audio_format);
+	} catch (...) {
+		filter.Close();
+		delete prepared_replay_gain_filter;
+		delete prepared_other_replay_gain_filter;
+		delete prepared_filter;
+		throw;
+	}
+}
+
+SharedFilter::~SharedFilter()
+{
+	filter.Close();
+
+	delete prepared_replay_gain_filter;
+	delete prepared_other_replay_gain_filter;
+	delete prepared_filter;
+}
+
+SharedFilter *
+SharedFilter::Get(const SharedFilterConfig &config,
+		  AudioFormat in_audio_format,
+		  AudioFormat out_audio_format,
+		  ReplayGainMode replay_gain_mode)
+{
+	if (config.n_outputs < 2)
+		return nullptr;
+
+	const std::lock_guard<Mutex> protect(shared_filters_mutex);
+
+	for (auto *i : shared_filters) {
+		if (i->Equals(config, in_audio_format, out_audio_format,
+			      replay_gain_mode)) {
+			if (i->refs.fetch_add(1, std::memory_order_relaxed) == 1) {
+				/* a second output attaches; the filter
+				   was idle while the first one used
+				   its own chain, so its state is
+				   stale */
+				i->Cancel();
+
+				FormatDebug(output_domain,
+					    "sharing filter in=%s -> out=%s",
+					    ToString(in_audio_format).c_str(),
+					    ToString(out_audio_format).c_str());
+			}
+
+			return i;
+		}
+	}
+
+	auto *f = new SharedFilter(config, in_audio_format, out_audio_format,
+				   replay_gain_mode);
+	shared_filters.push_back(f);
+	return f;
+}
+
+void
+SharedFilter::Put() noexcept
+{
+	const std::lock_guard<Mutex> protect(shared_filters_mutex);
+
+	assert(refs.load(std::memory_order_relaxed) > 0);
+	if (refs.fetch_sub(1, std::memory_order_relaxed) > 1)
+		return;
+
+	shared_filters.remove(this);
+	delete this;
+}
+
+void
+SharedFilter::Cancel() noexcept
+{
+	const std::lock_guard<Mutex> protect(mutex);
+	reset_pending = true;
+}
+
+ConstBuffer<void>
+SharedFilter::FilterChunk(const MusicChunk &chunk)
+{
+	/* fast path without locking: another output has already
+	   filtered this chunk */
+	const FilteredChunk *f = chunk.FindFiltered(id);
+	if (f != nullptr)
+		return f->GetData();
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	f = chunk.FindFiltered(id);
+	if (f != nullptr)
+		return f->GetData();
+
+	if (reset_pending) {
+		/* this is the first chunk after a seek */
+		filter.Reset();
+		reset_pending = false;
+	}
+
+	return chunk.AddFiltered(id, filter.FilterChunk(chunk,
+							replay_gain_mode))
+		.GetData();
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_OUTPUT_SHARED_FILTER_HXX
+#define MPD_OUTPUT_SHARED_FILTER_HXX
+
+#include "ChunkFilter.hxx"
+#include "filter/Observer.hxx"
+#include "thread/Mutex.hxx"
+#include "Compiler.h"
+
+#include <atomic>
+
+#include <stdint.h>
+
+struct MusicChunk;
+struct ReplayGainConfig;
+struct SharedFilterConfig;
+class PreparedFilter;
+
+/**
+ * The filters of all #AudioOutputSource instances which have the
+ * same filter settings (see Register()), the same input and output
+ * #AudioFormat and the same #ReplayGainMode.  Each #MusicChunk is
+ * filtered (and converted) only once; the result is attached to the
+ * chunk, where the other outputs find it.
+ *
+ * This is only used while more than one output is attached (see
+ * IsShared()); a single output filters with its own chain, which
+ * saves copying the data.
+ *
+ * The filters are stateful (e.g. the resampler), so the chunks must
+ * be filtered in the order of the #MusicPipe; the first output to
+ * reach a chunk filters it.
+ */
+class SharedFilter {
+	const SharedFilterConfig &config;
+	const AudioFormat in_audio_format, out_audio_format;
+
+	const ReplayGainMode replay_gain_mode;
+
+	/**
+	 * A unique number for FilteredChunk::filter_id.
+	 */
+	const uint64_t id;
+
+	/**
+	 * The number of #AudioOutputSource instances using this
+	 * object.  Modified only while holding the global registry
+	 * mutex, but IsShared() reads it without.
+	 */
+	std::atomic<unsigned> refs{1};
+
+	/**
+	 * Protects #filter and #reset_pending.
+	 */
+	Mutex mutex;
+
+	PreparedFilter *prepared_replay_gain_filter = nullptr;
+	PreparedFilter *prepared_other_replay_gain_filter = nullptr;
+	PreparedFilter *prepared_filter = nullptr;
+	FilterObserver convert_filter;
+
+	ChunkFilter filter;
+
+	/**
+	 * Has Cancel() been called since the last chunk was
+	 * filtered?
+	 */
+	bool reset_pending = false;
+
+	SharedFilter(const SharedFilterConfig &_config,
+		     AudioFormat _in_audio_format,
+		     AudioFormat _out_audio_format,
+		     ReplayGainMode _replay_gain_mode);
+
+	~SharedFilter();
+
+public:
+	SharedFilter(const SharedFilter &) = delete;
+	SharedFilter &operator=(const SharedFilter &) = delete;
+
+	/**
+	 * Register an output which uses the given filter settings.
+	 * Must be called in the main thread, while the outputs are
+	 * being configured.
+	 *
+	 * @param replay_gain_config the #ReplayGainConfig which must
+	 * live as long as the outputs
+	 * @param replay_gain true if the output applies software
+	 * ReplayGain
+	 * @param filters the "filters" setting of the output
+	 * @return a handle to be passed to Get()
+	 */
+	static SharedFilterConfig &Register(const ReplayGainConfig &replay_gain_config,
+					    bool replay_gain,
+					    const char *filters);
+
+	/**
+	 * Obtain the instance for the given settings and formats,
+	 * and create one if none exists yet.  Returns nullptr if no
+	 * other output has registered the same filter settings,
+	 * because then there is nothing to share.  This method is
+	 * thread-safe.
+	 *
+	 * Throws #std::runtime_error on error.
+	 */
+	static SharedFilter *Get(const SharedFilterConfig &config,
+				 AudioFormat in_audio_format,
+				 AudioFormat out_audio_format,
+				 ReplayGainMode replay_gain_mode);
+
+	/**
+	 * Release a reference obtained by Get().  This method is
+	 * thread-safe.
+	 */
+	void Put() noexcept;
+
+	const SharedFilterConfig &GetConfig() const noexcept {
+		return config;
+	}
+
+	AudioFormat GetOutAudioFormat() const noexcept {
+		return out_audio_format;
+	}
+
+	ReplayGainMode GetReplayGainMode() const noexcept {
+		return replay_gain_mode;
+	}
+
+	gcc_pure
+	bool Equals(const SharedFilterConfig &other_config,
+		    AudioFormat other_in_audio_format,
+		    AudioFormat other_out_audio_format,
+		    ReplayGainMode other_replay_gain_mode) const noexcept {
+		return &config == &other_config &&
+			in_audio_format == other_in_audio_format &&
+			out_audio_format == other_out_audio_format &&
+			replay_gain_mode == other_replay_gain_mode;
+	}
+
+	/**
+	 * Is more than one #AudioOutputSource attached?  Only then
+	 * should FilterChunk() be used.  This method is thread-safe,
+	 * but the result may be outdated immediately.
+	 */
+	gcc_pure
+	bool IsShared() const noexcept {
+		return refs.load(std::memory_order_relaxed) > 1;
+	}
+
+	/**
+	 * The outputs have been canceled (e.g. because the player
+	 * seeks); discard the filter state before the next chunk.
+	 * Each #AudioOutputSource calls this; the calls are collapsed
+	 * into one reset.  This method is thread-safe.
+	 */
+	void Cancel() noexcept;
+
+	/**
+	 * Returns the filtered data of the given chunk; it is valid
+	 * as long as the chunk lives.  This method is thread-safe.
+	 *
+	 * Throws #std::runtime_error on error.
+	 */
+	ConstBuffer<void> FilterChunk(const MusicChunk &chunk);
+};
+
+#endif
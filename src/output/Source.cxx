@@ -19,15 +19,13 @@
 
 #include "config.h"
 #include "Source.hxx"
+#include "SharedFilter.hxx"
 #include "MusicChunk.hxx"
-#include "filter/FilterInternal.hxx"
-#include "filter/plugins/ReplayGainFilterPlugin.hxx"
-#include "pcm/PcmMix.hxx"
 #include "thread/Mutex.hxx"
 #include "util/ConstBuffer.hxx"
-#include "util/RuntimeError.hxx"
+#include "Log.hxx"
 
-#include <string.h>
+#include <stdexcept>
 
 AudioFormat
 AudioOutputSource::Open(AudioFormat audio_format, const MusicPipe &_pipe,
@@ -42,21 +40,20 @@ AudioOutputSource::Open(AudioFormat audio_format, const MusicPipe &_pipe,
 
 	/* (re)open the filter */
 
-	if (filter_instance != nullptr &&
-	    audio_format != in_audio_format)
+	if (filter.IsOpen() && audio_format != in_audio_format)
 		/* the filter must be reopened on all input format
 		   changes */
 		CloseFilter();
 
-	if (filter_instance == nullptr)
+	if (!filter.IsOpen())
 		/* open the filter */
-		OpenFilter(audio_format,
-			   prepared_replay_gain_filter,
-			   prepared_other_replay_gain_filter,
-			   prepared_filter);
+		filter.Open(audio_format,
+			    prepared_replay_gain_filter,
+			    prepared_other_replay_gain_filter,
+			    *prepared_filter);
 
 	in_audio_format = audio_format;
-	return filter_instance->GetOutAudioFormat();
+	return filter.GetOutAudioFormat();
 }
 
 void
@@ -65,6 +62,10 @@ AudioOutputSource::Close() noexcept
 	assert(in_audio_format.IsValid());
 	in_audio_format.Clear();
 
+	/* release the #SharedFilter first; closing one output must
+	   not reset the filter state of the others */
+	ReleaseSharedFilter();
+
 	Cancel();
 
 	CloseFilter();
@@ -76,136 +77,79 @@ AudioOutputSource::Cancel() noexcept
 	current_chunk = nullptr;
 	pipe.Cancel();
 
-	if (replay_gain_filter_instance != nullptr)
-		replay_gain_filter_instance->Reset();
-
-	if (other_replay_gain_filter_instance != nullptr)
-		other_replay_gain_filter_instance->Reset();
+	filter.Reset();
 
-	if (filter_instance != nullptr)
-		filter_instance->Reset();
+	if (shared_filter != nullptr)
+		shared_filter->Cancel();
 }
 
 void
-AudioOutputSource::OpenFilter(AudioFormat audio_format,
-			      PreparedFilter *prepared_replay_gain_filter,
-			      PreparedFilter *prepared_other_replay_gain_filter,
-			      PreparedFilter *prepared_filter)
-try {
-	assert(audio_format.IsValid());
+AudioOutputSource::SetSharedFilter(const SharedFilterConfig &config,
+				   AudioFormat out_audio_format)
+{
+	assert(IsOpen());
 
-	/* the replay_gain filter cannot fail here */
-	if (prepared_replay_gain_filter != nullptr) {
-		replay_gain_serial = 0;
-		replay_gain_filter_instance =
-			prepared_replay_gain_filter->Open(audio_format);
-	}
+	if (shared_filter != nullptr &&
+	    shared_filter->Equals(config, in_audio_format, out_audio_format,
+				  replay_gain_mode))
+		return;
 
-	if (prepared_other_replay_gain_filter != nullptr) {
-		other_replay_gain_serial = 0;
-		other_replay_gain_filter_instance =
-			prepared_other_replay_gain_filter->Open(audio_format);
-	}
+	ReleaseSharedFilter();
 
-	filter_instance = prepared_filter->Open(audio_format);
-} catch (...) {
-	CloseFilter();
-	throw;
+	shared_filter = SharedFilter::Get(config, in_audio_format,
+					  out_audio_format, replay_gain_mode);
 }
 
 void
-AudioOutputSource::CloseFilter() noexcept
+AudioOutputSource::ReleaseSharedFilter() noexcept
 {
-	delete replay_gain_filter_instance;
-	replay_gain_filter_instance = nullptr;
-
-	delete other_replay_gain_filter_instance;
-	other_replay_gain_filter_instance = nullptr;
-
-	delete filter_instance;
-	filter_instance = nullptr;
+	if (shared_filter != nullptr) {
+		shared_filter->Put();
+		shared_filter = nullptr;
+	}
 }
 
-ConstBuffer<void>
-AudioOutputSource::GetChunkData(const MusicChunk &chunk,
-				Filter *replay_gain_filter,
-				unsigned *replay_gain_serial_p)
+void
+AudioOutputSource::CloseFilter() noexcept
 {
-	assert(!chunk.IsEmpty());
-	assert(chunk.CheckFormat(in_audio_format));
-
-	ConstBuffer<void> data(chunk.data, chunk.length);
-
-	assert(data.size % in_audio_format.GetFrameSize() == 0);
-
-	if (!data.IsEmpty() && replay_gain_filter != nullptr) {
-		replay_gain_filter_set_mode(*replay_gain_filter,
-					    replay_gain_mode);
-
-		if (chunk.replay_gain_serial != *replay_gain_serial_p &&
-		    chunk.replay_gain_serial != MusicChunk::IGNORE_REPLAY_GAIN) {
-			replay_gain_filter_set_info(*replay_gain_filter,
-						    chunk.replay_gain_serial != 0
-						    ? &chunk.replay_gain_info
-						    : nullptr);
-			*replay_gain_serial_p = chunk.replay_gain_serial;
-		}
-
-		data = replay_gain_filter->FilterPCM(data);
-	}
-
-	return data;
+	ReleaseSharedFilter();
+	filter.Close();
 }
 
 ConstBuffer<void>
 AudioOutputSource::FilterChunk(const MusicChunk &chunk)
 {
-	auto data = GetChunkData(chunk, replay_gain_filter_instance,
-				 &replay_gain_serial);
-	if (data.IsEmpty())
-		return data;
-
-	/* cross-fade */
-
-	if (chunk.other != nullptr) {
-		auto other_data = GetChunkData(*chunk.other,
-					       other_replay_gain_filter_instance,
-					       &other_replay_gain_serial);
-		if (other_data.IsEmpty())
-			return data;
-
-		/* if the "other" chunk is longer, then that trailer
-		   is used as-is, without mixing; it is part of the
-		   "next" song being faded in, and if there's a rest,
-		   it means cross-fading ends here */
-
-		if (data.size > other_data.size)
-			data.size = other_data.size;
-
-		float mix_ratio = chunk.mix_ratio;
-		if (mix_ratio >= 0)
-			/* reverse the mix ratio (because the
-			   arguments to pcm_mix() are reversed), but
-			   only if the mix ratio is non-negative; a
-			   negative mix ratio is a MixRamp special
-			   case */
-			mix_ratio = 1.0 - mix_ratio;
-
-		void *dest = cross_fade_buffer.Get(other_data.size);
-		memcpy(dest, other_data.data, other_data.size);
-		if (!pcm_mix(cross_fade_dither, dest, data.data, data.size,
-			     in_audio_format.format,
-			     mix_ratio))
-			throw FormatRuntimeError("Cannot cross-fade format %s",
-						 sample_format_to_string(in_audio_format.format));
-
-		data.data = dest;
-		data.size = other_data.size;
+	if (shared_filter != nullptr &&
+	    shared_filter->GetReplayGainMode() != replay_gain_mode) {
+		/* the ReplayGain mode has been changed; it is part of
+		   the #SharedFilter key */
+		const SharedFilterConfig &config = shared_filter->GetConfig();
+		const AudioFormat out_audio_format =
+			shared_filter->GetOutAudioFormat();
+
+		try {
+			SetSharedFilter(config, out_audio_format);
+		} catch (const std::runtime_error &e) {
+			/* not fatal: keep using our own filter
+			   chain */
+			LogError(e);
+		}
 	}
 
-	/* apply filter chain */
+	const bool use_shared = shared_filter != nullptr &&
+		shared_filter->IsShared();
+	if (use_shared != filter_shared) {
+		/* our own filter chain has missed the chunks filtered
+		   by the #SharedFilter */
+		if (!use_shared)
+			filter.Reset();
+
+		filter_shared = use_shared;
+	}
 
-	return filter_instance->FilterPCM(data);
+	return use_shared
+		? shared_filter->FilterChunk(chunk)
+		: filter.FilterChunk(chunk, replay_gain_mode);
 }
 
 bool
@@ -23,10 +23,9 @@
 #include "check.h"
 #include "Compiler.h"
 #include "SharedPipeConsumer.hxx"
+#include "ChunkFilter.hxx"
 #include "AudioFormat.hxx"
 #include "ReplayGainMode.hxx"
-#include "pcm/PcmBuffer.hxx"
-#include "pcm/PcmDither.hxx"
 #include "util/ConstBuffer.hxx"
 
 #include <utility>
@@ -37,8 +36,9 @@
 struct MusicChunk;
 struct Tag;
 class Mutex;
-class Filter;
 class PreparedFilter;
+class SharedFilter;
+struct SharedFilterConfig;
 
 /**
  * Source of audio data to be played by an #AudioOutput.  It receives
@@ -61,45 +61,23 @@ class AudioOutputSource {
 	SharedPipeConsumer pipe;
 
 	/**
-	 * The serial number of the last replay gain info.  0 means no
-	 * replay gain info was available.
+	 * The ReplayGain, cross-fading and filter chain of this
+	 * audio output.
 	 */
-	unsigned replay_gain_serial;
+	ChunkFilter filter;
 
 	/**
-	 * The serial number of the last replay gain info by the
-	 * "other" chunk during cross-fading.
+	 * If this is not nullptr, then it filters the chunks instead
+	 * of #filter, shared with other outputs; see
+	 * SetSharedFilter().
 	 */
-	unsigned other_replay_gain_serial;
+	SharedFilter *shared_filter = nullptr;
 
 	/**
-	 * The replay_gain_filter_plugin instance of this audio
-	 * output.
+	 * Was the last chunk filtered by #shared_filter (and not by
+	 * #filter)?
 	 */
-	Filter *replay_gain_filter_instance = nullptr;
-
-	/**
-	 * The replay_gain_filter_plugin instance of this audio
-	 * output, to be applied to the second chunk during
-	 * cross-fading.
-	 */
-	Filter *other_replay_gain_filter_instance = nullptr;
-
-	/**
-	 * The buffer used to allocate the cross-fading result.
-	 */
-	PcmBuffer cross_fade_buffer;
-
-	/**
-	 * The dithering state for cross-fading two streams.
-	 */
-	PcmDither cross_fade_dither;
-
-	/**
-	 * The filter object of this audio output.  This is an
-	 * instance of chain_filter_plugin.
-	 */
-	Filter *filter_instance = nullptr;
+	bool filter_shared = false;
 
 	/**
 	 * The #MusicChunk currently being processed (see
@@ -141,6 +119,17 @@ public:
 	void Close() noexcept;
 	void Cancel() noexcept;
 
+	/**
+	 * Let a #SharedFilter (producing the given #AudioFormat)
+	 * filter the chunks while other outputs with the same filter
+	 * settings are attached to it.  Call this after Open(), when
+	 * the final #AudioFormat is known.
+	 *
+	 * Throws #std::runtime_error on error.
+	 */
+	void SetSharedFilter(const SharedFilterConfig &config,
+			     AudioFormat out_audio_format);
+
 	/**
 	 * Ensure that ReadTag() or PeekData() return any input.
 	 *
@@ -192,16 +181,9 @@ public:
 	}
 
 private:
-	void OpenFilter(AudioFormat audio_format,
-			PreparedFilter *prepared_replay_gain_filter,
-			PreparedFilter *prepared_other_replay_gain_filter,
-			PreparedFilter *prepared_filter);
-
 	void CloseFilter() noexcept;
 
-	ConstBuffer<void> GetChunkData(const MusicChunk &chunk,
-				       Filter *replay_gain_filter,
-				       unsigned *replay_gain_serial_p);
+	void ReleaseSharedFilter() noexcept;
 
 	ConstBuffer<void> FilterChunk(const MusicChunk &chunk);
 };
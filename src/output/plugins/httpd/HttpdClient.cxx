@@ -20,29 +20,37 @@
 #include "config.h"
 #include "HttpdClient.hxx"
 #include "HttpdInternal.hxx"
+#include "HttpdShard.hxx"
 #include "util/ASCII.hxx"
 #include "util/AllocatedString.hxx"
 #include "Page.hxx"
 #include "IcyMetaDataServer.hxx"
 #include "net/SocketError.hxx"
+#include "util/ConstBuffer.hxx"
 #include "Log.hxx"
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
 HttpdClient::~HttpdClient()
 {
-	if (state == RESPONSE) {
-		if (current_page != nullptr)
-			current_page->Unref();
-
+	if (state == RESPONSE)
 		ClearQueue();
-	}
 
 	if (metadata)
 		metadata->Unref();
 
+	if (next_metadata != nullptr)
+		next_metadata->Unref();
+
 	if (IsDefined())
 		BufferedSocket::Close();
 }
@@ -50,7 +58,7 @@ HttpdClient::~HttpdClient()
 void
 HttpdClient::Close()
 {
-	httpd.RemoveClient(*this);
+	shard.RemoveClient(*this);
 }
 
 void
@@ -66,7 +74,13 @@ HttpdClient::BeginResponse()
 	assert(state != RESPONSE);
 
 	state = RESPONSE;
-	current_page = nullptr;
+
+	/* the first page may begin in the middle of a frame; skip
+	   to its end */
+	const auto burst_start = httpd.GetBurstStart();
+	cursor = burst_start.cursor;
+	n_pending = 0;
+	current_position = burst_start.offset;
 
 	if (!head_method)
 		httpd.SendHeader(*this);
@@ -171,17 +185,17 @@ HttpdClient::SendResponse()
 	return true;
 }
 
-HttpdClient::HttpdClient(HttpdOutput &_httpd, int _fd, EventLoop &_loop,
+HttpdClient::HttpdClient(HttpdOutput &_httpd, HttpdShard &_shard,
+			 int _fd, EventLoop &_loop,
 			 bool _metadata_supported)
 	:BufferedSocket(_fd, _loop),
-	 httpd(_httpd),
+	 httpd(_httpd), shard(_shard),
 	 state(REQUEST),
-	 queue_size(0),
 	 head_method(false),
 	 metadata_supported(_metadata_supported),
 	 metadata_requested(false), metadata_sent(true),
 	 metaint(8192), /*TODO: just a std value */
-	 metadata(nullptr),
+	 metadata(nullptr), next_metadata(nullptr),
 	 metadata_current_position(0), metadata_fill(0)
 {
 }
@@ -191,19 +205,11 @@ HttpdClient::ClearQueue()
 {
 	assert(state == RESPONSE);
 
-	while (!pages.empty()) {
-		Page *page = pages.front();
-		pages.pop();
-
-#ifndef NDEBUG
-		assert(queue_size >= page->size);
-		queue_size -= page->size;
-#endif
-
-		page->Unref();
-	}
+	for (unsigned i = 0; i < n_pending; ++i)
+		pending[i]->Unref();
 
-	assert(queue_size == 0);
+	n_pending = 0;
+	current_position = 0;
 }
 
 void
@@ -212,150 +218,222 @@ HttpdClient::CancelQueue()
 	if (state != RESPONSE)
 		return;
 
-	ClearQueue();
+	/* finish sending the current page, or else the client would
+	   receive a truncated frame */
+	const unsigned keep = current_position > 0;
 
-	if (current_page == nullptr)
-		CancelWrite();
-}
+	for (unsigned i = keep; i < n_pending; ++i)
+		pending[i]->Unref();
 
-ssize_t
-HttpdClient::TryWritePage(const Page &page, size_t position)
-{
-	assert(position < page.size);
+	n_pending = keep;
 
-	return Write(page.data + position, page.size - position);
+	if (n_pending == 0)
+		CancelWrite();
 }
 
-ssize_t
-HttpdClient::TryWritePageN(const Page &page, size_t position, ssize_t n)
+bool
+HttpdClient::FillPending()
 {
-	return n >= 0
-		? Write(page.data + position, n)
-		: TryWritePage(page, position);
-}
+	if (n_pending < MAX_PENDING) {
+		const uint64_t old_cursor = cursor;
+		const size_t n = httpd.pages.Read(cursor, pending + n_pending,
+						  MAX_PENDING - n_pending);
+		if (cursor - n != old_cursor) {
+			FormatDebug(httpd_output_domain,
+				    "client is too slow, skipping %u pages",
+				    unsigned(cursor - n - old_cursor));
+
+			if (n_pending == 0)
+				/* the burst offset applied to a page
+				   which was dropped */
+				current_position = 0;
+		}
 
-ssize_t
-HttpdClient::GetBytesTillMetaData() const noexcept
-{
-	if (metadata_requested &&
-	    current_page->size - current_position > metaint - metadata_fill)
-		return metaint - metadata_fill;
+		n_pending += n;
+	}
 
-	return -1;
+	return n_pending > 0;
 }
 
-inline bool
-HttpdClient::TryWrite()
+size_t
+HttpdClient::PrepareVector(ConstBuffer<void> *v, size_t max) const
 {
-	const std::lock_guard<Mutex> protect(httpd.mutex);
+	static constexpr char empty_data = 0;
+
+	size_t n = 0;
+	unsigned fill = metadata_fill;
+	bool send_metadata = !metadata_sent;
+
+	for (unsigned i = 0; i < n_pending; ++i) {
+		const Page &page = *pending[i];
+		size_t position = i == 0 ? current_position : 0;
+
+		while (position < page.size) {
+			if (n == max)
+				return n;
+
+			size_t length = page.size - position;
+
+			if (metadata_requested) {
+				if (fill == metaint) {
+					/* time for a metadata block
+					   (or an empty one) */
+					if (send_metadata) {
+						v[n++] = {metadata->data + metadata_current_position,
+							  metadata->size - metadata_current_position};
+						send_metadata = false;
+					} else
+						v[n++] = {&empty_data, 1};
+
+					fill = 0;
+					continue;
+				}
 
-	assert(state == RESPONSE);
+				length = std::min<size_t>(length,
+							  metaint - fill);
+				fill += length;
+			}
 
-	if (current_page == nullptr) {
-		if (pages.empty()) {
-			/* another thread has removed the event source
-			   while this thread was waiting for
-			   httpd.mutex */
-			CancelWrite();
-			return true;
+			v[n++] = {page.data + position, length};
+			position += length;
 		}
-
-		current_page = pages.front();
-		pages.pop();
-		current_position = 0;
-
-		assert(queue_size >= current_page->size);
-		queue_size -= current_page->size;
 	}
 
-	const ssize_t bytes_to_write = GetBytesTillMetaData();
-	if (bytes_to_write == 0) {
-		if (!metadata_sent) {
-			ssize_t nbytes = TryWritePage(*metadata,
-						      metadata_current_position);
-			if (nbytes < 0) {
-				auto e = GetSocketError();
-				if (IsSocketErrorAgain(e))
-					return true;
-
-				if (!IsSocketErrorClosed(e)) {
-					SocketErrorMessage msg(e);
-					FormatWarning(httpd_output_domain,
-						      "failed to write to client: %s",
-						      (const char *)msg);
-				}
+	return n;
+}
 
-				Close();
-				return false;
-			}
+void
+HttpdClient::Consume(size_t nbytes)
+{
+	while (nbytes > 0) {
+		assert(n_pending > 0);
 
-			metadata_current_position += nbytes;
+		if (metadata_requested && metadata_fill == metaint) {
+			if (!metadata_sent) {
+				const size_t length =
+					std::min(metadata->size - metadata_current_position,
+						 nbytes);
+				metadata_current_position += length;
+				nbytes -= length;
+
+				if (metadata_current_position < metadata->size)
+					continue;
 
-			if (metadata->size - metadata_current_position == 0) {
-				metadata_fill = 0;
 				metadata_current_position = 0;
 				metadata_sent = true;
-			}
-		} else {
-			char empty_data = 0;
-
-			ssize_t nbytes = Write(&empty_data, 1);
-			if (nbytes < 0) {
-				auto e = GetSocketError();
-				if (IsSocketErrorAgain(e))
-					return true;
-
-				if (!IsSocketErrorClosed(e)) {
-					SocketErrorMessage msg(e);
-					FormatWarning(httpd_output_domain,
-						      "failed to write to client: %s",
-						      (const char *)msg);
-				}
 
-				Close();
-				return false;
-			}
+				if (next_metadata != nullptr) {
+					metadata->Unref();
+					metadata = next_metadata;
+					next_metadata = nullptr;
+					metadata_sent = false;
+				}
+			} else
+				/* the empty metadata block */
+				--nbytes;
 
 			metadata_fill = 0;
-			metadata_current_position = 0;
+			continue;
 		}
-	} else {
-		ssize_t nbytes =
-			TryWritePageN(*current_page, current_position,
-				      bytes_to_write);
-		if (nbytes < 0) {
-			auto e = GetSocketError();
-			if (IsSocketErrorAgain(e))
-				return true;
-
-			if (!IsSocketErrorClosed(e)) {
-				SocketErrorMessage msg(e);
-				FormatWarning(httpd_output_domain,
-					      "failed to write to client: %s",
-					      (const char *)msg);
-			}
 
-			Close();
-			return false;
-		}
+		Page &page = *pending[0];
+		size_t length = page.size - current_position;
+		if (metadata_requested)
+			length = std::min<size_t>(length,
+						  metaint - metadata_fill);
 
-		current_position += nbytes;
-		assert(current_position <= current_page->size);
+		length = std::min(length, nbytes);
+		current_position += length;
+		nbytes -= length;
 
 		if (metadata_requested)
-			metadata_fill += nbytes;
+			metadata_fill += length;
+
+		if (current_position == page.size) {
+			page.Unref();
+			std::copy(pending + 1, pending + n_pending, pending);
+			--n_pending;
+			current_position = 0;
+		}
+	}
+}
+
+/**
+ * The maximum number of buffers passed to one sendmsg() call.
+ */
+static constexpr size_t MAX_VECTOR = 64;
+
+static ssize_t
+SendVector(int fd, const ConstBuffer<void> *v, size_t n)
+{
+#ifdef _WIN32
+	/* no vectored I/O here; send only the first buffer */
+	(void)n;
+	return send(fd, (const char *)v[0].data, v[0].size, 0);
+#else
+	struct iovec iov[MAX_VECTOR];
+	assert(n <= MAX_VECTOR);
+
+	for (size_t i = 0; i < n; ++i) {
+		iov[i].iov_base = const_cast<void *>(v[i].data);
+		iov[i].iov_len = v[i].size;
+	}
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = n;
+
+	int flags = 0;
+#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+#endif
+#ifdef MSG_DONTWAIT
+	flags |= MSG_DONTWAIT;
+#endif
+
+	return sendmsg(fd, &msg, flags);
+#endif
+}
+
+inline bool
+HttpdClient::TryWrite()
+{
+	assert(state == RESPONSE);
 
-		if (current_position >= current_page->size) {
-			current_page->Unref();
-			current_page = nullptr;
+	if (!FillPending()) {
+		/* all pages are sent: remove the event source */
+		CancelWrite();
+		return true;
+	}
+
+	ConstBuffer<void> v[MAX_VECTOR];
+	const size_t n = PrepareVector(v, MAX_VECTOR);
+	assert(n > 0);
+
+	const ssize_t nbytes = SendVector(Get(), v, n);
+	if (nbytes < 0) {
+		auto e = GetSocketError();
+		if (IsSocketErrorAgain(e))
+			return true;
 
-			if (pages.empty())
-				/* all pages are sent: remove the
-				   event source */
-				CancelWrite();
+		if (!IsSocketErrorClosed(e)) {
+			SocketErrorMessage msg(e);
+			FormatWarning(httpd_output_domain,
+				      "failed to write to client: %s",
+				      (const char *)msg);
 		}
+
+		LockClose();
+		return false;
 	}
 
+	Consume(nbytes);
+
+	if (n_pending == 0 && !FillPending())
+		/* all pages are sent: remove the event source */
+		CancelWrite();
+
 	return true;
 }
 
@@ -366,15 +444,11 @@ HttpdClient::PushPage(Page *page)
 		/* the client is still writing the HTTP request */
 		return;
 
-	if (queue_size > 256 * 1024) {
-		FormatDebug(httpd_output_domain,
-			    "client is too slow, flushing its queue");
-		ClearQueue();
-	}
+	if (n_pending == MAX_PENDING)
+		return;
 
 	page->Ref();
-	pages.push(page);
-	queue_size += page->size;
+	pending[n_pending++] = page;
 
 	ScheduleWrite();
 }
@@ -384,12 +458,20 @@ HttpdClient::PushMetaData(Page *page)
 {
 	assert(page != nullptr);
 
-	if (metadata) {
-		metadata->Unref();
-		metadata = nullptr;
+	page->Ref();
+
+	if (metadata_current_position > 0) {
+		/* don't interrupt the metadata block which is
+		   currently being sent */
+		if (next_metadata != nullptr)
+			next_metadata->Unref();
+		next_metadata = page;
+		return;
 	}
 
-	page->Ref();
+	if (metadata)
+		metadata->Unref();
+
 	metadata = page;
 	metadata_sent = false;
 }
@@ -26,13 +26,13 @@
 #include <boost/intrusive/link_mode.hpp>
 #include <boost/intrusive/list_hook.hpp>
 
-#include <queue>
-#include <list>
-
 #include <stddef.h>
+#include <stdint.h>
 
 class HttpdOutput;
+class HttpdShard;
 class Page;
+template<typename T> struct ConstBuffer;
 
 class HttpdClient final
 	: BufferedSocket,
@@ -42,6 +42,11 @@ class HttpdClient final
 	 */
 	HttpdOutput &httpd;
 
+	/**
+	 * The shard which handles this client.
+	 */
+	HttpdShard &shard;
+
 	/**
 	 * The current state of the client.
 	 */
@@ -57,23 +62,31 @@ class HttpdClient final
 	} state;
 
 	/**
-	 * A queue of #Page objects to be sent to the client.
+	 * The maximum number of #pending pages.
+	 */
+	static constexpr unsigned MAX_PENDING = 16;
+
+	/**
+	 * The sequence number of the next page to be obtained from
+	 * HttpdOutput's #PageRing.
 	 */
-	std::queue<Page *, std::list<Page *>> pages;
+	uint64_t cursor;
 
 	/**
-	 * The sum of all page sizes in #pages.
+	 * The pages which are about to be sent to the client, each
+	 * holding a reference.  They are sent with one vectored
+	 * write.
 	 */
-	size_t queue_size;
+	Page *pending[MAX_PENDING];
 
 	/**
-	 * The #page which is currently being sent to the client.
+	 * The number of pages in #pending.
 	 */
-	Page *current_page;
+	unsigned n_pending;
 
 	/**
-	 * The amount of bytes which were already sent from
-	 * #current_page.
+	 * The amount of bytes which were already sent from the first
+	 * page in #pending.
 	 */
 	size_t current_position;
 
@@ -110,6 +123,12 @@ class HttpdClient final
 	 */
 	Page *metadata;
 
+	/**
+	 * New metadata which has arrived while #metadata was being
+	 * sent; it replaces #metadata as soon as that is complete.
+	 */
+	Page *next_metadata;
+
 	/*
 	 * The amount of bytes which were already sent from the metadata.
 	 */
@@ -124,19 +143,24 @@ class HttpdClient final
 public:
 	/**
 	 * @param httpd the HTTP output device
+	 * @param _shard the shard which handles this client
 	 * @param _fd the socket file descriptor
 	 */
-	HttpdClient(HttpdOutput &httpd, int _fd, EventLoop &_loop,
+	HttpdClient(HttpdOutput &httpd, HttpdShard &_shard,
+		    int _fd, EventLoop &_loop,
 		    bool _metadata_supported);
 
 	/**
 	 * Note: this does not remove the client from the
-	 * #HttpdOutput object.
+	 * #HttpdShard object.
 	 */
 	~HttpdClient();
 
 	/**
-	 * Frees the client and removes it from the server's client list.
+	 * Frees the client and removes it from the shard's client
+	 * list.
+	 *
+	 * Caller must lock the mutex.
 	 */
 	void Close();
 
@@ -162,19 +186,23 @@ public:
 	 */
 	bool SendResponse();
 
-	gcc_pure
-	ssize_t GetBytesTillMetaData() const noexcept;
-
-	ssize_t TryWritePage(const Page &page, size_t position);
-	ssize_t TryWritePageN(const Page &page, size_t position, ssize_t n);
-
 	bool TryWrite();
 
 	/**
-	 * Appends a page to the client's queue.
+	 * Appends a page to the client's queue.  This is used for
+	 * the header page; all other pages are obtained from the
+	 * #PageRing.
 	 */
 	void PushPage(Page *page);
 
+	/**
+	 * New pages have been pushed to the #PageRing.
+	 */
+	void OnPages() {
+		if (state == RESPONSE)
+			ScheduleWrite();
+	}
+
 	/**
 	 * Sends the passed metadata.
 	 */
@@ -183,6 +211,27 @@ public:
 private:
 	void ClearQueue();
 
+	/**
+	 * Obtain more pages from the #PageRing.
+	 *
+	 * @return false if there are no pages to be sent
+	 */
+	bool FillPending();
+
+	/**
+	 * Fill the vector with all pending data (interleaved with
+	 * ICY metadata).
+	 *
+	 * @return the number of buffers
+	 */
+	size_t PrepareVector(ConstBuffer<void> *v, size_t max) const;
+
+	/**
+	 * Mark the specified number of bytes as sent, as prepared by
+	 * PrepareVector().
+	 */
+	void Consume(size_t nbytes);
+
 protected:
 	virtual bool OnSocketReady(unsigned flags) override;
 	virtual InputResult OnSocketInput(void *data, size_t length) override;
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "HttpdEncoderGroup.hxx"
+#include "HttpdInternal.hxx"
+#include "config/Block.hxx"
+
+#include <algorithm>
+#include <forward_list>
+
+#include <assert.h>
+
+/**
+ * These settings only affect the listener, not the stream.
+ */
+static constexpr const char *httpd_listener_settings[] = {
+	"name",
+	"enabled",
+	"port",
+	"bind_to_address",
+	"max_clients",
+	"threads",
+	"burst_size",
+	"burst_time",
+	"genre",
+	"website",
+};
+
+gcc_pure
+static bool
+IsListenerSetting(const std::string &name) noexcept
+{
+	for (const char *i : httpd_listener_settings)
+		if (name == i)
+			return true;
+
+	return false;
+}
+
+/**
+ * Build a string from all settings which affect the encoded stream.
+ */
+static std::string
+MakeEncoderKey(const ConfigBlock &block)
+{
+	std::vector<const BlockParam *> params;
+	for (const auto &i : block.block_params)
+		if (!IsListenerSetting(i.name))
+			params.push_back(&i);
+
+	std::sort(params.begin(), params.end(),
+		  [](const BlockParam *a, const BlockParam *b){
+			  return a->name < b->name;
+		  });
+
+	std::string key;
+	for (const auto *i : params) {
+		key += i->name;
+		key.push_back('\0');
+		key += i->value;
+		key.push_back('\0');
+	}
+
+	return key;
+}
+
+/**
+ * All groups.  This is only accessed by the main thread, while
+ * the outputs are being configured or deleted.
+ */
+static std::forward_list<HttpdEncoderGroup> httpd_encoder_groups;
+
+HttpdEncoderGroup &
+HttpdEncoderGroup::Join(HttpdOutput &output, const ConfigBlock &block)
+{
+	auto key = MakeEncoderKey(block);
+
+	auto i = std::find_if(httpd_encoder_groups.begin(),
+			      httpd_encoder_groups.end(),
+			      [&key](const HttpdEncoderGroup &g){
+				      return g.key == key;
+			      });
+	if (i == httpd_encoder_groups.end()) {
+		httpd_encoder_groups.emplace_front(std::move(key));
+		i = httpd_encoder_groups.begin();
+	}
+
+	i->members.push_back(&output);
+	return *i;
+}
+
+void
+HttpdEncoderGroup::Leave(HttpdOutput &output)
+{
+	auto i = std::find(members.begin(), members.end(), &output);
+	assert(i != members.end());
+	members.erase(i);
+
+	if (members.empty())
+		httpd_encoder_groups.remove_if([this](const HttpdEncoderGroup &g){
+				return &g == this;
+			});
+}
+
+HttpdOutput *
+HttpdEncoderGroup::FindLeader(const HttpdOutput &output,
+			      const AudioFormat &audio_format) const noexcept
+{
+	for (auto *i : members)
+		if (i != &output && i->IsEncoding(audio_format))
+			return i;
+
+	return nullptr;
+}
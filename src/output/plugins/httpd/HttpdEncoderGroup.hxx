@@ -0,0 +1,91 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_OUTPUT_HTTPD_ENCODER_GROUP_HXX
+#define MPD_OUTPUT_HTTPD_ENCODER_GROUP_HXX
+
+#include "thread/Mutex.hxx"
+#include "Compiler.h"
+
+#include <string>
+#include <vector>
+
+struct ConfigBlock;
+struct AudioFormat;
+class HttpdOutput;
+
+/**
+ * A group of "httpd" outputs whose settings differ only in the
+ * listener (port, name, ...), i.e. they have the same filters and
+ * the same encoder settings.  Only one open member (the "leader")
+ * runs the encoder; its pages are fanned out to the other open
+ * members which have the same input audio format (the "followers").
+ */
+class HttpdEncoderGroup {
+	/**
+	 * All settings which affect the encoded stream.
+	 */
+	const std::string key;
+
+	/**
+	 * All configured outputs in this group.
+	 */
+	std::vector<HttpdOutput *> members;
+
+public:
+	/**
+	 * Protects the encoder state of all members
+	 * (HttpdOutput::encoder, HttpdOutput::leader,
+	 * HttpdOutput::followers).  It must be locked before
+	 * HttpdOutput::mutex.
+	 */
+	mutable Mutex mutex;
+
+	explicit HttpdEncoderGroup(std::string &&_key)
+		:key(std::move(_key)) {}
+
+	HttpdEncoderGroup(const HttpdEncoderGroup &) = delete;
+	HttpdEncoderGroup &operator=(const HttpdEncoderGroup &) = delete;
+
+	/**
+	 * Add the output to the group with the same settings,
+	 * creating a new one if there is none.  Must be called in
+	 * the main thread.
+	 */
+	static HttpdEncoderGroup &Join(HttpdOutput &output,
+				       const ConfigBlock &block);
+
+	/**
+	 * Remove the output from this group.  The last member
+	 * deletes the group.  Must be called in the main thread.
+	 */
+	void Leave(HttpdOutput &output);
+
+	/**
+	 * Find a member which runs an encoder whose input matches
+	 * the given #AudioFormat.
+	 *
+	 * Caller must lock the mutex.
+	 */
+	gcc_pure
+	HttpdOutput *FindLeader(const HttpdOutput &output,
+				const AudioFormat &audio_format) const noexcept;
+};
+
+#endif
@@ -25,30 +25,31 @@
 #ifndef MPD_OUTPUT_HTTPD_INTERNAL_H
 #define MPD_OUTPUT_HTTPD_INTERNAL_H
 
-#include "HttpdClient.hxx"
+#include "PageRing.hxx"
+#include "AudioFormat.hxx"
 #include "output/Internal.hxx"
 #include "output/Timer.hxx"
 #include "thread/Mutex.hxx"
 #include "event/ServerSocket.hxx"
-#include "event/DeferredMonitor.hxx"
 #include "util/Cast.hxx"
 #include "Compiler.h"
 
-#include <boost/intrusive/list.hpp>
+#include <vector>
 
-#include <queue>
-#include <list>
+#include <assert.h>
 
 struct ConfigBlock;
 class EventLoop;
 class ServerSocket;
 class HttpdClient;
+class HttpdShard;
+class HttpdEncoderGroup;
 class Page;
 class PreparedEncoder;
 class Encoder;
 struct Tag;
 
-class HttpdOutput final : ServerSocket, DeferredMonitor {
+class HttpdOutput final : ServerSocket {
 	AudioOutput base;
 
 	/**
@@ -61,8 +62,48 @@ class HttpdOutput final : ServerSocket, DeferredMonitor {
 	 * The configured encoder plugin.
 	 */
 	PreparedEncoder *prepared_encoder = nullptr;
+
+	/**
+	 * The outputs which share the encoder settings with this
+	 * one.
+	 */
+	HttpdEncoderGroup &group;
+
+	/**
+	 * The encoder, if this output is open and encodes the stream
+	 * itself (i.e. it is not a follower).  After taking over
+	 * from another leader, it is opened lazily by
+	 * CheckEncoder().  Protected by HttpdEncoderGroup::mutex.
+	 */
 	Encoder *encoder;
 
+	/**
+	 * If this output is open and receives its pages from another
+	 * member of the #group, then this is that member.  Protected
+	 * by HttpdEncoderGroup::mutex.
+	 */
+	HttpdOutput *leader = nullptr;
+
+	/**
+	 * The members of the #group which receive the pages produced
+	 * by this output's #encoder.  Protected by
+	 * HttpdEncoderGroup::mutex.
+	 */
+	std::vector<HttpdOutput *> followers;
+
+	/**
+	 * The #AudioFormat passed to Open() (undefined while closed),
+	 * and the one the encoder has chosen from it.  Protected by
+	 * HttpdEncoderGroup::mutex.
+	 */
+	AudioFormat input_format, encoder_format;
+
+	/**
+	 * Does the encoder embed tags into the stream (instead of
+	 * sending Icy-Metadata)?
+	 */
+	bool encoder_tags;
+
 	/**
 	 * Number of bytes which were fed into the encoder, without
 	 * ever receiving new output.  This is used to estimate
@@ -71,6 +112,23 @@ class HttpdOutput final : ServerSocket, DeferredMonitor {
 	 */
 	size_t unflushed_input;
 
+	/**
+	 * The maximum size (in bytes) and age of the backlog which
+	 * is sent to new clients right after the header.  A zero
+	 * #burst_size disables the burst; a zero #burst_time means
+	 * there is no age limit.
+	 */
+	size_t burst_size;
+	const std::chrono::steady_clock::duration burst_time;
+
+	/**
+	 * Checks whether an encoder frame (or Ogg page) begins at the
+	 * given position of the stream, see FindFrameStart().  It is
+	 * nullptr if the format is unknown; then each page is
+	 * assumed to begin with a frame.
+	 */
+	bool (*is_frame_start)(const uint8_t *p, size_t size);
+
 public:
 	/**
 	 * The MIME type produced by the #encoder.
@@ -78,16 +136,26 @@ public:
 	const char *content_type;
 
 	/**
-	 * This mutex protects the listener socket and the client
-	 * list.
+	 * This mutex protects the listener socket, the client lists
+	 * and the metadata.
 	 */
 	mutable Mutex mutex;
 
 	/**
-	 * This condition gets signalled when an item is removed from
-	 * #pages.
+	 * The pages from the encoder to be broadcasted to all
+	 * clients.  Each client obtains them from here, in its
+	 * shard's thread.
 	 */
-	Cond cond;
+	PageRing pages;
+
+	/**
+	 * Returns the cursor at which a new client begins to
+	 * receive #pages.
+	 */
+	gcc_pure
+	PageRing::BurstStart GetBurstStart() const noexcept {
+		return pages.GetBurstStart(burst_size, burst_time);
+	}
 
 private:
 	/**
@@ -106,14 +174,6 @@ private:
 	 */
 	Page *metadata;
 
-	/**
-	 * The page queue, i.e. pages from the encoder to be
-	 * broadcasted to all clients.  This container is necessary to
-	 * pass pages from the OutputThread to the IOThread.  It is
-	 * protected by #mutex, and removing signals #cond.
-	 */
-	std::queue<Page *, std::list<Page *>> pages;
-
  public:
 	/**
 	 * The configured name.
@@ -130,11 +190,28 @@ private:
 
 private:
 	/**
-	 * A linked list containing all clients which are currently
-	 * connected.
+	 * The configured number of threads handling the clients.  If
+	 * this is 1, the clients are handled by the IOThread.
+	 */
+	unsigned n_threads;
+
+	/**
+	 * The client shards, one for each thread.  They exist while
+	 * the output is enabled.
 	 */
-	boost::intrusive::list<HttpdClient,
-			       boost::intrusive::constant_time_size<true>> clients;
+	std::vector<HttpdShard *> shards;
+
+	/**
+	 * The shard which receives the next client.
+	 */
+	unsigned next_shard;
+
+	/**
+	 * The number of clients in all shards, including sockets
+	 * which have been accepted, but not yet been added to a
+	 * shard.  Protected by #mutex.
+	 */
+	unsigned n_clients;
 
 	/**
 	 * A temporary buffer for the httpd_output_read_page()
@@ -163,26 +240,45 @@ public:
 		return &ContainerCast(*ao, &HttpdOutput::base);
 	}
 
-	using DeferredMonitor::GetEventLoop;
+	using ServerSocket::GetEventLoop;
 
 	void Bind();
 	void Unbind();
 
 	/**
-	 * Caller must lock the mutex.
+	 * Is this output open and does it encode (not follow) for
+	 * the given input #AudioFormat?
 	 *
-	 * Throws #std::runtime_error on error.
+	 * Caller must lock HttpdEncoderGroup::mutex.
 	 */
-	void OpenEncoder(AudioFormat &audio_format);
+	gcc_pure
+	bool IsEncoding(const AudioFormat &audio_format) const noexcept {
+		return leader == nullptr && input_format == audio_format;
+	}
 
 	/**
-	 * Caller must lock the mutex.
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 *
+	 * Throws #std::runtime_error on error.
+	 *
+	 * @return the header page (or nullptr)
 	 */
-	void Open(AudioFormat &audio_format);
+	Page *OpenEncoder(AudioFormat &audio_format);
 
 	/**
-	 * Caller must lock the mutex.
+	 * Open the encoder if this output has become the leader.
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 *
+	 * Throws #std::runtime_error on error.
+	 *
+	 * @return true if this output encodes, false if it is a
+	 * follower
 	 */
+	bool CheckEncoder();
+
+	void Open(AudioFormat &audio_format);
+
 	void Close();
 
 	/**
@@ -192,7 +288,7 @@ public:
 	 */
 	gcc_pure
 	bool HasClients() const noexcept {
-		return !clients.empty();
+		return n_clients > 0;
 	}
 
 	/**
@@ -204,12 +300,53 @@ public:
 		return HasClients();
 	}
 
-	void AddClient(int fd);
+	/**
+	 * Check whether there is at least one client which receives
+	 * pages from this output's encoder (including clients of the
+	 * followers).
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 */
+	gcc_pure
+	bool HasListeners() const noexcept;
+
+	gcc_pure
+	bool LockHasListeners() const noexcept;
+
+	/**
+	 * Caller must lock the mutex.
+	 */
+	bool IsOpen() const {
+		return open;
+	}
+
+	/**
+	 * Can clients receive Icy-Metadata?  This is not the case if
+	 * the encoder embeds tags into the stream.
+	 *
+	 * Caller must lock the mutex, and the output must be open.
+	 */
+	gcc_pure
+	bool IsMetadataSupported() const noexcept;
+
+	/**
+	 * Returns the current Icy-Metadata page (or nullptr).
+	 *
+	 * Caller must lock the mutex.
+	 */
+	Page *GetMetadata() const {
+		return metadata;
+	}
 
 	/**
-	 * Removes a client from the httpd_output.clients linked list.
+	 * A client has been removed from its shard.
+	 *
+	 * Caller must lock the mutex.
 	 */
-	void RemoveClient(HttpdClient &client);
+	void OnClientRemoved() {
+		assert(n_clients > 0);
+		--n_clients;
+	}
 
 	/**
 	 * Sends the encoder header to the client.  This is called
@@ -227,14 +364,24 @@ public:
 	Page *ReadPage();
 
 	/**
-	 * Broadcasts a page struct to all clients.
+	 * Returns the offset of the first encoder frame which begins
+	 * in the given page, or Page::size if there is none.
+	 */
+	gcc_pure
+	size_t FindFrameStart(const Page &page) const noexcept;
+
+	/**
+	 * Broadcasts a page struct to all clients (including the
+	 * followers).
 	 *
-	 * Mutext must not be locked.
+	 * Caller must lock HttpdEncoderGroup::mutex.
 	 */
 	void BroadcastPage(Page *page);
 
 	/**
 	 * Broadcasts data from the encoder to all clients.
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
 	 */
 	void BroadcastFromEncoder();
 
@@ -250,7 +397,50 @@ public:
 	void CancelAllClients();
 
 private:
-	virtual void RunDeferred() override;
+	/**
+	 * Notify all shards.  This method is thread-safe.
+	 */
+	void OrShardEvents(unsigned mask);
+
+	/**
+	 * Replace the header page which is sent to new clients.
+	 * Takes over the caller's reference.
+	 */
+	void SetHeader(Page *page);
+
+	/**
+	 * The encoder has begun a new stream with the given header
+	 * page: send it to all clients, and use it for new clients
+	 * (including the ones of the followers).  Takes over the
+	 * caller's reference.
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 */
+	void ReplaceHeader(Page *page);
+
+	/**
+	 * Receive pages from the given member.
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 */
+	void Follow(HttpdOutput &_leader, AudioFormat &audio_format);
+
+	/**
+	 * Stop receiving pages from the #leader.
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 */
+	void Unfollow();
+
+	/**
+	 * This output is about to close: let one of the #followers
+	 * become the leader of the others.
+	 *
+	 * Caller must lock HttpdEncoderGroup::mutex.
+	 */
+	void HandOver();
+
+	void DeleteShards();
 
 	void OnAccept(int fd, SocketAddress address, int uid) override;
 };
@@ -21,6 +21,8 @@
 #include "HttpdOutputPlugin.hxx"
 #include "HttpdInternal.hxx"
 #include "HttpdClient.hxx"
+#include "HttpdShard.hxx"
+#include "HttpdEncoderGroup.hxx"
 #include "output/OutputAPI.hxx"
 #include "encoder/EncoderInterface.hxx"
 #include "encoder/EncoderPlugin.hxx"
@@ -34,9 +36,10 @@
 #include "event/Call.hxx"
 #include "util/RuntimeError.hxx"
 #include "util/Domain.hxx"
-#include "util/DeleteDisposer.hxx"
 #include "Log.hxx"
 
+#include <algorithm>
+
 #include <assert.h>
 
 #include <string.h>
@@ -49,12 +52,65 @@
 
 const Domain httpd_output_domain("httpd_output");
 
+/**
+ * The minimum size of the #PageRing; this is how far a client may fall
+ * behind before it starts skipping pages.
+ */
+static constexpr size_t HTTPD_MIN_BACKLOG = 256 * 1024;
+
+gcc_pure
+static bool
+IsOggPageStart(const uint8_t *p, size_t size)
+{
+	/* capture pattern and stream structure version */
+	return size >= 5 && memcmp(p, "OggS", 4) == 0 && p[4] == 0;
+}
+
+gcc_pure
+static bool
+IsMpegFrameStart(const uint8_t *p, size_t size)
+{
+	/* frame sync, and no reserved version, layer, bitrate or
+	   sample rate */
+	return size >= 3 && p[0] == 0xff && (p[1] & 0xe0) == 0xe0 &&
+		((p[1] >> 3) & 0x3) != 0x1 &&
+		((p[1] >> 1) & 0x3) != 0x0 &&
+		(p[2] >> 4) != 0xf &&
+		((p[2] >> 2) & 0x3) != 0x3;
+}
+
+typedef bool (*FrameStartFunction)(const uint8_t *p, size_t size);
+
+/**
+ * Returns a function which detects frame boundaries in a stream of
+ * the given MIME type, or nullptr if the format is unknown.
+ */
+gcc_pure
+static FrameStartFunction
+GetFrameStartFunction(const char *mime_type)
+{
+	if (strcmp(mime_type, "audio/ogg") == 0)
+		return IsOggPageStart;
+
+	if (strcmp(mime_type, "audio/mpeg") == 0)
+		return IsMpegFrameStart;
+
+	return nullptr;
+}
+
 inline
 HttpdOutput::HttpdOutput(EventLoop &_loop, const ConfigBlock &block)
-	:ServerSocket(_loop), DeferredMonitor(_loop),
+	:ServerSocket(_loop),
 	 base(httpd_output_plugin, block),
-	 encoder(nullptr), unflushed_input(0),
-	 metadata(nullptr)
+	 group(HttpdEncoderGroup::Join(*this, block)),
+	 encoder(nullptr),
+	 input_format(AudioFormat::Undefined()),
+	 unflushed_input(0),
+	 burst_size(block.GetBlockValue("burst_size", 0u)),
+	 burst_time(std::chrono::milliseconds(block.GetBlockValue("burst_time",
+								  0u))),
+	 pages(std::max(burst_size, HTTPD_MIN_BACKLOG)),
+	 header(nullptr), metadata(nullptr), next_shard(0), n_clients(0)
 {
 	/* read configuration */
 	name = block.GetBlockValue("name", "Set name in config");
@@ -71,6 +127,15 @@ HttpdOutput::HttpdOutput(EventLoop &_loop, const ConfigBlock &block)
 
 	clients_max = block.GetBlockValue("max_clients", 0u);
 
+	if (burst_size == 0 && burst_time > burst_time.zero())
+		/* only limited by time: send as much as the
+		   backlog has */
+		burst_size = HTTPD_MIN_BACKLOG;
+
+	n_threads = block.GetBlockValue("threads", 1u);
+	if (n_threads == 0)
+		throw std::runtime_error("Invalid \"threads\" setting");
+
 	/* set up bind_to_address */
 
 	const char *bind_to_address = block.GetBlockValue("bind_to_address");
@@ -87,14 +152,20 @@ HttpdOutput::HttpdOutput(EventLoop &_loop, const ConfigBlock &block)
 	content_type = prepared_encoder->GetMimeType();
 	if (content_type == nullptr)
 		content_type = "application/octet-stream";
+
+	is_frame_start = GetFrameStartFunction(content_type);
 }
 
 HttpdOutput::~HttpdOutput()
 {
+	assert(shards.empty());
+
 	if (metadata != nullptr)
 		metadata->Unref();
 
 	delete prepared_encoder;
+
+	group.Leave(*this);
 }
 
 inline void
@@ -102,9 +173,24 @@ HttpdOutput::Bind()
 {
 	open = false;
 
-	BlockingCall(GetEventLoop(), [this](){
-			ServerSocket::Open();
-		});
+	assert(shards.empty());
+
+	if (n_threads == 1)
+		shards.push_back(new HttpdShard(*this, GetEventLoop()));
+	else
+		for (unsigned i = 0; i < n_threads; ++i)
+			shards.push_back(new HttpdShard(*this));
+
+	next_shard = 0;
+
+	try {
+		BlockingCall(GetEventLoop(), [this](){
+				ServerSocket::Open();
+			});
+	} catch (...) {
+		DeleteShards();
+		throw;
+	}
 }
 
 inline void
@@ -115,6 +201,25 @@ HttpdOutput::Unbind()
 	BlockingCall(GetEventLoop(), [this](){
 			ServerSocket::Close();
 		});
+
+	DeleteShards();
+}
+
+void
+HttpdOutput::DeleteShards()
+{
+	for (auto *shard : shards) {
+		if (&shard->GetEventLoop() == &GetEventLoop())
+			/* this shard shares the IOThread, and must be
+			   deleted inside it */
+			BlockingCall(GetEventLoop(), [shard](){
+					delete shard;
+				});
+		else
+			delete shard;
+	}
+
+	shards.clear();
 }
 
 static AudioOutput *
@@ -131,43 +236,11 @@ httpd_output_finish(AudioOutput *ao)
 	delete httpd;
 }
 
-/**
- * Creates a new #HttpdClient object and adds it into the
- * HttpdOutput.clients linked list.
- */
-inline void
-HttpdOutput::AddClient(int fd)
-{
-	auto *client = new HttpdClient(*this, fd, GetEventLoop(),
-				       !encoder->ImplementsTag());
-	clients.push_front(*client);
-
-	/* pass metadata to client */
-	if (metadata != nullptr)
-		clients.front().PushMetaData(metadata);
-}
-
 void
-HttpdOutput::RunDeferred()
+HttpdOutput::OrShardEvents(unsigned mask)
 {
-	/* this method runs in the IOThread; it broadcasts pages from
-	   our own queue to all clients */
-
-	const std::lock_guard<Mutex> protect(mutex);
-
-	while (!pages.empty()) {
-		Page *page = pages.front();
-		pages.pop();
-
-		for (auto &client : clients)
-			client.PushPage(page);
-
-		page->Unref();
-	}
-
-	/* wake up the client that may be waiting for the queue to be
-	   flushed */
-	cond.broadcast();
+	for (auto *shard : shards)
+		shard->OrEvents(mask);
 }
 
 void
@@ -204,9 +277,13 @@ HttpdOutput::OnAccept(int fd, SocketAddress address, gcc_unused int uid)
 
 	if (fd >= 0) {
 		/* can we allow additional client */
-		if (open && (clients_max == 0 || clients.size() < clients_max))
-			AddClient(fd);
-		else
+		if (open && (clients_max == 0 || n_clients < clients_max)) {
+			++n_clients;
+
+			/* distribute the clients over all shards */
+			shards[next_shard]->AddSocket(fd);
+			next_shard = (next_shard + 1) % shards.size();
+		} else
 			close_socket(fd);
 	} else if (fd < 0 && errno != EINTR) {
 		LogErrno(httpd_output_domain, "accept() failed");
@@ -247,6 +324,21 @@ HttpdOutput::ReadPage()
 	return Page::Copy(buffer, size);
 }
 
+size_t
+HttpdOutput::FindFrameStart(const Page &page) const noexcept
+{
+	if (is_frame_start == nullptr)
+		return 0;
+
+	/* a frame which begins at the end of the page and whose
+	   header is cut off is not found; the next one is */
+	for (size_t i = 0; i < page.size; ++i)
+		if (is_frame_start(page.data + i, page.size - i))
+			return i;
+
+	return page.size;
+}
+
 static void
 httpd_output_enable(AudioOutput *ao)
 {
@@ -263,29 +355,141 @@ httpd_output_disable(AudioOutput *ao)
 	httpd->Unbind();
 }
 
-inline void
+void
+HttpdOutput::SetHeader(Page *page)
+{
+	const std::lock_guard<Mutex> protect(mutex);
+
+	if (header != nullptr)
+		header->Unref();
+	header = page;
+}
+
+Page *
 HttpdOutput::OpenEncoder(AudioFormat &audio_format)
 {
+	assert(encoder == nullptr);
+	assert(leader == nullptr);
+
 	encoder = prepared_encoder->Open(audio_format);
+	encoder_format = audio_format;
+	encoder_tags = encoder->ImplementsTag();
+	unflushed_input = 0;
 
 	/* we have to remember the encoder header, i.e. the first
 	   bytes of encoder output after opening it, because it has to
 	   be sent to every new client */
-	header = ReadPage();
+	return ReadPage();
+}
 
-	unflushed_input = 0;
+bool
+HttpdOutput::CheckEncoder()
+{
+	if (encoder != nullptr)
+		return true;
+
+	if (leader != nullptr)
+		return false;
+
+	/* the previous leader has been closed, and this output has
+	   taken over its followers */
+
+	AudioFormat audio_format = input_format;
+	Page *page = OpenEncoder(audio_format);
+
+	/* the new encoder begins a new stream; send its header to
+	   all clients which are already connected */
+	ReplaceHeader(page);
+	return true;
+}
+
+void
+HttpdOutput::Follow(HttpdOutput &_leader, AudioFormat &audio_format)
+{
+	assert(encoder == nullptr);
+	assert(leader == nullptr);
+
+	assert(_leader.leader == nullptr);
+
+	leader = &_leader;
+	leader->followers.push_back(this);
+
+	input_format = audio_format;
+	audio_format = encoder_format = leader->encoder_format;
+	encoder_tags = leader->encoder_tags;
+
+	Page *page = leader->header;
+	if (page != nullptr)
+		page->Ref();
+	SetHeader(page);
+}
+
+void
+HttpdOutput::Unfollow()
+{
+	assert(leader != nullptr);
+
+	auto &v = leader->followers;
+	auto i = std::find(v.begin(), v.end(), this);
+	assert(i != v.end());
+	v.erase(i);
+
+	leader = nullptr;
+}
+
+void
+HttpdOutput::HandOver()
+{
+	if (followers.empty())
+		return;
+
+	/* the first follower becomes the new leader; it opens its
+	   encoder in CheckEncoder(), unless it gets closed before
+	   (e.g. because all outputs are being closed) */
+
+	HttpdOutput &next = *followers.front();
+	next.leader = nullptr;
+
+	assert(next.followers.empty());
+	next.followers.assign(std::next(followers.begin()), followers.end());
+	for (auto *i : next.followers)
+		i->leader = &next;
+
+	followers.clear();
+
+	FormatDebug(httpd_output_domain,
+		    "output \"%s\" takes over the encoder from \"%s\"",
+		    next.base.GetName(), base.GetName());
 }
 
 inline void
 HttpdOutput::Open(AudioFormat &audio_format)
 {
 	assert(!open);
-	assert(clients.empty());
-
-	OpenEncoder(audio_format);
+	assert(n_clients == 0);
+
+	{
+		const std::lock_guard<Mutex> protect(group.mutex);
+
+		/* if another output with the same settings encodes
+		   the same input, share its pages */
+		HttpdOutput *other = group.FindLeader(*this, audio_format);
+		if (other != nullptr) {
+			Follow(*other, audio_format);
+			FormatDebug(httpd_output_domain,
+				    "output \"%s\" shares the encoder of \"%s\"",
+				    base.GetName(), other->base.GetName());
+		} else {
+			const AudioFormat requested = audio_format;
+			SetHeader(OpenEncoder(audio_format));
+			input_format = requested;
+		}
+	}
 
 	/* initialize other attributes */
 
+	const std::lock_guard<Mutex> protect(mutex);
+
 	timer = new Timer(audio_format);
 
 	open = true;
@@ -296,7 +500,6 @@ httpd_output_open(AudioOutput *ao, AudioFormat &audio_format)
 {
 	HttpdOutput *httpd = HttpdOutput::Cast(ao);
 
-	const std::lock_guard<Mutex> protect(httpd->mutex);
 	httpd->Open(audio_format);
 }
 
@@ -305,18 +508,48 @@ HttpdOutput::Close()
 {
 	assert(open);
 
+	{
+		/* leave the group first, so the leader doesn't push
+		   any more pages into this output */
+		const std::lock_guard<Mutex> protect(group.mutex);
+
+		if (leader != nullptr)
+			Unfollow();
+		else {
+			HandOver();
+			delete encoder;
+			encoder = nullptr;
+		}
+
+		input_format.Clear();
+	}
+
+	const std::lock_guard<Mutex> protect(mutex);
+
 	open = false;
 
 	delete timer;
 
-	BlockingCall(GetEventLoop(), [this](){
-			clients.clear_and_dispose(DeleteDisposer());
-		});
+	{
+		/* unlock the mutex while waiting for the shards, which
+		   lock it to remove their clients */
+		const ScopeUnlock unlock(mutex);
 
-	if (header != nullptr)
-		header->Unref();
+		for (auto *shard : shards)
+			BlockingCall(shard->GetEventLoop(), [this, shard](){
+					const std::lock_guard<Mutex> protect2(mutex);
+					shard->CloseAllClients();
+				});
+	}
+
+	assert(n_clients == 0);
+
+	pages.Clear();
 
-	delete encoder;
+	if (header != nullptr) {
+		header->Unref();
+		header = nullptr;
+	}
 }
 
 static void
@@ -324,22 +557,42 @@ httpd_output_close(AudioOutput *ao)
 {
 	HttpdOutput *httpd = HttpdOutput::Cast(ao);
 
-	const std::lock_guard<Mutex> protect(httpd->mutex);
 	httpd->Close();
 }
 
-void
-HttpdOutput::RemoveClient(HttpdClient &client)
+bool
+HttpdOutput::IsMetadataSupported() const noexcept
+{
+	assert(open);
+
+	return !encoder_tags;
+}
+
+bool
+HttpdOutput::HasListeners() const noexcept
 {
-	assert(!clients.empty());
+	if (LockHasClients())
+		return true;
+
+	for (const auto *i : followers)
+		if (i->LockHasClients())
+			return true;
 
-	clients.erase_and_dispose(clients.iterator_to(client),
-				  DeleteDisposer());
+	return false;
+}
+
+bool
+HttpdOutput::LockHasListeners() const noexcept
+{
+	const std::lock_guard<Mutex> protect(group.mutex);
+	return HasListeners();
 }
 
 void
 HttpdOutput::SendHeader(HttpdClient &client) const
 {
+	const std::lock_guard<Mutex> protect(mutex);
+
 	if (header != nullptr)
 		client.PushPage(header);
 }
@@ -347,7 +600,7 @@ HttpdOutput::SendHeader(HttpdClient &client) const
 inline std::chrono::steady_clock::duration
 HttpdOutput::Delay() const noexcept
 {
-	if (!LockHasClients() && base.pause) {
+	if (!LockHasListeners() && base.pause) {
 		/* if there's no client and this output is paused,
 		   then httpd_output_pause() will not do anything, it
 		   will not fill the buffer and it will not update the
@@ -378,29 +631,59 @@ HttpdOutput::BroadcastPage(Page *page)
 {
 	assert(page != nullptr);
 
-	mutex.lock();
-	pages.push(page);
-	page->Ref();
-	mutex.unlock();
+	const size_t frame_start = FindFrameStart(*page);
+
+	pages.Push(*page, frame_start);
+	OrShardEvents(HttpdShard::PAGES);
+
+	for (auto *i : followers) {
+		i->pages.Push(*page, frame_start);
+		i->OrShardEvents(HttpdShard::PAGES);
+	}
+}
+
+void
+HttpdOutput::ReplaceHeader(Page *page)
+{
+	if (page != nullptr)
+		BroadcastPage(page);
+
+	/* the backlog sent to new clients must not contain pages of
+	   the old stream; this is done before the header is replaced,
+	   so a client accepted right now gets the old header followed
+	   by the new one */
+	pages.MarkStreamStart();
+	for (auto *i : followers) {
+		i->pages.MarkStreamStart();
+		if (page != nullptr)
+			page->Ref();
+		i->SetHeader(page);
+	}
 
-	DeferredMonitor::Schedule();
+	SetHeader(page);
 }
 
 void
 HttpdOutput::BroadcastFromEncoder()
 {
-	/* synchronize with the IOThread */
-	mutex.lock();
-	while (!pages.empty())
-		cond.wait(mutex);
+	bool empty = true;
 
 	Page *page;
-	while ((page = ReadPage()) != nullptr)
-		pages.push(page);
+	while ((page = ReadPage()) != nullptr) {
+		const size_t frame_start = FindFrameStart(*page);
 
-	mutex.unlock();
+		pages.Push(*page, frame_start);
+		for (auto *i : followers)
+			i->pages.Push(*page, frame_start);
+		page->Unref();
+		empty = false;
+	}
 
-	DeferredMonitor::Schedule();
+	if (!empty) {
+		OrShardEvents(HttpdShard::PAGES);
+		for (auto *i : followers)
+			i->OrShardEvents(HttpdShard::PAGES);
+	}
 }
 
 inline void
@@ -416,8 +699,13 @@ HttpdOutput::EncodeAndPlay(const void *chunk, size_t size)
 inline size_t
 HttpdOutput::Play(const void *chunk, size_t size)
 {
-	if (LockHasClients())
-		EncodeAndPlay(chunk, size);
+	{
+		/* a follower discards its input; the leader's encoder
+		   produces its pages */
+		const std::lock_guard<Mutex> protect(group.mutex);
+		if (CheckEncoder() && HasListeners())
+			EncodeAndPlay(chunk, size);
+	}
 
 	if (!timer->IsStarted())
 		timer->Start();
@@ -439,7 +727,7 @@ httpd_output_pause(AudioOutput *ao)
 {
 	HttpdOutput *httpd = HttpdOutput::Cast(ao);
 
-	if (httpd->LockHasClients()) {
+	if (httpd->LockHasListeners()) {
 		static const char silence[1020] = { 0 };
 		httpd->Play(silence, sizeof(silence));
 	}
@@ -450,9 +738,15 @@ httpd_output_pause(AudioOutput *ao)
 inline void
 HttpdOutput::SendTag(const Tag &tag)
 {
-	if (encoder->ImplementsTag()) {
+	if (encoder_tags) {
 		/* embed encoder tags */
 
+		const std::lock_guard<Mutex> protect(group.mutex);
+		if (!CheckEncoder())
+			/* this is a follower; the leader's encoder
+			   receives the same tag */
+			return;
+
 		/* flush the current stream, and end it */
 
 		try {
@@ -478,29 +772,27 @@ HttpdOutput::SendTag(const Tag &tag)
 		   new clients */
 
 		Page *page = ReadPage();
-		if (page != nullptr) {
-			if (header != nullptr)
-				header->Unref();
-			header = page;
-			BroadcastPage(page);
-		}
+		if (page != nullptr)
+			ReplaceHeader(page);
 	} else {
 		/* use Icy-Metadata */
 
-		if (metadata != nullptr)
-			metadata->Unref();
-
 		static constexpr TagType types[] = {
 			TAG_ALBUM, TAG_ARTIST, TAG_TITLE,
 			TAG_NUM_OF_ITEM_TYPES
 		};
 
-		metadata = icy_server_metadata_page(tag, &types[0]);
-		if (metadata != nullptr) {
+		Page *page = icy_server_metadata_page(tag, &types[0]);
+
+		{
 			const std::lock_guard<Mutex> protect(mutex);
-			for (auto &client : clients)
-				client.PushMetaData(metadata);
+			if (metadata != nullptr)
+				metadata->Unref();
+			metadata = page;
 		}
+
+		if (page != nullptr)
+			OrShardEvents(HttpdShard::METADATA);
 	}
 }
 
@@ -515,18 +807,12 @@ httpd_output_tag(AudioOutput *ao, const Tag &tag)
 inline void
 HttpdOutput::CancelAllClients()
 {
-	const std::lock_guard<Mutex> protect(mutex);
+	pages.Clear();
 
-	while (!pages.empty()) {
-		Page *page = pages.front();
-		pages.pop();
-		page->Unref();
-	}
-
-	for (auto &client : clients)
-		client.CancelQueue();
-
-	cond.broadcast();
+	for (auto *shard : shards)
+		BlockingCall(shard->GetEventLoop(), [shard](){
+				shard->CancelAllClients();
+			});
 }
 
 static void
@@ -534,9 +820,7 @@ httpd_output_cancel(AudioOutput *ao)
 {
 	HttpdOutput *httpd = HttpdOutput::Cast(ao);
 
-	BlockingCall(io_thread_get(), [httpd](){
-			httpd->CancelAllClients();
-		});
+	httpd->CancelAllClients();
 }
 
 const struct AudioOutputPlugin httpd_output_plugin = {
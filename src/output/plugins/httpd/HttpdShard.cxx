@@ -0,0 +1,149 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "HttpdShard.hxx"
+#include "HttpdInternal.hxx"
+#include "event/Loop.hxx"
+#include "event/Call.hxx"
+#include "thread/Name.hxx"
+#include "system/fd_util.h"
+#include "util/DeleteDisposer.hxx"
+
+HttpdShard::HttpdShard(HttpdOutput &_httpd, EventLoop &_loop)
+	:httpd(_httpd), loop(_loop),
+	 thread(BIND_THIS_METHOD(Run)),
+	 events(loop, BIND_THIS_METHOD(OnEvents))
+{
+}
+
+HttpdShard::HttpdShard(HttpdOutput &_httpd)
+	:httpd(_httpd), own_loop(new EventLoop()), loop(*own_loop),
+	 thread(BIND_THIS_METHOD(Run)),
+	 events(loop, BIND_THIS_METHOD(OnEvents))
+{
+	thread.Start();
+}
+
+HttpdShard::~HttpdShard()
+{
+	assert(clients.empty());
+	assert(new_sockets.empty());
+
+	if (own_loop) {
+		BlockingCall(loop, [this](){
+				events.Cancel();
+				loop.Break();
+			});
+		thread.Join();
+	} else
+		events.Cancel();
+}
+
+void
+HttpdShard::Run() noexcept
+{
+	SetThreadName("httpd");
+
+	loop.Run();
+}
+
+void
+HttpdShard::AddSocket(int fd)
+{
+	new_sockets.push_back(fd);
+	events.OrMask(ACCEPT);
+}
+
+void
+HttpdShard::RemoveClient(HttpdClient &client)
+{
+	assert(!clients.empty());
+
+	clients.erase_and_dispose(clients.iterator_to(client),
+				  DeleteDisposer());
+	httpd.OnClientRemoved();
+}
+
+void
+HttpdShard::CloseAllClients()
+{
+	for (int fd : new_sockets) {
+		close_socket(fd);
+		httpd.OnClientRemoved();
+	}
+
+	new_sockets.clear();
+
+	while (!clients.empty())
+		RemoveClient(clients.front());
+}
+
+void
+HttpdShard::CancelAllClients()
+{
+	for (auto &client : clients)
+		client.CancelQueue();
+}
+
+inline void
+HttpdShard::AcceptSockets()
+{
+	const std::lock_guard<Mutex> protect(httpd.mutex);
+
+	for (int fd : new_sockets) {
+		if (!httpd.IsOpen()) {
+			/* the output has been closed meanwhile */
+			close_socket(fd);
+			httpd.OnClientRemoved();
+			continue;
+		}
+
+		auto *client = new HttpdClient(httpd, *this, fd, loop,
+					       httpd.IsMetadataSupported());
+		clients.push_front(*client);
+
+		/* pass metadata to client */
+		Page *metadata = httpd.GetMetadata();
+		if (metadata != nullptr)
+			client->PushMetaData(metadata);
+	}
+
+	new_sockets.clear();
+}
+
+void
+HttpdShard::OnEvents(unsigned mask)
+{
+	if (mask & ACCEPT)
+		AcceptSockets();
+
+	if (mask & METADATA) {
+		const std::lock_guard<Mutex> protect(httpd.mutex);
+
+		Page *metadata = httpd.GetMetadata();
+		if (metadata != nullptr)
+			for (auto &client : clients)
+				client.PushMetaData(metadata);
+	}
+
+	if (mask & PAGES)
+		for (auto &client : clients)
+			client.OnPages();
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_OUTPUT_HTTPD_SHARD_HXX
+#define MPD_OUTPUT_HTTPD_SHARD_HXX
+
+#include "HttpdClient.hxx"
+#include "event/MaskMonitor.hxx"
+#include "thread/Thread.hxx"
+
+#include <boost/intrusive/list.hpp>
+
+#include <memory>
+#include <vector>
+
+class EventLoop;
+class HttpdOutput;
+
+/**
+ * A group of #HttpdClient objects which are handled by one
+ * #EventLoop.  An httpd output distributes its clients over one or
+ * more shards; each one (unless it shares the IOThread) runs its own
+ * thread.
+ */
+class HttpdShard final {
+	HttpdOutput &httpd;
+
+	/**
+	 * If this shard runs its own thread, then this is its
+	 * #EventLoop.
+	 */
+	const std::unique_ptr<EventLoop> own_loop;
+
+	EventLoop &loop;
+
+	Thread thread;
+
+	MaskMonitor events;
+
+	/**
+	 * Accepted sockets which shall be added to this shard.
+	 * Protected by HttpdOutput::mutex.
+	 */
+	std::vector<int> new_sockets;
+
+	/**
+	 * The clients of this shard.  This list is modified only in
+	 * this shard's thread, and only while HttpdOutput::mutex is
+	 * locked.
+	 */
+	boost::intrusive::list<HttpdClient,
+			       boost::intrusive::constant_time_size<true>> clients;
+
+public:
+	/**
+	 * Flags for #events.
+	 */
+	static constexpr unsigned ACCEPT = 0x1;
+	static constexpr unsigned PAGES = 0x2;
+	static constexpr unsigned METADATA = 0x4;
+
+	/**
+	 * Construct a shard which runs in the specified (already
+	 * running) #EventLoop.
+	 */
+	HttpdShard(HttpdOutput &_httpd, EventLoop &_loop);
+
+	/**
+	 * Construct a shard with its own #EventLoop and thread.
+	 */
+	explicit HttpdShard(HttpdOutput &_httpd);
+
+	/**
+	 * Stops the thread, if this shard has one.  A shard which
+	 * shares an #EventLoop must be destructed inside it.
+	 */
+	~HttpdShard();
+
+	HttpdShard(const HttpdShard &) = delete;
+	HttpdShard &operator=(const HttpdShard &) = delete;
+
+	EventLoop &GetEventLoop() {
+		return loop;
+	}
+
+	/**
+	 * Schedule a call to OnEvents().  This method is
+	 * thread-safe.
+	 */
+	void OrEvents(unsigned mask) {
+		events.OrMask(mask);
+	}
+
+	/**
+	 * Pass an accepted socket to this shard.
+	 *
+	 * Caller must lock the mutex.
+	 */
+	void AddSocket(int fd);
+
+	/**
+	 * Removes a client from this shard and frees it.
+	 *
+	 * Caller must lock the mutex.
+	 */
+	void RemoveClient(HttpdClient &client);
+
+	/**
+	 * Frees all clients and pending sockets.  Must be called in
+	 * this shard's thread.
+	 *
+	 * Caller must lock the mutex.
+	 */
+	void CloseAllClients();
+
+	/**
+	 * Clears the page queue of all clients.  Must be called in
+	 * this shard's thread.
+	 */
+	void CancelAllClients();
+
+private:
+	void Run() noexcept;
+
+	/**
+	 * Creates #HttpdClient objects for all #new_sockets.
+	 */
+	void AcceptSockets();
+
+	void OnEvents(unsigned mask);
+};
+
+#endif
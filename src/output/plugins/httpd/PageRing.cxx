@@ -0,0 +1,135 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "PageRing.hxx"
+#include "Page.hxx"
+
+#include <assert.h>
+
+inline void
+PageRing::PopFront()
+{
+	assert(head < tail);
+	assert(!items.empty());
+
+	Page *page = items.front().page;
+	items.pop_front();
+	++head;
+
+	assert(size >= page->size);
+	size -= page->size;
+	page->Unref();
+}
+
+void
+PageRing::Push(Page &page, size_t frame_start)
+{
+	assert(frame_start <= page.size);
+
+	page.Ref();
+
+	const auto now = std::chrono::steady_clock::now();
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	while (head < tail && size + page.size > max_size)
+		PopFront();
+
+	items.push_back({&page, now, frame_start});
+	++tail;
+	size += page.size;
+}
+
+void
+PageRing::Clear()
+{
+	const std::lock_guard<Mutex> protect(mutex);
+
+	while (head < tail)
+		PopFront();
+
+	assert(size == 0);
+}
+
+void
+PageRing::MarkStreamStart()
+{
+	const std::lock_guard<Mutex> protect(mutex);
+	stream_start = tail;
+}
+
+uint64_t
+PageRing::GetTail() const noexcept
+{
+	const std::lock_guard<Mutex> protect(mutex);
+	return tail;
+}
+
+PageRing::BurstStart
+PageRing::GetBurstStart(size_t burst_size,
+			std::chrono::steady_clock::duration burst_time) const noexcept
+{
+	const bool check_time = burst_time > burst_time.zero();
+	const auto min_time = std::chrono::steady_clock::now() - burst_time;
+
+	const std::lock_guard<Mutex> protect(mutex);
+
+	/* walk backwards from the newest page */
+	uint64_t cursor = tail;
+	size_t burst = 0;
+	while (cursor > head && cursor > stream_start) {
+		const Item &item = items[cursor - 1 - head];
+		if (burst + item.page->size > burst_size ||
+		    (check_time && item.time < min_time))
+			break;
+
+		burst += item.page->size;
+		--cursor;
+	}
+
+	/* the pages are cut from the encoder output at arbitrary
+	   offsets; begin at the first frame boundary, so the client
+	   does not receive a truncated frame (or Ogg page) */
+	for (; cursor < tail; ++cursor) {
+		const Item &item = items[cursor - head];
+		if (item.frame_start < item.page->size)
+			return {cursor, item.frame_start};
+	}
+
+	return {tail, 0};
+}
+
+size_t
+PageRing::Read(uint64_t &cursor, Page **dest, size_t max) const
+{
+	const std::lock_guard<Mutex> protect(mutex);
+
+	if (cursor < head)
+		cursor = head;
+
+	size_t n = 0;
+	for (; n < max && cursor < tail; ++n, ++cursor) {
+		Page *page = items[cursor - head].page;
+		page->Ref();
+		dest[n] = page;
+	}
+
+	return n;
+}
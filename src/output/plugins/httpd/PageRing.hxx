@@ -0,0 +1,174 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_OUTPUT_HTTPD_PAGE_RING_HXX
+#define MPD_OUTPUT_HTTPD_PAGE_RING_HXX
+
+#include "thread/Mutex.hxx"
+#include "Compiler.h"
+
+#include <chrono>
+#include <deque>
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Page;
+
+/**
+ * A bounded FIFO of #Page objects which is shared by all clients of
+ * an httpd output.  Instead of copying each page into a queue per
+ * client, each client keeps a cursor, i.e. the sequence number of
+ * the next page it wants to send.  When the ring is full, the oldest
+ * pages are dropped, and clients which have not sent them yet (i.e.
+ * clients which are too slow) skip them.
+ *
+ * The pages which have been sent already are kept as long as they fit
+ * into the ring; they are the backlog for newly connected clients
+ * (see GetBurstStart()).
+ *
+ * This class is thread-safe.
+ */
+class PageRing {
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	/**
+	 * The maximum sum of all page sizes.  This limits how far a
+	 * client may fall behind.
+	 */
+	const size_t max_size;
+
+	mutable Mutex mutex;
+
+	struct Item {
+		Page *page;
+
+		/**
+		 * When was this page pushed?
+		 */
+		TimePoint time;
+
+		/**
+		 * The offset of the first encoder frame (or Ogg page)
+		 * which begins in this page; Page::size if there is
+		 * none.
+		 */
+		size_t frame_start;
+	};
+
+	std::deque<Item> items;
+
+	/**
+	 * The sequence number of the oldest page, and the one of
+	 * the next page to be pushed.
+	 */
+	uint64_t head = 0, tail = 0;
+
+	/**
+	 * New clients shall not receive pages before this sequence
+	 * number, see MarkStreamStart().
+	 */
+	uint64_t stream_start = 0;
+
+	/**
+	 * The sum of all page sizes.
+	 */
+	size_t size = 0;
+
+public:
+	explicit PageRing(size_t _max_size):max_size(_max_size) {}
+
+	~PageRing() {
+		Clear();
+	}
+
+	PageRing(const PageRing &) = delete;
+	PageRing &operator=(const PageRing &) = delete;
+
+	/**
+	 * Append a page (adding a reference), and drop the oldest
+	 * pages if necessary.
+	 *
+	 * @param frame_start the offset of the first encoder frame
+	 * which begins in this page (Page::size if none does); a new
+	 * client's burst begins there
+	 */
+	void Push(Page &page, size_t frame_start);
+
+	/**
+	 * Drop all pages.  Cursors remain valid.
+	 */
+	void Clear();
+
+	/**
+	 * The next page begins a new stream (i.e. the encoder has
+	 * generated a new header); the backlog must not reach beyond
+	 * it.
+	 */
+	void MarkStreamStart();
+
+	/**
+	 * Returns a cursor pointing to the next page to be pushed.
+	 */
+	gcc_pure
+	uint64_t GetTail() const noexcept;
+
+	struct BurstStart {
+		/**
+		 * The cursor of the first page to be sent.
+		 */
+		uint64_t cursor;
+
+		/**
+		 * The number of bytes to be skipped in the first
+		 * page, because they belong to a frame which began
+		 * in an earlier page.
+		 */
+		size_t offset;
+	};
+
+	/**
+	 * Returns a cursor for a new client, which includes as much
+	 * backlog as allowed by the parameters.  The backlog begins
+	 * at a frame boundary passed to Push().
+	 *
+	 * @param burst_size the maximum size of the backlog in bytes
+	 * @param burst_time the maximum age of the backlog pages;
+	 * zero means no limit
+	 */
+	gcc_pure
+	BurstStart GetBurstStart(size_t burst_size,
+				 std::chrono::steady_clock::duration burst_time) const noexcept;
+
+	/**
+	 * Obtain the pages starting at the given cursor, and advance
+	 * it.  If the pages at the cursor have been dropped already,
+	 * they are skipped.
+	 *
+	 * @param dest an array receiving the pages; the caller is
+	 * responsible for releasing the references
+	 * @return the number of pages stored in #dest
+	 */
+	size_t Read(uint64_t &cursor, Page **dest, size_t max) const;
+
+private:
+	void PopFront();
+};
+
+#endif
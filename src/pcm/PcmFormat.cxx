@@ -24,6 +24,7 @@
 #include "Traits.hxx"
 #include "FloatConvert.hxx"
 #include "ShiftConvert.hxx"
+#include "X86Simd.hxx"
 #include "util/ConstBuffer.hxx"
 
 #include "PcmDither.cxx" // including the .cxx file to get inlined templates
@@ -45,8 +46,92 @@ struct PerSampleConvert : C {
 	}
 };
 
+/**
+ * Converts a buffer with the per-sample converter #C, or with a
+ * vectorized implementation if there is one for this CPU.
+ */
+template<typename C>
+struct OptimizedConvert : PerSampleConvert<C> {};
+
+#ifdef PCM_HAVE_X86_SIMD
+
+/**
+ * Glue a runtime-dispatched x86 kernel (which converts as many
+ * samples as fit into whole vectors) to the "portable" algorithm
+ * which converts the rest.
+ */
+template<typename C,
+	 size_t (*optimized)(typename C::DstTraits::pointer_type,
+			     typename C::SrcTraits::const_pointer_type,
+			     size_t)>
+struct X86GlueConvert : PerSampleConvert<C> {
+	void Convert(typename C::DstTraits::pointer_type gcc_restrict out,
+		     typename C::SrcTraits::const_pointer_type gcc_restrict in,
+		     size_t n) const {
+		const size_t done = optimized(out, in, n);
+		PerSampleConvert<C>::Convert(out + done, in + done, n - done);
+	}
+};
+
+typedef LeftShiftSampleConvert<SampleFormat::S16,
+			       SampleFormat::S24_P32> ShiftConvert16To24;
+typedef LeftShiftSampleConvert<SampleFormat::S16,
+			       SampleFormat::S32> ShiftConvert16To32;
+typedef LeftShiftSampleConvert<SampleFormat::S24_P32,
+			       SampleFormat::S32> ShiftConvert24To32;
+typedef RightShiftSampleConvert<SampleFormat::S32,
+				SampleFormat::S24_P32> ShiftConvert32To24;
+
+template<>
+struct OptimizedConvert<ShiftConvert16To24>
+	: X86GlueConvert<ShiftConvert16To24, X86Convert16To24> {};
+
+template<>
+struct OptimizedConvert<ShiftConvert16To32>
+	: X86GlueConvert<ShiftConvert16To32, X86Convert16To32> {};
+
+template<>
+struct OptimizedConvert<ShiftConvert24To32>
+	: X86GlueConvert<ShiftConvert24To32, X86Convert24To32> {};
+
+template<>
+struct OptimizedConvert<ShiftConvert32To24>
+	: X86GlueConvert<ShiftConvert32To24, X86Convert32To24> {};
+
+template<>
+struct OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S16>>
+	: X86GlueConvert<IntegerToFloatSampleConvert<SampleFormat::S16>,
+			 X86Convert16ToFloat> {};
+
+template<>
+struct OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S24_P32>>
+	: X86GlueConvert<IntegerToFloatSampleConvert<SampleFormat::S24_P32>,
+			 X86Convert24ToFloat> {};
+
+template<>
+struct OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S32>>
+	: X86GlueConvert<IntegerToFloatSampleConvert<SampleFormat::S32>,
+			 X86Convert32ToFloat> {};
+
+template<>
+struct OptimizedConvert<FloatToIntegerSampleConvert<SampleFormat::S16>>
+	: X86GlueConvert<FloatToIntegerSampleConvert<SampleFormat::S16>,
+			 X86ConvertFloatTo16> {};
+
+template<>
+struct OptimizedConvert<FloatToIntegerSampleConvert<SampleFormat::S24_P32>>
+	: X86GlueConvert<FloatToIntegerSampleConvert<SampleFormat::S24_P32>,
+			 X86ConvertFloatTo24> {};
+
+template<>
+struct OptimizedConvert<FloatToIntegerSampleConvert<SampleFormat::S32>>
+	: X86GlueConvert<FloatToIntegerSampleConvert<SampleFormat::S32>,
+			 X86ConvertFloatTo32> {};
+
+#endif
+
 struct Convert8To16
-	: PerSampleConvert<LeftShiftSampleConvert<SampleFormat::S8,
+	: OptimizedConvert<LeftShiftSampleConvert<SampleFormat::S8,
 						  SampleFormat::S16>> {};
 
 struct Convert24To16 {
@@ -80,7 +165,8 @@ struct PortableFloatToInteger
 	: PerSampleConvert<FloatToIntegerSampleConvert<F, Traits>> {};
 
 template<SampleFormat F, class Traits=SampleTraits<F>>
-struct FloatToInteger : PortableFloatToInteger<F, Traits> {};
+struct FloatToInteger
+	: OptimizedConvert<FloatToIntegerSampleConvert<F, Traits>> {};
 
 /**
  * A template class that attempts to use the "optimized" algorithm for
@@ -192,11 +278,11 @@ pcm_convert_to_16(PcmBuffer &buffer, PcmDither &dither,
 }
 
 struct Convert8To24
-	: PerSampleConvert<LeftShiftSampleConvert<SampleFormat::S8,
+	: OptimizedConvert<LeftShiftSampleConvert<SampleFormat::S8,
 						  SampleFormat::S24_P32>> {};
 
 struct Convert16To24
-	: PerSampleConvert<LeftShiftSampleConvert<SampleFormat::S16,
+	: OptimizedConvert<LeftShiftSampleConvert<SampleFormat::S16,
 						  SampleFormat::S24_P32>> {};
 
 static ConstBuffer<int32_t>
@@ -212,7 +298,7 @@ pcm_allocate_16_to_24(PcmBuffer &buffer, ConstBuffer<int16_t> src)
 }
 
 struct Convert32To24
-	: PerSampleConvert<RightShiftSampleConvert<SampleFormat::S32,
+	: OptimizedConvert<RightShiftSampleConvert<SampleFormat::S32,
 						   SampleFormat::S24_P32>> {};
 
 static ConstBuffer<int32_t>
@@ -260,15 +346,15 @@ pcm_convert_to_24(PcmBuffer &buffer,
 }
 
 struct Convert8To32
-	: PerSampleConvert<LeftShiftSampleConvert<SampleFormat::S8,
+	: OptimizedConvert<LeftShiftSampleConvert<SampleFormat::S8,
 						  SampleFormat::S32>> {};
 
 struct Convert16To32
-	: PerSampleConvert<LeftShiftSampleConvert<SampleFormat::S16,
+	: OptimizedConvert<LeftShiftSampleConvert<SampleFormat::S16,
 						  SampleFormat::S32>> {};
 
 struct Convert24To32
-	: PerSampleConvert<LeftShiftSampleConvert<SampleFormat::S24_P32,
+	: OptimizedConvert<LeftShiftSampleConvert<SampleFormat::S24_P32,
 						  SampleFormat::S32>> {};
 
 static ConstBuffer<int32_t>
@@ -328,16 +414,16 @@ pcm_convert_to_32(PcmBuffer &buffer,
 }
 
 struct Convert8ToFloat
-	: PerSampleConvert<IntegerToFloatSampleConvert<SampleFormat::S8>> {};
+	: OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S8>> {};
 
 struct Convert16ToFloat
-	: PerSampleConvert<IntegerToFloatSampleConvert<SampleFormat::S16>> {};
+	: OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S16>> {};
 
 struct Convert24ToFloat
-	: PerSampleConvert<IntegerToFloatSampleConvert<SampleFormat::S24_P32>> {};
+	: OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S24_P32>> {};
 
 struct Convert32ToFloat
-	: PerSampleConvert<IntegerToFloatSampleConvert<SampleFormat::S32>> {};
+	: OptimizedConvert<IntegerToFloatSampleConvert<SampleFormat::S32>> {};
 
 static ConstBuffer<float>
 pcm_allocate_8_to_float(PcmBuffer &buffer, ConstBuffer<int8_t> src)
@@ -22,6 +22,7 @@
 #include "Volume.hxx"
 #include "PcmUtils.hxx"
 #include "Traits.hxx"
+#include "X86Simd.hxx"
 #include "util/Clamp.hxx"
 
 #include "PcmDither.cxx" // including the .cxx file to get inlined templates
@@ -74,6 +75,14 @@ static void
 pcm_add_vol_float(float *buffer1, const float *buffer2,
 		  unsigned num_samples, float volume1, float volume2)
 {
+#ifdef PCM_HAVE_X86_SIMD
+	const size_t done = X86AddVolumeFloat(buffer1, buffer2, num_samples,
+					      volume1, volume2);
+	buffer1 += done;
+	buffer2 += done;
+	num_samples -= done;
+#endif
+
 	while (num_samples > 0) {
 		float sample1 = *buffer1;
 		float sample2 = *buffer2++;
@@ -140,12 +149,56 @@ PcmAdd(typename Traits::value_type _a, typename Traits::value_type _b)
 	return PcmClamp<F, Traits>(a + b);
 }
 
+/**
+ * Add as many samples as possible with a vectorized implementation.
+ *
+ * @return the number of samples which were added
+ */
+template<SampleFormat F, class Traits=SampleTraits<F>>
+static inline size_t
+PcmAddOptimized(typename Traits::pointer_type,
+		typename Traits::const_pointer_type,
+		size_t)
+{
+	return 0;
+}
+
+#ifdef PCM_HAVE_X86_SIMD
+
+template<>
+inline size_t
+PcmAddOptimized<SampleFormat::S16>(int16_t *a, const int16_t *b, size_t n)
+{
+	return X86Add16(a, b, n);
+}
+
+template<>
+inline size_t
+PcmAddOptimized<SampleFormat::S24_P32>(int32_t *a, const int32_t *b, size_t n)
+{
+	return X86Add24(a, b, n);
+}
+
+template<>
+inline size_t
+PcmAddOptimized<SampleFormat::S32>(int32_t *a, const int32_t *b, size_t n)
+{
+	return X86Add32(a, b, n);
+}
+
+#endif
+
 template<SampleFormat F, class Traits=SampleTraits<F>>
 static void
 PcmAdd(typename Traits::pointer_type a,
        typename Traits::const_pointer_type b,
        size_t n)
 {
+	const size_t done = PcmAddOptimized<F, Traits>(a, b, n);
+	a += done;
+	b += done;
+	n -= done;
+
 	for (size_t i = 0; i != n; ++i)
 		a[i] = PcmAdd<F, Traits>(a[i], b[i]);
 }
@@ -165,6 +218,13 @@ PcmAddVoid(void *a, const void *b, size_t size)
 static void
 pcm_add_float(float *buffer1, const float *buffer2, unsigned num_samples)
 {
+#ifdef PCM_HAVE_X86_SIMD
+	const size_t done = X86AddFloat(buffer1, buffer2, num_samples);
+	buffer1 += done;
+	buffer2 += done;
+	num_samples -= done;
+#endif
+
 	while (num_samples > 0) {
 		float sample1 = *buffer1;
 		float sample2 = *buffer2++;
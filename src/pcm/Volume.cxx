@@ -21,6 +21,7 @@
 #include "Volume.hxx"
 #include "Silence.hxx"
 #include "Traits.hxx"
+#include "X86Simd.hxx"
 #include "util/ConstBuffer.hxx"
 #include "util/WritableBuffer.hxx"
 #include "util/RuntimeError.hxx"
@@ -93,6 +94,13 @@ static void
 pcm_volume_change_float(float *dest, const float *src, size_t n,
 			float volume)
 {
+#ifdef PCM_HAVE_X86_SIMD
+	const size_t done = X86VolumeFloat(dest, src, n, volume);
+	dest += done;
+	src += done;
+	n -= done;
+#endif
+
 	for (size_t i = 0; i != n; ++i)
 		dest[i] = src[i] * volume;
 }
@@ -0,0 +1,729 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "X86Simd.hxx"
+
+#ifdef PCM_HAVE_X86_SIMD
+
+#include "PcmUtils.hxx"
+#include "FloatConvert.hxx"
+
+#include <immintrin.h>
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static bool
+DetectAvx2() noexcept
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static bool
+HaveAvx2() noexcept
+{
+	static const bool value = DetectAvx2();
+	return value;
+}
+
+/**
+ * Round the sample count down to a multiple of the vector width.
+ */
+template<size_t width>
+static constexpr size_t
+Whole(size_t n) noexcept
+{
+	return n & ~(width - 1);
+}
+
+typedef FloatToIntegerSampleConvert<SampleFormat::S16> FloatTo16;
+typedef FloatToIntegerSampleConvert<SampleFormat::S24_P32> FloatTo24;
+typedef FloatToIntegerSampleConvert<SampleFormat::S32> FloatTo32;
+typedef IntegerToFloatSampleConvert<SampleFormat::S16> Int16ToFloat;
+typedef IntegerToFloatSampleConvert<SampleFormat::S24_P32> Int24ToFloat;
+typedef IntegerToFloatSampleConvert<SampleFormat::S32> Int32ToFloat;
+
+/*
+ * SSE2
+ *
+ */
+
+static inline __m128i
+Sse2Load(const void *p) noexcept
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline void
+Sse2Store(void *p, __m128i x) noexcept
+{
+	_mm_storeu_si128((__m128i *)p, x);
+}
+
+/**
+ * Select #a where #mask is all ones, and #b where it is zero.
+ */
+static inline __m128i
+Sse2Select(__m128i mask, __m128i a, __m128i b) noexcept
+{
+	return _mm_or_si128(_mm_and_si128(mask, a),
+			    _mm_andnot_si128(mask, b));
+}
+
+/**
+ * Sign-extend the lower four 16 bit integers to 32 bit.
+ */
+static inline __m128i
+Sse2ExtendLo16(__m128i x) noexcept
+{
+	return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+}
+
+/**
+ * Sign-extend the upper four 16 bit integers to 32 bit.
+ */
+static inline __m128i
+Sse2ExtendHi16(__m128i x) noexcept
+{
+	return _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+}
+
+static size_t
+Sse2VolumeFloat(float *dest, const float *src, size_t n,
+		float volume) noexcept
+{
+	const __m128 v = _mm_set1_ps(volume);
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4)
+		_mm_storeu_ps(dest + i, _mm_mul_ps(_mm_loadu_ps(src + i), v));
+	return end;
+}
+
+static size_t
+Sse2AddVolumeFloat(float *a, const float *b, size_t n,
+		   float volume1, float volume2) noexcept
+{
+	const __m128 v1 = _mm_set1_ps(volume1), v2 = _mm_set1_ps(volume2);
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4) {
+		const __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), v1);
+		const __m128 y = _mm_mul_ps(_mm_loadu_ps(b + i), v2);
+		_mm_storeu_ps(a + i, _mm_add_ps(x, y));
+	}
+
+	return end;
+}
+
+static size_t
+Sse2AddFloat(float *a, const float *b, size_t n) noexcept
+{
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4)
+		_mm_storeu_ps(a + i, _mm_add_ps(_mm_loadu_ps(a + i),
+						_mm_loadu_ps(b + i)));
+	return end;
+}
+
+static size_t
+Sse2Add16(int16_t *a, const int16_t *b, size_t n) noexcept
+{
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		Sse2Store(a + i, _mm_adds_epi16(Sse2Load(a + i),
+						Sse2Load(b + i)));
+	return end;
+}
+
+static size_t
+Sse2Add24(int32_t *a, const int32_t *b, size_t n) noexcept
+{
+	const __m128i min = _mm_set1_epi32(SampleTraits<SampleFormat::S24_P32>::MIN);
+	const __m128i max = _mm_set1_epi32(SampleTraits<SampleFormat::S24_P32>::MAX);
+
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4) {
+		__m128i x = _mm_add_epi32(Sse2Load(a + i), Sse2Load(b + i));
+		x = Sse2Select(_mm_cmpgt_epi32(x, max), max, x);
+		x = Sse2Select(_mm_cmplt_epi32(x, min), min, x);
+		Sse2Store(a + i, x);
+	}
+
+	return end;
+}
+
+static size_t
+Sse2Add32(int32_t *a, const int32_t *b, size_t n) noexcept
+{
+	const __m128i max = _mm_set1_epi32(0x7fffffff);
+
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4) {
+		const __m128i x = Sse2Load(a + i), y = Sse2Load(b + i);
+		const __m128i sum = _mm_add_epi32(x, y);
+
+		/* the addition has overflowed if both operands have
+		   a different sign than the result */
+		const __m128i overflow =
+			_mm_srai_epi32(_mm_and_si128(_mm_xor_si128(x, sum),
+						     _mm_xor_si128(y, sum)),
+				       31);
+		const __m128i saturated =
+			_mm_xor_si128(_mm_srai_epi32(x, 31), max);
+
+		Sse2Store(a + i, Sse2Select(overflow, saturated, sum));
+	}
+
+	return end;
+}
+
+template<int shift>
+static size_t
+Sse2Convert16To32(int32_t *dest, const int16_t *src, size_t n) noexcept
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m128i x = Sse2Load(src + i);
+
+		/* interleaving with zero shifts left by 16 */
+		Sse2Store(dest + i,
+			  _mm_srai_epi32(_mm_unpacklo_epi16(zero, x),
+					 16 - shift));
+		Sse2Store(dest + i + 4,
+			  _mm_srai_epi32(_mm_unpackhi_epi16(zero, x),
+					 16 - shift));
+	}
+
+	return end;
+}
+
+static size_t
+Sse2Convert24To32(int32_t *dest, const int32_t *src, size_t n) noexcept
+{
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4)
+		Sse2Store(dest + i, _mm_slli_epi32(Sse2Load(src + i), 8));
+	return end;
+}
+
+static size_t
+Sse2Convert32To24(int32_t *dest, const int32_t *src, size_t n) noexcept
+{
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4)
+		Sse2Store(dest + i, _mm_srai_epi32(Sse2Load(src + i), 8));
+	return end;
+}
+
+static size_t
+Sse2Convert16ToFloat(float *dest, const int16_t *src, size_t n) noexcept
+{
+	const __m128 factor = _mm_set1_ps(Int16ToFloat::factor);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m128i x = Sse2Load(src + i);
+		_mm_storeu_ps(dest + i,
+			      _mm_mul_ps(_mm_cvtepi32_ps(Sse2ExtendLo16(x)),
+					 factor));
+		_mm_storeu_ps(dest + i + 4,
+			      _mm_mul_ps(_mm_cvtepi32_ps(Sse2ExtendHi16(x)),
+					 factor));
+	}
+
+	return end;
+}
+
+static size_t
+Sse2Convert32ToFloat(float *dest, const int32_t *src, size_t n,
+		     float _factor) noexcept
+{
+	const __m128 factor = _mm_set1_ps(_factor);
+
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4)
+		_mm_storeu_ps(dest + i,
+			      _mm_mul_ps(_mm_cvtepi32_ps(Sse2Load(src + i)),
+					 factor));
+	return end;
+}
+
+/**
+ * Scale and clamp four floating point samples to the given integer
+ * range and truncate them.  Clamping in the floating point domain
+ * gives the same result as PcmClamp() after truncation, because the
+ * limits are exactly representable.
+ */
+static inline __m128i
+Sse2FloatToInt(__m128 x, __m128 factor, __m128 min, __m128 max) noexcept
+{
+	x = _mm_mul_ps(x, factor);
+	x = _mm_min_ps(_mm_max_ps(x, min), max);
+	return _mm_cvttps_epi32(x);
+}
+
+static size_t
+Sse2ConvertFloatTo16(int16_t *dest, const float *src, size_t n) noexcept
+{
+	const __m128 factor = _mm_set1_ps(FloatTo16::factor);
+	const __m128 min = _mm_set1_ps(SampleTraits<SampleFormat::S16>::MIN);
+	const __m128 max = _mm_set1_ps(SampleTraits<SampleFormat::S16>::MAX);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m128i a = Sse2FloatToInt(_mm_loadu_ps(src + i),
+						 factor, min, max);
+		const __m128i b = Sse2FloatToInt(_mm_loadu_ps(src + i + 4),
+						 factor, min, max);
+		Sse2Store(dest + i, _mm_packs_epi32(a, b));
+	}
+
+	return end;
+}
+
+static size_t
+Sse2ConvertFloatTo24(int32_t *dest, const float *src, size_t n) noexcept
+{
+	const __m128 factor = _mm_set1_ps(FloatTo24::factor);
+	const __m128 min = _mm_set1_ps(SampleTraits<SampleFormat::S24_P32>::MIN);
+	const __m128 max = _mm_set1_ps(SampleTraits<SampleFormat::S24_P32>::MAX);
+
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4)
+		Sse2Store(dest + i, Sse2FloatToInt(_mm_loadu_ps(src + i),
+						   factor, min, max));
+	return end;
+}
+
+static size_t
+Sse2ConvertFloatTo32(int32_t *dest, const float *src, size_t n) noexcept
+{
+	const __m128 factor = _mm_set1_ps(FloatTo32::factor);
+	const __m128 limit = _mm_set1_ps(2147483648.f);
+
+	const size_t end = Whole<4>(n);
+	for (size_t i = 0; i != end; i += 4) {
+		const __m128 x = _mm_mul_ps(_mm_loadu_ps(src + i), factor);
+
+		/* out-of-range values are converted to INT32_MIN,
+		   which is already the right answer for negative
+		   ones; flip the positive ones to INT32_MAX */
+		const __m128i overflow =
+			_mm_castps_si128(_mm_cmpge_ps(x, limit));
+		Sse2Store(dest + i,
+			  _mm_xor_si128(_mm_cvttps_epi32(x), overflow));
+	}
+
+	return end;
+}
+
+/*
+ * AVX2
+ *
+ */
+
+AVX2_TARGET
+static inline __m256i
+Avx2Load(const void *p) noexcept
+{
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+
+AVX2_TARGET
+static inline void
+Avx2Store(void *p, __m256i x) noexcept
+{
+	_mm256_storeu_si256((__m256i *)p, x);
+}
+
+AVX2_TARGET
+static size_t
+Avx2VolumeFloat(float *dest, const float *src, size_t n,
+		float volume) noexcept
+{
+	const __m256 v = _mm256_set1_ps(volume);
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		_mm256_storeu_ps(dest + i,
+				 _mm256_mul_ps(_mm256_loadu_ps(src + i), v));
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2AddVolumeFloat(float *a, const float *b, size_t n,
+		   float volume1, float volume2) noexcept
+{
+	const __m256 v1 = _mm256_set1_ps(volume1);
+	const __m256 v2 = _mm256_set1_ps(volume2);
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), v1);
+		const __m256 y = _mm256_mul_ps(_mm256_loadu_ps(b + i), v2);
+		_mm256_storeu_ps(a + i, _mm256_add_ps(x, y));
+	}
+
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2AddFloat(float *a, const float *b, size_t n) noexcept
+{
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		_mm256_storeu_ps(a + i,
+				 _mm256_add_ps(_mm256_loadu_ps(a + i),
+					       _mm256_loadu_ps(b + i)));
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Add16(int16_t *a, const int16_t *b, size_t n) noexcept
+{
+	const size_t end = Whole<16>(n);
+	for (size_t i = 0; i != end; i += 16)
+		Avx2Store(a + i, _mm256_adds_epi16(Avx2Load(a + i),
+						   Avx2Load(b + i)));
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Add24(int32_t *a, const int32_t *b, size_t n) noexcept
+{
+	const __m256i min = _mm256_set1_epi32(SampleTraits<SampleFormat::S24_P32>::MIN);
+	const __m256i max = _mm256_set1_epi32(SampleTraits<SampleFormat::S24_P32>::MAX);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m256i x = _mm256_add_epi32(Avx2Load(a + i),
+						   Avx2Load(b + i));
+		Avx2Store(a + i, _mm256_min_epi32(_mm256_max_epi32(x, min),
+						  max));
+	}
+
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Add32(int32_t *a, const int32_t *b, size_t n) noexcept
+{
+	const __m256i max = _mm256_set1_epi32(0x7fffffff);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m256i x = Avx2Load(a + i), y = Avx2Load(b + i);
+		const __m256i sum = _mm256_add_epi32(x, y);
+
+		/* see Sse2Add32() */
+		const __m256i overflow =
+			_mm256_and_si256(_mm256_xor_si256(x, sum),
+					 _mm256_xor_si256(y, sum));
+		const __m256i saturated =
+			_mm256_xor_si256(_mm256_srai_epi32(x, 31), max);
+
+		Avx2Store(a + i,
+			  _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(sum),
+							       _mm256_castsi256_ps(saturated),
+							       _mm256_castsi256_ps(overflow))));
+	}
+
+	return end;
+}
+
+template<int shift>
+AVX2_TARGET
+static size_t
+Avx2Convert16To32(int32_t *dest, const int16_t *src, size_t n) noexcept
+{
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m256i x = _mm256_cvtepi16_epi32(Sse2Load(src + i));
+		Avx2Store(dest + i, _mm256_slli_epi32(x, shift));
+	}
+
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Convert24To32(int32_t *dest, const int32_t *src, size_t n) noexcept
+{
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		Avx2Store(dest + i, _mm256_slli_epi32(Avx2Load(src + i), 8));
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Convert32To24(int32_t *dest, const int32_t *src, size_t n) noexcept
+{
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		Avx2Store(dest + i, _mm256_srai_epi32(Avx2Load(src + i), 8));
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Convert16ToFloat(float *dest, const int16_t *src, size_t n) noexcept
+{
+	const __m256 factor = _mm256_set1_ps(Int16ToFloat::factor);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m256i x = _mm256_cvtepi16_epi32(Sse2Load(src + i));
+		_mm256_storeu_ps(dest + i,
+				 _mm256_mul_ps(_mm256_cvtepi32_ps(x), factor));
+	}
+
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2Convert32ToFloat(float *dest, const int32_t *src, size_t n,
+		     float _factor) noexcept
+{
+	const __m256 factor = _mm256_set1_ps(_factor);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		_mm256_storeu_ps(dest + i,
+				 _mm256_mul_ps(_mm256_cvtepi32_ps(Avx2Load(src + i)),
+					       factor));
+	return end;
+}
+
+/**
+ * See Sse2FloatToInt().
+ */
+AVX2_TARGET
+static inline __m256i
+Avx2FloatToInt(__m256 x, __m256 factor, __m256 min, __m256 max) noexcept
+{
+	x = _mm256_mul_ps(x, factor);
+	x = _mm256_min_ps(_mm256_max_ps(x, min), max);
+	return _mm256_cvttps_epi32(x);
+}
+
+AVX2_TARGET
+static size_t
+Avx2ConvertFloatTo16(int16_t *dest, const float *src, size_t n) noexcept
+{
+	const __m256 factor = _mm256_set1_ps(FloatTo16::factor);
+	const __m256 min = _mm256_set1_ps(SampleTraits<SampleFormat::S16>::MIN);
+	const __m256 max = _mm256_set1_ps(SampleTraits<SampleFormat::S16>::MAX);
+
+	const size_t end = Whole<16>(n);
+	for (size_t i = 0; i != end; i += 16) {
+		const __m256i a = Avx2FloatToInt(_mm256_loadu_ps(src + i),
+						 factor, min, max);
+		const __m256i b = Avx2FloatToInt(_mm256_loadu_ps(src + i + 8),
+						 factor, min, max);
+
+		/* _mm256_packs_epi32() works on 128 bit lanes;
+		   restore the sample order */
+		const __m256i packed = _mm256_packs_epi32(a, b);
+		Avx2Store(dest + i, _mm256_permute4x64_epi64(packed, 0xd8));
+	}
+
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2ConvertFloatTo24(int32_t *dest, const float *src, size_t n) noexcept
+{
+	const __m256 factor = _mm256_set1_ps(FloatTo24::factor);
+	const __m256 min = _mm256_set1_ps(SampleTraits<SampleFormat::S24_P32>::MIN);
+	const __m256 max = _mm256_set1_ps(SampleTraits<SampleFormat::S24_P32>::MAX);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8)
+		Avx2Store(dest + i, Avx2FloatToInt(_mm256_loadu_ps(src + i),
+						   factor, min, max));
+	return end;
+}
+
+AVX2_TARGET
+static size_t
+Avx2ConvertFloatTo32(int32_t *dest, const float *src, size_t n) noexcept
+{
+	const __m256 factor = _mm256_set1_ps(FloatTo32::factor);
+	const __m256 limit = _mm256_set1_ps(2147483648.f);
+
+	const size_t end = Whole<8>(n);
+	for (size_t i = 0; i != end; i += 8) {
+		const __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src + i),
+					       factor);
+
+		/* see Sse2ConvertFloatTo32() */
+		const __m256i overflow =
+			_mm256_castps_si256(_mm256_cmp_ps(x, limit,
+							  _CMP_GE_OQ));
+		Avx2Store(dest + i,
+			  _mm256_xor_si256(_mm256_cvttps_epi32(x), overflow));
+	}
+
+	return end;
+}
+
+/*
+ * dispatch
+ *
+ */
+
+size_t
+X86VolumeFloat(float *dest, const float *src, size_t n,
+	       float volume) noexcept
+{
+	return HaveAvx2()
+		? Avx2VolumeFloat(dest, src, n, volume)
+		: Sse2VolumeFloat(dest, src, n, volume);
+}
+
+size_t
+X86AddVolumeFloat(float *a, const float *b, size_t n,
+		  float volume1, float volume2) noexcept
+{
+	return HaveAvx2()
+		? Avx2AddVolumeFloat(a, b, n, volume1, volume2)
+		: Sse2AddVolumeFloat(a, b, n, volume1, volume2);
+}
+
+size_t
+X86AddFloat(float *a, const float *b, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2AddFloat(a, b, n)
+		: Sse2AddFloat(a, b, n);
+}
+
+size_t
+X86Add16(int16_t *a, const int16_t *b, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Add16(a, b, n)
+		: Sse2Add16(a, b, n);
+}
+
+size_t
+X86Add24(int32_t *a, const int32_t *b, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Add24(a, b, n)
+		: Sse2Add24(a, b, n);
+}
+
+size_t
+X86Add32(int32_t *a, const int32_t *b, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Add32(a, b, n)
+		: Sse2Add32(a, b, n);
+}
+
+size_t
+X86Convert16To24(int32_t *dest, const int16_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert16To32<8>(dest, src, n)
+		: Sse2Convert16To32<8>(dest, src, n);
+}
+
+size_t
+X86Convert16To32(int32_t *dest, const int16_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert16To32<16>(dest, src, n)
+		: Sse2Convert16To32<16>(dest, src, n);
+}
+
+size_t
+X86Convert24To32(int32_t *dest, const int32_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert24To32(dest, src, n)
+		: Sse2Convert24To32(dest, src, n);
+}
+
+size_t
+X86Convert32To24(int32_t *dest, const int32_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert32To24(dest, src, n)
+		: Sse2Convert32To24(dest, src, n);
+}
+
+size_t
+X86Convert16ToFloat(float *dest, const int16_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert16ToFloat(dest, src, n)
+		: Sse2Convert16ToFloat(dest, src, n);
+}
+
+size_t
+X86Convert24ToFloat(float *dest, const int32_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert32ToFloat(dest, src, n, Int24ToFloat::factor)
+		: Sse2Convert32ToFloat(dest, src, n, Int24ToFloat::factor);
+}
+
+size_t
+X86Convert32ToFloat(float *dest, const int32_t *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2Convert32ToFloat(dest, src, n, Int32ToFloat::factor)
+		: Sse2Convert32ToFloat(dest, src, n, Int32ToFloat::factor);
+}
+
+size_t
+X86ConvertFloatTo16(int16_t *dest, const float *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2ConvertFloatTo16(dest, src, n)
+		: Sse2ConvertFloatTo16(dest, src, n);
+}
+
+size_t
+X86ConvertFloatTo24(int32_t *dest, const float *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2ConvertFloatTo24(dest, src, n)
+		: Sse2ConvertFloatTo24(dest, src, n);
+}
+
+size_t
+X86ConvertFloatTo32(int32_t *dest, const float *src, size_t n) noexcept
+{
+	return HaveAvx2()
+		? Avx2ConvertFloatTo32(dest, src, n)
+		: Sse2ConvertFloatTo32(dest, src, n);
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Vectorized x86 implementations of the stateless PCM kernels
+ * (software volume and mixing of floating point samples, saturating
+ * integer addition and sample format conversions).  They are
+ * dispatched at runtime: AVX2 is used if the CPU supports it, SSE2
+ * otherwise.
+ *
+ * Each function processes as many samples as fit into whole vectors
+ * and returns that number; the caller is responsible for the
+ * remaining samples.  The results are bit-exact with the portable
+ * implementations.
+ */
+
+#ifndef MPD_PCM_X86_SIMD_HXX
+#define MPD_PCM_X86_SIMD_HXX
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#define PCM_HAVE_X86_SIMD
+
+#include <stdint.h>
+#include <stddef.h>
+
+size_t
+X86VolumeFloat(float *dest, const float *src, size_t n,
+	       float volume) noexcept;
+
+size_t
+X86AddVolumeFloat(float *a, const float *b, size_t n,
+		  float volume1, float volume2) noexcept;
+
+size_t
+X86AddFloat(float *a, const float *b, size_t n) noexcept;
+
+size_t
+X86Add16(int16_t *a, const int16_t *b, size_t n) noexcept;
+
+size_t
+X86Add24(int32_t *a, const int32_t *b, size_t n) noexcept;
+
+size_t
+X86Add32(int32_t *a, const int32_t *b, size_t n) noexcept;
+
+size_t
+X86Convert16To24(int32_t *dest, const int16_t *src, size_t n) noexcept;
+
+size_t
+X86Convert16To32(int32_t *dest, const int16_t *src, size_t n) noexcept;
+
+size_t
+X86Convert24To32(int32_t *dest, const int32_t *src, size_t n) noexcept;
+
+size_t
+X86Convert32To24(int32_t *dest, const int32_t *src, size_t n) noexcept;
+
+size_t
+X86Convert16ToFloat(float *dest, const int16_t *src, size_t n) noexcept;
+
+size_t
+X86Convert24ToFloat(float *dest, const int32_t *src, size_t n) noexcept;
+
+size_t
+X86Convert32ToFloat(float *dest, const int32_t *src, size_t n) noexcept;
+
+size_t
+X86ConvertFloatTo16(int16_t *dest, const float *src, size_t n) noexcept;
+
+size_t
+X86ConvertFloatTo24(int32_t *dest, const float *src, size_t n) noexcept;
+
+size_t
+X86ConvertFloatTo32(int32_t *dest, const float *src, size_t n) noexcept;
+
+#endif
+
+#endif
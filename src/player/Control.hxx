@@ -104,6 +104,11 @@ struct PlayerControl final : AudioOutputClient {
 
 	const unsigned buffer_chunks;
 
+	/**
+	 * The payload size of each #MusicChunk.
+	 */
+	const size_t chunk_size;
+
 	const unsigned buffered_before_play;
 
 	/**
@@ -192,6 +197,7 @@ struct PlayerControl final : AudioOutputClient {
 	PlayerControl(PlayerListener &_listener,
 		      MultipleOutputs &_outputs,
 		      unsigned buffer_chunks,
+		      size_t chunk_size,
 		      unsigned buffered_before_play,
 		      AudioFormat _configured_audio_format,
 		      const ReplayGainConfig &_replay_gain_config);
@@ -22,6 +22,8 @@
 
 #include "Compiler.h"
 
+#include <stddef.h>
+
 struct AudioFormat;
 class SignedSongTime;
 
@@ -57,6 +59,7 @@ struct CrossFadeSettings {
 	 * @param af the audio format of the new song
 	 * @param old_format the audio format of the current song
 	 * @param max_chunks the maximum number of chunks
+	 * @param chunk_size the payload size of each chunk
 	 * @return the number of chunks for crossfading, or 0 if cross fading
 	 * should be disabled for this song change
 	 */
@@ -66,7 +69,8 @@ struct CrossFadeSettings {
 			   const char *mixramp_start,
 			   const char *mixramp_prev_end,
 			   AudioFormat af, AudioFormat old_format,
-			   unsigned max_chunks) const noexcept;
+			   unsigned max_chunks,
+			   size_t chunk_size) const noexcept;
 };
 
 #endif
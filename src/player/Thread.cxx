@@ -556,13 +556,13 @@ Player::SendSilence()
 	const size_t frame_size = play_audio_format.GetFrameSize();
 	/* this formula ensures that we don't send
 	   partial frames */
-	unsigned num_frames = sizeof(chunk->data) / frame_size;
+	unsigned num_frames = chunk->capacity / frame_size;
 
 	chunk->bit_rate = 0;
 	chunk->time = SignedSongTime::Negative(); /* undefined time stamp */
 	chunk->length = num_frames * frame_size;
 	chunk->replay_gain_serial = MusicChunk::IGNORE_REPLAY_GAIN;
-	PcmSilence({chunk->data, chunk->length}, play_audio_format.format);
+	PcmSilence({chunk->GetData(), chunk->length}, play_audio_format.format);
 
 	try {
 		pc.outputs.Play(chunk);
@@ -1052,7 +1052,8 @@ Player::Run()
 							dc.out_audio_format,
 							play_audio_format,
 							buffer.GetSize() -
-							pc.buffered_before_play);
+							pc.buffered_before_play,
+							buffer.GetChunkSize());
 			if (cross_fade_chunks > 0)
 				xfade_state = CrossFadeState::ENABLED;
 			else
@@ -1158,7 +1159,7 @@ PlayerControl::RunThread()
 			  replay_gain_config);
 	decoder_thread_start(dc);
 
-	MusicBuffer buffer(buffer_chunks);
+	MusicBuffer buffer(buffer_chunks, chunk_size);
 
 	Lock();
 
@@ -20,6 +20,7 @@
 #include "config.h"
 #include "TagPool.hxx"
 #include "TagItem.hxx"
+#include "thread/Mutex.hxx"
 #include "util/Cast.hxx"
 #include "util/VarSize.hxx"
 #include "util/StringView.hxx"
@@ -27,69 +28,124 @@
 #include <limits>
 
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
-Mutex tag_pool_lock;
+/**
+ * The number of independently locked hash tables.  The upper bits of
+ * the hash select one.
+ */
+static constexpr unsigned N_SHARDS = 16;
 
-static constexpr size_t NUM_SLOTS = 4093;
+static constexpr size_t INITIAL_CAPACITY = 256;
 
 struct TagPoolSlot {
-	TagPoolSlot *next;
-	unsigned char ref;
+	uint32_t hash;
+	uint32_t ref;
 	TagItem item;
 
-	static constexpr unsigned MAX_REF = std::numeric_limits<decltype(ref)>::max();
+	static constexpr auto MAX_REF = std::numeric_limits<decltype(ref)>::max();
 
-	TagPoolSlot(TagPoolSlot *_next, TagType type,
-		    StringView value)
-		:next(_next), ref(1) {
+	TagPoolSlot(uint32_t _hash, TagType type, StringView value)
+		:hash(_hash), ref(1) {
 		item.type = type;
 		memcpy(item.value, value.data, value.size);
 		item.value[value.size] = 0;
 	}
 
-	static TagPoolSlot *Create(TagPoolSlot *_next, TagType type,
+	static TagPoolSlot *Create(uint32_t hash, TagType type,
 				   StringView value);
 };
 
 TagPoolSlot *
-TagPoolSlot::Create(TagPoolSlot *_next, TagType type,
-		    StringView value)
+TagPoolSlot::Create(uint32_t hash, TagType type, StringView value)
 {
 	TagPoolSlot *dummy;
 	return NewVarSize<TagPoolSlot>(sizeof(dummy->item.value),
 				       value.size + 1,
-				       _next, type,
-				       value);
+				       hash, type, value);
 }
 
-static TagPoolSlot *slots[NUM_SLOTS];
+/**
+ * A hash table with open addressing and linear probing.  It grows
+ * when it becomes two thirds full; it never shrinks.
+ */
+class TagPoolShard {
+public:
+	Mutex mutex;
 
-static inline unsigned
-calc_hash(TagType type, StringView p)
-{
-	unsigned hash = 5381;
+private:
+	TagPoolSlot **table = nullptr;
 
-	for (auto ch : p)
-		hash = (hash << 5) + hash + ch;
+	/**
+	 * The number of elements in #table minus one (it is a power
+	 * of two).
+	 */
+	size_t mask = 0;
 
-	return hash ^ type;
-}
+	/**
+	 * The number of #TagPoolSlot instances in #table.
+	 */
+	size_t n = 0;
+
+	uint64_t hits = 0, misses = 0;
+
+public:
+	/**
+	 * Caller must lock the #mutex.
+	 */
+	TagItem *Get(uint32_t hash, TagType type, StringView value);
+
+	/**
+	 * Remove and free the given slot.  Caller must lock the
+	 * #mutex.
+	 */
+	void Remove(TagPoolSlot &slot) noexcept;
+
+	/**
+	 * Caller must lock the #mutex.
+	 */
+	void AddStats(TagPoolStats &stats) const noexcept {
+		stats.n_items += n;
+		stats.capacity += table != nullptr ? mask + 1 : 0;
+		stats.hits += hits;
+		stats.misses += misses;
+	}
+
+private:
+	void Grow();
+};
 
-static inline unsigned
-calc_hash(TagType type, const char *p)
+static TagPoolShard shards[N_SHARDS];
+
+static inline uint32_t
+calc_hash(TagType type, StringView p) noexcept
 {
-	unsigned hash = 5381;
+	/* FNV-1a */
+	uint32_t hash = 2166136261u ^ type;
 
-	assert(p != nullptr);
+	for (auto ch : p)
+		hash = (hash ^ (uint8_t)ch) * 16777619u;
 
-	while (*p != 0)
-		hash = (hash << 5) + hash + *p++;
+	/* finalize with MurmurHash3's fmix32 to spread the bits for
+	   the mask and for the shard selection */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash;
+}
 
-	return hash ^ type;
+static inline TagPoolShard &
+GetShard(uint32_t hash) noexcept
+{
+	return shards[hash >> 28];
 }
 
+static_assert(N_SHARDS == 16, "GetShard() needs to be adjusted");
+
 #if CLANG_OR_GCC_VERSION(4,7)
 	constexpr
 #endif
@@ -99,41 +155,103 @@ tag_item_to_slot(TagItem *item)
 	return &ContainerCast(*item, &TagPoolSlot::item);
 }
 
-static inline TagPoolSlot **
-tag_value_slot_p(TagType type, StringView value)
+void
+TagPoolShard::Grow()
 {
-	return &slots[calc_hash(type, value) % NUM_SLOTS];
-}
+	const size_t old_capacity = table != nullptr ? mask + 1 : 0;
+	const size_t new_capacity = old_capacity > 0
+		? old_capacity * 2
+		: INITIAL_CAPACITY;
 
-static inline TagPoolSlot **
-tag_value_slot_p(TagType type, const char *value)
-{
-	return &slots[calc_hash(type, value) % NUM_SLOTS];
+	TagPoolSlot **old_table = table;
+	table = new TagPoolSlot *[new_capacity]();
+	mask = new_capacity - 1;
+
+	for (size_t i = 0; i < old_capacity; ++i) {
+		TagPoolSlot *slot = old_table[i];
+		if (slot == nullptr)
+			continue;
+
+		size_t j = slot->hash & mask;
+		while (table[j] != nullptr)
+			j = (j + 1) & mask;
+		table[j] = slot;
+	}
+
+	delete[] old_table;
 }
 
 TagItem *
-tag_pool_get_item(TagType type, StringView value)
+TagPoolShard::Get(uint32_t hash, TagType type, StringView value)
 {
-	auto slot_p = tag_value_slot_p(type, value);
-	for (auto slot = *slot_p; slot != nullptr; slot = slot->next) {
-		if (slot->item.type == type &&
+	if (table == nullptr || (n + 1) * 3 > (mask + 1) * 2)
+		Grow();
+
+	size_t i = hash & mask;
+	for (TagPoolSlot *slot; (slot = table[i]) != nullptr;
+	     i = (i + 1) & mask) {
+		if (slot->hash == hash &&
+		    slot->item.type == type &&
 		    value.Equals(slot->item.value) &&
 		    slot->ref < TagPoolSlot::MAX_REF) {
 			assert(slot->ref > 0);
 			++slot->ref;
+			++hits;
 			return &slot->item;
 		}
 	}
 
-	auto slot = TagPoolSlot::Create(*slot_p, type, value);
-	*slot_p = slot;
+	auto slot = TagPoolSlot::Create(hash, type, value);
+	table[i] = slot;
+	++n;
+	++misses;
 	return &slot->item;
 }
 
+void
+TagPoolShard::Remove(TagPoolSlot &slot) noexcept
+{
+	size_t i = slot.hash & mask;
+	while (table[i] != &slot) {
+		assert(table[i] != nullptr);
+		i = (i + 1) & mask;
+	}
+
+	/* backward shift deletion: move following entries of the
+	   cluster into the gap unless that would place them before
+	   their home position */
+	for (size_t j = (i + 1) & mask; table[j] != nullptr;
+	     j = (j + 1) & mask) {
+		const size_t home = table[j]->hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+
+	table[i] = nullptr;
+	--n;
+
+	DeleteVarSize(&slot);
+}
+
+TagItem *
+tag_pool_get_item(TagType type, StringView value)
+{
+	const uint32_t hash = calc_hash(type, value);
+	auto &shard = GetShard(hash);
+
+	const std::lock_guard<Mutex> protect(shard.mutex);
+	return shard.Get(hash, type, value);
+}
+
 TagItem *
 tag_pool_dup_item(TagItem *item)
 {
 	TagPoolSlot *slot = tag_item_to_slot(item);
+	auto &shard = GetShard(slot->hash);
+
+	const std::lock_guard<Mutex> protect(shard.mutex);
 
 	assert(slot->ref > 0);
 
@@ -144,28 +262,34 @@ tag_pool_dup_item(TagItem *item)
 		/* the reference counter overflows above MAX_REF;
 		   obtain a reference to a different TagPoolSlot which
 		   isn't yet "full" */
-		return tag_pool_get_item(item->type, item->value);
+		return shard.Get(slot->hash, item->type, item->value);
 	}
 }
 
 void
 tag_pool_put_item(TagItem *item)
 {
-	TagPoolSlot **slot_p, *slot;
+	TagPoolSlot *slot = tag_item_to_slot(item);
+	auto &shard = GetShard(slot->hash);
+
+	const std::lock_guard<Mutex> protect(shard.mutex);
 
-	slot = tag_item_to_slot(item);
 	assert(slot->ref > 0);
 	--slot->ref;
 
-	if (slot->ref > 0)
-		return;
+	if (slot->ref == 0)
+		shard.Remove(*slot);
+}
+
+TagPoolStats
+tag_pool_get_stats() noexcept
+{
+	TagPoolStats stats{0, 0, 0, 0};
 
-	for (slot_p = tag_value_slot_p(item->type, item->value);
-	     *slot_p != slot;
-	     slot_p = &(*slot_p)->next) {
-		assert(*slot_p != nullptr);
+	for (auto &shard : shards) {
+		const std::lock_guard<Mutex> protect(shard.mutex);
+		shard.AddStats(stats);
 	}
 
-	*slot_p = slot->next;
-	DeleteVarSize(slot);
+	return stats;
 }
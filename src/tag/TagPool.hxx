@@ -21,13 +21,20 @@
 #define MPD_TAG_POOL_HXX
 
 #include "TagType.h"
-#include "thread/Mutex.hxx"
+#include "Compiler.h"
 
-extern Mutex tag_pool_lock;
+#include <stddef.h>
+#include <stdint.h>
 
 struct TagItem;
 struct StringView;
 
+/*
+ * All functions are thread-safe.  The pool is split into several
+ * independently locked hash tables, so concurrent callers rarely
+ * contend.
+ */
+
 TagItem *
 tag_pool_get_item(TagType type, StringView value);
 
@@ -37,4 +44,27 @@ tag_pool_dup_item(TagItem *item);
 void
 tag_pool_put_item(TagItem *item);
 
+struct TagPoolStats {
+	/**
+	 * The number of distinct items in the pool.
+	 */
+	size_t n_items;
+
+	/**
+	 * The total number of hash table slots; n_items/capacity is
+	 * the load factor.
+	 */
+	size_t capacity;
+
+	/**
+	 * The number of tag_pool_get_item() calls which found an
+	 * existing item (hits) or created a new one (misses).
+	 */
+	uint64_t hits, misses;
+};
+
+gcc_pure
+TagPoolStats
+tag_pool_get_stats() noexcept;
+
 #endif
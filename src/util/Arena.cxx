@@ -0,0 +1,82 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Arena.hxx"
+#include "Alloc.hxx"
+
+#include <stdlib.h>
+
+/**
+ * The usual chunk size.  It is larger than glibc's mmap threshold,
+ * so Clear() returns the memory to the kernel.
+ */
+static constexpr size_t ARENA_CHUNK_SIZE = 256 * 1024;
+
+void
+Arena::Clear() noexcept
+{
+	while (head != nullptr) {
+		Chunk *chunk = head;
+		head = chunk->next;
+		free(chunk);
+	}
+
+	position = end = nullptr;
+	size = 0;
+}
+
+void *
+Arena::AllocateSlow(size_t nbytes, size_t alignment)
+{
+	/* the chunk header is padded so the first object in the chunk
+	   can have any (reasonable) alignment */
+	constexpr size_t header_size = alignof(max_align_t) > sizeof(Chunk)
+		? alignof(max_align_t)
+		: sizeof(Chunk);
+
+	if (nbytes + alignment > ARENA_CHUNK_SIZE / 4) {
+		/* large allocations get a dedicated chunk, which is
+		   inserted after the current one to avoid wasting the
+		   rest of it */
+		const size_t chunk_size = header_size + nbytes + alignment;
+		auto *chunk = (Chunk *)xalloc(chunk_size);
+		size += chunk_size;
+
+		if (head != nullptr) {
+			chunk->next = head->next;
+			head->next = chunk;
+		} else {
+			chunk->next = nullptr;
+			head = chunk;
+		}
+
+		return (void *)((uintptr_t((uint8_t *)chunk + header_size)
+				 + alignment - 1) & ~(alignment - 1));
+	}
+
+	auto *chunk = (Chunk *)xalloc(ARENA_CHUNK_SIZE);
+	size += ARENA_CHUNK_SIZE;
+	chunk->next = head;
+	head = chunk;
+
+	position = (uint8_t *)chunk + header_size;
+	end = (uint8_t *)chunk + ARENA_CHUNK_SIZE;
+
+	return Allocate(nbytes, alignment);
+}
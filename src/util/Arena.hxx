@@ -0,0 +1,115 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_ARENA_HXX
+#define MPD_ARENA_HXX
+
+#include "Compiler.h"
+
+#include <new>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A bump allocator: memory is carved from large chunks, and there is
+ * no way to free individual allocations; all of it is released at
+ * once by Clear() or by the destructor.  This avoids per-object
+ * allocator overhead and keeps objects which are allocated together
+ * close together in memory.
+ *
+ * This class is not thread-safe.
+ */
+class Arena {
+	struct Chunk {
+		Chunk *next;
+	};
+
+	Chunk *head = nullptr;
+
+	uint8_t *position = nullptr, *end = nullptr;
+
+	/**
+	 * The total size of all chunks.
+	 */
+	size_t size = 0;
+
+public:
+	Arena() = default;
+
+	~Arena() {
+		Clear();
+	}
+
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	/**
+	 * Free all chunks.  The caller is responsible for destructing
+	 * all objects in the arena before.
+	 */
+	void Clear() noexcept;
+
+	/**
+	 * Returns the number of bytes allocated from the system.
+	 */
+	size_t GetSize() const {
+		return size;
+	}
+
+	/**
+	 * Allocate memory.  Like xalloc(), this function never fails.
+	 */
+	gcc_malloc
+	void *Allocate(size_t nbytes, size_t alignment) {
+		auto p = (uint8_t *)
+			((uintptr_t(position) + alignment - 1) & ~(alignment - 1));
+		if (gcc_unlikely(p == nullptr || size_t(end - p) < nbytes))
+			return AllocateSlow(nbytes, alignment);
+
+		position = p + nbytes;
+		return p;
+	}
+
+	/**
+	 * Allocate and construct an object.  Its destructor must be
+	 * invoked explicitly.
+	 */
+	template<typename T, typename... Args>
+	gcc_malloc
+	T *New(Args&&... args) {
+		void *p = Allocate(sizeof(T), alignof(T));
+		return new(p) T(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Allocate an uninitialized array of trivial objects.
+	 */
+	template<typename T>
+	gcc_malloc
+	T *NewArray(size_t n) {
+		return (T *)Allocate(sizeof(T) * n, alignof(T));
+	}
+
+private:
+	void *AllocateSlow(size_t nbytes, size_t alignment);
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MPD_ATOMIC_SLICE_BUFFER_HXX
+#define MPD_ATOMIC_SLICE_BUFFER_HXX
+
+#include "HugeAllocator.hxx"
+#include "Compiler.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <new>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A lock-free variant of #SliceBuffer: any number of threads may
+ * call Allocate() and Free() concurrently.
+ *
+ * The free slices are kept in a stack whose head is a slice index
+ * combined with a modification counter, which protects against the
+ * ABA problem.  Unlike #SliceBuffer, memory is not given back to the
+ * kernel when the last slice is freed, because that cannot be done
+ * safely without a lock.
+ *
+ * Each slice may be larger than sizeof(T), which allows objects to
+ * keep a variable-sized payload right behind themselves.
+ */
+template<typename T>
+class AtomicSliceBuffer {
+
+	/**
+	 * The bits of #available which contain the slice index plus
+	 * one; zero means the stack is empty.  The upper bits are
+	 * the modification counter.
+	 */
+	static constexpr uint64_t INDEX_MASK = 0xffffffff;
+
+	/**
+	 * The maximum number of slices in this container.
+	 */
+	const unsigned n_max;
+
+	/**
+	 * The size of each slice in bytes, a multiple of alignof(T).
+	 */
+	const size_t slice_size;
+
+	/**
+	 * The number of slices that have ever been handed out.  This
+	 * is used to avoid page faulting on the new allocation, so
+	 * the kernel does not need to reserve physical memory pages.
+	 */
+	std::atomic<unsigned> n_initialized;
+
+	/**
+	 * The number of slices currently allocated.
+	 */
+	std::atomic<unsigned> n_allocated;
+
+	char *const data;
+
+	/**
+	 * For each free slice, the index plus one of the next free
+	 * slice in the stack.
+	 */
+	const std::unique_ptr<std::atomic<unsigned>[]> next_free;
+
+	/**
+	 * The top of the stack of free slices.
+	 */
+	std::atomic<uint64_t> available;
+
+	size_t CalcAllocationSize() const {
+		return n_max * slice_size;
+	}
+
+	static constexpr size_t AlignSliceSize(size_t size) {
+		return (size + alignof(T) - 1) / alignof(T) * alignof(T);
+	}
+
+	static constexpr uint64_t MakeHead(uint64_t old_head,
+					   unsigned index_plus_one) {
+		return (((old_head >> 32) + 1) << 32) | index_plus_one;
+	}
+
+	/**
+	 * Pop an index from the stack of free slices, or take a
+	 * slice which was never used before.
+	 *
+	 * @return the index or -1 if the buffer is full
+	 */
+	int AllocateIndex() noexcept {
+		uint64_t head = available.load(std::memory_order_acquire);
+		while (true) {
+			const unsigned i = head & INDEX_MASK;
+			if (i == 0) {
+				unsigned n = n_initialized.load(std::memory_order_relaxed);
+				while (n < n_max &&
+				       !n_initialized.compare_exchange_weak(n, n + 1,
+									    std::memory_order_relaxed))
+					;
+
+				if (n < n_max)
+					return n;
+
+				/* check again, maybe another thread has
+				   freed a slice meanwhile */
+				head = available.load(std::memory_order_acquire);
+				if ((head & INDEX_MASK) == 0)
+					return -1;
+
+				continue;
+			}
+
+			const unsigned next =
+				next_free[i - 1].load(std::memory_order_relaxed);
+			if (available.compare_exchange_weak(head,
+							    MakeHead(head, next),
+							    std::memory_order_acquire,
+							    std::memory_order_acquire))
+				return i - 1;
+		}
+	}
+
+public:
+	/**
+	 * @param _slice_size the size of each slice; must be at
+	 * least sizeof(T)
+	 */
+	AtomicSliceBuffer(unsigned _count, size_t _slice_size=sizeof(T))
+		:n_max(_count), slice_size(AlignSliceSize(_slice_size)),
+		 n_initialized(0), n_allocated(0),
+		 data((char *)HugeAllocate(CalcAllocationSize())),
+		 next_free(new std::atomic<unsigned>[_count]),
+		 available(0) {
+		assert(n_max > 0);
+		assert(slice_size >= sizeof(T));
+	}
+
+	~AtomicSliceBuffer() {
+		/* all slices must be freed explicitly, and this
+		   assertion checks for leaks */
+		assert(n_allocated.load() == 0);
+
+		HugeFree(data, CalcAllocationSize());
+	}
+
+	AtomicSliceBuffer(const AtomicSliceBuffer &other) = delete;
+	AtomicSliceBuffer &operator=(const AtomicSliceBuffer &other) = delete;
+
+	unsigned GetCapacity() const {
+		return n_max;
+	}
+
+	size_t GetSliceSize() const {
+		return slice_size;
+	}
+
+	bool IsEmpty() const {
+		return n_allocated.load(std::memory_order_relaxed) == 0;
+	}
+
+	bool IsFull() const {
+		return n_allocated.load(std::memory_order_relaxed) == n_max;
+	}
+
+	template<typename... Args>
+	T *Allocate(Args&&... args) {
+		const int i = AllocateIndex();
+		if (i < 0)
+			/* out of (internal) memory, buffer is full */
+			return nullptr;
+
+		n_allocated.fetch_add(1, std::memory_order_relaxed);
+
+		/* construct the object */
+		return ::new((void *)(data + i * slice_size))
+			T(std::forward<Args>(args)...);
+	}
+
+	void Free(T *value) {
+		const char *slice = reinterpret_cast<const char *>(value);
+		assert(slice >= data && slice < data + CalcAllocationSize());
+		assert((slice - data) % slice_size == 0);
+
+		const unsigned i = (slice - data) / slice_size;
+		assert(i < n_initialized.load());
+
+		/* destruct the object */
+		value->~T();
+
+		const unsigned old_allocated =
+			n_allocated.fetch_sub(1, std::memory_order_relaxed);
+		assert(old_allocated > 0);
+		(void)old_allocated;
+
+		/* push the slice on the stack of free slices */
+		uint64_t head = available.load(std::memory_order_relaxed);
+		do {
+			next_free[i].store(head & INDEX_MASK,
+					   std::memory_order_relaxed);
+		} while (!available.compare_exchange_weak(head,
+							  MakeHead(head, i + 1),
+							  std::memory_order_release,
+							  std::memory_order_relaxed));
+	}
+};
+
+#endif
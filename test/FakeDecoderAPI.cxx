@@ -41,6 +41,7 @@ FakeDecoder::Ready(const AudioFormat audio_format,
 		ToString(audio_format).c_str(),
 		duration.ToDoubleS());
 
+	frame_size = audio_format.GetFrameSize();
 	initialized = true;
 }
 
@@ -108,6 +109,18 @@ FakeDecoder::SubmitData(gcc_unused InputStream *is,
 	return DecoderCommand::NONE;
 }
 
+WritableBuffer<void>
+FakeDecoder::GetDataBuffer()
+{
+	return {data_buffer, sizeof(data_buffer) / frame_size * frame_size};
+}
+
+DecoderCommand
+FakeDecoder::CommitData(InputStream *is, size_t length, uint16_t kbit_rate)
+{
+	return SubmitData(is, data_buffer, length, kbit_rate);
+}
+
 DecoderCommand
 FakeDecoder::SubmitTag(gcc_unused InputStream *is,
 		       Tag &&tag)
@@ -29,8 +29,18 @@ struct FakeDecoder final : DecoderClient {
 	Mutex mutex;
 	Cond cond;
 
+	/**
+	 * The buffer returned by GetDataBuffer().
+	 */
+	char data_buffer[8192];
+
 	bool initialized = false;
 
+	/**
+	 * The frame size of the format passed to Ready().
+	 */
+	size_t frame_size = 1;
+
 	/* virtual methods from DecoderClient */
 	void Ready(AudioFormat audio_format,
 		   bool seekable, SignedSongTime duration) override;
@@ -45,6 +55,9 @@ struct FakeDecoder final : DecoderClient {
 	DecoderCommand SubmitData(InputStream *is,
 				  const void *data, size_t length,
 				  uint16_t kbit_rate) override;
+	WritableBuffer<void> GetDataBuffer() override;
+	DecoderCommand CommitData(InputStream *is, size_t length,
+				  uint16_t kbit_rate) override;
 	DecoderCommand SubmitTag(InputStream *is, Tag &&tag) override ;
 	void SubmitReplayGain(const ReplayGainInfo *replay_gain_info) override;
 	void SubmitMixRamp(MixRampInfo &&mix_ramp) override;
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A micro benchmark for #MusicPipe and #MusicBuffer.  It moves
+ * chunks from a producer thread to a consumer thread, once with the
+ * lock-free implementation and once with a mutex-protected reference
+ * implementation (like the one MPD used before), and prints the
+ * throughput of both.  With only one hardware thread, both threads
+ * take turns and the mutex is never contended, so expect no
+ * difference there.
+ */
+
+#include "config.h"
+#include "MusicPipe.hxx"
+#include "MusicBuffer.hxx"
+#include "MusicChunk.hxx"
+#include "AudioFormat.hxx"
+#include "thread/Mutex.hxx"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static constexpr unsigned BUFFER_CHUNKS = 1024;
+
+/**
+ * The lock-free implementation.
+ */
+class LockFreeQueue {
+	MusicBuffer buffer;
+	MusicPipe pipe;
+
+public:
+	explicit LockFreeQueue(size_t chunk_size)
+		:buffer(BUFFER_CHUNKS, chunk_size) {}
+
+	~LockFreeQueue() {
+		pipe.Clear(buffer);
+	}
+
+	MusicChunk *Allocate() {
+		return buffer.Allocate();
+	}
+
+	void Return(MusicChunk *chunk) {
+		buffer.Return(chunk);
+	}
+
+	void Push(MusicChunk *chunk) {
+		pipe.Push(chunk);
+	}
+
+	MusicChunk *Shift() {
+		return pipe.Shift();
+	}
+};
+
+/**
+ * A mutex-protected pipe and allocator, for comparison.
+ */
+class LockedQueue {
+	const size_t chunk_size, slice_size;
+	std::unique_ptr<char[]> storage;
+
+	Mutex buffer_mutex;
+	std::vector<void *> available;
+
+	Mutex mutex;
+	MusicChunk *head = nullptr, *tail = nullptr;
+
+public:
+	explicit LockedQueue(size_t _chunk_size)
+		:chunk_size(_chunk_size),
+		 slice_size((sizeof(MusicChunk) + chunk_size + 7) & ~size_t(7)),
+		 storage(new char[BUFFER_CHUNKS * slice_size]) {
+		for (unsigned i = 0; i < BUFFER_CHUNKS; ++i)
+			available.push_back(storage.get() + i * slice_size);
+	}
+
+	~LockedQueue() {
+		MusicChunk *chunk;
+		while ((chunk = Shift()) != nullptr)
+			Return(chunk);
+	}
+
+	MusicChunk *Allocate() {
+		const std::lock_guard<Mutex> protect(buffer_mutex);
+		if (available.empty())
+			return nullptr;
+
+		void *p = available.back();
+		available.pop_back();
+		return ::new(p) MusicChunk(chunk_size);
+	}
+
+	void Return(MusicChunk *chunk) {
+		chunk->~MusicChunk();
+
+		const std::lock_guard<Mutex> protect(buffer_mutex);
+		available.push_back(chunk);
+	}
+
+	void Push(MusicChunk *chunk) {
+		const std::lock_guard<Mutex> protect(mutex);
+		chunk->next = nullptr;
+		if (tail == nullptr)
+			head = chunk;
+		else
+			tail->next = chunk;
+		tail = chunk;
+	}
+
+	MusicChunk *Shift() {
+		const std::lock_guard<Mutex> protect(mutex);
+		MusicChunk *chunk = head;
+		if (chunk != nullptr) {
+			head = chunk->next;
+			if (head == nullptr)
+				tail = nullptr;
+		}
+
+		return chunk;
+	}
+};
+
+static constexpr AudioFormat audio_format(44100, SampleFormat::S16, 2);
+
+template<typename Q>
+static double
+Run(unsigned n_chunks, size_t chunk_size)
+{
+	Q queue(chunk_size);
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::thread producer([&queue, n_chunks](){
+			for (unsigned i = 0; i < n_chunks; ++i) {
+				MusicChunk *chunk;
+				while ((chunk = queue.Allocate()) == nullptr)
+					std::this_thread::yield();
+
+				auto w = chunk->Write(audio_format,
+						      SongTime::zero(), 0);
+				chunk->Expand(audio_format, w.size);
+				queue.Push(chunk);
+			}
+		});
+
+	unsigned long long sum = 0;
+	for (unsigned i = 0; i < n_chunks;) {
+		MusicChunk *chunk = queue.Shift();
+		if (chunk == nullptr) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		sum += chunk->length;
+		queue.Return(chunk);
+		++i;
+	}
+
+	producer.join();
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	const size_t frame_size = audio_format.GetFrameSize();
+	if (sum != (unsigned long long)n_chunks * (chunk_size / frame_size * frame_size))
+		fprintf(stderr, "Data mismatch\n");
+
+	return n_chunks / duration.count();
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 3) {
+		fprintf(stderr, "Usage: bench_music_pipe [N_CHUNKS [CHUNK_SIZE]]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned n_chunks = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 1000000;
+
+	const size_t chunk_size = argc > 2
+		? strtoul(argv[2], nullptr, 10)
+		: DEFAULT_CHUNK_SIZE;
+	if (chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE) {
+		fprintf(stderr, "Invalid chunk size\n");
+		return EXIT_FAILURE;
+	}
+
+	/* the result depends mostly on whether producer and
+	   consumer really run in parallel, so print the number of
+	   hardware threads along with it */
+	printf("threads:   %12u\n", std::thread::hardware_concurrency());
+
+	const double locked = Run<LockedQueue>(n_chunks, chunk_size);
+	printf("mutex:     %12.0f chunks/s\n", locked);
+
+	const double lock_free = Run<LockFreeQueue>(n_chunks, chunk_size);
+	printf("lock-free: %12.0f chunks/s (%.2fx)\n",
+	       lock_free, lock_free / locked);
+	return EXIT_SUCCESS;
+}
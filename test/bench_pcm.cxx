@@ -0,0 +1,295 @@
+/*
+ * Copyright 2003-2017 The Music Player Daemon Project
+ * http://www.musicpd.org
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * A micro benchmark for the PCM kernels which have vectorized
+ * implementations.  Each one is run on the same input once through
+ * the libpcm function and once as a plain per-sample loop, and the
+ * throughput of both is printed.
+ */
+
+#include "config.h"
+#include "pcm/PcmFormat.hxx"
+#include "pcm/PcmMix.hxx"
+#include "pcm/Volume.hxx"
+#include "pcm/PcmBuffer.hxx"
+#include "pcm/PcmDither.hxx"
+#include "pcm/PcmUtils.hxx"
+#include "pcm/FloatConvert.hxx"
+#include "pcm/ShiftConvert.hxx"
+#include "util/ConstBuffer.hxx"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Samples per call; a bit more than a 4 kB stereo chunk of S32.
+ */
+static constexpr size_t N_SAMPLES = 4096 + 3;
+
+typedef LeftShiftSampleConvert<SampleFormat::S16,
+			       SampleFormat::S32> Convert16To32;
+typedef LeftShiftSampleConvert<SampleFormat::S24_P32,
+			       SampleFormat::S32> Convert24To32;
+typedef IntegerToFloatSampleConvert<SampleFormat::S16> Convert16ToFloat;
+typedef FloatToIntegerSampleConvert<SampleFormat::S16> ConvertFloatTo16;
+typedef FloatToIntegerSampleConvert<SampleFormat::S32> ConvertFloatTo32;
+
+template<typename C>
+static void
+PortableConvert(typename C::DstTraits::pointer_type dest,
+		typename C::SrcTraits::const_pointer_type src, size_t n)
+{
+	for (size_t i = 0; i != n; ++i)
+		dest[i] = C::Convert(src[i]);
+}
+
+static void
+PortableVolumeFloat(float *dest, const float *src, size_t n, float volume)
+{
+	for (size_t i = 0; i != n; ++i)
+		dest[i] = src[i] * volume;
+}
+
+static void
+PortableMixFloat(float *a, const float *b, size_t n,
+		 float volume1, float volume2)
+{
+	for (size_t i = 0; i != n; ++i)
+		a[i] = a[i] * volume1 + b[i] * volume2;
+}
+
+static void
+PortableAdd16(int16_t *a, const int16_t *b, size_t n)
+{
+	for (size_t i = 0; i != n; ++i)
+		a[i] = PcmClamp<SampleFormat::S16>(int32_t(a[i]) + b[i]);
+}
+
+static const void *volatile opaque;
+static volatile float opaque_float;
+static volatile int sink;
+
+/**
+ * Hide the buffer address from the optimizer, so it cannot fold
+ * repeated calls to the (pure) libpcm functions into one.
+ */
+static ConstBuffer<void>
+Opaque(ConstBuffer<void> src)
+{
+	opaque = src.data;
+	return { opaque, src.size };
+}
+
+/**
+ * Hide a constant from the optimizer, so the portable loops do not
+ * get an unfair advantage from folding it (e.g. "a * 0.5 + b * 0.5"
+ * into "(a + b) * 0.5"); libpcm gets its factors at runtime.
+ */
+static float
+OpaqueFloat(float value)
+{
+	opaque_float = value;
+	return opaque_float;
+}
+
+/**
+ * Consume the result of a libpcm call, so it does not get optimized
+ * away.
+ */
+template<typename T>
+static void
+Consume(ConstBuffer<T> result)
+{
+	sink = result.size > 0 && result.data != nullptr;
+}
+
+/**
+ * Call the function repeatedly and return the number of samples
+ * processed per second.
+ */
+template<typename F>
+static double
+Measure(unsigned n_iterations, F &&f)
+{
+	/* warm up, so the first measurement does not pay for page
+	   faults and the CPU feature detection */
+	f();
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (unsigned i = 0; i < n_iterations; ++i)
+		f();
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+	return double(n_iterations) * N_SAMPLES / duration.count();
+}
+
+static void
+Print(const char *name, double optimized, double portable)
+{
+	printf("%-16s %9.1f %9.1f Msamples/s (%.2fx)\n", name,
+	       optimized / 1e6, portable / 1e6, optimized / portable);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc > 2) {
+		fprintf(stderr, "Usage: bench_pcm [N_ITERATIONS]\n");
+		return EXIT_FAILURE;
+	}
+
+	const unsigned n = argc > 1
+		? strtoul(argv[1], nullptr, 10)
+		: 100000;
+
+	std::mt19937 gen;
+	std::uniform_int_distribution<int32_t> dis16(-32768, 32767);
+	std::uniform_int_distribution<int32_t> dis24(-(1 << 23), (1 << 23) - 1);
+	std::uniform_real_distribution<float> dis_float(-1.0, 1.0);
+
+	std::vector<int16_t> s16(N_SAMPLES), s16b(N_SAMPLES), d16(N_SAMPLES);
+	std::vector<int32_t> s24(N_SAMPLES), d32(N_SAMPLES);
+	std::vector<float> f(N_SAMPLES), fb(N_SAMPLES), df(N_SAMPLES);
+	for (size_t i = 0; i < N_SAMPLES; ++i) {
+		s16[i] = dis16(gen);
+		s16b[i] = dis16(gen);
+		s24[i] = dis24(gen);
+		f[i] = dis_float(gen);
+		fb[i] = dis_float(gen);
+	}
+
+	const ConstBuffer<void> s16_buffer(s16.data(), N_SAMPLES * 2);
+	const ConstBuffer<void> s24_buffer(s24.data(), N_SAMPLES * 4);
+	const ConstBuffer<void> f_buffer(f.data(), N_SAMPLES * 4);
+
+	PcmBuffer buffer;
+	PcmDither dither;
+
+	printf("%-16s %9s %9s\n", "", "libpcm", "portable");
+
+	Print("S16 -> S32",
+	      Measure(n, [&](){
+			      Consume(pcm_convert_to_32(buffer, SampleFormat::S16,
+							Opaque(s16_buffer)));
+		      }),
+	      Measure(n, [&](){
+			      PortableConvert<Convert16To32>(d32.data(),
+							       s16.data(),
+							       N_SAMPLES);
+		      }));
+
+	Print("S24 -> S32",
+	      Measure(n, [&](){
+			      Consume(pcm_convert_to_32(buffer, SampleFormat::S24_P32,
+							Opaque(s24_buffer)));
+		      }),
+	      Measure(n, [&](){
+			      PortableConvert<Convert24To32>(d32.data(),
+							       s24.data(),
+							       N_SAMPLES);
+		      }));
+
+	Print("S16 -> float",
+	      Measure(n, [&](){
+			      Consume(pcm_convert_to_float(buffer, SampleFormat::S16,
+							   Opaque(s16_buffer)));
+		      }),
+	      Measure(n, [&](){
+			      PortableConvert<Convert16ToFloat>(df.data(),
+								  s16.data(),
+								  N_SAMPLES);
+		      }));
+
+	Print("float -> S16",
+	      Measure(n, [&](){
+			      Consume(pcm_convert_to_16(buffer, dither,
+							SampleFormat::FLOAT,
+							Opaque(f_buffer)));
+		      }),
+	      Measure(n, [&](){
+			      PortableConvert<ConvertFloatTo16>(d16.data(),
+								  f.data(),
+								  N_SAMPLES);
+		      }));
+
+	Print("float -> S32",
+	      Measure(n, [&](){
+			      Consume(pcm_convert_to_32(buffer, SampleFormat::FLOAT,
+							Opaque(f_buffer)));
+		      }),
+	      Measure(n, [&](){
+			      PortableConvert<ConvertFloatTo32>(d32.data(),
+								  f.data(),
+								  N_SAMPLES);
+		      }));
+
+	PcmVolume pv;
+	pv.Open(SampleFormat::FLOAT);
+	pv.SetVolume(PCM_VOLUME_1 / 3);
+	const float volume = OpaqueFloat(pcm_volume_to_float(pv.GetVolume()));
+
+	Print("volume float",
+	      Measure(n, [&](){
+			      Consume(pv.Apply(Opaque(f_buffer)));
+		      }),
+	      Measure(n, [&](){
+			      PortableVolumeFloat(df.data(), f.data(),
+						  N_SAMPLES, volume);
+		      }));
+
+	pv.Close();
+
+	/* pcm_mix() turns this portion into 0.5 for both */
+	const float half = OpaqueFloat(0.5);
+
+	df = f;
+	Print("mix float",
+	      Measure(n, [&](){
+			      if (!pcm_mix(dither, df.data(), fb.data(),
+					   N_SAMPLES * 4,
+					   SampleFormat::FLOAT, 0.5))
+				      abort();
+		      }),
+	      Measure(n, [&](){
+			      PortableMixFloat(df.data(), fb.data(),
+					       N_SAMPLES, half, half);
+		      }));
+
+	d16 = s16;
+	Print("add S16",
+	      Measure(n, [&](){
+			      if (!pcm_mix(dither, d16.data(), s16b.data(),
+					   N_SAMPLES * 2,
+					   SampleFormat::S16, -1))
+				      abort();
+		      }),
+	      Measure(n, [&](){
+			      PortableAdd16(d16.data(), s16b.data(),
+					    N_SAMPLES);
+		      }));
+
+	return EXIT_SUCCESS;
+}
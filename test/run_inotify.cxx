@@ -33,10 +33,10 @@ static constexpr unsigned IN_MASK =
 	|IN_MOVE|IN_MOVE_SELF;
 
 static void
-my_inotify_callback(gcc_unused int wd, unsigned mask,
+my_inotify_callback(gcc_unused int wd, unsigned mask, unsigned cookie,
 		    const char *name, gcc_unused void *ctx)
 {
-	printf("mask=0x%x name='%s'\n", mask, name);
+	printf("mask=0x%x cookie=%u name='%s'\n", mask, cookie, name);
 }
 
 int main(int argc, char **argv)
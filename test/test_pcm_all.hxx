@@ -80,14 +80,22 @@ class PcmFormatTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST(TestFormat8to16);
 	CPPUNIT_TEST(TestFormat16to24);
 	CPPUNIT_TEST(TestFormat16to32);
+	CPPUNIT_TEST(TestFormat24to32);
+	CPPUNIT_TEST(TestFormat32to24);
 	CPPUNIT_TEST(TestFormatFloat);
+	CPPUNIT_TEST(TestFormatToFloat);
+	CPPUNIT_TEST(TestFormatFromFloat);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
 	void TestFormat8to16();
 	void TestFormat16to24();
 	void TestFormat16to32();
+	void TestFormat24to32();
+	void TestFormat32to24();
 	void TestFormatFloat();
+	void TestFormatToFloat();
+	void TestFormatFromFloat();
 };
 
 class PcmMixTest : public CppUnit::TestFixture {
@@ -96,6 +104,11 @@ class PcmMixTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST(TestMix16);
 	CPPUNIT_TEST(TestMix24);
 	CPPUNIT_TEST(TestMix32);
+	CPPUNIT_TEST(TestMixFloat);
+	CPPUNIT_TEST(TestAdd16);
+	CPPUNIT_TEST(TestAdd24);
+	CPPUNIT_TEST(TestAdd32);
+	CPPUNIT_TEST(TestAddFloat);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -103,6 +116,11 @@ public:
 	void TestMix16();
 	void TestMix24();
 	void TestMix32();
+	void TestMixFloat();
+	void TestAdd16();
+	void TestAdd24();
+	void TestAdd32();
+	void TestAddFloat();
 };
 
 class PcmInterleaveTest : public CppUnit::TestFixture {
@@ -25,6 +25,9 @@
 #include "pcm/PcmUtils.hxx"
 #include "pcm/PcmBuffer.hxx"
 #include "pcm/SampleFormat.hxx"
+#include "pcm/FloatConvert.hxx"
+
+#include <cmath>
 
 void
 PcmFormatTest::TestFormat8to16()
@@ -72,6 +75,36 @@ PcmFormatTest::TestFormat16to32()
 		CPPUNIT_ASSERT_EQUAL(int(src[i]), d[i] >> 16);
 }
 
+void
+PcmFormatTest::TestFormat24to32()
+{
+	constexpr size_t N = 509;
+	const auto src = TestDataBuffer<int32_t, N>(RandomInt24());
+
+	PcmBuffer buffer;
+
+	auto d = pcm_convert_to_32(buffer, SampleFormat::S24_P32, src);
+	CPPUNIT_ASSERT_EQUAL(N, d.size);
+
+	for (size_t i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(src[i], d[i] >> 8);
+}
+
+void
+PcmFormatTest::TestFormat32to24()
+{
+	constexpr size_t N = 509;
+	const auto src = TestDataBuffer<int32_t, N>();
+
+	PcmBuffer buffer;
+
+	auto d = pcm_convert_to_24(buffer, SampleFormat::S32, src);
+	CPPUNIT_ASSERT_EQUAL(N, d.size);
+
+	for (size_t i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(src[i] >> 8, d[i]);
+}
+
 void
 PcmFormatTest::TestFormatFloat()
 {
@@ -118,3 +151,106 @@ PcmFormatTest::TestFormatFloat()
 	for (size_t i = 4; i < N; ++i)
 		CPPUNIT_ASSERT_EQUAL(src[i], d[i]);
 }
+
+template<SampleFormat F, class Traits=SampleTraits<F>,
+	 typename G=RandomInt<typename Traits::value_type>>
+static void
+TestToFloat(G g=G())
+{
+	constexpr size_t N = 509;
+	const auto src = TestDataBuffer<typename Traits::value_type, N>(g);
+
+	PcmBuffer buffer;
+
+	auto f = pcm_convert_to_float(buffer, F, src);
+	CPPUNIT_ASSERT_EQUAL(N, f.size);
+
+	/* the result must be bit-exact with the portable
+	   implementation */
+	typedef IntegerToFloatSampleConvert<F, Traits> C;
+	for (size_t i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(C::Convert(src[i]), f[i]);
+}
+
+void
+PcmFormatTest::TestFormatToFloat()
+{
+	TestToFloat<SampleFormat::S16>();
+	TestToFloat<SampleFormat::S24_P32>(RandomInt24());
+	TestToFloat<SampleFormat::S32>();
+}
+
+template<SampleFormat F, class Traits=SampleTraits<F>>
+static ConstBuffer<typename Traits::value_type>
+ConvertFromFloat(PcmBuffer &buffer, ConstBuffer<void> src);
+
+template<>
+ConstBuffer<int16_t>
+ConvertFromFloat<SampleFormat::S16>(PcmBuffer &buffer, ConstBuffer<void> src)
+{
+	PcmDither dither;
+	return pcm_convert_to_16(buffer, dither, SampleFormat::FLOAT, src);
+}
+
+template<>
+ConstBuffer<int32_t>
+ConvertFromFloat<SampleFormat::S24_P32>(PcmBuffer &buffer,
+					ConstBuffer<void> src)
+{
+	return pcm_convert_to_24(buffer, SampleFormat::FLOAT, src);
+}
+
+template<>
+ConstBuffer<int32_t>
+ConvertFromFloat<SampleFormat::S32>(PcmBuffer &buffer, ConstBuffer<void> src)
+{
+	return pcm_convert_to_32(buffer, SampleFormat::FLOAT, src);
+}
+
+template<SampleFormat F, class Traits=SampleTraits<F>>
+static void
+TestFromFloat()
+{
+	constexpr size_t N = 509;
+	auto src = TestDataBuffer<float, N>(RandomFloat());
+
+	/* exceed the range a bit to check clamping, and add the
+	   edge cases */
+	for (size_t i = 0; i < N; ++i)
+		src[i] *= 1.25f;
+
+	src[0] = 1;
+	src[1] = -1;
+	src[2] = 0;
+	src[3] = 10;
+	src[4] = -10;
+	src[5] = std::nextafter(1.f, 0.f);
+
+	PcmBuffer buffer;
+
+	auto d = ConvertFromFloat<F>(buffer, src);
+	CPPUNIT_ASSERT_EQUAL(N, d.size);
+
+	/* the result must be bit-exact with the portable
+	   implementation */
+	typedef FloatToIntegerSampleConvert<F, Traits> C;
+	for (size_t i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(C::Convert(src[i]), d[i]);
+
+	/* copies, because CPPUNIT_ASSERT_EQUAL() takes references,
+	   and the static members have no definition */
+	const typename Traits::value_type max = Traits::MAX;
+	const typename Traits::value_type min = Traits::MIN;
+	CPPUNIT_ASSERT_EQUAL(max, d[0]);
+	CPPUNIT_ASSERT_EQUAL(min, d[1]);
+	CPPUNIT_ASSERT_EQUAL(max, d[3]);
+	CPPUNIT_ASSERT_EQUAL(min, d[4]);
+}
+
+void
+PcmFormatTest::TestFormatFromFloat()
+{
+	TestFromFloat<SampleFormat::S16>();
+	TestFromFloat<SampleFormat::S24_P32>();
+	TestFromFloat<SampleFormat::S32>();
+}
@@ -22,6 +22,8 @@
 #include "test_pcm_util.hxx"
 #include "pcm/PcmMix.hxx"
 #include "pcm/PcmDither.hxx"
+#include "pcm/PcmUtils.hxx"
+#include "pcm/Traits.hxx"
 
 template<typename T, SampleFormat format, typename G=RandomInt<T>>
 static void
@@ -84,3 +86,89 @@ PcmMixTest::TestMix32()
 {
 	TestPcmMix<int32_t, SampleFormat::S32>();
 }
+
+void
+PcmMixTest::TestMixFloat()
+{
+	constexpr unsigned N = 509;
+	const auto src1 = TestDataBuffer<float, N>(RandomFloat());
+	const auto src2 = TestDataBuffer<float, N>(RandomFloat());
+
+	PcmDither dither;
+
+	/* portion1=0.5 maps to exactly half of #PCM_VOLUME_1, so the
+	   result must be bit-exact with this formula */
+	auto result = src1;
+	bool success = pcm_mix(dither,
+			       result.begin(), src2.begin(), sizeof(result),
+			       SampleFormat::FLOAT, 0.5);
+	CPPUNIT_ASSERT(success);
+
+	for (unsigned i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(src1[i] * 0.5f + src2[i] * 0.5f,
+				     result[i]);
+}
+
+template<SampleFormat F, class Traits=SampleTraits<F>,
+	 typename G=RandomInt<typename Traits::value_type>>
+static void
+TestPcmAdd(G g=G())
+{
+	constexpr unsigned N = 509;
+	const auto src1 = TestDataBuffer<typename Traits::value_type, N>(g);
+	const auto src2 = TestDataBuffer<typename Traits::value_type, N>(g);
+
+	PcmDither dither;
+
+	/* portion1<0: add with clipping */
+	auto result = src1;
+	bool success = pcm_mix(dither,
+			       result.begin(), src2.begin(), sizeof(result),
+			       F, -1);
+	CPPUNIT_ASSERT(success);
+
+	for (unsigned i = 0; i < N; ++i) {
+		typename Traits::long_type sum = src1[i];
+		sum += src2[i];
+
+		const auto expected = PcmClamp<F, Traits>(sum);
+		CPPUNIT_ASSERT_EQUAL(expected, result[i]);
+	}
+}
+
+void
+PcmMixTest::TestAdd16()
+{
+	TestPcmAdd<SampleFormat::S16>();
+}
+
+void
+PcmMixTest::TestAdd24()
+{
+	TestPcmAdd<SampleFormat::S24_P32>(RandomInt24());
+}
+
+void
+PcmMixTest::TestAdd32()
+{
+	TestPcmAdd<SampleFormat::S32>();
+}
+
+void
+PcmMixTest::TestAddFloat()
+{
+	constexpr unsigned N = 509;
+	const auto src1 = TestDataBuffer<float, N>(RandomFloat());
+	const auto src2 = TestDataBuffer<float, N>(RandomFloat());
+
+	PcmDither dither;
+
+	auto result = src1;
+	bool success = pcm_mix(dither,
+			       result.begin(), src2.begin(), sizeof(result),
+			       SampleFormat::FLOAT, -1);
+	CPPUNIT_ASSERT(success);
+
+	for (unsigned i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(src1[i] + src2[i], result[i]);
+}
@@ -116,9 +116,21 @@ PcmVolumeTest::TestVolumeFloat()
 	dest = pv.Apply(src);
 	CPPUNIT_ASSERT_EQUAL(src.size, dest.size);
 
-	const auto _dest = ConstBuffer<float>::FromVoid(dest);
+	auto _dest = ConstBuffer<float>::FromVoid(dest);
 	for (unsigned i = 0; i < N; ++i)
 		CPPUNIT_ASSERT_DOUBLES_EQUAL(_src[i] / 2, _dest[i], 1);
 
+	/* the result must be bit-exact with the portable
+	   implementation */
+	constexpr unsigned volume = PCM_VOLUME_1 * 3 / 7;
+	pv.SetVolume(volume);
+	dest = pv.Apply(src);
+	CPPUNIT_ASSERT_EQUAL(src.size, dest.size);
+
+	_dest = ConstBuffer<float>::FromVoid(dest);
+	const float factor = pcm_volume_to_float(volume);
+	for (unsigned i = 0; i < N; ++i)
+		CPPUNIT_ASSERT_EQUAL(_src[i] * factor, _dest[i]);
+
 	pv.Close();
 }